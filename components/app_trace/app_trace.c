@@ -140,6 +140,10 @@
 //   When low prio task takes mutex and enables local IRQs gets preempted by high prio task which in its turn can try to acquire mutex using infinite timeout.
 //   So no local task switch occurs when mutex is locked. But this does not apply to tasks on another CPU.
 //   WARNING: Priority inversion can happen when low prio task works on one CPU and medium and high prio tasks work on another.
+// When CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE is not zero user data chunks are allocated in the buffer of the current CPU instead.
+// Allocation and completion of chunks in that buffer use compare-and-set on its counters and do not take the mutex.
+// When the buffer is full and all chunks in it are completed the whole buffer is copied to TRAX memory block under the mutex.
+// So chunks from different CPUs are not ordered in trace data stream, host tools sort them by timestamps contained in user data.
 // WARNING: Care must be taken when selecting timeout values for trace calls from ISRs. Tracing module does not care about watchdogs when waiting
 // on internal locks and for host to complete previous block reading, so if timeout value exceeds watchdog's one it can lead to the system reboot.
 
@@ -155,14 +159,17 @@
 
 #include <string.h>
 #include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_app_trace.h"
+#include "esp_app_trace_port.h"
+#if CONFIG_ESP32_APPTRACE_DEST_TRAX
 #include "soc/soc.h"
 #include "soc/dport_reg.h"
 #include "eri.h"
 #include "trax.h"
 #include "soc/timer_group_struct.h"
 #include "soc/timer_group_reg.h"
-#include "freertos/FreeRTOS.h"
-#include "esp_app_trace.h"
+#endif
 
 #if CONFIG_ESP32_APPTRACE_ENABLE
 #define ESP_APPTRACE_MAX_VPRINTF_ARGS           256
@@ -201,6 +208,7 @@ const static char *TAG = "esp_apptrace";
 #define ESP_APPTRACE_LOGV( format, ... )  ESP_APPTRACE_LOG_LEV(V, ESP_LOG_VERBOSE, format, ##__VA_ARGS__)
 #define ESP_APPTRACE_LOGO( format, ... )  ESP_APPTRACE_LOG_LEV(E, ESP_LOG_NONE, format, ##__VA_ARGS__)
 
+#if CONFIG_ESP32_APPTRACE_DEST_TRAX
 // TODO: move these (and same definitions in trax.c to dport_reg.h)
 #define TRACEMEM_MUX_PROBLK0_APPBLK1            0
 #define TRACEMEM_MUX_BLK0_ONLY                  1
@@ -250,10 +258,6 @@ static volatile uint8_t *s_trax_blocks[] = {
 #define ESP_APPTRACE_USR_DATA_LEN_MAX           (ESP_APPTRACE_TRAX_BLOCK_SIZE - sizeof(esp_tracedata_hdr_t))
 #endif
 
-#define ESP_APPTRACE_HW_TRAX                    0
-#define ESP_APPTRACE_HW_MAX                     1
-#define ESP_APPTRACE_HW(_i_)                    (&s_trace_hw[_i_])
-
 /** Trace data header. Every user data chunk is prepended with this header.
  * User allocates block with esp_apptrace_buffer_get and then fills it with data,
  * in multithreading environment it can happen that tasks gets buffer and then gets interrupted,
@@ -308,7 +312,14 @@ typedef struct {
     uint16_t                            cur_pending_chunk_sz;
 #endif
 #endif
+#if CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE > 0
+    // per-CPU buffers for user blocks, they are copied to TRAX memory block when full
+    esp_apptrace_stage_t                stages[portNUM_PROCESSORS];
+    // storage for above buffers data
+    uint8_t                             stage_data[portNUM_PROCESSORS][CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE];
+#endif
 } esp_apptrace_trax_data_t;
+#endif
 
 /** tracing module internal data */
 typedef struct {
@@ -316,8 +327,11 @@ typedef struct {
     uint8_t                     inited; // module initialization state flag
     // ring buffer control struct for data from host (down buffer)
     esp_apptrace_rb_t           rb_down;
-    // storage for above ring buffer data
+    // transport serving ESP_APPTRACE_DEST_TRAX destination
+    const esp_apptrace_hw_t *   hw;
+#if CONFIG_ESP32_APPTRACE_DEST_TRAX
     esp_apptrace_trax_data_t    trax;   // TRAX HW transport data
+#endif
 } esp_apptrace_buffer_t;
 
 static esp_apptrace_buffer_t    s_trace_buf;
@@ -326,17 +340,7 @@ static esp_apptrace_buffer_t    s_trace_buf;
 static esp_apptrace_lock_t s_log_lock = {.irq_stat = 0, .portmux = portMUX_INITIALIZER_UNLOCKED};
 #endif
 
-typedef struct {
-    uint8_t *(*get_up_buffer)(uint32_t, esp_apptrace_tmo_t *);
-    esp_err_t (*put_up_buffer)(uint8_t *, esp_apptrace_tmo_t *);
-    esp_err_t (*flush_up_buffer)(uint32_t, esp_apptrace_tmo_t *);
-    uint8_t *(*get_down_buffer)(uint32_t *, esp_apptrace_tmo_t *);
-    esp_err_t (*put_down_buffer)(uint8_t *, esp_apptrace_tmo_t *);
-    bool (*host_is_connected)(void);
-    esp_err_t (*status_reg_set)(uint32_t val);
-    esp_err_t (*status_reg_get)(uint32_t *val);
-} esp_apptrace_hw_t;
-
+#if CONFIG_ESP32_APPTRACE_DEST_TRAX
 static uint32_t esp_apptrace_trax_down_buffer_write_nolock(uint8_t *data, uint32_t size);
 static esp_err_t esp_apptrace_trax_flush(uint32_t min_sz, esp_apptrace_tmo_t *tmo);
 static uint8_t *esp_apptrace_trax_get_buffer(uint32_t size, esp_apptrace_tmo_t *tmo);
@@ -347,18 +351,17 @@ static esp_err_t esp_apptrace_trax_down_buffer_put(uint8_t *ptr, esp_apptrace_tm
 static esp_err_t esp_apptrace_trax_status_reg_set(uint32_t val);
 static esp_err_t esp_apptrace_trax_status_reg_get(uint32_t *val);
 
-static esp_apptrace_hw_t s_trace_hw[ESP_APPTRACE_HW_MAX] = {
-    {
-        .get_up_buffer = esp_apptrace_trax_get_buffer,
-        .put_up_buffer = esp_apptrace_trax_put_buffer,
-        .flush_up_buffer = esp_apptrace_trax_flush,
-        .get_down_buffer = esp_apptrace_trax_down_buffer_get,
-        .put_down_buffer = esp_apptrace_trax_down_buffer_put,
-        .host_is_connected = esp_apptrace_trax_host_is_connected,
-        .status_reg_set = esp_apptrace_trax_status_reg_set,
-        .status_reg_get = esp_apptrace_trax_status_reg_get
-    }
+static const esp_apptrace_hw_t s_trace_hw_trax = {
+    .get_up_buffer = esp_apptrace_trax_get_buffer,
+    .put_up_buffer = esp_apptrace_trax_put_buffer,
+    .flush_up_buffer = esp_apptrace_trax_flush,
+    .get_down_buffer = esp_apptrace_trax_down_buffer_get,
+    .put_down_buffer = esp_apptrace_trax_down_buffer_put,
+    .host_is_connected = esp_apptrace_trax_host_is_connected,
+    .status_reg_set = esp_apptrace_trax_status_reg_set,
+    .status_reg_get = esp_apptrace_trax_status_reg_get
 };
+#endif
 
 static inline int esp_apptrace_log_lock()
 {
@@ -700,19 +703,11 @@ static inline uint8_t *esp_apptrace_trax_wait4buf(uint16_t size, esp_apptrace_tm
     return ptr;
 }
 
-static uint8_t *esp_apptrace_trax_get_buffer(uint32_t size, esp_apptrace_tmo_t *tmo)
+// assumed to be protected by caller from multi-core/thread access
+static uint8_t *esp_apptrace_trax_get_buffer_nolock(uint32_t sz, esp_apptrace_tmo_t *tmo)
 {
     uint8_t *buf_ptr = NULL;
 
-    if (size > ESP_APPTRACE_USR_DATA_LEN_MAX) {
-        ESP_APPTRACE_LOGE("Too large user data size %d!", size);
-        return NULL;
-    }
-
-    int res = esp_apptrace_lock(tmo);
-    if (res != ESP_OK) {
-        return NULL;
-    }
     // check for data in the pending buffer
 #if CONFIG_ESP32_APPTRACE_PENDING_DATA_SIZE_MAX > 0
     if (esp_apptrace_rb_read_size_get(&s_trace_buf.trax.rb_pend) > 0) {
@@ -722,62 +717,130 @@ static uint8_t *esp_apptrace_trax_get_buffer(uint32_t size, esp_apptrace_tmo_t *
     }
     if (esp_apptrace_rb_read_size_get(&s_trace_buf.trax.rb_pend) > 0) {
         // if we have buffered data alloc new pending buffer
-        ESP_APPTRACE_LOGD("Get %d bytes from PEND buffer", size);
-        buf_ptr = esp_apptrace_rb_produce(&s_trace_buf.trax.rb_pend, ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+        ESP_APPTRACE_LOGD("Get %d bytes from PEND buffer", sz);
+        buf_ptr = esp_apptrace_rb_produce(&s_trace_buf.trax.rb_pend, sz);
         if (buf_ptr == NULL) {
             int pended_buf;
-            buf_ptr = esp_apptrace_trax_wait4buf(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size), tmo, &pended_buf);
+            buf_ptr = esp_apptrace_trax_wait4buf(sz, tmo, &pended_buf);
             if (buf_ptr) {
                 if (pended_buf) {
 #if CONFIG_ESP32_APPTRACE_PENDING_DATA_SIZE_MAX > ESP_APPTRACE_TRAX_BLOCK_SIZE
-                    esp_apptrace_trax_pend_chunk_sz_update(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+                    esp_apptrace_trax_pend_chunk_sz_update(sz);
 #endif
                 } else {
-                    ESP_APPTRACE_LOGD("Get %d bytes from TRAX buffer", size);
+                    ESP_APPTRACE_LOGD("Get %d bytes from TRAX buffer", sz);
                     // update cur block marker
-                    ESP_APPTRACE_TRAX_INBLOCK_MARKER_UPD(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+                    ESP_APPTRACE_TRAX_INBLOCK_MARKER_UPD(sz);
                 }
             }
         } else {
 #if CONFIG_ESP32_APPTRACE_PENDING_DATA_SIZE_MAX > ESP_APPTRACE_TRAX_BLOCK_SIZE
-            esp_apptrace_trax_pend_chunk_sz_update(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+            esp_apptrace_trax_pend_chunk_sz_update(sz);
 #endif
         }
     } else
 #endif
-    if (ESP_APPTRACE_TRAX_INBLOCK_MARKER() + ESP_APPTRACE_USR_BLOCK_RAW_SZ(size) > ESP_APPTRACE_TRAX_INBLOCK_GET()->sz) {
+    if (ESP_APPTRACE_TRAX_INBLOCK_MARKER() + sz > ESP_APPTRACE_TRAX_INBLOCK_GET()->sz) {
 #if CONFIG_ESP32_APPTRACE_PENDING_DATA_SIZE_MAX > 0
-        ESP_APPTRACE_LOGD("TRAX full. Get %d bytes from PEND buffer", size);
-        buf_ptr = esp_apptrace_rb_produce(&s_trace_buf.trax.rb_pend, ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+        ESP_APPTRACE_LOGD("TRAX full. Get %d bytes from PEND buffer", sz);
+        buf_ptr = esp_apptrace_rb_produce(&s_trace_buf.trax.rb_pend, sz);
         if (buf_ptr) {
 #if CONFIG_ESP32_APPTRACE_PENDING_DATA_SIZE_MAX > ESP_APPTRACE_TRAX_BLOCK_SIZE
-            esp_apptrace_trax_pend_chunk_sz_update(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+            esp_apptrace_trax_pend_chunk_sz_update(sz);
 #endif
         }
 #endif
         if (buf_ptr == NULL) {
             int pended_buf;
-            ESP_APPTRACE_LOGD("TRAX full. Get %d bytes from pend buffer", size);
-            buf_ptr = esp_apptrace_trax_wait4buf(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size), tmo, &pended_buf);
+            ESP_APPTRACE_LOGD("TRAX full. Get %d bytes from pend buffer", sz);
+            buf_ptr = esp_apptrace_trax_wait4buf(sz, tmo, &pended_buf);
             if (buf_ptr) {
                 if (pended_buf) {
 #if CONFIG_ESP32_APPTRACE_PENDING_DATA_SIZE_MAX > ESP_APPTRACE_TRAX_BLOCK_SIZE
-                    esp_apptrace_trax_pend_chunk_sz_update(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+                    esp_apptrace_trax_pend_chunk_sz_update(sz);
 #endif
                 } else {
-                    ESP_APPTRACE_LOGD("Got %d bytes from TRAX buffer", size);
+                    ESP_APPTRACE_LOGD("Got %d bytes from TRAX buffer", sz);
                     // update cur block marker
-                    ESP_APPTRACE_TRAX_INBLOCK_MARKER_UPD(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+                    ESP_APPTRACE_TRAX_INBLOCK_MARKER_UPD(sz);
                 }
             }
         }
     } else {
-        ESP_APPTRACE_LOGD("Get %d bytes from TRAX buffer", size);
+        ESP_APPTRACE_LOGD("Get %d bytes from TRAX buffer", sz);
         // fit to curr TRAX nlock
         buf_ptr = ESP_APPTRACE_TRAX_INBLOCK_GET()->start + ESP_APPTRACE_TRAX_INBLOCK_MARKER();
         // update cur block marker
-        ESP_APPTRACE_TRAX_INBLOCK_MARKER_UPD(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size));
+        ESP_APPTRACE_TRAX_INBLOCK_MARKER_UPD(sz);
     }
+
+    return buf_ptr;
+}
+
+#if CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE > 0
+// copies per-CPU buffer to TRAX memory block (or pending data buffer), assumed to be protected by caller from multi-core/thread access
+static esp_err_t esp_apptrace_trax_stage_flush(esp_apptrace_stage_t *stage, esp_apptrace_tmo_t *tmo)
+{
+    uint32_t sz = esp_apptrace_stage_close(stage);
+    if (sz == 0) {
+        // buffer is empty or some tasks/ISRs have not completed writing their data yet
+        return ESP_OK;
+    }
+    uint8_t *ptr = esp_apptrace_trax_get_buffer_nolock(sz, tmo);
+    if (ptr) {
+        memcpy(ptr, stage->data, sz);
+    } else {
+        ESP_APPTRACE_LOGD("Failed to flush %d bytes from CPU buffer!", sz);
+    }
+    // keep data in per-CPU buffer if there is no space for them yet
+    esp_apptrace_stage_release(stage, ptr != NULL);
+    return ptr ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static uint8_t *esp_apptrace_trax_stage_get_buffer(uint32_t sz, esp_apptrace_tmo_t *tmo)
+{
+    if (sz > CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE) {
+        return NULL;
+    }
+    // task can be moved to another CPU after this call, it is not a problem because chunks can be reserved from any CPU
+    esp_apptrace_stage_t *stage = &s_trace_buf.trax.stages[xPortGetCoreID()];
+    uint8_t *ptr = esp_apptrace_stage_reserve(stage, sz);
+    if (ptr == NULL) {
+        // buffer is full, move its data to TRAX memory block
+        if (esp_apptrace_lock(tmo) != ESP_OK) {
+            return NULL;
+        }
+        esp_apptrace_trax_stage_flush(stage, tmo);
+        if (esp_apptrace_unlock() != ESP_OK) {
+            assert(false && "Failed to unlock apptrace data!");
+        }
+        ptr = esp_apptrace_stage_reserve(stage, sz);
+    }
+    return ptr;
+}
+#endif
+
+static uint8_t *esp_apptrace_trax_get_buffer(uint32_t size, esp_apptrace_tmo_t *tmo)
+{
+    uint8_t *buf_ptr = NULL;
+
+    if (size > ESP_APPTRACE_USR_DATA_LEN_MAX) {
+        ESP_APPTRACE_LOGE("Too large user data size %d!", size);
+        return NULL;
+    }
+#if CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE > 0
+    buf_ptr = esp_apptrace_trax_stage_get_buffer(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size), tmo);
+    if (buf_ptr) {
+        return esp_apptrace_data_header_init(buf_ptr, size);
+    }
+    // per-CPU buffer is busy, allocate user block directly in TRAX memory block
+#endif
+
+    int res = esp_apptrace_lock(tmo);
+    if (res != ESP_OK) {
+        return NULL;
+    }
+    buf_ptr = esp_apptrace_trax_get_buffer_nolock(ESP_APPTRACE_USR_BLOCK_RAW_SZ(size), tmo);
     if (buf_ptr) {
         buf_ptr = esp_apptrace_data_header_init(buf_ptr, size);
     }
@@ -797,6 +860,16 @@ static esp_err_t esp_apptrace_trax_put_buffer(uint8_t *ptr, esp_apptrace_tmo_t *
 
     // update written size
     hdr->wr_sz = hdr->block_sz;
+#if CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE > 0
+    // user block can be completed on another CPU, so look for the buffer it belongs to
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        esp_apptrace_stage_t *stage = &s_trace_buf.trax.stages[i];
+        if ((uint8_t *)hdr >= stage->data && (uint8_t *)hdr < stage->data + stage->size) {
+            esp_apptrace_stage_commit(stage, ESP_APPTRACE_USR_BLOCK_RAW_SZ(ESP_APPTRACE_USR_BLOCK_LEN(hdr->block_sz)));
+            break;
+        }
+    }
+#endif
 
     // TODO: mark block as busy in order not to re-use it for other tracing calls until it is completely written
     // TODO: avoid potential situation when all memory is consumed by low prio tasks which can not complete writing due to
@@ -811,6 +884,13 @@ static esp_err_t esp_apptrace_trax_flush(uint32_t min_sz, esp_apptrace_tmo_t *tm
 {
     int res = ESP_OK;
 
+#if CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE > 0
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        if (esp_apptrace_trax_stage_flush(&s_trace_buf.trax.stages[i], tmo) != ESP_OK) {
+            ESP_APPTRACE_LOGE("Failed to flush CPU%d buffer!", i);
+        }
+    }
+#endif
     if (ESP_APPTRACE_TRAX_INBLOCK_MARKER() < min_sz) {
         ESP_APPTRACE_LOGI("Ignore flush request for min %d bytes. Bytes in TRAX block: %d.", min_sz, ESP_APPTRACE_TRAX_INBLOCK_MARKER());
         return ESP_OK;
@@ -861,6 +941,11 @@ static esp_err_t esp_apptrace_trax_dest_init()
     esp_apptrace_rb_init(&s_trace_buf.trax.rb_pend_chunk_sz, (uint8_t *)s_trace_buf.trax.pending_chunk_sz,
                         sizeof(s_trace_buf.trax.pending_chunk_sz));
 #endif
+#endif
+#if CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE > 0
+    for (int i = 0; i < portNUM_PROCESSORS; i++) {
+        esp_apptrace_stage_init(&s_trace_buf.trax.stages[i], s_trace_buf.trax.stage_data[i], CONFIG_ESP32_APPTRACE_PERCPU_BUF_SIZE);
+    }
 #endif
 
     DPORT_WRITE_PERI_REG(DPORT_PRO_TRACEMEM_ENA_REG, DPORT_PRO_TRACEMEM_ENA_M);
@@ -894,6 +979,7 @@ esp_err_t esp_apptrace_init()
             esp_apptrace_lock_cleanup();
             return res;
         }
+        s_trace_buf.hw = &s_trace_hw_trax;
 #endif
     }
 
@@ -907,6 +993,28 @@ esp_err_t esp_apptrace_init()
     return ESP_OK;
 }
 
+esp_err_t esp_apptrace_hw_register(esp_apptrace_dest_t dest, const esp_apptrace_hw_t *hw)
+{
+    if (dest != ESP_APPTRACE_DEST_TRAX) {
+        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_trace_buf.hw = hw;
+    return ESP_OK;
+}
+
+static const esp_apptrace_hw_t *esp_apptrace_hw_get(esp_apptrace_dest_t dest)
+{
+    if (dest != ESP_APPTRACE_DEST_TRAX) {
+        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+        return NULL;
+    }
+    if (s_trace_buf.hw == NULL) {
+        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
+    }
+    return s_trace_buf.hw;
+}
+
 void esp_apptrace_down_buffer_config(uint8_t *buf, uint32_t size)
 {
     esp_apptrace_rb_init(&s_trace_buf.rb_down, buf, size);
@@ -916,17 +1024,9 @@ esp_err_t esp_apptrace_read(esp_apptrace_dest_t dest, void *buf, uint32_t *size,
 {
     int res = ESP_OK;
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
@@ -950,17 +1050,9 @@ esp_err_t esp_apptrace_read(esp_apptrace_dest_t dest, void *buf, uint32_t *size,
 uint8_t *esp_apptrace_down_buffer_get(esp_apptrace_dest_t dest, uint32_t *size, uint32_t user_tmo)
 {
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return NULL;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return NULL;
     }
 
@@ -972,17 +1064,9 @@ uint8_t *esp_apptrace_down_buffer_get(esp_apptrace_dest_t dest, uint32_t *size,
 esp_err_t esp_apptrace_down_buffer_put(esp_apptrace_dest_t dest, uint8_t *ptr, uint32_t user_tmo)
 {
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
@@ -994,17 +1078,9 @@ esp_err_t esp_apptrace_write(esp_apptrace_dest_t dest, const void *data, uint32_
 {
     uint8_t *ptr = NULL;
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
@@ -1027,17 +1103,9 @@ int esp_apptrace_vprintf_to(esp_apptrace_dest_t dest, uint32_t user_tmo, const c
     uint16_t nargs = 0;
     uint8_t *pout, *p = (uint8_t *)fmt;
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
@@ -1045,7 +1113,10 @@ int esp_apptrace_vprintf_to(esp_apptrace_dest_t dest, uint32_t user_tmo, const c
     ESP_APPTRACE_LOGD("fmt %x", fmt);
     while ((p = (uint8_t *)strchr((char *)p, '%')) && nargs < ESP_APPTRACE_MAX_VPRINTF_ARGS) {
         p++;
-        if (*p != '%' && *p != 0) {
+        if (*p == '%') {
+            // escaped '%' does not consume an argument, skip it to not count the next char
+            p++;
+        } else if (*p != 0) {
             nargs++;
         }
     }
@@ -1088,17 +1159,9 @@ int esp_apptrace_vprintf(const char *fmt, va_list ap)
 uint8_t *esp_apptrace_buffer_get(esp_apptrace_dest_t dest, uint32_t size, uint32_t user_tmo)
 {
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return NULL;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return NULL;
     }
 
@@ -1109,17 +1172,9 @@ uint8_t *esp_apptrace_buffer_get(esp_apptrace_dest_t dest, uint32_t size, uint32
 esp_err_t esp_apptrace_buffer_put(esp_apptrace_dest_t dest, uint8_t *ptr, uint32_t user_tmo)
 {
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
@@ -1130,17 +1185,9 @@ esp_err_t esp_apptrace_buffer_put(esp_apptrace_dest_t dest, uint8_t *ptr, uint32
 esp_err_t esp_apptrace_flush_nolock(esp_apptrace_dest_t dest, uint32_t min_sz, uint32_t usr_tmo)
 {
     esp_apptrace_tmo_t tmo;
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
 
@@ -1174,17 +1221,9 @@ esp_err_t esp_apptrace_flush(esp_apptrace_dest_t dest, uint32_t usr_tmo)
 
 bool esp_apptrace_host_is_connected(esp_apptrace_dest_t dest)
 {
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return false;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return false;
     }
     return hw->host_is_connected();
@@ -1192,17 +1231,9 @@ bool esp_apptrace_host_is_connected(esp_apptrace_dest_t dest)
 
 esp_err_t esp_apptrace_status_reg_set(esp_apptrace_dest_t dest, uint32_t val)
 {
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
     return hw->status_reg_set(val);
@@ -1210,17 +1241,9 @@ esp_err_t esp_apptrace_status_reg_set(esp_apptrace_dest_t dest, uint32_t val)
 
 esp_err_t esp_apptrace_status_reg_get(esp_apptrace_dest_t dest, uint32_t *val)
 {
-    esp_apptrace_hw_t *hw = NULL;
+    const esp_apptrace_hw_t *hw = esp_apptrace_hw_get(dest);
 
-    if (dest == ESP_APPTRACE_DEST_TRAX) {
-#if CONFIG_ESP32_APPTRACE_DEST_TRAX
-        hw = ESP_APPTRACE_HW(ESP_APPTRACE_HW_TRAX);
-#else
-        ESP_APPTRACE_LOGE("Application tracing via TRAX is disabled in menuconfig!");
-        return ESP_ERR_NOT_SUPPORTED;
-#endif
-    } else {
-        ESP_APPTRACE_LOGE("Trace destinations other then TRAX are not supported yet!");
+    if (hw == NULL) {
         return ESP_ERR_NOT_SUPPORTED;
     }
     return hw->status_reg_get(val);
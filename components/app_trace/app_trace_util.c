@@ -189,3 +189,62 @@ uint32_t esp_apptrace_rb_write_size_get(esp_apptrace_rb_t *rb)
     }
     return size;
 }
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// STAGING BUFFER ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+static inline bool esp_apptrace_cas(volatile uint32_t *addr, uint32_t compare, uint32_t set)
+{
+    uxPortCompareSet(addr, compare, &set);
+    return set == compare;
+}
+
+uint8_t *esp_apptrace_stage_reserve(esp_apptrace_stage_t *st, uint32_t size)
+{
+    uint32_t reserved;
+
+    do {
+        reserved = st->reserved;
+        // closed buffer is marked as full
+        if (size > st->size - reserved) {
+            return NULL;
+        }
+    } while (!esp_apptrace_cas(&st->reserved, reserved, reserved + size));
+    return st->data + reserved;
+}
+
+void esp_apptrace_stage_commit(esp_apptrace_stage_t *st, uint32_t size)
+{
+    uint32_t committed;
+
+    do {
+        committed = st->committed;
+    } while (!esp_apptrace_cas(&st->committed, committed, committed + size));
+}
+
+uint32_t esp_apptrace_stage_close(esp_apptrace_stage_t *st)
+{
+    uint32_t reserved = st->reserved;
+
+    // committed counter can not exceed reserved one, so if they are equal there are no writers in progress
+    if (reserved == 0 || st->committed != reserved) {
+        return 0;
+    }
+    // fails if new chunk has been reserved after the check above
+    if (!esp_apptrace_cas(&st->reserved, reserved, st->size)) {
+        return 0;
+    }
+    return reserved;
+}
+
+void esp_apptrace_stage_release(esp_apptrace_stage_t *st, bool consumed)
+{
+    if (consumed) {
+        st->committed = 0;
+        // re-open buffer after committed counter is reset
+        st->reserved = 0;
+    } else {
+        st->reserved = st->committed;
+    }
+}
@@ -14,6 +14,7 @@
 #ifndef ESP_APP_TRACE_UTIL_H_
 #define ESP_APP_TRACE_UTIL_H_
 
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "esp_err.h"
 
@@ -164,4 +165,70 @@ uint32_t esp_apptrace_rb_read_size_get(esp_apptrace_rb_t *rb);
  */
 uint32_t esp_apptrace_rb_write_size_get(esp_apptrace_rb_t *rb);
 
+/** Per-CPU staging buffer control structure.
+ *
+ * Trace data chunks are reserved and committed in the buffer of the CPU they are written on without taking any locks.
+ * When the buffer is full all committed chunks are moved to the trace memory in one go, only this step needs to be synchronized.
+ * Chunks are reserved and committed using compare-and-set, so they can be written from tasks and ISRs on any CPU.
+ */
+typedef struct {
+    uint8_t *data;                  ///< pointer to data storage
+    uint32_t size;                  ///< size of data storage
+    volatile uint32_t reserved;     ///< number of reserved bytes
+    volatile uint32_t committed;    ///< number of committed bytes
+} esp_apptrace_stage_t;
+
+/**
+ * @brief Initializes staging buffer control structure.
+ *
+ * @param st   Pointer to staging buffer structure to be initialized.
+ * @param data Pointer to buffer to be used as staging buffer's data storage.
+ * @param size Size of buffer to be used as staging buffer's data storage.
+ */
+static inline void esp_apptrace_stage_init(esp_apptrace_stage_t *st, uint8_t *data, uint32_t size)
+{
+    st->data = data;
+    st->size = size;
+    st->reserved = 0;
+    st->committed = 0;
+}
+
+/**
+ * @brief Reserves memory chunk in staging buffer.
+ *
+ * @param st   Pointer to staging buffer structure.
+ * @param size Size of the memory to reserve.
+ *
+ * @return Pointer to the reserved memory or NULL if there is not enough space in the buffer.
+ */
+uint8_t *esp_apptrace_stage_reserve(esp_apptrace_stage_t *st, uint32_t size);
+
+/**
+ * @brief Commits memory chunk reserved in staging buffer, after that its data can be moved out of the buffer.
+ *
+ * @param st   Pointer to staging buffer structure.
+ * @param size Size of the reserved memory chunk.
+ */
+void esp_apptrace_stage_commit(esp_apptrace_stage_t *st, uint32_t size);
+
+/**
+ * @brief Closes staging buffer for new reservations if all reserved chunks are committed.
+ *
+ * Data of the closed buffer can be read by caller. Buffer must be released with esp_apptrace_stage_release() after that.
+ * Callers of this function must be synchronized with each other.
+ *
+ * @param st Pointer to staging buffer structure.
+ *
+ * @return Size of data in the closed buffer or 0 if buffer is empty or has uncommitted chunks, in this case it is not closed.
+ */
+uint32_t esp_apptrace_stage_close(esp_apptrace_stage_t *st);
+
+/**
+ * @brief Re-opens staging buffer closed with esp_apptrace_stage_close().
+ *
+ * @param st       Pointer to staging buffer structure.
+ * @param consumed If true buffer data have been moved out and buffer is emptied, otherwise data are kept in the buffer.
+ */
+void esp_apptrace_stage_release(esp_apptrace_stage_t *st, bool consumed);
+
 #endif //ESP_APP_TRACE_UTIL_H_
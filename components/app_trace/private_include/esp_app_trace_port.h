@@ -0,0 +1,72 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef ESP_APP_TRACE_PORT_H_
+#define ESP_APP_TRACE_PORT_H_
+
+#include "esp_app_trace.h"
+
+/** Application tracing transport (HW interface).
+ *
+ * Tracing API routines check destination and forward calls to the transport serving it.
+ * TRAX memory transport is registered by esp_apptrace_init() when CONFIG_ESP32_APPTRACE_DEST_TRAX is enabled.
+ * Other implementations (e.g. memory buffers emulating TRAX in host tests) can be registered with esp_apptrace_hw_register().
+ */
+typedef struct {
+    /** Allocates buffer for user data of the specified size in up channel, the buffer must be released with put_up_buffer */
+    uint8_t *(*get_up_buffer)(uint32_t, esp_apptrace_tmo_t *);
+    /** Indicates that user data in the buffer are ready to be sent to the host */
+    esp_err_t (*put_up_buffer)(uint8_t *, esp_apptrace_tmo_t *);
+    /** Exposes data written to up channel to the host if there are not less than the specified number of bytes */
+    esp_err_t (*flush_up_buffer)(uint32_t, esp_apptrace_tmo_t *);
+    /** Gets buffer with data received from the host, on input the parameter holds maximum size, on output actual size */
+    uint8_t *(*get_down_buffer)(uint32_t *, esp_apptrace_tmo_t *);
+    /** Releases buffer returned by get_down_buffer */
+    esp_err_t (*put_down_buffer)(uint8_t *, esp_apptrace_tmo_t *);
+    /** Checks whether the host is connected (streaming mode) */
+    bool (*host_is_connected)(void);
+    /** Sets value of the status register shared with the host */
+    esp_err_t (*status_reg_set)(uint32_t val);
+    /** Gets value of the status register shared with the host */
+    esp_err_t (*status_reg_get)(uint32_t *val);
+} esp_apptrace_hw_t;
+
+/**
+ * @brief Registers transport serving the specified destination.
+ *
+ * @note Must be called after esp_apptrace_init(), replaces the transport registered by it.
+ *
+ * @param dest Destination to be served by the transport.
+ * @param hw   Pointer to transport interface, must stay valid while tracing module is in use.
+ *
+ * @return ESP_OK on success, otherwise \see esp_err_t
+ */
+esp_err_t esp_apptrace_hw_register(esp_apptrace_dest_t dest, const esp_apptrace_hw_t *hw);
+
+/**
+ * @brief Locks tracing module data. Transports use it to serialize access to their data from tasks and ISRs on all CPUs.
+ *
+ * @param tmo Pointer to timeout struct.
+ *
+ * @return ESP_OK on success, otherwise \see esp_err_t
+ */
+esp_err_t esp_apptrace_lock(esp_apptrace_tmo_t *tmo);
+
+/**
+ * @brief Unlocks tracing module data.
+ *
+ * @return ESP_OK on success, otherwise \see esp_err_t
+ */
+esp_err_t esp_apptrace_unlock(void);
+
+#endif //ESP_APP_TRACE_PORT_H_
@@ -0,0 +1,6 @@
+#pragma once
+
+static inline int esp_clk_cpu_freq(void)
+{
+    return 1000000;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "sdkconfig.h"
+
+// Port layer functions used by tracing module, threads of the host test play the role of CPUs
+
+#define portNUM_PROCESSORS  2
+
+static inline int xPortGetCoreID(void)
+{
+    return 0;
+}
+
+typedef struct {
+    volatile uint32_t owner;
+} portMUX_TYPE;
+
+static inline void uxPortCompareSet(volatile uint32_t *addr, uint32_t compare, uint32_t *set)
+{
+    *set = __sync_val_compare_and_swap(addr, compare, *set);
+}
+
+static inline void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    mux->owner = 0;
+}
+
+static inline bool vPortCPUAcquireMutexTimeout(portMUX_TYPE *mux, int timeout_cycles)
+{
+    return __sync_bool_compare_and_swap(&mux->owner, 0, 1);
+}
+
+static inline void vPortCPUReleaseMutex(portMUX_TYPE *mux)
+{
+    __sync_lock_release(&mux->owner);
+}
+
+#define portENTER_CRITICAL_NESTED()         0
+#define portEXIT_CRITICAL_NESTED(state)     (void)(state)
+
+// Run time counter ticks at 1 MHz, see esp_clk_cpu_freq()
+static inline uint32_t stub_run_time_counter(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#define portGET_RUN_TIME_COUNTER_VALUE()    stub_run_time_counter()
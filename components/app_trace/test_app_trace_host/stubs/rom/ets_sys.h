@@ -0,0 +1,3 @@
+#pragma once
+
+int ets_printf(const char *fmt, ...);
@@ -0,0 +1,5 @@
+#pragma once
+
+#define CONFIG_ESP32_APPTRACE_ENABLE        1
+#define CONFIG_ESP32_APPTRACE_LOCK_ENABLE   1
+#define CONFIG_LOG_DEFAULT_LEVEL            1
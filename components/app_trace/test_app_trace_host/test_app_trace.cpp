@@ -0,0 +1,298 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+#include "trax_emulation.h"
+
+extern "C" {
+#include "esp_app_trace.h"
+}
+
+using std::vector;
+
+// Same layout as records written by app_trace unit test and checked by apptrace_proc.py
+static vector<uint8_t> make_record(uint32_t task, uint32_t ts, uint8_t stamp, size_t len)
+{
+    vector<uint8_t> rec(len, stamp);
+    memcpy(&rec[0], &task, sizeof(task));
+    memcpy(&rec[4], &ts, sizeof(ts));
+    return rec;
+}
+
+// Reads trace data like OpenOCD does in streaming mode until stopped
+class HostReader
+{
+public:
+    HostReader(TraxEmulator &emu) : m_emu(emu), m_stop(false), m_thread([this]() {
+        while (!m_stop) {
+            m_emu.read(m_stream);
+            std::this_thread::yield();
+        }
+    })
+    {
+    }
+
+    vector<uint8_t> &stop()
+    {
+        m_stop = true;
+        m_thread.join();
+        m_emu.read(m_stream);
+        return m_stream;
+    }
+
+private:
+    TraxEmulator &m_emu;
+    vector<uint8_t> m_stream;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+};
+
+TEST_CASE("written data are delivered to host in order", "[app_trace]")
+{
+    TraxEmulator emu(1024);
+    HostReader host(emu);
+    vector<uint8_t> expected;
+
+    for (uint32_t i = 0; i < 1000; i++) {
+        vector<uint8_t> rec = make_record(1, i, i, 8 + i % 200);
+        REQUIRE(esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, rec.data(), rec.size(), ESP_APPTRACE_TMO_INFINITE) == ESP_OK);
+        expected.insert(expected.end(), rec.begin(), rec.end());
+    }
+    REQUIRE(esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, ESP_APPTRACE_TMO_INFINITE) == ESP_OK);
+
+    CHECK(host.stop() == expected);
+    CHECK(emu.incomplete_blocks() == 0);
+    CHECK(emu.block_switches() > 100);
+}
+
+TEST_CASE("data are dropped when host does not read them in time", "[app_trace]")
+{
+    TraxEmulator emu(256);
+    vector<uint8_t> rec = make_record(1, 0, 0, 60);
+    int written = 0;
+
+    while (esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, rec.data(), rec.size(), 0) == ESP_OK) {
+        REQUIRE(++written < 100);
+    }
+    // one block is exposed to the host, another one is full
+    CHECK(written == 2 * (256 / 64));
+    CHECK(esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, 0) == ESP_ERR_TIMEOUT);
+
+    vector<uint8_t> stream;
+    CHECK(emu.read(stream) == 4 * rec.size());
+    CHECK(esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, rec.data(), rec.size(), 0) == ESP_OK);
+}
+
+TEST_CASE("old data are overwritten in post-mortem mode", "[app_trace]")
+{
+    TraxEmulator emu(256, false);
+
+    for (uint32_t i = 0; i < 100; i++) {
+        vector<uint8_t> rec = make_record(1, i, i, 60);
+        REQUIRE(esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, rec.data(), rec.size(), 0) == ESP_OK);
+    }
+    REQUIRE(esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, 0) == ESP_OK);
+
+    vector<vector<uint8_t> > blocks;
+    emu.read(blocks);
+    REQUIRE(blocks.size() == 4);
+    CHECK(blocks.back() == make_record(1, 99, 99, 60));
+}
+
+TEST_CASE("incomplete user block is reported by host", "[app_trace]")
+{
+    TraxEmulator emu(256);
+
+    uint8_t *ptr = esp_apptrace_buffer_get(ESP_APPTRACE_DEST_TRAX, 16, 0);
+    REQUIRE(ptr != NULL);
+    memset(ptr, 0xAA, 16);
+    REQUIRE(esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, 0) == ESP_OK);
+    vector<uint8_t> stream;
+    emu.read(stream);
+    CHECK(emu.incomplete_blocks() == 1);
+
+    ptr = esp_apptrace_buffer_get(ESP_APPTRACE_DEST_TRAX, 16, 0);
+    REQUIRE(ptr != NULL);
+    REQUIRE(esp_apptrace_buffer_put(ESP_APPTRACE_DEST_TRAX, ptr, 0) == ESP_OK);
+    REQUIRE(esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, 0) == ESP_OK);
+    emu.read(stream);
+    CHECK(emu.incomplete_blocks() == 1);
+}
+
+static int trace_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = esp_apptrace_vprintf_to(ESP_APPTRACE_DEST_TRAX, ESP_APPTRACE_TMO_INFINITE, fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+TEST_CASE("log records contain format address and arguments", "[app_trace]")
+{
+    TraxEmulator emu(1024);
+    const char *fmt = "%d items in %s at 0x%x, 100%%\n";
+
+    REQUIRE(trace_printf(fmt, 42, "queue", 0x1234) > 0);
+    REQUIRE(esp_apptrace_flush(ESP_APPTRACE_DEST_TRAX, 0) == ESP_OK);
+
+    // record layout parsed by logtrace_proc.py: args number, format address, 32-bit args
+    vector<vector<uint8_t> > blocks;
+    emu.read(blocks);
+    REQUIRE(blocks.size() == 1);
+    vector<uint8_t> &rec = blocks[0];
+    REQUIRE(rec.size() == 1 + sizeof(char *) + 3 * sizeof(uint32_t));
+    CHECK(rec[0] == 3);
+    const char *fmt_addr;
+    memcpy(&fmt_addr, &rec[1], sizeof(fmt_addr));
+    CHECK(fmt_addr == fmt);
+    uint32_t args[3];
+    memcpy(args, &rec[1 + sizeof(char *)], sizeof(args));
+    CHECK(args[0] == 42);
+    CHECK(args[2] == 0x1234);
+}
+
+#define FILE_CMD_FOPEN     0x0
+#define FILE_CMD_FCLOSE    0x1
+#define FILE_CMD_FWRITE    0x2
+#define FILE_CMD_FREAD     0x3
+#define FILE_CMD_STOP      0x6
+
+// Host side of file I/O protocol, see host_file_io.c
+static void file_server(TraxEmulator &emu)
+{
+    while (true) {
+        vector<vector<uint8_t> > cmds;
+        emu.read(cmds);
+        for (auto &cmd : cmds) {
+            const uint8_t *args = &cmd[1];
+            FILE *f;
+            switch (cmd[0]) {
+            case FILE_CMD_FOPEN: {
+                const char *path = (const char *)args;
+                f = fopen(path, path + strlen(path) + 1);
+                emu.write(&f, sizeof(f));
+                break;
+            }
+            case FILE_CMD_FCLOSE: {
+                memcpy(&f, args, sizeof(f));
+                int ret = fclose(f);
+                emu.write(&ret, sizeof(ret));
+                break;
+            }
+            case FILE_CMD_FWRITE: {
+                memcpy(&f, args, sizeof(f));
+                size_t ret = fwrite(args + sizeof(f), 1, cmd.size() - 1 - sizeof(f), f);
+                emu.write(&ret, sizeof(ret));
+                break;
+            }
+            case FILE_CMD_FREAD: {
+                size_t size;
+                memcpy(&f, args, sizeof(f));
+                memcpy(&size, args + sizeof(f), sizeof(size));
+                vector<uint8_t> buf(size);
+                size_t ret = fread(buf.data(), 1, size, f);
+                emu.write(&ret, sizeof(ret));
+                emu.write(buf.data(), ret);
+                break;
+            }
+            case FILE_CMD_STOP:
+                return;
+            }
+        }
+        std::this_thread::yield();
+    }
+}
+
+TEST_CASE("files are written and read on host", "[app_trace]")
+{
+    TraxEmulator emu(1024);
+    std::thread host(file_server, std::ref(emu));
+    char path[] = "/tmp/apptrace_XXXXXX";
+    close(mkstemp(path));
+    const char data[] = "gcov data written via JTAG";
+
+    void *f = esp_apptrace_fopen(ESP_APPTRACE_DEST_TRAX, path, "w");
+    REQUIRE(f != NULL);
+    CHECK(esp_apptrace_fwrite(ESP_APPTRACE_DEST_TRAX, data, 1, sizeof(data), f) == sizeof(data));
+    CHECK(esp_apptrace_fclose(ESP_APPTRACE_DEST_TRAX, f) == 0);
+
+    f = esp_apptrace_fopen(ESP_APPTRACE_DEST_TRAX, path, "r");
+    REQUIRE(f != NULL);
+    char buf[64] = { 0 };
+    CHECK(esp_apptrace_fread(ESP_APPTRACE_DEST_TRAX, buf, 1, sizeof(buf), f) == sizeof(data));
+    CHECK(strcmp(buf, data) == 0);
+    CHECK(esp_apptrace_fclose(ESP_APPTRACE_DEST_TRAX, f) == 0);
+
+    CHECK(esp_apptrace_fstop(ESP_APPTRACE_DEST_TRAX) == ESP_OK);
+    host.join();
+    unlink(path);
+}
+
+TEST_CASE("trace throughput and drop rate", "[.][benchmark]")
+{
+    // Rough model of OpenOCD reading trace memory over JTAG: fixed polling latency per block and limited bandwidth
+    const auto host_latency = std::chrono::microseconds(500);
+    const double host_bytes_per_us = 2.0;
+    const auto duration = std::chrono::milliseconds(500);
+    const size_t rec_len = 64;
+
+    for (uint32_t block_size : {1024, 4096, 16384}) {
+        TraxEmulator emu(block_size);
+        std::atomic<bool> stop(false);
+        size_t delivered = 0;
+        std::thread host([&]() {
+            while (!stop) {
+                vector<uint8_t> stream;
+                size_t n = emu.read(stream);
+                delivered += n;
+                if (n) {
+                    std::this_thread::sleep_for(host_latency + std::chrono::microseconds((int)(n / host_bytes_per_us)));
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        vector<uint8_t> rec = make_record(1, 0, 0, rec_len);
+        size_t written = 0, dropped = 0;
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < duration) {
+            // the same as tracing from ISR: do not wait
+            if (esp_apptrace_write(ESP_APPTRACE_DEST_TRAX, rec.data(), rec.size(), 0) == ESP_OK) {
+                written++;
+            } else {
+                dropped++;
+            }
+            // some work between trace events
+            for (volatile int i = 0; i < 200; i++) {
+            }
+        }
+        stop = true;
+        host.join();
+
+        double secs = std::chrono::duration<double>(duration).count();
+        printf("block %5u bytes: delivered %.2f MB/s, dropped %.1f%% of %zu records, %zu block switches\n",
+               block_size, delivered / secs / 1e6, 100.0 * dropped / (written + dropped),
+               written + dropped, emu.block_switches());
+    }
+}
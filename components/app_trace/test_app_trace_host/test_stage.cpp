@@ -0,0 +1,254 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+
+extern "C" {
+#include "esp_app_trace_util.h"
+}
+
+using std::vector;
+
+struct record_t {
+    uint32_t thread;
+    uint32_t seq;
+    uint32_t payload[2];
+};
+
+// Plays the role of TRAX memory: records moved out of staging buffers are appended here
+struct trace_sink_t {
+    esp_apptrace_lock_t lock;
+    vector<uint8_t> data;
+    size_t wr;
+
+    trace_sink_t(size_t size) : data(size), wr(0)
+    {
+        esp_apptrace_lock_init(&lock);
+    }
+
+    void take()
+    {
+        esp_apptrace_tmo_t tmo;
+        esp_apptrace_tmo_init(&tmo, ESP_APPTRACE_TMO_INFINITE);
+        // catch assertions are not thread safe
+        esp_err_t err = esp_apptrace_lock_take(&lock, &tmo);
+        assert(err == ESP_OK);
+        (void) err;
+    }
+
+    void give()
+    {
+        esp_apptrace_lock_give(&lock);
+    }
+
+    // wraps around as the host would have read the data, assumed to be called under the lock
+    void put(const void *src, size_t len)
+    {
+        if (wr + len > data.size()) {
+            wr = 0;
+        }
+        memcpy(&data[wr], src, len);
+        wr += len;
+    }
+
+    // moves staging buffer data out, assumed to be called under the lock
+    void flush(esp_apptrace_stage_t *st)
+    {
+        uint32_t sz = esp_apptrace_stage_close(st);
+        if (sz) {
+            put(st->data, sz);
+            esp_apptrace_stage_release(st, true);
+        }
+    }
+};
+
+static void stage_write(esp_apptrace_stage_t *st, trace_sink_t *sink, const record_t &rec)
+{
+    uint8_t *ptr;
+    while ((ptr = esp_apptrace_stage_reserve(st, sizeof(rec))) == NULL) {
+        sink->take();
+        sink->flush(st);
+        sink->give();
+    }
+    memcpy(ptr, &rec, sizeof(rec));
+    esp_apptrace_stage_commit(st, sizeof(rec));
+}
+
+TEST_CASE("staging buffer reserves until full", "[stage]")
+{
+    uint8_t buf[64];
+    esp_apptrace_stage_t st;
+    esp_apptrace_stage_init(&st, buf, sizeof(buf));
+
+    CHECK(esp_apptrace_stage_close(&st) == 0);
+    CHECK(esp_apptrace_stage_reserve(&st, 24) == buf);
+    CHECK(esp_apptrace_stage_reserve(&st, 24) == buf + 24);
+    CHECK(esp_apptrace_stage_reserve(&st, 24) == NULL);
+    CHECK(esp_apptrace_stage_reserve(&st, 16) == buf + 48);
+    esp_apptrace_stage_commit(&st, 24);
+    esp_apptrace_stage_commit(&st, 40);
+
+    CHECK(esp_apptrace_stage_close(&st) == 64);
+    esp_apptrace_stage_release(&st, true);
+    CHECK(esp_apptrace_stage_reserve(&st, 64) == buf);
+}
+
+TEST_CASE("staging buffer is not closed while chunks are uncommitted", "[stage]")
+{
+    uint8_t buf[64];
+    esp_apptrace_stage_t st;
+    esp_apptrace_stage_init(&st, buf, sizeof(buf));
+
+    CHECK(esp_apptrace_stage_reserve(&st, 8) == buf);
+    CHECK(esp_apptrace_stage_reserve(&st, 8) == buf + 8);
+    esp_apptrace_stage_commit(&st, 8);
+    CHECK(esp_apptrace_stage_close(&st) == 0);
+    // still open for writers
+    CHECK(esp_apptrace_stage_reserve(&st, 8) == buf + 16);
+    esp_apptrace_stage_commit(&st, 16);
+
+    CHECK(esp_apptrace_stage_close(&st) == 24);
+    // closed buffer rejects new chunks
+    CHECK(esp_apptrace_stage_reserve(&st, 8) == NULL);
+    esp_apptrace_stage_release(&st, true);
+    CHECK(esp_apptrace_stage_reserve(&st, 8) == buf);
+}
+
+TEST_CASE("staging buffer keeps data which could not be moved out", "[stage]")
+{
+    uint8_t buf[64];
+    esp_apptrace_stage_t st;
+    esp_apptrace_stage_init(&st, buf, sizeof(buf));
+
+    CHECK(esp_apptrace_stage_reserve(&st, 16) == buf);
+    esp_apptrace_stage_commit(&st, 16);
+    CHECK(esp_apptrace_stage_close(&st) == 16);
+    esp_apptrace_stage_release(&st, false);
+
+    CHECK(esp_apptrace_stage_reserve(&st, 16) == buf + 16);
+    esp_apptrace_stage_commit(&st, 16);
+    CHECK(esp_apptrace_stage_close(&st) == 32);
+}
+
+TEST_CASE("records written concurrently are moved out exactly once", "[stage]")
+{
+    const int cpus = 2;
+    const int threads = 8;
+    const uint32_t records = 20000;
+
+    vector<uint8_t> stage_data(cpus * 256);
+    esp_apptrace_stage_t stages[cpus];
+    for (int i = 0; i < cpus; i++) {
+        esp_apptrace_stage_init(&stages[i], &stage_data[i * 256], 256);
+    }
+    // large enough to keep all records
+    trace_sink_t sink(threads * records * sizeof(record_t));
+
+    vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            // several threads (tasks and ISRs) share buffer of the same CPU
+            esp_apptrace_stage_t *st = &stages[t % cpus];
+            for (uint32_t i = 0; i < records; i++) {
+                record_t rec = { (uint32_t)t, i, { ~i, i * 3 } };
+                stage_write(st, &sink, rec);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    for (int i = 0; i < cpus; i++) {
+        sink.flush(&stages[i]);
+    }
+
+    REQUIRE(sink.wr == threads * records * sizeof(record_t));
+    vector<uint32_t> next(threads, 0);
+    for (size_t off = 0; off < sink.wr; off += sizeof(record_t)) {
+        record_t rec;
+        memcpy(&rec, &sink.data[off], sizeof(rec));
+        REQUIRE(rec.thread < (uint32_t)threads);
+        // records of every thread are in order, none is lost or duplicated
+        REQUIRE(rec.seq == next[rec.thread]);
+        REQUIRE(rec.payload[0] == ~rec.seq);
+        REQUIRE(rec.payload[1] == rec.seq * 3);
+        next[rec.thread]++;
+    }
+}
+
+static double elapsed_sec(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+TEST_CASE("recording throughput", "[.][benchmark]")
+{
+    const uint32_t records = 1000000;
+    const size_t stage_size = 1024;
+
+    for (int threads : {1, 2, 4}) {
+        trace_sink_t sink(16 * 1024);
+        struct timespec start;
+
+        // every record takes the global lock
+        vector<std::thread> workers;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (uint32_t i = 0; i < records; i++) {
+                    record_t rec = { (uint32_t)t, i, { 0, 0 } };
+                    sink.take();
+                    sink.put(&rec, sizeof(rec));
+                    sink.give();
+                }
+            });
+        }
+        for (auto &w : workers) {
+            w.join();
+        }
+        double locked = elapsed_sec(start);
+
+        // every thread has its own CPU buffer, the lock is taken when it is full
+        vector<uint8_t> stage_data(threads * stage_size);
+        vector<esp_apptrace_stage_t> stages(threads);
+        for (int t = 0; t < threads; t++) {
+            esp_apptrace_stage_init(&stages[t], &stage_data[t * stage_size], stage_size);
+        }
+        workers.clear();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (uint32_t i = 0; i < records; i++) {
+                    record_t rec = { (uint32_t)t, i, { 0, 0 } };
+                    stage_write(&stages[t], &sink, rec);
+                }
+            });
+        }
+        for (auto &w : workers) {
+            w.join();
+        }
+        double staged = elapsed_sec(start);
+
+        double mrecs = (double) threads * records / 1e6;
+        printf("%d thread(s): global lock %.1f Mrec/s, per-CPU buffers %.1f Mrec/s\n",
+               threads, mrecs / locked, mrecs / staged);
+    }
+}
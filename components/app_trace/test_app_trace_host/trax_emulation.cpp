@@ -0,0 +1,255 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include "trax_emulation.h"
+
+// Same as esp_tracedata_hdr_t in app_trace.c, bit 15 of the fields holds ID of the CPU which wrote the data
+struct trace_data_hdr_t {
+    uint16_t block_sz;
+    uint16_t wr_sz;
+};
+
+#define USR_BLOCK_LEN(_v_)  ((_v_) & 0x7FFF)
+
+TraxEmulator *TraxEmulator::s_instance = nullptr;
+
+static uint8_t *emu_get_up_buffer(uint32_t size, esp_apptrace_tmo_t *tmo)
+{
+    return TraxEmulator::instance()->get_up_buffer(size, tmo);
+}
+
+static esp_err_t emu_put_up_buffer(uint8_t *ptr, esp_apptrace_tmo_t *tmo)
+{
+    return TraxEmulator::instance()->put_up_buffer(ptr, tmo);
+}
+
+static esp_err_t emu_flush_up_buffer(uint32_t min_sz, esp_apptrace_tmo_t *tmo)
+{
+    return TraxEmulator::instance()->flush_up_buffer(min_sz, tmo);
+}
+
+static uint8_t *emu_get_down_buffer(uint32_t *size, esp_apptrace_tmo_t *tmo)
+{
+    return TraxEmulator::instance()->get_down_buffer(size, tmo);
+}
+
+static esp_err_t emu_put_down_buffer(uint8_t *ptr, esp_apptrace_tmo_t *tmo)
+{
+    return TraxEmulator::instance()->put_down_buffer(ptr, tmo);
+}
+
+static bool emu_host_is_connected(void)
+{
+    return TraxEmulator::instance()->host_is_connected();
+}
+
+static esp_err_t emu_status_reg_set(uint32_t val)
+{
+    return TraxEmulator::instance()->status_reg_set(val);
+}
+
+static esp_err_t emu_status_reg_get(uint32_t *val)
+{
+    return TraxEmulator::instance()->status_reg_get(val);
+}
+
+static const esp_apptrace_hw_t s_emu_hw = {
+    .get_up_buffer = emu_get_up_buffer,
+    .put_up_buffer = emu_put_up_buffer,
+    .flush_up_buffer = emu_flush_up_buffer,
+    .get_down_buffer = emu_get_down_buffer,
+    .put_down_buffer = emu_put_down_buffer,
+    .host_is_connected = emu_host_is_connected,
+    .status_reg_set = emu_status_reg_set,
+    .status_reg_get = emu_status_reg_get,
+};
+
+TraxEmulator::TraxEmulator(uint32_t block_size, bool host_connected)
+    : m_block_size(block_size), m_host_connected(host_connected)
+{
+    m_blocks[0].resize(block_size);
+    m_blocks[1].resize(block_size);
+    s_instance = this;
+    esp_apptrace_init();
+    esp_apptrace_hw_register(ESP_APPTRACE_DEST_TRAX, &s_emu_hw);
+}
+
+TraxEmulator::~TraxEmulator()
+{
+    esp_apptrace_hw_register(ESP_APPTRACE_DEST_TRAX, nullptr);
+    s_instance = nullptr;
+}
+
+bool TraxEmulator::switch_block(esp_apptrace_tmo_t *tmo)
+{
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_host_lock);
+            if (!m_host_connected || m_exposed == 0) {
+                m_exposed = m_marker;
+                m_in_block ^= 1;
+                m_marker = 0;
+                m_switches++;
+                return true;
+            }
+        }
+        // wait for the host to read previous block
+        if (esp_apptrace_tmo_check(tmo) != ESP_OK) {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+}
+
+uint8_t *TraxEmulator::get_up_buffer(uint32_t size, esp_apptrace_tmo_t *tmo)
+{
+    uint32_t raw_sz = size + sizeof(trace_data_hdr_t);
+    if (raw_sz > m_block_size) {
+        return NULL;
+    }
+    if (esp_apptrace_lock(tmo) != ESP_OK) {
+        return NULL;
+    }
+    uint8_t *ptr = NULL;
+    if (m_marker + raw_sz <= m_block_size || switch_block(tmo)) {
+        ptr = &m_blocks[m_in_block][m_marker];
+        m_marker += raw_sz;
+        trace_data_hdr_t *hdr = (trace_data_hdr_t *)ptr;
+        hdr->block_sz = size;
+        hdr->wr_sz = 0;
+        ptr += sizeof(trace_data_hdr_t);
+    }
+    esp_apptrace_unlock();
+    return ptr;
+}
+
+esp_err_t TraxEmulator::put_up_buffer(uint8_t *ptr, esp_apptrace_tmo_t *tmo)
+{
+    trace_data_hdr_t *hdr = (trace_data_hdr_t *)(ptr - sizeof(trace_data_hdr_t));
+    hdr->wr_sz = hdr->block_sz;
+    return ESP_OK;
+}
+
+esp_err_t TraxEmulator::flush_up_buffer(uint32_t min_sz, esp_apptrace_tmo_t *tmo)
+{
+    // called under the tracing module lock
+    if (m_marker == 0 || m_marker < min_sz) {
+        return ESP_OK;
+    }
+    return switch_block(tmo) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+uint8_t *TraxEmulator::get_down_buffer(uint32_t *size, esp_apptrace_tmo_t *tmo)
+{
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(m_host_lock);
+            if (!m_down.empty()) {
+                uint32_t sz = std::min<size_t>(*size, m_down.size());
+                m_down_buf.assign(m_down.begin(), m_down.begin() + sz);
+                m_down.erase(m_down.begin(), m_down.begin() + sz);
+                *size = sz;
+                return m_down_buf.data();
+            }
+        }
+        if (esp_apptrace_tmo_check(tmo) != ESP_OK) {
+            *size = 0;
+            return NULL;
+        }
+        std::this_thread::yield();
+    }
+}
+
+esp_err_t TraxEmulator::put_down_buffer(uint8_t *ptr, esp_apptrace_tmo_t *tmo)
+{
+    return ESP_OK;
+}
+
+bool TraxEmulator::host_is_connected()
+{
+    return m_host_connected;
+}
+
+esp_err_t TraxEmulator::status_reg_set(uint32_t val)
+{
+    m_status = val;
+    return ESP_OK;
+}
+
+esp_err_t TraxEmulator::status_reg_get(uint32_t *val)
+{
+    *val = m_status;
+    return ESP_OK;
+}
+
+size_t TraxEmulator::read(std::vector<std::vector<uint8_t> > &blocks)
+{
+    std::lock_guard<std::mutex> lock(m_host_lock);
+    const uint8_t *data = m_blocks[m_in_block ^ 1].data();
+    size_t total = 0;
+
+    for (uint32_t off = 0; off + sizeof(trace_data_hdr_t) <= m_exposed; ) {
+        const trace_data_hdr_t *hdr = (const trace_data_hdr_t *)(data + off);
+        uint32_t len = USR_BLOCK_LEN(hdr->block_sz);
+        if (USR_BLOCK_LEN(hdr->wr_sz) != len) {
+            m_incomplete++;
+        }
+        off += sizeof(trace_data_hdr_t);
+        blocks.emplace_back(data + off, data + off + len);
+        off += len;
+        total += len;
+    }
+    m_exposed = 0;
+    return total;
+}
+
+size_t TraxEmulator::read(std::vector<uint8_t> &stream)
+{
+    std::vector<std::vector<uint8_t> > blocks;
+    size_t total = read(blocks);
+    for (auto &b : blocks) {
+        stream.insert(stream.end(), b.begin(), b.end());
+    }
+    return total;
+}
+
+void TraxEmulator::write(const void *data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_host_lock);
+    m_down.insert(m_down.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+}
+
+// ROM and log functions used by tracing module
+
+extern "C" int ets_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int ret = vprintf(fmt, ap);
+    va_end(ap);
+    return ret;
+}
+
+extern "C" uint32_t esp_log_timestamp(void)
+{
+    return 0;
+}
+
+extern "C" uint32_t esp_log_early_timestamp(void)
+{
+    return 0;
+}
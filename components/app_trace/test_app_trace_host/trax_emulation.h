@@ -0,0 +1,102 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef trax_emulation_h
+#define trax_emulation_h
+
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+extern "C" {
+#include "esp_app_trace_port.h"
+}
+
+/**
+ * Memory transport for the tracing module which works the same way as TRAX memory transport.
+ *
+ * Up data are written to one of two memory blocks. When it is full (or flushed) blocks are switched
+ * and the filled one is exposed to the host. In streaming mode (host connected) blocks are switched
+ * only after the host has read the previously exposed block, so writers wait for the host or fail with timeout.
+ * In post-mortem mode exposed block is overwritten.
+ *
+ * Host side methods do what OpenOCD does: read the exposed block and strip user data headers,
+ * and send data to the target.
+ */
+class TraxEmulator
+{
+public:
+    TraxEmulator(uint32_t block_size, bool host_connected = true);
+    ~TraxEmulator();
+
+    // Host side: appends user data blocks from exposed memory block to 'blocks', returns number of bytes read
+    size_t read(std::vector<std::vector<uint8_t> > &blocks);
+
+    // Host side: appends user data from exposed memory block to 'stream', returns number of bytes read
+    size_t read(std::vector<uint8_t> &stream);
+
+    // Host side: sends data to the target
+    void write(const void *data, size_t size);
+
+    // Number of user data blocks which were not completely written when exposed to the host
+    size_t incomplete_blocks() const
+    {
+        return m_incomplete;
+    }
+
+    // Number of times the filled memory block was exposed to the host
+    size_t block_switches() const
+    {
+        return m_switches;
+    }
+
+    static TraxEmulator *instance()
+    {
+        return s_instance;
+    }
+
+    uint8_t *get_up_buffer(uint32_t size, esp_apptrace_tmo_t *tmo);
+    esp_err_t put_up_buffer(uint8_t *ptr, esp_apptrace_tmo_t *tmo);
+    esp_err_t flush_up_buffer(uint32_t min_sz, esp_apptrace_tmo_t *tmo);
+    uint8_t *get_down_buffer(uint32_t *size, esp_apptrace_tmo_t *tmo);
+    esp_err_t put_down_buffer(uint8_t *ptr, esp_apptrace_tmo_t *tmo);
+    bool host_is_connected();
+    esp_err_t status_reg_set(uint32_t val);
+    esp_err_t status_reg_get(uint32_t *val);
+
+protected:
+    bool switch_block(esp_apptrace_tmo_t *tmo);
+
+    static TraxEmulator *s_instance;
+
+    uint32_t m_block_size;
+    bool m_host_connected;
+    std::vector<uint8_t> m_blocks[2];
+    // block which target writes to and its filling level
+    int m_in_block = 0;
+    uint32_t m_marker = 0;
+
+    // protects data shared with the host
+    std::mutex m_host_lock;
+    // size of data in the block exposed to the host, 0 if host has read them
+    uint32_t m_exposed = 0;
+    std::deque<uint8_t> m_down;
+    std::vector<uint8_t> m_down_buf;
+    uint32_t m_status = 0;
+
+    size_t m_incomplete = 0;
+    size_t m_switches = 0;
+};
+
+#endif /* trax_emulation_h */
@@ -21,8 +21,6 @@ import argparse
 import os
 import sys
 import binascii
-import subprocess
-import tempfile
 import collections
 import struct
 
@@ -30,7 +28,10 @@ __version__ = '1.0'
 
 IDF_COMPONENTS_PATH = os.path.expandvars(os.path.join("$IDF_PATH", "components"))
 
-PARTTOOL_PY = os.path.join(IDF_COMPONENTS_PATH, "partition_table", "parttool.py")
+# otatool performs the operations with parttool, in the same process
+sys.path.append(os.path.join(IDF_COMPONENTS_PATH, "partition_table"))
+import gen_esp32part as gen  # noqa: E402
+import parttool  # noqa: E402
 
 SPI_FLASH_SEC_SIZE = 0x2000
 
@@ -42,59 +43,18 @@ def status(msg):
         print(msg)
 
 
-def _invoke_parttool(parttool_args, args, output=False, partition=None):
-    invoke_args = []
+def _get_otadata_partition(session):
+    partition = session.partition_table.find_by_type("data", "ota")
 
-    if partition:
-        invoke_args += [sys.executable, PARTTOOL_PY] + partition
-    else:
-        invoke_args += [sys.executable, PARTTOOL_PY, "--partition-type", "data", "--partition-subtype", "ota"]
-
-    if quiet:
-        invoke_args += ["-q"]
-
-    if args.port != "":
-        invoke_args += ["--port", args.port]
-
-    if args.partition_table_file:
-        invoke_args += ["--partition-table-file", args.partition_table_file]
-
-    if args.partition_table_offset:
-        invoke_args += ["--partition-table-offset", args.partition_table_offset]
-
-    invoke_args += parttool_args
-
-    if output:
-        return subprocess.check_output(invoke_args)
-    else:
-        return subprocess.check_call(invoke_args)
+    if not partition:
+        raise RuntimeError("No ota_data partition found")
 
+    return partition
 
-def _get_otadata_contents(args, check=True):
-    global quiet
-
-    if check:
-        check_args = ["get_partition_info", "--info", "offset", "size"]
-
-        quiet = True
-        output = _invoke_parttool(check_args, args, True).split(b" ")
-        quiet = args.quiet
 
-        if not output:
-            raise RuntimeError("No ota_data partition found")
-
-    with tempfile.NamedTemporaryFile(delete=False) as f:
-        f_name = f.name
-
-    try:
-        invoke_args = ["read_partition", "--output", f_name]
-        _invoke_parttool(invoke_args, args)
-        with open(f_name, "rb") as f:
-            contents = f.read()
-    finally:
-        os.unlink(f_name)
-
-    return contents
+def _get_otadata_contents(session):
+    partition = _get_otadata_partition(session)
+    return session.read(partition.offset, partition.size)
 
 
 def _get_otadata_status(otadata_contents):
@@ -116,9 +76,9 @@ def _get_otadata_status(otadata_contents):
     return status
 
 
-def read_otadata(args):
+def read_otadata(session, args):
     status("Reading ota_data partition contents...")
-    otadata_info = _get_otadata_contents(args)
+    otadata_info = _get_otadata_contents(session)
     otadata_info = _get_otadata_status(otadata_info)
 
     print(otadata_info)
@@ -128,169 +88,163 @@ def read_otadata(args):
                                                                         otadata_info[1].seq, otadata_info[1].crc))
 
 
-def erase_otadata(args):
+def erase_otadata(session, args):
     status("Erasing ota_data partition contents...")
-    _invoke_parttool(["erase_partition"], args)
+    partition = _get_otadata_partition(session)
+    session.erase(partition.offset, partition.size)
     status("Erased ota_data partition contents")
 
 
-def switch_otadata(args):
-    sys.path.append(os.path.join(IDF_COMPONENTS_PATH, "partition_table"))
-    import gen_esp32part as gen
+def switch_otadata(session, args):
+    def is_otadata_status_valid(status):
+        seq = status.seq % (1 << 32)
+        crc = hex(binascii.crc32(struct.pack("I", seq), 0xFFFFFFFF) % (1 << 32))
+        return seq < (int('0xFFFFFFFF', 16) % (1 << 32)) and status.crc == crc
 
-    with tempfile.NamedTemporaryFile(delete=False) as f:
-        f_name = f.name
-
-    try:
-        def is_otadata_status_valid(status):
-            seq = status.seq % (1 << 32)
-            crc = hex(binascii.crc32(struct.pack("I", seq), 0xFFFFFFFF) % (1 << 32))
-            return seq < (int('0xFFFFFFFF', 16) % (1 << 32)) and status.crc == crc
+    status("Looking for ota app partitions...")
 
-        status("Looking for ota app partitions...")
+    # In order to get the number of ota app partitions, we need the partition table
+    partition_table = session.partition_table
 
-        # In order to get the number of ota app partitions, we need the partition table
-        partition_table = None
-        invoke_args = ["get_partition_info", "--table", f_name]
+    ota_partitions = list()
 
-        _invoke_parttool(invoke_args, args)
+    for i in range(gen.NUM_PARTITION_SUBTYPE_APP_OTA):
+        ota_partition = filter(lambda p: p.subtype == (gen.MIN_PARTITION_SUBTYPE_APP_OTA + i), partition_table)
 
-        partition_table = open(f_name, "rb").read()
-        partition_table = gen.PartitionTable.from_binary(partition_table)
+        try:
+            ota_partitions.append(list(ota_partition)[0])
+        except IndexError:
+            break
 
-        ota_partitions = list()
+    ota_partitions = sorted(ota_partitions, key=lambda p: p.subtype)
 
-        for i in range(gen.NUM_PARTITION_SUBTYPE_APP_OTA):
-            ota_partition = filter(lambda p: p.subtype == (gen.MIN_PARTITION_SUBTYPE_APP_OTA + i), partition_table)
+    if not ota_partitions:
+        raise RuntimeError("No ota app partitions found")
 
-            try:
-                ota_partitions.append(list(ota_partition)[0])
-            except IndexError:
-                break
+    status("Verifying partition to switch to exists...")
 
-        ota_partitions = sorted(ota_partitions, key=lambda p: p.subtype)
+    # Look for the app partition to switch to
+    ota_partition_next = None
 
-        if not ota_partitions:
-            raise RuntimeError("No ota app partitions found")
+    try:
+        if args.name:
+            ota_partition_next = filter(lambda p: p.name == args.name, ota_partitions)
+        else:
+            ota_partition_next = filter(lambda p: p.subtype - gen.MIN_PARTITION_SUBTYPE_APP_OTA  == args.slot, ota_partitions)
 
-        status("Verifying partition to switch to exists...")
+        ota_partition_next = list(ota_partition_next)[0]
+    except IndexError:
+        raise RuntimeError("Partition to switch to not found")
 
-        # Look for the app partition to switch to
-        ota_partition_next = None
+    otadata_contents = _get_otadata_contents(session)
+    otadata_status = _get_otadata_status(otadata_contents)
 
-        try:
-            if args.name:
-                ota_partition_next = filter(lambda p: p.name == args.name, ota_partitions)
-            else:
-                ota_partition_next = filter(lambda p: p.subtype - gen.MIN_PARTITION_SUBTYPE_APP_OTA  == args.slot, ota_partitions)
+    # Find the copy to base the computation for ota sequence number on
+    otadata_compute_base = -1
 
-            ota_partition_next = list(ota_partition_next)[0]
-        except IndexError:
-            raise RuntimeError("Partition to switch to not found")
-
-        otadata_contents = _get_otadata_contents(args)
-        otadata_status = _get_otadata_status(otadata_contents)
-
-        # Find the copy to base the computation for ota sequence number on
-        otadata_compute_base = -1
-
-        # Both are valid, take the max as computation base
-        if is_otadata_status_valid(otadata_status[0]) and is_otadata_status_valid(otadata_status[1]):
-            if otadata_status[0].seq >= otadata_status[1].seq:
-                otadata_compute_base = 0
-            else:
-                otadata_compute_base = 1
-        # Only one copy is valid, use that
-        elif is_otadata_status_valid(otadata_status[0]):
+    # Both are valid, take the max as computation base
+    if is_otadata_status_valid(otadata_status[0]) and is_otadata_status_valid(otadata_status[1]):
+        if otadata_status[0].seq >= otadata_status[1].seq:
             otadata_compute_base = 0
-        elif is_otadata_status_valid(otadata_status[1]):
-            otadata_compute_base = 1
-        # Both are invalid (could be initial state - all 0xFF's)
         else:
-            pass
-
-        ota_seq_next = 0
-        ota_partitions_num = len(ota_partitions)
-
-        target_seq = (ota_partition_next.subtype & 0x0F) + 1
-
-        # Find the next ota sequence number
-        if otadata_compute_base == 0 or otadata_compute_base == 1:
-            base_seq = otadata_status[otadata_compute_base].seq % (1 << 32)
-
-            i = 0
-            while base_seq > target_seq % ota_partitions_num + i * ota_partitions_num:
-                i += 1
+            otadata_compute_base = 1
+    # Only one copy is valid, use that
+    elif is_otadata_status_valid(otadata_status[0]):
+        otadata_compute_base = 0
+    elif is_otadata_status_valid(otadata_status[1]):
+        otadata_compute_base = 1
+    # Both are invalid (could be initial state - all 0xFF's)
+    else:
+        pass
 
-            ota_seq_next = target_seq % ota_partitions_num + i * ota_partitions_num
-        else:
-            ota_seq_next = target_seq
+    ota_seq_next = 0
+    ota_partitions_num = len(ota_partitions)
 
-        # Create binary data from computed values
-        ota_seq_next = struct.pack("I", ota_seq_next)
-        ota_seq_crc_next = binascii.crc32(ota_seq_next, 0xFFFFFFFF) % (1 << 32)
-        ota_seq_crc_next = struct.pack("I", ota_seq_crc_next)
+    target_seq = (ota_partition_next.subtype & 0x0F) + 1
 
-        with open(f_name, "wb") as otadata_next_file:
-            start = (1 if otadata_compute_base == 0 else 0) * (SPI_FLASH_SEC_SIZE >> 1)
+    # Find the next ota sequence number
+    if otadata_compute_base == 0 or otadata_compute_base == 1:
+        base_seq = otadata_status[otadata_compute_base].seq % (1 << 32)
 
-            otadata_next_file.write(otadata_contents)
+        i = 0
+        while base_seq > target_seq % ota_partitions_num + i * ota_partitions_num:
+            i += 1
 
-            otadata_next_file.seek(start)
-            otadata_next_file.write(ota_seq_next)
+        ota_seq_next = target_seq % ota_partitions_num + i * ota_partitions_num
+    else:
+        ota_seq_next = target_seq
 
-            otadata_next_file.seek(start + 28)
-            otadata_next_file.write(ota_seq_crc_next)
+    # Create binary data from computed values
+    ota_seq_next = struct.pack("I", ota_seq_next)
+    ota_seq_crc_next = binascii.crc32(ota_seq_next, 0xFFFFFFFF) % (1 << 32)
+    ota_seq_crc_next = struct.pack("I", ota_seq_crc_next)
 
-            otadata_next_file.flush()
+    otadata_next = bytearray(otadata_contents)
+    start = (1 if otadata_compute_base == 0 else 0) * (SPI_FLASH_SEC_SIZE >> 1)
+    otadata_next[start:start + 4] = ota_seq_next
+    otadata_next[start + 28:start + 32] = ota_seq_crc_next
 
-        _invoke_parttool(["write_partition", "--input", f_name], args)
-        status("Updated ota_data partition")
-    finally:
-        os.unlink(f_name)
+    partition = _get_otadata_partition(session)
+    session.write(partition.offset, bytes(otadata_next))
+    status("Updated ota_data partition")
 
 
-def _get_partition_specifier(args):
+def _get_ota_partition(session, args):
     if args.name:
-        return ["--partition-name", args.name]
+        partition = session.partition_table.find_by_name(args.name)
     else:
-        return ["--partition-type", "app", "--partition-subtype", "ota_" + str(args.slot)]
+        partition = session.partition_table.find_by_type("app", "ota_" + str(args.slot))
+
+    if not partition:
+        raise RuntimeError("Unable to find specified partition.")
+
+    return partition
 
 
-def read_ota_partition(args):
-    invoke_args = ["read_partition", "--output", args.output]
-    _invoke_parttool(invoke_args, args, partition=_get_partition_specifier(args))
+def read_ota_partition(session, args):
+    partition = _get_ota_partition(session, args)
+    with open(args.output, "wb") as f:
+        f.write(session.read(partition.offset, partition.size))
     status("Read ota partition contents to file {}".format(args.output))
 
 
-def write_ota_partition(args):
-    invoke_args = ["write_partition", "--input", args.input]
-    _invoke_parttool(invoke_args, args, partition=_get_partition_specifier(args))
+def write_ota_partition(session, args):
+    partition = _get_ota_partition(session, args)
+    with open(args.input, "rb") as f:
+        content = f.read()
+    session.write_erased(partition.offset, partition.size, content)
     status("Written contents of file {} to ota partition".format(args.input))
 
 
-def erase_ota_partition(args):
-    invoke_args = ["erase_partition"]
-    _invoke_parttool(invoke_args, args, partition=_get_partition_specifier(args))
+def erase_ota_partition(session, args):
+    partition = _get_ota_partition(session, args)
+    session.erase(partition.offset, partition.size)
     status("Erased contents of ota partition")
 
 
-def main():
-    global quiet
+def batch(session, args):
+    # parsed the same as the command line, without the partition table source options
+    parser = argparse.ArgumentParser("batch", add_help=False)
+    _add_operation_args(parser, batch=True)
+    operations = parttool.read_batch(parser, args.input)
 
-    parser = argparse.ArgumentParser("ESP-IDF OTA Partitions Tool")
-
-    parser.add_argument("--quiet", "-q", help="suppress stderr messages", action="store_true")
-
-    # There are two possible sources for the partition table: a device attached to the host
-    # or a partition table CSV/binary file. These sources are mutually exclusive.
-    partition_table_info_source_args = parser.add_mutually_exclusive_group()
+    # read the data of all read operations together
+    regions = []
+    for operation in operations:
+        if operation.operation in ["read_otadata", "switch_otadata"]:
+            partition = _get_otadata_partition(session)
+        elif operation.operation == "read_ota_partition":
+            partition = _get_ota_partition(session, operation)
+        else:
+            continue
+        regions.append((partition.offset, partition.size))
+    session.prefetch(regions)
 
-    partition_table_info_source_args.add_argument("--port", "-p", help="port where the device to read the partition table from is attached", default="")
-    partition_table_info_source_args.add_argument("--partition-table-file", "-f", help="file (CSV/binary) to read the partition table from", default="")
+    for operation in operations:
+        globals()[operation.operation](session, operation)
 
-    parser.add_argument("--partition-table-offset", "-o", help="offset to read the partition table from", default="0x8000")
 
+def _add_operation_args(parser, batch=False):
     subparsers = parser.add_subparsers(dest="operation", help="run otatool -h for additional help")
 
     # Specify the supported operations
@@ -312,9 +266,40 @@ def main():
 
     subparsers.add_parser("erase_ota_partition", help="erase contents of an ota partition", parents=[slot_or_name_parser])
 
+    if not batch:
+        batch_subparser = subparsers.add_parser("batch", help="perform the operations listed in a file, one per line with the same arguments \
+                                                as on the command line. The partition table is read once, data are written with a single \
+                                                esptool invocation after all the operations")
+        batch_subparser.add_argument("--input", help="file with the operations, - for stdin", default="-")
+
+
+def main():
+    global quiet
+
+    parser = argparse.ArgumentParser("ESP-IDF OTA Partitions Tool")
+
+    parser.add_argument("--quiet", "-q", help="suppress stderr messages", action="store_true")
+
+    # There are two possible sources for the partition table: a device attached to the host
+    # or a partition table CSV/binary file. These sources are mutually exclusive.
+    partition_table_info_source_args = parser.add_mutually_exclusive_group()
+
+    partition_table_info_source_args.add_argument("--port", "-p", help="port where the device to read the partition table from is attached", default="")
+    partition_table_info_source_args.add_argument("--partition-table-file", "-f", help="file (CSV/binary) to read the partition table from", default="")
+
+    parser.add_argument("--partition-table-offset", "-o", help="offset to read the partition table from", default="0x8000")
+
+    parser.add_argument("--image", help="flash image file to perform the operations on, instead of a device")
+
+    _add_operation_args(parser)
+
     args = parser.parse_args()
 
     quiet = args.quiet
+    parttool.quiet = quiet
+
+    if args.image and args.port:
+        parser.error("--port and --image can't be used together")
 
     # No operation specified, display help and exit
     if args.operation is None:
@@ -325,14 +310,19 @@ def main():
     # Else execute the operation
     operation_func = globals()[args.operation]
 
+    def run():
+        session = parttool.get_session(args)
+        operation_func(session, args)
+        session.flush()
+
     if quiet:
         # If exceptions occur, suppress and exit quietly
         try:
-            operation_func(args)
+            run()
         except Exception:
             sys.exit(2)
     else:
-        operation_func(args)
+        run()
 
 
 if __name__ == '__main__':
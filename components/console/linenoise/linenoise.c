@@ -129,22 +129,6 @@ static int history_max_len = LINENOISE_DEFAULT_HISTORY_MAX_LEN;
 static int history_len = 0;
 static char **history = NULL;
 
-/* The linenoiseState structure represents the state during line editing.
- * We pass this state to functions implementing specific editing
- * functionalities. */
-struct linenoiseState {
-    char *buf;          /* Edited line buffer. */
-    size_t buflen;      /* Edited line buffer size. */
-    const char *prompt; /* Prompt to display. */
-    size_t plen;        /* Prompt length. */
-    size_t pos;         /* Current cursor position. */
-    size_t oldpos;      /* Previous refresh cursor position. */
-    size_t len;         /* Current edited line length. */
-    size_t cols;        /* Number of columns in terminal. */
-    size_t maxrows;     /* Maximum num of rows used so far (multiline mode) */
-    int history_index;  /* The history index we are currently editing. */
-};
-
 enum KEY_ACTION{
 	KEY_NULL = 0,	    /* NULL */
 	CTRL_A = 1,         /* Ctrl+a */
@@ -169,6 +153,7 @@ enum KEY_ACTION{
 
 int linenoiseHistoryAdd(const char *line);
 static void refreshLine(struct linenoiseState *l);
+static void refreshLineFrom(struct linenoiseState *l, size_t from);
 
 /* Debugging macro. */
 #if 0
@@ -191,6 +176,43 @@ FILE *lndebug_fp = NULL;
 
 /* ======================= Low level terminal handling ====================== */
 
+/* We define a very simple "append buffer" structure, that is an heap
+ * allocated string where we can append to. This is useful in order to
+ * write all the escape sequences in a buffer and flush them to the standard
+ * output in a single call, to avoid flickering effects and to keep the
+ * number of writes to slow terminals low. */
+struct abuf {
+    char *b;
+    int len;
+    int cap;
+};
+
+static void abInit(struct abuf *ab) {
+    ab->b = NULL;
+    ab->len = 0;
+    ab->cap = 0;
+}
+
+static void abAppend(struct abuf *ab, const char *s, int len) {
+    if (ab->len + len > ab->cap) {
+        /* Grow geometrically, so that a refresh needs only a couple
+         * of reallocations no matter how many pieces it is built from. */
+        int cap = ab->cap ? ab->cap * 2 : 64;
+        while (cap < ab->len + len) cap *= 2;
+        char *new = realloc(ab->b,cap);
+        if (new == NULL) return;
+        ab->b = new;
+        ab->cap = cap;
+    }
+    memcpy(ab->b+ab->len,s,len);
+    ab->len += len;
+}
+
+static void abFree(struct abuf *ab) {
+    free(ab->b);
+}
+
+
 /* Set if to use or not the multi line mode. */
 void linenoiseSetMultiLine(int ml) {
     mlmode = ml;
@@ -201,17 +223,13 @@ void linenoiseSetDumbMode(int set) {
     dumbmode = set;
 }
 
-/* Use the ESC [6n escape sequence to query the horizontal cursor position
- * and return it. On error -1 is returned, on success the position of the
- * cursor. */
-static int getCursorPosition() {
+/* Read the response to an ESC [6n cursor position request and return the
+ * horizontal cursor position. On error -1 is returned. */
+static int readCursorPosition() {
     char buf[32];
     int cols, rows;
     unsigned int i = 0;
 
-    /* Report cursor location */
-    fprintf(stdout, "\x1b[6n");
-
     /* Read the response: ESC [ rows ; cols R */
     while (i < sizeof(buf)-1) {
         if (fread(buf+i, 1, 1, stdin) != 1) break;
@@ -225,32 +243,53 @@ static int getCursorPosition() {
     return cols;
 }
 
-/* Try to get the number of columns in the current terminal, or assume 80
- * if it fails. */
-static int getColumns() {
-    int start, cols;
-
-    /* Get the initial position so we can restore it later. */
-    start = getCursorPosition();
-    if (start == -1) goto failed;
-
-    /* Go to right margin and get position. */
-    if (fwrite("\x1b[999C", 1, 6, stdout) != 6) goto failed;
-    cols = getCursorPosition();
-    if (cols == -1) goto failed;
-
-    /* Restore position. */
-    if (cols > start) {
-        char seq[32];
-        snprintf(seq,32,"\x1b[%dD",cols-start);
-        if (fwrite(seq, 1, strlen(seq), stdout) == -1) {
-            /* Can't recover... */
-        }
+/* Write the prompt, and find out how many columns it takes on the screen
+ * and how wide the terminal is. All three cursor position requests are
+ * sent together with the prompt, so this costs a single round trip to the
+ * terminal. If the terminal does not answer, the prompt length in bytes
+ * and 80 columns are assumed. */
+static int writePromptAndMeasure(struct linenoiseState *l) {
+    char seq[32];
+    struct abuf ab;
+    int pos1, pos2, cols;
+
+    abInit(&ab);
+    /* Position before and after the prompt */
+    abAppend(&ab,"\x1b[6n",4);
+    abAppend(&ab,l->prompt,l->plen);
+    abAppend(&ab,"\x1b[6n",4);
+    /* Go to right margin and get position */
+    abAppend(&ab,"\x1b[999C\x1b[6n",10);
+    if (fwrite(ab.b,ab.len,1,stdout) != 1) {
+        abFree(&ab);
+        return -1;
     }
-    return cols;
+    abFree(&ab);
+    fflush(stdout);
+
+    pos1 = readCursorPosition();
+    pos2 = readCursorPosition();
+    cols = readCursorPosition();
 
-failed:
-    return 80;
+    if (pos1 >= 0 && pos2 >= 0) {
+        l->plen = pos2 - pos1;
+    }
+    if (cols >= 0 && pos2 >= 0) {
+        l->cols = cols;
+        /* Restore position. */
+        if (cols > pos2) {
+            snprintf(seq,32,"\x1b[%dD",cols-pos2);
+            if (fwrite(seq, 1, strlen(seq), stdout) == -1) {
+                /* Can't recover... */
+            }
+        }
+    } else {
+        l->cols = 80;
+        /* Cursor position is unknown, write the prompt again */
+        if (fwrite("\r",1,1,stdout) == -1) return -1;
+        if (fwrite(l->prompt,strlen(l->prompt),1,stdout) == -1) return -1;
+    }
+    return 0;
 }
 
 /* Clear the screen. Used to handle ctrl+l */
@@ -273,69 +312,73 @@ static void freeCompletions(linenoiseCompletions *lc) {
         free(lc->cvec[i]);
     if (lc->cvec != NULL)
         free(lc->cvec);
+    lc->len = 0;
+    lc->cvec = NULL;
+}
+
+/* Show the currently selected completion, or the original buffer if all
+ * the completions were cycled through. */
+static void showCompletion(struct linenoiseState *ls) {
+    if (ls->completion_idx < ls->lc.len) {
+        struct linenoiseState saved = *ls;
+
+        ls->len = ls->pos = strlen(ls->lc.cvec[ls->completion_idx]);
+        ls->buf = ls->lc.cvec[ls->completion_idx];
+        refreshLine(ls);
+        ls->len = saved.len;
+        ls->pos = saved.pos;
+        ls->buf = saved.buf;
+    } else {
+        refreshLine(ls);
+    }
 }
 
-/* This is an helper function for linenoiseEdit() and is called when the
+/* This is an helper function for linenoiseEditFeed() and is called when the
  * user types the <tab> key in order to complete the string currently in the
- * input.
+ * input, and then with every key typed while completions are cycled through.
+ *
+ * Returns the character that should be handled next as a regular key press,
+ * or 0 if the key was consumed by the completion.
  *
  * The state of the editing is encapsulated into the pointed linenoiseState
  * structure as described in the structure definition. */
-static int completeLine(struct linenoiseState *ls) {
-    linenoiseCompletions lc = { 0, NULL };
-    int nread, nwritten;
-    char c = 0;
-
-    completionCallback(ls->buf,&lc);
-    if (lc.len == 0) {
-        linenoiseBeep();
-    } else {
-        size_t stop = 0, i = 0;
-
-        while(!stop) {
-            /* Show completion or original buffer */
-            if (i < lc.len) {
-                struct linenoiseState saved = *ls;
-
-                ls->len = ls->pos = strlen(lc.cvec[i]);
-                ls->buf = lc.cvec[i];
-                refreshLine(ls);
-                ls->len = saved.len;
-                ls->pos = saved.pos;
-                ls->buf = saved.buf;
-            } else {
-                refreshLine(ls);
-            }
-
-            nread = fread(&c, 1, 1, stdin);
-            if (nread <= 0) {
-                freeCompletions(&lc);
-                return -1;
-            }
+static int completeLineFeed(struct linenoiseState *ls, char c) {
+    int nwritten;
+
+    if (!ls->in_completion) {
+        completionCallback(ls->buf,&ls->lc);
+        if (ls->lc.len == 0) {
+            linenoiseBeep();
+            freeCompletions(&ls->lc);
+            return 0;
+        }
+        ls->in_completion = 1;
+        ls->completion_idx = 0;
+        showCompletion(ls);
+        return 0;
+    }
 
-            switch(c) {
-                case TAB: /* tab */
-                    i = (i+1) % (lc.len+1);
-                    if (i == lc.len) linenoiseBeep();
-                    break;
-                case ESC: /* escape */
-                    /* Re-show original buffer */
-                    if (i < lc.len) refreshLine(ls);
-                    stop = 1;
-                    break;
-                default:
-                    /* Update buffer and return */
-                    if (i < lc.len) {
-                        nwritten = snprintf(ls->buf,ls->buflen,"%s",lc.cvec[i]);
-                        ls->len = ls->pos = nwritten;
-                    }
-                    stop = 1;
-                    break;
+    switch(c) {
+        case TAB: /* tab */
+            ls->completion_idx = (ls->completion_idx+1) % (ls->lc.len+1);
+            if (ls->completion_idx == ls->lc.len) linenoiseBeep();
+            showCompletion(ls);
+            return 0;
+        case ESC: /* escape */
+            /* Re-show original buffer */
+            if (ls->completion_idx < ls->lc.len) refreshLine(ls);
+            break;
+        default:
+            /* Update buffer and return */
+            if (ls->completion_idx < ls->lc.len) {
+                nwritten = snprintf(ls->buf,ls->buflen,"%s",ls->lc.cvec[ls->completion_idx]);
+                ls->len = ls->pos = nwritten;
             }
-        }
+            break;
     }
 
-    freeCompletions(&lc);
+    freeCompletions(&ls->lc);
+    ls->in_completion = 0;
     return c; /* Return last read character */
 }
 
@@ -378,33 +421,6 @@ void linenoiseAddCompletion(linenoiseCompletions *lc, const char *str) {
 
 /* =========================== Line editing ================================= */
 
-/* We define a very simple "append buffer" structure, that is an heap
- * allocated string where we can append to. This is useful in order to
- * write all the escape sequences in a buffer and flush them to the standard
- * output in a single call, to avoid flickering effects. */
-struct abuf {
-    char *b;
-    int len;
-};
-
-static void abInit(struct abuf *ab) {
-    ab->b = NULL;
-    ab->len = 0;
-}
-
-static void abAppend(struct abuf *ab, const char *s, int len) {
-    char *new = realloc(ab->b,ab->len+len);
-
-    if (new == NULL) return;
-    memcpy(new+ab->len,s,len);
-    ab->b = new;
-    ab->len += len;
-}
-
-static void abFree(struct abuf *ab) {
-    free(ab->b);
-}
-
 /* Helper of refreshSingleLine() and refreshMultiLine() to show hints
  * to the right of the prompt. */
 void refreshShowHints(struct abuf *ab, struct linenoiseState *l, int plen) {
@@ -417,9 +433,10 @@ void refreshShowHints(struct abuf *ab, struct linenoiseState *l, int plen) {
             int hintmaxlen = l->cols-(plen+l->len);
             if (hintlen > hintmaxlen) hintlen = hintmaxlen;
             if (bold == 1 && color == -1) color = 37;
-            if (color != -1 || bold != 0)
+            if (color != -1 || bold != 0) {
                 snprintf(seq,64,"\033[%d;%d;49m",bold,color);
-            abAppend(ab,seq,strlen(seq));
+                abAppend(ab,seq,strlen(seq));
+            }
             abAppend(ab,hint,hintlen);
             if (color != -1 || bold != 0)
                 abAppend(ab,"\033[0m",4);
@@ -463,10 +480,15 @@ static void refreshSingleLine(struct linenoiseState *l) {
     snprintf(seq,64,"\x1b[0K");
     abAppend(&ab,seq,strlen(seq));
     /* Move cursor to original position. */
-    snprintf(seq,64,"\r\x1b[%dC", (int)(pos+plen));
+    if (pos+plen)
+        snprintf(seq,64,"\r\x1b[%dC", (int)(pos+plen));
+    else
+        snprintf(seq,64,"\r");
     abAppend(&ab,seq,strlen(seq));
     if (fwrite(ab.b, ab.len, 1, stdout) == -1) {} /* Can't recover from write error. */
     abFree(&ab);
+    l->oldpos = l->pos;
+    l->oldlen = l->len;
 }
 
 /* Multi line low level line refresh.
@@ -551,6 +573,7 @@ static void refreshMultiLine(struct linenoiseState *l) {
 
     lndebug("\n");
     l->oldpos = l->pos;
+    l->oldlen = l->len;
 
     if (fwrite(ab.b,ab.len,1,stdout) == -1) {} /* Can't recover from write error. */
     abFree(&ab);
@@ -565,31 +588,73 @@ static void refreshLine(struct linenoiseState *l) {
         refreshSingleLine(l);
 }
 
+/* Append an escape sequence moving the cursor horizontally by 'n' columns. */
+static void abMoveCursor(struct abuf *ab, int n) {
+    char seq[16];
+    if (n == 0) return;
+    snprintf(seq,16,"\x1b[%d%c",n > 0 ? n : -n,n > 0 ? 'C' : 'D');
+    abAppend(ab,seq,strlen(seq));
+}
+
+/* Differential line refresh.
+ *
+ * Only characters of the buffer starting at 'from' are assumed to have
+ * changed since the previous refresh, so only those (and the hints) are
+ * written, followed by a cursor movement. This is a lot less output than
+ * redrawing the prompt and the whole line, which matters on slow
+ * terminals. Falls back to a full refresh when the line does not fit in a
+ * single row, as scrolling or wrapping moves everything else too. */
+static void refreshLineFrom(struct linenoiseState *l, size_t from) {
+    struct abuf ab;
+
+    if (l->plen+l->len >= l->cols || l->plen+l->oldlen >= l->cols ||
+        (mlmode && l->maxrows > 1)) {
+        refreshLine(l);
+        return;
+    }
+
+    abInit(&ab);
+    if (from >= l->len && l->len == l->oldlen) {
+        /* Only the cursor moved */
+        abMoveCursor(&ab,(int)l->pos-(int)l->oldpos);
+    } else {
+        abMoveCursor(&ab,(int)from-(int)l->oldpos);
+        abAppend(&ab,l->buf+from,l->len-from);
+        refreshShowHints(&ab,l,l->plen);
+        /* Erase leftovers of the previous, longer line or hint */
+        if (l->len < l->oldlen || hintsCallback) {
+            abAppend(&ab,"\x1b[0K",4);
+        }
+        if (hintsCallback) {
+            /* Column after the hint is not known, go via the left edge */
+            abAppend(&ab,"\r",1);
+            abMoveCursor(&ab,(int)(l->plen+l->pos));
+        } else {
+            abMoveCursor(&ab,(int)l->pos-(int)l->len);
+        }
+    }
+    if (ab.len > 0 && fwrite(ab.b,ab.len,1,stdout) == -1) {} /* Can't recover from write error. */
+    abFree(&ab);
+    l->oldpos = l->pos;
+    l->oldlen = l->len;
+    if (mlmode && l->maxrows == 0) l->maxrows = 1;
+}
+
 /* Insert the character 'c' at cursor current position.
  *
  * On error writing to the terminal -1 is returned, otherwise 0. */
 int linenoiseEditInsert(struct linenoiseState *l, char c) {
     if (l->len < l->buflen) {
-        if (l->len == l->pos) {
-            l->buf[l->pos] = c;
-            l->pos++;
-            l->len++;
-            l->buf[l->len] = '\0';
-            if ((!mlmode && l->plen+l->len < l->cols && !hintsCallback)) {
-                /* Avoid a full update of the line in the
-                 * trivial case. */
-                if (fwrite(&c,1,1,stdout) == -1) return -1;
-            } else {
-                refreshLine(l);
-            }
-        } else {
+        if (l->len != l->pos) {
             memmove(l->buf+l->pos+1,l->buf+l->pos,l->len-l->pos);
-            l->buf[l->pos] = c;
-            l->len++;
-            l->pos++;
-            l->buf[l->len] = '\0';
-            refreshLine(l);
         }
+        l->buf[l->pos] = c;
+        l->len++;
+        l->pos++;
+        l->buf[l->len] = '\0';
+        /* In the trivial case of appending to the end of a line without
+         * hints, this writes just the typed character. */
+        refreshLineFrom(l,l->pos-1);
     }
     return 0;
 }
@@ -598,7 +663,7 @@ int linenoiseEditInsert(struct linenoiseState *l, char c) {
 void linenoiseEditMoveLeft(struct linenoiseState *l) {
     if (l->pos > 0) {
         l->pos--;
-        refreshLine(l);
+        refreshLineFrom(l,l->len);
     }
 }
 
@@ -606,7 +671,7 @@ void linenoiseEditMoveLeft(struct linenoiseState *l) {
 void linenoiseEditMoveRight(struct linenoiseState *l) {
     if (l->pos != l->len) {
         l->pos++;
-        refreshLine(l);
+        refreshLineFrom(l,l->len);
     }
 }
 
@@ -614,7 +679,7 @@ void linenoiseEditMoveRight(struct linenoiseState *l) {
 void linenoiseEditMoveHome(struct linenoiseState *l) {
     if (l->pos != 0) {
         l->pos = 0;
-        refreshLine(l);
+        refreshLineFrom(l,l->len);
     }
 }
 
@@ -622,7 +687,7 @@ void linenoiseEditMoveHome(struct linenoiseState *l) {
 void linenoiseEditMoveEnd(struct linenoiseState *l) {
     if (l->pos != l->len) {
         l->pos = l->len;
-        refreshLine(l);
+        refreshLineFrom(l,l->len);
     }
 }
 
@@ -659,7 +724,7 @@ void linenoiseEditDelete(struct linenoiseState *l) {
         memmove(l->buf+l->pos,l->buf+l->pos+1,l->len-l->pos-1);
         l->len--;
         l->buf[l->len] = '\0';
-        refreshLine(l);
+        refreshLineFrom(l,l->pos);
     }
 }
 
@@ -670,7 +735,7 @@ void linenoiseEditBackspace(struct linenoiseState *l) {
         l->pos--;
         l->len--;
         l->buf[l->len] = '\0';
-        refreshLine(l);
+        refreshLineFrom(l,l->pos);
     }
 }
 
@@ -687,200 +752,272 @@ void linenoiseEditDeletePrevWord(struct linenoiseState *l) {
     diff = old_pos - l->pos;
     memmove(l->buf+l->pos,l->buf+old_pos,l->len-old_pos+1);
     l->len -= diff;
-    refreshLine(l);
+    refreshLineFrom(l,l->pos);
 }
 
-/* This function is the core of the line editing capability of linenoise.
- * It expects 'fd' to be already in "raw mode" so that every key pressed
- * will be returned ASAP to read().
- *
- * The resulting string is put into 'buf' when the user type enter, or
- * when ctrl+d is typed.
+/* Handle a complete escape sequence received in l->seq. */
+static void linenoiseEditEscape(struct linenoiseState *l) {
+    char *seq = l->seq;
+
+    /* ESC [ sequences. */
+    if (seq[0] == '[') {
+        if (seq[1] >= '0' && seq[1] <= '9') {
+            /* Extended escape, with an additional byte. */
+            if (seq[2] == '~') {
+                switch(seq[1]) {
+                case '3': /* Delete key. */
+                    linenoiseEditDelete(l);
+                    break;
+                }
+            }
+        } else {
+            switch(seq[1]) {
+            case 'A': /* Up */
+                linenoiseEditHistoryNext(l, LINENOISE_HISTORY_PREV);
+                break;
+            case 'B': /* Down */
+                linenoiseEditHistoryNext(l, LINENOISE_HISTORY_NEXT);
+                break;
+            case 'C': /* Right */
+                linenoiseEditMoveRight(l);
+                break;
+            case 'D': /* Left */
+                linenoiseEditMoveLeft(l);
+                break;
+            case 'H': /* Home */
+                linenoiseEditMoveHome(l);
+                break;
+            case 'F': /* End*/
+                linenoiseEditMoveEnd(l);
+                break;
+            }
+        }
+    }
+
+    /* ESC O sequences. */
+    else if (seq[0] == 'O') {
+        switch(seq[1]) {
+        case 'H': /* Home */
+            linenoiseEditMoveHome(l);
+            break;
+        case 'F': /* End*/
+            linenoiseEditMoveEnd(l);
+            break;
+        }
+    }
+}
+
+/* Start editing a line: print the prompt and prepare the state for
+ * linenoiseEditFeed(). The terminal is queried for the prompt and screen
+ * width once, which needs a single round trip.
  *
- * The function returns the length of the current buffer. */
-static int linenoiseEdit(char *buf, size_t buflen, const char *prompt)
+ * Returns 0 on success, -1 on error. */
+int linenoiseEditStart(struct linenoiseState *l, char *buf, size_t buflen, const char *prompt)
 {
-    struct linenoiseState l;
+    if (buflen == 0) {
+        errno = EINVAL;
+        return -1;
+    }
 
     /* Populate the linenoise state that we pass to functions implementing
      * specific editing functionalities. */
-    l.buf = buf;
-    l.buflen = buflen;
-    l.prompt = prompt;
-    l.plen = strlen(prompt);
-    l.oldpos = l.pos = 0;
-    l.len = 0;
-    l.cols = getColumns();
-    l.maxrows = 0;
-    l.history_index = 0;
+    l->buf = buf;
+    l->buflen = buflen;
+    l->prompt = prompt;
+    l->plen = strlen(prompt);
+    l->oldpos = l->pos = 0;
+    l->oldlen = l->len = 0;
+    l->cols = 80;
+    l->maxrows = 0;
+    l->history_index = 0;
+    l->seqlen = -1;
+    l->in_completion = 0;
+    l->completion_idx = 0;
+    l->lc.len = 0;
+    l->lc.cvec = NULL;
 
     /* Buffer starts empty. */
-    l.buf[0] = '\0';
-    l.buflen--; /* Make sure there is always space for the nulterm */
+    l->buf[0] = '\0';
+    l->buflen--; /* Make sure there is always space for the nulterm */
 
     /* The latest history entry is always our current buffer, that
      * initially is just an empty string. */
     linenoiseHistoryAdd("");
 
-    int pos1 = getCursorPosition();
-    if (fwrite(prompt,l.plen,1,stdout) == -1) return -1;
-    int pos2 = getCursorPosition();
-    if (pos1 >= 0 && pos2 >= 0) {
-        l.plen = pos2 - pos1;
+    return writePromptAndMeasure(l);
+}
+
+/* This function is the core of the line editing capability of linenoise.
+ * It processes a single key press, so that the editing can be driven by
+ * an event loop without blocking on input. Output caused by the key press
+ * is written to stdout, which is flushed once before returning.
+ *
+ * The resulting string is put into 'buf' when the user type enter, or
+ * when ctrl+d is typed.
+ *
+ * The function returns LINENOISE_EDIT_MORE while the line is being edited,
+ * the length of the line once it is complete, or -1 when editing was
+ * cancelled with ctrl+c (errno is set to EAGAIN) or ctrl+d. */
+int linenoiseEditFeed(struct linenoiseState *l, char c)
+{
+    int ret = LINENOISE_EDIT_MORE;
+    char *buf = l->buf;
+
+    /* Only autocomplete when the callback is set. While completing, it
+     * returns the character that should be handled next, or 0 if there
+     * is nothing to handle. */
+    if (l->in_completion || (c == TAB && completionCallback != NULL)) {
+        c = completeLineFeed(l, c);
+        if (c == 0) goto out;
     }
-    while(1) {
-        char c;
-        int nread;
-        char seq[3];
 
-        nread = fread(&c, 1, 1, stdin);
-        if (nread <= 0) return l.len;
-
-        /* Only autocomplete when the callback is set. It returns < 0 when
-         * there was an error reading from fd. Otherwise it will return the
-         * character that should be handled next. */
-        if (c == 9 && completionCallback != NULL) {
-            int c2 = completeLine(&l);
-            /* Return on errors */
-            if (c2 < 0) return l.len;
-            /* Read next character when 0 */
-            if (c2 == 0) continue;
-            c = c2;
+    /* Collect the bytes of an escape sequence. */
+    if (l->seqlen >= 0) {
+        l->seq[l->seqlen++] = c;
+        if (l->seqlen == 2 && l->seq[0] == '[' && l->seq[1] >= '0' && l->seq[1] <= '9') {
+            /* Extended escape, wait for additional byte. */
+            goto out;
+        }
+        if (l->seqlen >= 2) {
+            l->seqlen = -1;
+            linenoiseEditEscape(l);
         }
+        goto out;
+    }
 
-        switch(c) {
-        case ENTER:    /* enter */
+    switch(c) {
+    case ENTER:    /* enter */
+        history_len--;
+        free(history[history_len]);
+        if (mlmode) linenoiseEditMoveEnd(l);
+        if (hintsCallback) {
+            /* Force a refresh without hints to leave the previous
+             * line as the user typed it after a newline. */
+            linenoiseHintsCallback *hc = hintsCallback;
+            hintsCallback = NULL;
+            refreshLine(l);
+            hintsCallback = hc;
+        }
+        ret = (int)l->len;
+        break;
+    case CTRL_C:     /* ctrl-c */
+        errno = EAGAIN;
+        ret = -1;
+        break;
+    case BACKSPACE:   /* backspace */
+    case 8:     /* ctrl-h */
+        linenoiseEditBackspace(l);
+        break;
+    case CTRL_D:     /* ctrl-d, remove char at right of cursor, or if the
+                        line is empty, act as end-of-file. */
+        if (l->len > 0) {
+            linenoiseEditDelete(l);
+        } else {
             history_len--;
             free(history[history_len]);
-            if (mlmode) linenoiseEditMoveEnd(&l);
-            if (hintsCallback) {
-                /* Force a refresh without hints to leave the previous
-                 * line as the user typed it after a newline. */
-                linenoiseHintsCallback *hc = hintsCallback;
-                hintsCallback = NULL;
-                refreshLine(&l);
-                hintsCallback = hc;
-            }
-            return (int)l.len;
-        case CTRL_C:     /* ctrl-c */
-            errno = EAGAIN;
-            return -1;
-        case BACKSPACE:   /* backspace */
-        case 8:     /* ctrl-h */
-            linenoiseEditBackspace(&l);
-            break;
-        case CTRL_D:     /* ctrl-d, remove char at right of cursor, or if the
-                            line is empty, act as end-of-file. */
-            if (l.len > 0) {
-                linenoiseEditDelete(&l);
-            } else {
-                history_len--;
-                free(history[history_len]);
-                return -1;
-            }
-            break;
-        case CTRL_T:    /* ctrl-t, swaps current character with previous. */
-            if (l.pos > 0 && l.pos < l.len) {
-                int aux = buf[l.pos-1];
-                buf[l.pos-1] = buf[l.pos];
-                buf[l.pos] = aux;
-                if (l.pos != l.len-1) l.pos++;
-                refreshLine(&l);
-            }
-            break;
-        case CTRL_B:     /* ctrl-b */
-            linenoiseEditMoveLeft(&l);
-            break;
-        case CTRL_F:     /* ctrl-f */
-            linenoiseEditMoveRight(&l);
-            break;
-        case CTRL_P:    /* ctrl-p */
-            linenoiseEditHistoryNext(&l, LINENOISE_HISTORY_PREV);
-            break;
-        case CTRL_N:    /* ctrl-n */
-            linenoiseEditHistoryNext(&l, LINENOISE_HISTORY_NEXT);
-            break;
-        case ESC:    /* escape sequence */
-            /* Read the next two bytes representing the escape sequence. */
-            if (fread(seq, 1, 2, stdin) < 2) break;
-
-            /* ESC [ sequences. */
-            if (seq[0] == '[') {
-                if (seq[1] >= '0' && seq[1] <= '9') {
-                    /* Extended escape, read additional byte. */
-                    if (fread(seq+2, 1, 1, stdin) == -1) break;
-                    if (seq[2] == '~') {
-                        switch(seq[1]) {
-                        case '3': /* Delete key. */
-                            linenoiseEditDelete(&l);
-                            break;
-                        }
-                    }
-                } else {
-                    switch(seq[1]) {
-                    case 'A': /* Up */
-                        linenoiseEditHistoryNext(&l, LINENOISE_HISTORY_PREV);
-                        break;
-                    case 'B': /* Down */
-                        linenoiseEditHistoryNext(&l, LINENOISE_HISTORY_NEXT);
-                        break;
-                    case 'C': /* Right */
-                        linenoiseEditMoveRight(&l);
-                        break;
-                    case 'D': /* Left */
-                        linenoiseEditMoveLeft(&l);
-                        break;
-                    case 'H': /* Home */
-                        linenoiseEditMoveHome(&l);
-                        break;
-                    case 'F': /* End*/
-                        linenoiseEditMoveEnd(&l);
-                        break;
-                    }
-                }
-            }
+            ret = -1;
+        }
+        break;
+    case CTRL_T:    /* ctrl-t, swaps current character with previous. */
+        if (l->pos > 0 && l->pos < l->len) {
+            int aux = buf[l->pos-1];
+            size_t from = l->pos-1;
+            buf[l->pos-1] = buf[l->pos];
+            buf[l->pos] = aux;
+            if (l->pos != l->len-1) l->pos++;
+            refreshLineFrom(l, from);
+        }
+        break;
+    case CTRL_B:     /* ctrl-b */
+        linenoiseEditMoveLeft(l);
+        break;
+    case CTRL_F:     /* ctrl-f */
+        linenoiseEditMoveRight(l);
+        break;
+    case CTRL_P:    /* ctrl-p */
+        linenoiseEditHistoryNext(l, LINENOISE_HISTORY_PREV);
+        break;
+    case CTRL_N:    /* ctrl-n */
+        linenoiseEditHistoryNext(l, LINENOISE_HISTORY_NEXT);
+        break;
+    case ESC:    /* escape sequence */
+        /* The next two bytes represent the escape sequence. */
+        l->seqlen = 0;
+        break;
+    default:
+        if (linenoiseEditInsert(l,c)) ret = -1;
+        break;
+    case CTRL_U: /* Ctrl+u, delete the whole line. */
+        buf[0] = '\0';
+        l->pos = l->len = 0;
+        refreshLineFrom(l, 0);
+        break;
+    case CTRL_K: /* Ctrl+k, delete from current to end of line. */
+        buf[l->pos] = '\0';
+        l->len = l->pos;
+        refreshLineFrom(l, l->pos);
+        break;
+    case CTRL_A: /* Ctrl+a, go to the start of the line */
+        linenoiseEditMoveHome(l);
+        break;
+    case CTRL_E: /* ctrl+e, go to the end of the line */
+        linenoiseEditMoveEnd(l);
+        break;
+    case CTRL_L: /* ctrl+l, clear screen */
+        linenoiseClearScreen();
+        refreshLine(l);
+        break;
+    case CTRL_W: /* ctrl+w, delete previous word */
+        linenoiseEditDeletePrevWord(l);
+        break;
+    }
 
-            /* ESC O sequences. */
-            else if (seq[0] == 'O') {
-                switch(seq[1]) {
-                case 'H': /* Home */
-                    linenoiseEditMoveHome(&l);
-                    break;
-                case 'F': /* End*/
-                    linenoiseEditMoveEnd(&l);
-                    break;
-                }
-            }
-            break;
-        default:
-            if (linenoiseEditInsert(&l,c)) return -1;
-            break;
-        case CTRL_U: /* Ctrl+u, delete the whole line. */
-            buf[0] = '\0';
-            l.pos = l.len = 0;
-            refreshLine(&l);
-            break;
-        case CTRL_K: /* Ctrl+k, delete from current to end of line. */
-            buf[l.pos] = '\0';
-            l.len = l.pos;
-            refreshLine(&l);
-            break;
-        case CTRL_A: /* Ctrl+a, go to the start of the line */
-            linenoiseEditMoveHome(&l);
-            break;
-        case CTRL_E: /* ctrl+e, go to the end of the line */
-            linenoiseEditMoveEnd(&l);
-            break;
-        case CTRL_L: /* ctrl+l, clear screen */
-            linenoiseClearScreen();
-            refreshLine(&l);
-            break;
-        case CTRL_W: /* ctrl+w, delete previous word */
-            linenoiseEditDeletePrevWord(&l);
+out:
+    fflush(stdout);
+    return ret;
+}
+
+/* Finish editing a line started with linenoiseEditStart(), moving the
+ * cursor to the next line. */
+void linenoiseEditStop(struct linenoiseState *l)
+{
+    if (l->in_completion) {
+        freeCompletions(&l->lc);
+        l->in_completion = 0;
+    }
+    fputc('\n', stdout);
+    fflush(stdout);
+}
+
+/* Blocking line editing, reading key presses from stdin. It expects the
+ * terminal to be already in "raw mode" so that every key pressed will be
+ * returned ASAP to read().
+ *
+ * The function returns the length of the current buffer. */
+static int linenoiseEdit(char *buf, size_t buflen, const char *prompt)
+{
+    struct linenoiseState l;
+    int ret;
+
+    if (linenoiseEditStart(&l, buf, buflen, prompt) == -1) {
+        /* The prompt may have been printed in part */
+        if (buflen != 0) fputc('\n', stdout);
+        return -1;
+    }
+    while(1) {
+        char c;
+        int nread;
+
+        nread = fread(&c, 1, 1, stdin);
+        if (nread <= 0) {
+            ret = l.len;
             break;
         }
+        ret = linenoiseEditFeed(&l, c);
+        if (ret != LINENOISE_EDIT_MORE) break;
     }
-    return l.len;
+    linenoiseEditStop(&l);
+    return ret;
 }
 
 int linenoiseProbe() {
@@ -902,7 +1039,7 @@ int linenoiseProbe() {
         char c;
         int cb = fread(&c, 1, 1, stdin);
         read_bytes += cb;
-        timeout_ms--;
+        timeout_ms -= 10;
     }
     /* Restore old mode */
     flags &= ~O_NONBLOCK;
@@ -917,16 +1054,7 @@ int linenoiseProbe() {
 }
 
 static int linenoiseRaw(char *buf, size_t buflen, const char *prompt) {
-    int count;
-
-    if (buflen == 0) {
-        errno = EINVAL;
-        return -1;
-    }
-
-    count = linenoiseEdit(buf, buflen, prompt);
-    fputc('\n', stdout);
-    return count;
+    return linenoiseEdit(buf, buflen, prompt);
 }
 
 static int linenoiseDumb(char* buf, size_t buflen, const char* prompt) {
@@ -39,6 +39,8 @@
 #ifndef __LINENOISE_H
 #define __LINENOISE_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -48,6 +50,31 @@ typedef struct linenoiseCompletions {
   char **cvec;
 } linenoiseCompletions;
 
+/* The linenoiseState structure represents the state during line editing.
+ * We pass this state to functions implementing specific editing
+ * functionalities. */
+struct linenoiseState {
+    char *buf;          /* Edited line buffer. */
+    size_t buflen;      /* Edited line buffer size. */
+    const char *prompt; /* Prompt to display. */
+    size_t plen;        /* Prompt length. */
+    size_t pos;         /* Current cursor position. */
+    size_t oldpos;      /* Previous refresh cursor position. */
+    size_t len;         /* Current edited line length. */
+    size_t oldlen;      /* Previous refresh line length. */
+    size_t cols;        /* Number of columns in terminal. */
+    size_t maxrows;     /* Maximum num of rows used so far (multiline mode) */
+    int history_index;  /* The history index we are currently editing. */
+    char seq[3];        /* Escape sequence being received. */
+    int seqlen;         /* Bytes of escape sequence received, -1 if none. */
+    int in_completion;  /* Tab completions are being cycled through. */
+    size_t completion_idx;  /* Completion currently shown. */
+    linenoiseCompletions lc;    /* Completions for the current line. */
+};
+
+/* Returned by linenoiseEditFeed() while the line is still being edited. */
+#define LINENOISE_EDIT_MORE (-2)
+
 typedef void(linenoiseCompletionCallback)(const char *, linenoiseCompletions *);
 typedef char*(linenoiseHintsCallback)(const char *, int *color, int *bold);
 typedef void(linenoiseFreeHintsCallback)(void *);
@@ -58,6 +85,9 @@ void linenoiseAddCompletion(linenoiseCompletions *, const char *);
 
 int linenoiseProbe(void);
 char *linenoise(const char *prompt);
+int linenoiseEditStart(struct linenoiseState *l, char *buf, size_t buflen, const char *prompt);
+int linenoiseEditFeed(struct linenoiseState *l, char c);
+void linenoiseEditStop(struct linenoiseState *l);
 void linenoiseFree(void *ptr);
 int linenoiseHistoryAdd(const char *line);
 int linenoiseHistorySetMaxLen(int len);
@@ -0,0 +1,224 @@
+#include "catch.hpp"
+#include "linenoise.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+/* Answers to the cursor position requests sent by linenoiseEditStart:
+ * column before and after the "> " prompt, and at the right margin. */
+static const char terminal_replies[] = "\x1b[1;1R\x1b[1;3R\x1b[1;80R";
+
+/* Redirects stdin and stdout to memory, to drive linenoise without a terminal */
+class FakeTerminal {
+public:
+    FakeTerminal(const char *replies = terminal_replies)
+    {
+        saved_stdin = stdin;
+        saved_stdout = stdout;
+        stdin = fmemopen((void *) replies, strlen(replies), "r");
+        stdout = open_memstream(&out, &out_size);
+        REQUIRE(stdin != NULL);
+        REQUIRE(stdout != NULL);
+    }
+
+    ~FakeTerminal()
+    {
+        fclose(stdin);
+        fclose(stdout);
+        stdin = saved_stdin;
+        stdout = saved_stdout;
+        free(out);
+    }
+
+    /* Bytes written to the terminal so far */
+    size_t written()
+    {
+        fflush(stdout);
+        return out_size;
+    }
+
+    /* Feed keys one by one, return number of bytes written in response */
+    size_t feed(struct linenoiseState *l, const string &keys, int *ret = NULL)
+    {
+        size_t before = written();
+        int r = LINENOISE_EDIT_MORE;
+        for (char c : keys) {
+            r = linenoiseEditFeed(l, c);
+        }
+        if (ret) {
+            *ret = r;
+        }
+        return written() - before;
+    }
+
+    string output()
+    {
+        fflush(stdout);
+        return string(out, out_size);
+    }
+
+private:
+    FILE *saved_stdin;
+    FILE *saved_stdout;
+    char *out = NULL;
+    size_t out_size = 0;
+};
+
+struct Editor {
+    char buf[128];
+    struct linenoiseState l;
+};
+
+static void start(FakeTerminal &term, Editor &ed)
+{
+    REQUIRE(linenoiseEditStart(&ed.l, ed.buf, sizeof(ed.buf), "> ") == 0);
+    CHECK(ed.l.plen == 2);
+    CHECK(ed.l.cols == 80);
+}
+
+TEST_CASE("typing at the end of the line writes one byte per keystroke", "[linenoise]")
+{
+    linenoiseSetMultiLine(0);
+    FakeTerminal term;
+    Editor ed;
+    start(term, ed);
+
+    const string text = "help wifi_join";
+    for (char c : text) {
+        CHECK(term.feed(&ed.l, string(1, c)) == 1);
+    }
+    int ret;
+    term.feed(&ed.l, "\n", &ret);
+    CHECK(ret == (int) text.size());
+    CHECK(string(ed.buf) == text);
+    linenoiseEditStop(&ed.l);
+}
+
+TEST_CASE("editing in the middle of the line redraws only the changed part", "[linenoise]")
+{
+    linenoiseSetMultiLine(1);
+    FakeTerminal term;
+    Editor ed;
+    start(term, ed);
+
+    const string text = "set_config --name=device --value=0123456789";
+    term.feed(&ed.l, text);
+
+    /* Full refresh: CR, prompt, line, erase, cursor column */
+    const size_t full_refresh = 1 + 2 + text.size() + 4 + 5;
+
+    /* Cursor movement only: one short escape sequence per key */
+    size_t left = term.feed(&ed.l, "\x1b[D");
+    CHECK(left <= 4);
+    size_t home = term.feed(&ed.l, "\x01");
+    CHECK(home <= 5);
+    size_t end = term.feed(&ed.l, "\x05");
+    CHECK(end <= 5);
+
+    /* Insert and delete near the end: cursor move, tail, cursor move */
+    term.feed(&ed.l, "\x1b[D\x1b[D\x1b[D");
+    size_t insert = term.feed(&ed.l, "X");
+    CHECK(insert <= 4 + 4);
+    size_t backspace = term.feed(&ed.l, "\x7f");
+    CHECK(backspace <= 4 + 3 + 4 + 4);
+
+    printf("bytes per keystroke: left %zu, home %zu, end %zu, insert %zu, backspace %zu, full refresh %zu\n",
+           left, home, end, insert, backspace, full_refresh);
+    CHECK(insert < full_refresh / 4);
+    CHECK(backspace < full_refresh / 3);
+
+    int ret;
+    term.feed(&ed.l, "\n", &ret);
+    CHECK(ret == (int) text.size());
+    CHECK(string(ed.buf) == text);
+    linenoiseEditStop(&ed.l);
+    linenoiseSetMultiLine(0);
+}
+
+TEST_CASE("escape sequences can be split across feeds", "[linenoise]")
+{
+    FakeTerminal term;
+    Editor ed;
+    start(term, ed);
+
+    term.feed(&ed.l, "abc");
+    term.feed(&ed.l, "\x1b");
+    term.feed(&ed.l, "[");
+    term.feed(&ed.l, "D");
+    CHECK(ed.l.pos == 2);
+    /* Delete key: ESC [ 3 ~ */
+    term.feed(&ed.l, "\x1b[3");
+    CHECK(ed.l.len == 3);
+    term.feed(&ed.l, "~");
+    CHECK(ed.l.len == 2);
+    CHECK(string(ed.buf) == "ab");
+    linenoiseEditStop(&ed.l);
+}
+
+static void complete_cb(const char *buf, linenoiseCompletions *lc)
+{
+    if (buf[0] == 'h') {
+        linenoiseAddCompletion(lc, "help");
+        linenoiseAddCompletion(lc, "heap");
+    }
+}
+
+TEST_CASE("tab completion does not block waiting for input", "[linenoise]")
+{
+    linenoiseSetCompletionCallback(complete_cb);
+    FakeTerminal term;
+    Editor ed;
+    start(term, ed);
+
+    term.feed(&ed.l, "h\t");
+    CHECK(ed.l.in_completion);
+    term.feed(&ed.l, "\t");
+    int ret;
+    term.feed(&ed.l, "\n", &ret);
+    CHECK(ret == 4);
+    CHECK(string(ed.buf) == "heap");
+    linenoiseEditStop(&ed.l);
+    linenoiseSetCompletionCallback(NULL);
+}
+
+static char *hints_cb(const char *buf, int *color, int *bold)
+{
+    return (char *) (strcmp(buf, "join") == 0 ? " <ssid>" : NULL);
+}
+
+TEST_CASE("hints are redrawn after the changed part of the line", "[linenoise]")
+{
+    linenoiseSetHintsCallback(hints_cb);
+    FakeTerminal term;
+    Editor ed;
+    start(term, ed);
+
+    term.feed(&ed.l, "joi");
+    size_t before = term.written();
+    term.feed(&ed.l, "n");
+    string out = term.output().substr(before);
+    CHECK(out.find("n <ssid>\x1b[0K") == 0);
+    CHECK(out.find("> ") == string::npos); /* prompt is not rewritten */
+    linenoiseEditStop(&ed.l);
+    linenoiseSetHintsCallback(NULL);
+}
+
+TEST_CASE("cursor is not moved by zero columns at the left edge", "[linenoise]")
+{
+    /* empty prompt, cursor stays in the first column */
+    static const char replies[] = "\x1b[1;1R\x1b[1;1R\x1b[1;80R";
+    linenoiseSetHintsCallback(hints_cb);
+    FakeTerminal term(replies);
+    Editor ed;
+    REQUIRE(linenoiseEditStart(&ed.l, ed.buf, sizeof(ed.buf), "") == 0);
+
+    term.feed(&ed.l, "j\x7f");
+    CHECK(ed.l.len == 0);
+    /* some terminals move the cursor by one column for ESC[0C */
+    CHECK(term.output().find("\x1b[0C") == string::npos);
+    linenoiseEditStop(&ed.l);
+    linenoiseSetHintsCallback(NULL);
+}
@@ -18,28 +18,121 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/queue.h>
 #include <netdb.h>
+#include <netinet/in.h>
+#include <pthread.h>
 
+#include "sdkconfig.h"
 #include <http_parser.h>
 #include "esp_tls.h"
+#include "mbedtls/sha256.h"
 #include <errno.h>
 
 static const char *TAG = "esp-tls";
 static mbedtls_x509_crt *global_cacert = NULL;
 
+/* Host names of non-blocking connections are resolved in background. Host builds always do it,
+   so that the host test covers it */
+#if !defined(ESP_PLATFORM) || CONFIG_ESP_TLS_ASYNC_DNS
+#define ESP_TLS_ASYNC_DNS 1
+#endif
+
 #ifdef ESP_PLATFORM
 #include <esp_log.h>
+#include <esp_timer.h>
+#ifdef ESP_TLS_ASYNC_DNS
+#include "lwip/dns.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+#endif
 #else
+#include <time.h>
 #define ESP_LOGD(TAG, ...) //printf(__VA_ARGS__);
+#define ESP_LOGI(TAG, ...) //printf(__VA_ARGS__);
 #define ESP_LOGE(TAG, ...) printf(__VA_ARGS__);
 #endif
 
+#define ESP_TLS_DIGEST_LEN  32
+
+/* Longest wait of esp_tls_conn_new() for non-blocking connection progress, time
+   limit is checked and host name lookup is polled with this interval */
+#define ESP_TLS_POLL_INTERVAL_MS    10
+
+/* Parsed certificate, shared by cached configurations. Private keys are not shared:
+   mbedTLS is built without threading support and RSA blinding values or EC precomputed
+   points are updated by every private key operation, so each connection parses its own key */
+typedef struct esp_tls_cert_entry {
+    SLIST_ENTRY(esp_tls_cert_entry) next;
+    unsigned char digest[ESP_TLS_DIGEST_LEN];   /* SHA-256 of PEM data */
+    int refcount;                               /* number of cached configurations using it */
+    mbedtls_x509_crt crt;
+} esp_tls_cert_entry_t;
+
+/* TLS configuration shared by connections with the same settings */
+struct esp_tls_shared_conf {
+    TAILQ_ENTRY(esp_tls_shared_conf) next;
+    unsigned char digest[ESP_TLS_DIGEST_LEN];   /* SHA-256 of the settings, see conf_digest() */
+    int refcount;                               /* number of connections using the configuration */
+    mbedtls_ssl_config conf;
+    esp_tls_cert_entry_t *cacert;
+    esp_tls_cert_entry_t *clientcert;           /* used with the key of each connection, see create_client_auth_conf() */
+};
+
+/* Client session saved after handshake to be resumed by the next connection to the same server */
+typedef struct esp_tls_session_entry {
+    TAILQ_ENTRY(esp_tls_session_entry) next;
+    char *host;
+    int port;
+    unsigned char conf_digest[ESP_TLS_DIGEST_LEN];
+    mbedtls_ssl_session session;
+} esp_tls_session_entry_t;
+
+/* Protects all caches, the most recently used entries are kept at the head of the lists */
+static pthread_mutex_t s_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static SLIST_HEAD(esp_tls_cert_list, esp_tls_cert_entry) s_cert_cache = SLIST_HEAD_INITIALIZER(s_cert_cache);
+static TAILQ_HEAD(esp_tls_conf_list, esp_tls_shared_conf) s_conf_cache = TAILQ_HEAD_INITIALIZER(s_conf_cache);
+static size_t s_conf_cache_len;
+static TAILQ_HEAD(esp_tls_session_list, esp_tls_session_entry) s_session_cache = TAILQ_HEAD_INITIALIZER(s_session_cache);
+static size_t s_session_cache_len;
+
+/* Random generator of shared configurations. mbedTLS is built without threading support,
+   so it is protected by a separate lock, it is used during handshakes without holding the cache lock */
+static pthread_mutex_t s_rng_lock = PTHREAD_MUTEX_INITIALIZER;
+static mbedtls_entropy_context s_shared_entropy;
+static mbedtls_ctr_drbg_context s_shared_ctr_drbg;
+static bool s_shared_rng_seeded;
+
+static int64_t get_time_us(void)
+{
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/* Stores duration of the finished connection phase and starts the next one */
+static void phase_done(esp_tls_t *tls, int64_t *duration_us)
+{
+    int64_t now = get_time_us();
+    *duration_us = now - tls->phase_start_us;
+    tls->phase_start_us = now;
+}
+
+static void resolve_hints(struct addrinfo *hints)
+{
+    memset(hints, 0, sizeof(*hints));
+    hints->ai_family = AF_UNSPEC;
+    hints->ai_socktype = SOCK_STREAM;
+}
+
 static struct addrinfo *resolve_host_name(const char *host, size_t hostlen)
 {
     struct addrinfo hints;
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_UNSPEC;
-    hints.ai_socktype = SOCK_STREAM;
+    resolve_hints(&hints);
 
     char *use_host = strndup(host, hostlen);
     if (!use_host) {
@@ -57,6 +150,293 @@ static struct addrinfo *resolve_host_name(const char *host, size_t hostlen)
     return res;
 }
 
+#ifdef ESP_TLS_ASYNC_DNS
+
+/* Host name lookup running in background, freed by whichever of the lookup and the connection releases
+   it last (the connection may be deleted first). Completion is signalled with a datagram to a loopback UDP
+   socket, which the connection waits for with select() like for its TCP socket. */
+struct esp_tls_dns_req {
+    char *host;
+    char addr[INET6_ADDRSTRLEN];    /* resolved address, empty if the lookup failed */
+    bool done;
+    int refcount;
+    int signal_fd;                  /* -1 if there is no loopback socket or the connection is deleted */
+    struct sockaddr_in signal_addr;
+#ifndef ESP_PLATFORM
+    STAILQ_ENTRY(esp_tls_dns_req) next;
+#endif
+};
+
+static pthread_mutex_t s_dns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Must be called with s_dns_lock held */
+static void dns_req_put(esp_tls_dns_req_t *req)
+{
+    if (--req->refcount > 0) {
+        return;
+    }
+    free(req->host);
+    free(req);
+}
+
+#ifdef ESP_PLATFORM
+
+/* Called in lwIP thread, which can't use the socket API */
+static void dns_signal(esp_tls_dns_req_t *req)
+{
+    struct udp_pcb *pcb = udp_new();
+    struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, 1, PBUF_RAM);
+    if (pcb && p) {
+        ip_addr_t loopback = IPADDR4_INIT(PP_HTONL(INADDR_LOOPBACK));
+        udp_sendto(pcb, p, &loopback, ntohs(req->signal_addr.sin_port));
+    }
+    if (p) {
+        pbuf_free(p);
+    }
+    if (pcb) {
+        udp_remove(pcb);
+    }
+}
+
+#else
+
+static void dns_signal(esp_tls_dns_req_t *req)
+{
+    sendto(req->signal_fd, "", 1, 0, (struct sockaddr *)&req->signal_addr, sizeof(req->signal_addr));
+}
+
+#endif
+
+/* Stores result of the lookup (NULL if it failed) and wakes up the connection */
+static void dns_finish(esp_tls_dns_req_t *req, const char *addr)
+{
+    pthread_mutex_lock(&s_dns_lock);
+    if (addr) {
+        snprintf(req->addr, sizeof(req->addr), "%s", addr);
+    }
+    req->done = true;
+    if (req->signal_fd >= 0) {
+        dns_signal(req);
+    }
+    dns_req_put(req);
+    pthread_mutex_unlock(&s_dns_lock);
+}
+
+#ifdef ESP_PLATFORM
+
+static void dns_found(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    char addr[INET6_ADDRSTRLEN];
+    dns_finish(arg, ipaddr ? ipaddr_ntoa_r(ipaddr, addr, sizeof(addr)) : NULL);
+}
+
+/* Runs in lwIP thread */
+static void dns_lookup(void *arg)
+{
+    esp_tls_dns_req_t *req = arg;
+    ip_addr_t ipaddr;
+    err_t err = dns_gethostbyname(req->host, &ipaddr, dns_found, req);
+    if (err == ERR_OK) {
+        dns_found(req->host, &ipaddr, req);
+    } else if (err != ERR_INPROGRESS) {
+        dns_found(req->host, NULL, req);
+    }
+}
+
+static int dns_lookup_start(esp_tls_dns_req_t *req)
+{
+    return tcpip_callback(dns_lookup, req) == ERR_OK ? 0 : -1;
+}
+
+#else
+
+/* Without lwIP, lookups of all connections are made one after another by one thread */
+static STAILQ_HEAD(, esp_tls_dns_req) s_dns_queue = STAILQ_HEAD_INITIALIZER(s_dns_queue);
+static pthread_cond_t s_dns_cond = PTHREAD_COND_INITIALIZER;
+static bool s_dns_thread_started;
+
+static void *dns_thread(void *arg)
+{
+    pthread_mutex_lock(&s_dns_lock);
+    while (1) {
+        while (STAILQ_EMPTY(&s_dns_queue)) {
+            pthread_cond_wait(&s_dns_cond, &s_dns_lock);
+        }
+        esp_tls_dns_req_t *req = STAILQ_FIRST(&s_dns_queue);
+        STAILQ_REMOVE_HEAD(&s_dns_queue, next);
+        pthread_mutex_unlock(&s_dns_lock);
+
+        struct addrinfo hints;
+        struct addrinfo *res;
+        char addr[INET6_ADDRSTRLEN];
+        bool found = false;
+        resolve_hints(&hints);
+        if (getaddrinfo(req->host, NULL, &hints, &res) == 0) {
+            found = getnameinfo(res->ai_addr, res->ai_addrlen, addr, sizeof(addr), NULL, 0, NI_NUMERICHOST) == 0;
+            freeaddrinfo(res);
+        }
+        dns_finish(req, found ? addr : NULL);
+
+        pthread_mutex_lock(&s_dns_lock);
+    }
+    return NULL;
+}
+
+static int dns_lookup_start(esp_tls_dns_req_t *req)
+{
+    int ret = 0;
+    pthread_mutex_lock(&s_dns_lock);
+    if (!s_dns_thread_started) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, dns_thread, NULL) == 0) {
+            pthread_detach(thread);
+            s_dns_thread_started = true;
+        } else {
+            ret = -1;
+        }
+    }
+    if (ret == 0) {
+        STAILQ_INSERT_TAIL(&s_dns_queue, req, next);
+        pthread_cond_signal(&s_dns_cond);
+    }
+    pthread_mutex_unlock(&s_dns_lock);
+    return ret;
+}
+
+#endif
+
+/* Loopback UDP socket which receives a datagram when the lookup is finished, -1 if there is none */
+static int dns_signal_socket(struct sockaddr_in *addr)
+{
+#if defined(ESP_PLATFORM) && !defined(CONFIG_LWIP_NETIF_LOOPBACK)
+    return -1;
+#else
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    socklen_t addr_len = sizeof(*addr);
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)addr, addr_len) != 0 || getsockname(fd, (struct sockaddr *)addr, &addr_len) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#endif
+}
+
+/**
+ * Starts host name lookup without blocking. Numeric addresses are converted at once,
+ * other names are resolved in background.
+ *
+ * @return 1 and *res if the address is known, 0 if lookup is in progress, -1 on error
+ */
+static int dns_start(esp_tls_t *tls, const char *host, size_t hostlen, struct addrinfo **res)
+{
+    struct addrinfo hints;
+    resolve_hints(&hints);
+    hints.ai_flags = AI_NUMERICHOST;
+
+    esp_tls_dns_req_t *req = calloc(1, sizeof(esp_tls_dns_req_t));
+    if (!req) {
+        return -1;
+    }
+    req->host = strndup(host, hostlen);
+    if (!req->host) {
+        free(req);
+        return -1;
+    }
+    if (getaddrinfo(req->host, NULL, &hints, res) == 0) {
+        free(req->host);
+        free(req);
+        return 1;
+    }
+
+    req->signal_fd = dns_signal_socket(&req->signal_addr);
+    req->refcount = 2;
+    if (dns_lookup_start(req) != 0) {
+        ESP_LOGE(TAG, "Failed to start host name lookup");
+        if (req->signal_fd >= 0) {
+            close(req->signal_fd);
+        }
+        free(req->host);
+        free(req);
+        return -1;
+    }
+    tls->dns_req = req;
+    return 0;
+}
+
+/* Releases the lookup of the connection, the socket is closed without the lock: lwIP thread may wait for it */
+static void dns_release(esp_tls_t *tls)
+{
+    esp_tls_dns_req_t *req = tls->dns_req;
+    pthread_mutex_lock(&s_dns_lock);
+    int fd = req->signal_fd;
+    req->signal_fd = -1;
+    dns_req_put(req);
+    pthread_mutex_unlock(&s_dns_lock);
+    tls->dns_req = NULL;
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/* @return 1 and *res if lookup is finished, 0 if it is in progress, -1 on error */
+static int dns_poll(esp_tls_t *tls, struct addrinfo **res)
+{
+    esp_tls_dns_req_t *req = tls->dns_req;
+    char addr[INET6_ADDRSTRLEN];
+
+    pthread_mutex_lock(&s_dns_lock);
+    bool done = req->done;
+    memcpy(addr, req->addr, sizeof(addr));
+    pthread_mutex_unlock(&s_dns_lock);
+    if (!done) {
+        return 0;
+    }
+
+    struct addrinfo hints;
+    resolve_hints(&hints);
+    hints.ai_flags = AI_NUMERICHOST;
+    int ret = 1;
+    if (addr[0] == '\0' || getaddrinfo(addr, NULL, &hints, res) != 0) {
+        ESP_LOGE(TAG, "couldn't get hostname for :%s:", req->host);
+        ret = -1;
+    }
+    dns_release(tls);
+    return ret;
+}
+
+static void dns_cancel(esp_tls_t *tls)
+{
+    if (tls->dns_req) {
+        dns_release(tls);
+    }
+}
+
+#else // ESP_TLS_ASYNC_DNS
+
+/* Host name of non-blocking connection is resolved with blocking lookup when the connection starts */
+static int dns_start(esp_tls_t *tls, const char *host, size_t hostlen, struct addrinfo **res)
+{
+    *res = resolve_host_name(host, hostlen);
+    return *res ? 1 : -1;
+}
+
+static int dns_poll(esp_tls_t *tls, struct addrinfo **res)
+{
+    return -1;
+}
+
+static void dns_cancel(esp_tls_t *tls)
+{
+}
+
+#endif // ESP_TLS_ASYNC_DNS
+
 static ssize_t tcp_read(esp_tls_t *tls, char *data, size_t datalen)
 {
     return recv(tls->sockfd, data, datalen, 0);
@@ -82,20 +462,15 @@ static void ms_to_timeval(int timeout_ms, struct timeval *tv)
     tv->tv_usec = (timeout_ms % 1000) * 1000;
 }
 
-static int esp_tcp_connect(const char *host, int hostlen, int port, int *sockfd, const esp_tls_cfg_t *cfg)
+/* Creates socket and starts connection to the resolved address, in non-blocking mode it doesn't wait for the result */
+static int esp_tcp_connect(struct addrinfo *res, int port, int *sockfd, const esp_tls_cfg_t *cfg)
 {
     int ret = -1;
-    struct addrinfo *res = resolve_host_name(host, hostlen);
-    if (!res) {
-        return ret;
-    }
-
     int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
     if (fd < 0) {
         ESP_LOGE(TAG, "Failed to create socket (family %d socktype %d protocol %d)", res->ai_family, res->ai_socktype, res->ai_protocol);
-        goto err_freeaddr;
+        return ret;
     }
-    *sockfd = fd;
 
     void *addr_ptr;
     if (res->ai_family == AF_INET) {
@@ -125,20 +500,44 @@ static int esp_tcp_connect(const char *host, int hostlen, int port, int *sockfd,
     }
 
     ret = connect(fd, addr_ptr, res->ai_addrlen);
-    if (ret < 0 && !(errno == EINPROGRESS && cfg->non_block)) {
+    if (ret < 0 && !(errno == EINPROGRESS && cfg && cfg->non_block)) {
 
         ESP_LOGE(TAG, "Failed to connnect to host (errno %d)", errno);
         goto err_freesocket;
     }
 
-    freeaddrinfo(res);
+    *sockfd = fd;
     return 0;
 
 err_freesocket:
     close(fd);
-err_freeaddr:
-    freeaddrinfo(res);
-    return ret;
+    return -1;
+}
+
+/* @return 1 if non-blocking connection is established, 0 if it is in progress, -1 on error */
+static int esp_tcp_connect_poll(int fd)
+{
+    fd_set wset;
+    struct timeval tv = { 0 };
+    FD_ZERO(&wset);
+    FD_SET(fd, &wset);
+
+    int ret = select(fd + 1, NULL, &wset, NULL, &tv);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "select() failed (errno %d)", errno);
+        return -1;
+    }
+    if (ret == 0) {
+        return 0;
+    }
+    int error;
+    socklen_t len = sizeof(error);
+    /* pending error check */
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+        ESP_LOGE(TAG, "Non blocking connect failed (errno %d)", error);
+        return -1;
+    }
+    return 1;
 }
 
 esp_err_t esp_tls_init_global_ca_store()
@@ -184,9 +583,15 @@ mbedtls_x509_crt *esp_tls_get_global_ca_store()
     return global_cacert;
 }
 
+static void conf_cache_trim(size_t max_len);
+
 void esp_tls_free_global_ca_store()
 {
     if (global_cacert) {
+        /* cached configurations which are not in use may reference it */
+        pthread_mutex_lock(&s_cache_lock);
+        conf_cache_trim(0);
+        pthread_mutex_unlock(&s_cache_lock);
         mbedtls_x509_crt_free(global_cacert);
         global_cacert = NULL;
     }
@@ -206,6 +611,333 @@ static void verify_certificate(esp_tls_t *tls)
     }
 }
 
+static void digest_update(mbedtls_sha256_context *ctx, const void *buf, size_t len)
+{
+    /* length is hashed as well to separate fields */
+    uint32_t len32 = len;
+    mbedtls_sha256_update_ret(ctx, (const unsigned char *)&len32, sizeof(len32));
+    if (buf) {
+        mbedtls_sha256_update_ret(ctx, buf, len);
+    }
+}
+
+/* Certificates and keys are identified by contents. Global CA store and ALPN list
+   are referenced by the configuration, so they are identified by address */
+static void conf_digest(const esp_tls_cfg_t *cfg, unsigned char *digest)
+{
+    mbedtls_sha256_context ctx;
+    mbedtls_x509_crt *global_ca = cfg->use_global_ca_store ? global_cacert : NULL;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    digest_update(&ctx, &global_ca, sizeof(global_ca));
+    if (!global_ca) {
+        digest_update(&ctx, cfg->cacert_pem_buf, cfg->cacert_pem_bytes);
+    }
+    digest_update(&ctx, cfg->clientcert_pem_buf, cfg->clientcert_pem_bytes);
+    digest_update(&ctx, cfg->clientkey_pem_buf, cfg->clientkey_pem_bytes);
+    digest_update(&ctx, cfg->clientkey_password, cfg->clientkey_password_len);
+    digest_update(&ctx, &cfg->alpn_protos, sizeof(cfg->alpn_protos));
+    mbedtls_sha256_finish_ret(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+}
+
+/* Returns parsed certificate from cache, parses it if it is not there yet.
+   Must be called with cache lock held */
+static esp_tls_cert_entry_t *cert_cache_get(const unsigned char *pem, size_t pem_len)
+{
+    unsigned char digest[ESP_TLS_DIGEST_LEN];
+    mbedtls_sha256_context ctx;
+    esp_tls_cert_entry_t *entry;
+    int ret;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    digest_update(&ctx, pem, pem_len);
+    mbedtls_sha256_finish_ret(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+
+    SLIST_FOREACH(entry, &s_cert_cache, next) {
+        if (memcmp(entry->digest, digest, sizeof(digest)) == 0) {
+            entry->refcount++;
+            return entry;
+        }
+    }
+
+    entry = calloc(1, sizeof(esp_tls_cert_entry_t));
+    if (!entry) {
+        ESP_LOGE(TAG, "Failed to allocate certificate cache entry");
+        return NULL;
+    }
+    mbedtls_x509_crt_init(&entry->crt);
+    ret = mbedtls_x509_crt_parse(&entry->crt, pem, pem_len);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "mbedtls_x509_crt_parse returned -0x%x", -ret);
+        mbedtls_x509_crt_free(&entry->crt);
+        free(entry);
+        return NULL;
+    }
+    memcpy(entry->digest, digest, sizeof(digest));
+    entry->refcount = 1;
+    SLIST_INSERT_HEAD(&s_cert_cache, entry, next);
+    return entry;
+}
+
+/* Must be called with cache lock held */
+static void cert_cache_put(esp_tls_cert_entry_t *entry)
+{
+    if (entry && --entry->refcount == 0) {
+        SLIST_REMOVE(&s_cert_cache, entry, esp_tls_cert_entry, next);
+        mbedtls_x509_crt_free(&entry->crt);
+        free(entry);
+    }
+}
+
+static int shared_rng(void *ctx, unsigned char *buf, size_t len)
+{
+    pthread_mutex_lock(&s_rng_lock);
+    int ret = mbedtls_ctr_drbg_random(ctx, buf, len);
+    pthread_mutex_unlock(&s_rng_lock);
+    return ret;
+}
+
+static int shared_rng_init(void)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&s_rng_lock);
+    if (!s_shared_rng_seeded) {
+        mbedtls_entropy_init(&s_shared_entropy);
+        mbedtls_ctr_drbg_init(&s_shared_ctr_drbg);
+        ret = mbedtls_ctr_drbg_seed(&s_shared_ctr_drbg, mbedtls_entropy_func, &s_shared_entropy, NULL, 0);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed returned %d", ret);
+            mbedtls_ctr_drbg_free(&s_shared_ctr_drbg);
+            mbedtls_entropy_free(&s_shared_entropy);
+        } else {
+            s_shared_rng_seeded = true;
+        }
+    }
+    pthread_mutex_unlock(&s_rng_lock);
+    return ret;
+}
+
+static int configure_ssl_conf(mbedtls_ssl_config *conf, const esp_tls_cfg_t *cfg, mbedtls_x509_crt *cacert,
+                              mbedtls_x509_crt *clientcert, mbedtls_pk_context *clientkey)
+{
+    int ret;
+
+    if ((ret = mbedtls_ssl_config_defaults(conf,
+                    MBEDTLS_SSL_IS_CLIENT,
+                    MBEDTLS_SSL_TRANSPORT_STREAM,
+                    MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_config_defaults returned %d", ret);
+        return ret;
+    }
+
+#ifdef CONFIG_MBEDTLS_SSL_ALPN
+    if (cfg->alpn_protos) {
+        mbedtls_ssl_conf_alpn_protocols(conf, cfg->alpn_protos);
+    }
+#endif
+
+    if (cacert) {
+        mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_ca_chain(conf, cacert, NULL);
+    } else {
+        mbedtls_ssl_conf_authmode(conf, MBEDTLS_SSL_VERIFY_NONE);
+    }
+
+    if (clientcert) {
+        ret = mbedtls_ssl_conf_own_cert(conf, clientcert, clientkey);
+        if (ret < 0) {
+            ESP_LOGE(TAG, "mbedtls_ssl_conf_own_cert returned -0x%x\n\n", -ret);
+            return ret;
+        }
+    }
+
+#ifdef CONFIG_MBEDTLS_DEBUG
+    mbedtls_esp_enable_debug_log(conf, 4);
+#endif
+    return 0;
+}
+
+static void shared_conf_free(esp_tls_shared_conf_t *sc)
+{
+    mbedtls_ssl_config_free(&sc->conf);
+    cert_cache_put(sc->cacert);
+    cert_cache_put(sc->clientcert);
+    free(sc);
+}
+
+/* Frees the least recently used configurations which are not in use
+   while there are more than max_len of them. Must be called with cache lock held */
+static void conf_cache_trim(size_t max_len)
+{
+    esp_tls_shared_conf_t *sc = TAILQ_LAST(&s_conf_cache, esp_tls_conf_list);
+
+    while (sc && s_conf_cache_len > max_len) {
+        esp_tls_shared_conf_t *prev = TAILQ_PREV(sc, esp_tls_conf_list, next);
+        if (sc->refcount == 0) {
+            TAILQ_REMOVE(&s_conf_cache, sc, next);
+            s_conf_cache_len--;
+            shared_conf_free(sc);
+        }
+        sc = prev;
+    }
+}
+
+/* Returns configuration for the settings from cache, creates it if it is not there yet.
+   Must be called with cache lock held */
+static esp_tls_shared_conf_t *shared_conf_get(const esp_tls_cfg_t *cfg, const unsigned char *digest)
+{
+    esp_tls_shared_conf_t *sc;
+
+    TAILQ_FOREACH(sc, &s_conf_cache, next) {
+        if (memcmp(sc->digest, digest, ESP_TLS_DIGEST_LEN) == 0) {
+            TAILQ_REMOVE(&s_conf_cache, sc, next);
+            TAILQ_INSERT_HEAD(&s_conf_cache, sc, next);
+            sc->refcount++;
+            return sc;
+        }
+    }
+
+    if (shared_rng_init() != 0) {
+        return NULL;
+    }
+    sc = calloc(1, sizeof(esp_tls_shared_conf_t));
+    if (!sc) {
+        ESP_LOGE(TAG, "Failed to allocate shared configuration");
+        return NULL;
+    }
+    mbedtls_ssl_config_init(&sc->conf);
+    if (!cfg->use_global_ca_store && cfg->cacert_pem_buf != NULL) {
+        sc->cacert = cert_cache_get(cfg->cacert_pem_buf, cfg->cacert_pem_bytes);
+        if (!sc->cacert) {
+            goto exit;
+        }
+    }
+    if (cfg->clientcert_pem_buf != NULL) {
+        sc->clientcert = cert_cache_get(cfg->clientcert_pem_buf, cfg->clientcert_pem_bytes);
+        if (!sc->clientcert) {
+            goto exit;
+        }
+    }
+    if (configure_ssl_conf(&sc->conf, cfg,
+                           cfg->use_global_ca_store ? global_cacert : (sc->cacert ? &sc->cacert->crt : NULL),
+                           NULL, NULL) != 0) {
+        goto exit;
+    }
+    mbedtls_ssl_conf_rng(&sc->conf, shared_rng, &s_shared_ctr_drbg);
+
+    memcpy(sc->digest, digest, ESP_TLS_DIGEST_LEN);
+    sc->refcount = 1;
+    TAILQ_INSERT_HEAD(&s_conf_cache, sc, next);
+    s_conf_cache_len++;
+    conf_cache_trim(CONFIG_ESP_TLS_CONF_CACHE_SIZE);
+    return sc;
+exit:
+    shared_conf_free(sc);
+    return NULL;
+}
+
+/* Must be called with cache lock held */
+static void shared_conf_put(esp_tls_shared_conf_t *sc)
+{
+    sc->refcount--;
+    conf_cache_trim(CONFIG_ESP_TLS_CONF_CACHE_SIZE);
+}
+
+/* Must be called with cache lock held */
+static esp_tls_session_entry_t *session_cache_find(const char *host, size_t hostlen, int port,
+                                                   const unsigned char *conf_digest)
+{
+    esp_tls_session_entry_t *entry;
+
+    TAILQ_FOREACH(entry, &s_session_cache, next) {
+        if (entry->port == port && strlen(entry->host) == hostlen && strncmp(entry->host, host, hostlen) == 0 &&
+                memcmp(entry->conf_digest, conf_digest, ESP_TLS_DIGEST_LEN) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Must be called with cache lock held */
+static void session_cache_free(esp_tls_session_entry_t *entry)
+{
+    TAILQ_REMOVE(&s_session_cache, entry, next);
+    s_session_cache_len--;
+    mbedtls_ssl_session_free(&entry->session);
+    free(entry->host);
+    free(entry);
+}
+
+/* Sets session saved by previous connection to the same server, if there is one */
+static void session_cache_load(esp_tls_t *tls, const char *host, size_t hostlen, int port,
+                               const unsigned char *conf_digest)
+{
+    pthread_mutex_lock(&s_cache_lock);
+    esp_tls_session_entry_t *entry = session_cache_find(host, hostlen, port, conf_digest);
+    if (entry) {
+        int ret = mbedtls_ssl_set_session(&tls->ssl, &entry->session);
+        if (ret != 0) {
+            ESP_LOGD(TAG, "mbedtls_ssl_set_session returned -0x%x", -ret);
+        }
+    }
+    pthread_mutex_unlock(&s_cache_lock);
+}
+
+/* Saves session negotiated by completed handshake, it replaces session saved before for the same server */
+static void session_cache_save(esp_tls_t *tls, const char *host, size_t hostlen, int port, const esp_tls_cfg_t *cfg)
+{
+    unsigned char digest[ESP_TLS_DIGEST_LEN];
+    int ret;
+
+    if (tls->shared_conf) {
+        memcpy(digest, tls->shared_conf->digest, sizeof(digest));
+    } else {
+        conf_digest(cfg, digest);
+    }
+
+    pthread_mutex_lock(&s_cache_lock);
+    esp_tls_session_entry_t *entry = session_cache_find(host, hostlen, port, digest);
+    if (entry) {
+        session_cache_free(entry);
+    }
+    entry = calloc(1, sizeof(esp_tls_session_entry_t));
+    if (!entry || !(entry->host = strndup(host, hostlen))) {
+        ESP_LOGE(TAG, "Failed to allocate session cache entry");
+        free(entry);
+        goto exit;
+    }
+    entry->port = port;
+    memcpy(entry->conf_digest, digest, sizeof(digest));
+    mbedtls_ssl_session_init(&entry->session);
+    TAILQ_INSERT_HEAD(&s_session_cache, entry, next);
+    s_session_cache_len++;
+    if ((ret = mbedtls_ssl_get_session(&tls->ssl, &entry->session)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_get_session returned -0x%x", -ret);
+        session_cache_free(entry);
+        goto exit;
+    }
+    while (s_session_cache_len > CONFIG_ESP_TLS_SESSION_CACHE_SIZE) {
+        session_cache_free(TAILQ_LAST(&s_session_cache, esp_tls_session_list));
+    }
+exit:
+    pthread_mutex_unlock(&s_cache_lock);
+}
+
+void esp_tls_cache_clear()
+{
+    pthread_mutex_lock(&s_cache_lock);
+    conf_cache_trim(0);
+    while (!TAILQ_EMPTY(&s_session_cache)) {
+        session_cache_free(TAILQ_FIRST(&s_session_cache));
+    }
+    pthread_mutex_unlock(&s_cache_lock);
+}
+
 static void mbedtls_cleanup(esp_tls_t *tls) 
 {
     if (!tls) {
@@ -222,112 +954,159 @@ static void mbedtls_cleanup(esp_tls_t *tls)
     mbedtls_ssl_config_free(&tls->conf);
     mbedtls_ctr_drbg_free(&tls->ctr_drbg);
     mbedtls_ssl_free(&tls->ssl);
-    mbedtls_net_free(&tls->server_fd);
+    /* released after SSL context which refers to it */
+    if (tls->shared_conf) {
+        pthread_mutex_lock(&s_cache_lock);
+        shared_conf_put(tls->shared_conf);
+        pthread_mutex_unlock(&s_cache_lock);
+        tls->shared_conf = NULL;
+    }
+    /* socket is closed by esp_tls_conn_delete() */
 }
 
-static int create_ssl_handle(esp_tls_t *tls, const char *hostname, size_t hostlen, const esp_tls_cfg_t *cfg)
+static int parse_client_key(esp_tls_t *tls, const esp_tls_cfg_t *cfg)
 {
-    int ret;
-    
-    mbedtls_net_init(&tls->server_fd);
-    tls->server_fd.fd = tls->sockfd;
-    mbedtls_ssl_init(&tls->ssl);
-    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
-    mbedtls_ssl_config_init(&tls->conf);
-    mbedtls_entropy_init(&tls->entropy);
-    
-    if ((ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, 
-                    mbedtls_entropy_func, &tls->entropy, NULL, 0)) != 0) {
-        ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed returned %d", ret);
-        goto exit;        
-    }
-    
-    /* Hostname set here should match CN in server certificate */    
-    char *use_host = strndup(hostname, hostlen);
-    if (!use_host) {
-        goto exit;
+    int ret = mbedtls_pk_parse_key(&tls->clientkey, cfg->clientkey_pem_buf, cfg->clientkey_pem_bytes,
+                  cfg->clientkey_password, cfg->clientkey_password_len);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "mbedtls_pk_parse_keyfile returned -0x%x\n\n", -ret);
     }
+    return ret;
+}
 
-    if ((ret = mbedtls_ssl_set_hostname(&tls->ssl, use_host)) != 0) {
-        ESP_LOGE(TAG, "mbedtls_ssl_set_hostname returned -0x%x", -ret);
-        free(use_host);
-        goto exit;
-    }
-    free(use_host);
+/* Creates configuration of connection with client certificate from the cached one, certificates
+   are shared but the key is parsed by each connection, see esp_tls_cert_entry_t */
+static int create_client_auth_conf(esp_tls_t *tls, const esp_tls_cfg_t *cfg)
+{
+    int ret;
 
-    if ((ret = mbedtls_ssl_config_defaults(&tls->conf,
-                    MBEDTLS_SSL_IS_CLIENT,
-                    MBEDTLS_SSL_TRANSPORT_STREAM,
-                    MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
-        ESP_LOGE(TAG, "mbedtls_ssl_config_defaults returned %d", ret);
-        goto exit;
+    mbedtls_pk_init(&tls->clientkey);
+    if ((ret = parse_client_key(tls, cfg)) < 0) {
+        return ret;
     }
+    ret = configure_ssl_conf(&tls->conf, cfg, tls->shared_conf->conf.ca_chain,
+                             &tls->shared_conf->clientcert->crt, &tls->clientkey);
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_rng(&tls->conf, shared_rng, &s_shared_ctr_drbg);
+    return 0;
+}
 
-#ifdef CONFIG_MBEDTLS_SSL_ALPN
-    if (cfg->alpn_protos) {
-        mbedtls_ssl_conf_alpn_protocols(&tls->conf, cfg->alpn_protos);
+/* Creates configuration used only by this connection */
+static int create_own_conf(esp_tls_t *tls, const esp_tls_cfg_t *cfg)
+{
+    int ret;
+
+    if ((ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, 
+                    mbedtls_entropy_func, &tls->entropy, NULL, 0)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed returned %d", ret);
+        return ret;
     }
-#endif
 
     if (cfg->use_global_ca_store == true) {
-        if (global_cacert == NULL) {
-            ESP_LOGE(TAG, "global_cacert is NULL");
-            goto exit;
-        }
         tls->cacert_ptr = global_cacert;
-        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-        mbedtls_ssl_conf_ca_chain(&tls->conf, tls->cacert_ptr, NULL);
     } else if (cfg->cacert_pem_buf != NULL) {
         tls->cacert_ptr = &tls->cacert;
         mbedtls_x509_crt_init(tls->cacert_ptr);
         ret = mbedtls_x509_crt_parse(tls->cacert_ptr, cfg->cacert_pem_buf, cfg->cacert_pem_bytes);
         if (ret < 0) {
             ESP_LOGE(TAG, "mbedtls_x509_crt_parse returned -0x%x\n\n", -ret);
-            goto exit;
+            return ret;
         }
-        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_REQUIRED);
-        mbedtls_ssl_conf_ca_chain(&tls->conf, tls->cacert_ptr, NULL);
-    } else {
-        mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_NONE);
     }
 
-    if (cfg->clientcert_pem_buf != NULL && cfg->clientkey_pem_buf != NULL) {
+    if (cfg->clientcert_pem_buf != NULL) {
         mbedtls_x509_crt_init(&tls->clientcert);
         mbedtls_pk_init(&tls->clientkey);
 
         ret = mbedtls_x509_crt_parse(&tls->clientcert, cfg->clientcert_pem_buf, cfg->clientcert_pem_bytes);
         if (ret < 0) {
             ESP_LOGE(TAG, "mbedtls_x509_crt_parse returned -0x%x\n\n", -ret);
-            goto exit;
+            return ret;
         }
 
-        ret = mbedtls_pk_parse_key(&tls->clientkey, cfg->clientkey_pem_buf, cfg->clientkey_pem_bytes,
-                  cfg->clientkey_password, cfg->clientkey_password_len);
+        ret = parse_client_key(tls, cfg);
         if (ret < 0) {
-            ESP_LOGE(TAG, "mbedtls_pk_parse_keyfile returned -0x%x\n\n", -ret);
-            goto exit;
+            return ret;
         }
+    }
 
-        ret = mbedtls_ssl_conf_own_cert(&tls->conf, &tls->clientcert, &tls->clientkey);
-        if (ret < 0) {
-            ESP_LOGE(TAG, "mbedtls_ssl_conf_own_cert returned -0x%x\n\n", -ret);
-            goto exit;
-        }
-    } else if (cfg->clientcert_pem_buf != NULL || cfg->clientkey_pem_buf != NULL) {
-        ESP_LOGE(TAG, "You have to provide both clientcert_pem_buf and clientkey_pem_buf for mutual authentication\n\n");
+    ret = configure_ssl_conf(&tls->conf, cfg, tls->cacert_ptr,
+                             cfg->clientcert_pem_buf ? &tls->clientcert : NULL, &tls->clientkey);
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+    return 0;
+}
+
+static int create_ssl_handle(esp_tls_t *tls, const char *hostname, size_t hostlen, int port, const esp_tls_cfg_t *cfg)
+{
+    int ret;
+    unsigned char digest[ESP_TLS_DIGEST_LEN];
+    
+    mbedtls_net_init(&tls->server_fd);
+    tls->server_fd.fd = tls->sockfd;
+    mbedtls_ssl_init(&tls->ssl);
+    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
+    mbedtls_ssl_config_init(&tls->conf);
+    mbedtls_entropy_init(&tls->entropy);
+    
+    /* Hostname set here should match CN in server certificate */    
+    char *use_host = strndup(hostname, hostlen);
+    if (!use_host) {
         goto exit;
     }
 
-    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+    if ((ret = mbedtls_ssl_set_hostname(&tls->ssl, use_host)) != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_set_hostname returned -0x%x", -ret);
+        free(use_host);
+        goto exit;
+    }
+    free(use_host);
 
-#ifdef CONFIG_MBEDTLS_DEBUG
-    mbedtls_esp_enable_debug_log(&tls->conf, 4);
-#endif
+    if (cfg->use_global_ca_store == true && global_cacert == NULL) {
+        ESP_LOGE(TAG, "global_cacert is NULL");
+        goto exit;
+    }
+    if ((cfg->clientcert_pem_buf != NULL) != (cfg->clientkey_pem_buf != NULL)) {
+        ESP_LOGE(TAG, "You have to provide both clientcert_pem_buf and clientkey_pem_buf for mutual authentication\n\n");
+        goto exit;
+    }
 
-    if ((ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf)) != 0) {
+    if (cfg->use_cert_cache || cfg->use_session_cache) {
+        conf_digest(cfg, digest);
+    }
+
+    if (cfg->use_cert_cache) {
+        pthread_mutex_lock(&s_cache_lock);
+        tls->shared_conf = shared_conf_get(cfg, digest);
+        pthread_mutex_unlock(&s_cache_lock);
+        if (!tls->shared_conf) {
+            goto exit;
+        }
+        if (cfg->clientcert_pem_buf != NULL) {
+            if (create_client_auth_conf(tls, cfg) != 0) {
+                goto exit;
+            }
+            ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+        } else {
+            ret = mbedtls_ssl_setup(&tls->ssl, &tls->shared_conf->conf);
+        }
+    } else {
+        if (create_own_conf(tls, cfg) != 0) {
+            goto exit;
+        }
+        ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    }
+    if (ret != 0) {
         ESP_LOGE(TAG, "mbedtls_ssl_setup returned -0x%x\n\n", -ret);
         goto exit;
     }
+    if (cfg->use_session_cache) {
+        session_cache_load(tls, hostname, hostlen, port, digest);
+    }
     mbedtls_ssl_set_bio(&tls->ssl, &tls->server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
 
     return 0;
@@ -342,8 +1121,9 @@ exit:
 void esp_tls_conn_delete(esp_tls_t *tls)
 {
     if (tls != NULL) {
+        dns_cancel(tls);
         mbedtls_cleanup(tls);
-        if (tls->sockfd) {
+        if (tls->sockfd > 0) {
             close(tls->sockfd);
         }
         free(tls);
@@ -366,67 +1146,99 @@ static ssize_t tls_write(esp_tls_t *tls, const char *data, size_t datalen)
     return ret;
 }
 
+/* In non-blocking mode fails the connection if cfg->timeout_ms has passed since it was started */
+static int check_conn_timeout(esp_tls_t *tls, const esp_tls_cfg_t *cfg)
+{
+    if (cfg->timeout_ms > 0 && get_time_us() - tls->conn_start_us > (int64_t)cfg->timeout_ms * 1000) {
+        ESP_LOGE(TAG, "connection timed out");
+        tls->conn_state = ESP_TLS_FAIL;
+        return -1;
+    }
+    return 0;
+}
+
 static int esp_tls_low_level_conn(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls)
 {
     if (!tls) {
         ESP_LOGE(TAG, "empty esp_tls parameter");
         return -1;
     }
+    bool non_block = cfg && cfg->non_block;
+    struct addrinfo *res = NULL;
+    int ret;
     /* These states are used to keep a tab on connection progress in case of non-blocking connect,
     and in case of blocking connect these cases will get executed one after the other */
     switch (tls->conn_state) {
         case ESP_TLS_INIT:
-            ;
-            int sockfd;
-            int ret = esp_tcp_connect(hostname, hostlen, port, &sockfd, cfg);
+            tls->sockfd = -1;
+            tls->poll_events = 0;
+            tls->conn_start_us = get_time_us();
+            tls->phase_start_us = tls->conn_start_us;
+            memset(&tls->timing, 0, sizeof(tls->timing));
+            if (non_block) {
+                ret = dns_start(tls, hostname, hostlen, &res);
+                if (ret < 0) {
+                    tls->conn_state = ESP_TLS_FAIL;
+                    return -1;
+                }
+            } else {
+                res = resolve_host_name(hostname, hostlen);
+                if (!res) {
+                    return -1;
+                }
+            }
+            tls->conn_state = ESP_TLS_RESOLVING;
+            /* falls through */
+        case ESP_TLS_RESOLVING:
+            if (!res) {
+                ret = dns_poll(tls, &res);
+                if (ret < 0) {
+                    tls->conn_state = ESP_TLS_FAIL;
+                    return -1;
+                }
+                if (ret == 0) {
+                    return check_conn_timeout(tls, cfg);
+                }
+            }
+            phase_done(tls, &tls->timing.dns_us);
+            ret = esp_tcp_connect(res, port, &tls->sockfd, cfg);
+            freeaddrinfo(res);
             if (ret < 0) {
+                tls->conn_state = ESP_TLS_FAIL;
                 return -1;
             }
-            tls->sockfd = sockfd;
             if (!cfg) {
                 tls->read = tcp_read;
                 tls->write = tcp_write;
+                phase_done(tls, &tls->timing.tcp_connect_us);
+                tls->conn_state = ESP_TLS_DONE;
                 ESP_LOGD(TAG, "non-tls connection established");
                 return 1;
             }
-            if (cfg->non_block) {
-                FD_ZERO(&tls->rset);
-                FD_SET(tls->sockfd, &tls->rset);
-                tls->wset = tls->rset;
-            }
+            tls->poll_events = ESP_TLS_POLL_WRITE;
             tls->conn_state = ESP_TLS_CONNECTING;
             /* falls through */
         case ESP_TLS_CONNECTING:
-            if (cfg->non_block) {
+            if (non_block) {
                 ESP_LOGD(TAG, "connecting...");
-                struct timeval tv;
-                ms_to_timeval(cfg->timeout_ms, &tv);
-
-                /* In case of non-blocking I/O, we use the select() API to check whether
-                   connection has been estbalished or not*/
-                if (select(tls->sockfd + 1, &tls->rset, &tls->wset, NULL,
-                    cfg->timeout_ms ? &tv : NULL) == 0) {
-                    ESP_LOGD(TAG, "select() timed out");
-                    return 0;
+                ret = esp_tcp_connect_poll(tls->sockfd);
+                if (ret < 0) {
+                    tls->conn_state = ESP_TLS_FAIL;
+                    return -1;
                 }
-                if (FD_ISSET(tls->sockfd, &tls->rset) || FD_ISSET(tls->sockfd, &tls->wset)) {
-                    int error;
-                    unsigned int len = sizeof(error);
-                    /* pending error check */
-                    if (getsockopt(tls->sockfd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
-                        ESP_LOGD(TAG, "Non blocking connect failed");
-                        tls->conn_state = ESP_TLS_FAIL;
-                        return -1;
-                    }
+                if (ret == 0) {
+                    return check_conn_timeout(tls, cfg);
                 }
             }
             /* By now, the connection has been established */
-            ret = create_ssl_handle(tls, hostname, hostlen, cfg);
+            phase_done(tls, &tls->timing.tcp_connect_us);
+            ret = create_ssl_handle(tls, hostname, hostlen, port, cfg);
             if (ret != 0) {
                 ESP_LOGD(TAG, "create_ssl_handshake failed");
                 tls->conn_state = ESP_TLS_FAIL;
                 return -1;
             }
+            phase_done(tls, &tls->timing.tls_setup_us);
             tls->read = tls_read;
             tls->write = tls_write;
             tls->conn_state = ESP_TLS_HANDSHAKE;
@@ -435,7 +1247,16 @@ static int esp_tls_low_level_conn(const char *hostname, int hostlen, int port, c
             ESP_LOGD(TAG, "handshake in progress...");
             ret = mbedtls_ssl_handshake(&tls->ssl);
             if (ret == 0) {
+                phase_done(tls, &tls->timing.handshake_us);
+                if (cfg->use_session_cache) {
+                    session_cache_save(tls, hostname, hostlen, port, cfg);
+                }
+                tls->poll_events = 0;
                 tls->conn_state = ESP_TLS_DONE;
+                ESP_LOGD(TAG, "connected in %lld us (dns %lld, tcp %lld, setup %lld, handshake %lld)",
+                         (long long)(tls->phase_start_us - tls->conn_start_us), (long long)tls->timing.dns_us,
+                         (long long)tls->timing.tcp_connect_us, (long long)tls->timing.tls_setup_us,
+                         (long long)tls->timing.handshake_us);
                 return 1;
             } else {
                 if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
@@ -447,9 +1268,10 @@ static int esp_tls_low_level_conn(const char *hostname, int hostlen, int port, c
                     tls->conn_state = ESP_TLS_FAIL;
                     return -1;
                 }
+                tls->poll_events = (ret == MBEDTLS_ERR_SSL_WANT_READ) ? ESP_TLS_POLL_READ : ESP_TLS_POLL_WRITE;
                 /* Irrespective of blocking or non-blocking I/O, we return on getting MBEDTLS_ERR_SSL_WANT_READ
                    or MBEDTLS_ERR_SSL_WANT_WRITE during handshake */
-                return 0;
+                return non_block ? check_conn_timeout(tls, cfg) : 0;
             }
             break;
         case ESP_TLS_FAIL:
@@ -462,6 +1284,55 @@ static int esp_tls_low_level_conn(const char *hostname, int hostlen, int port, c
     return -1;
 }
 
+esp_err_t esp_tls_get_conn_poll_events(esp_tls_t *tls, int *sockfd, int *events)
+{
+    if (!tls || !sockfd || !events) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (tls->conn_state == ESP_TLS_DONE || tls->conn_state == ESP_TLS_FAIL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (tls->conn_state == ESP_TLS_INIT) {
+        *sockfd = -1;
+        *events = 0;
+    } else if (tls->conn_state == ESP_TLS_RESOLVING) {
+#ifdef ESP_TLS_ASYNC_DNS
+        /* readable when the lookup is finished */
+        *sockfd = tls->dns_req ? tls->dns_req->signal_fd : -1;
+#else
+        *sockfd = -1;
+#endif
+        *events = (*sockfd >= 0) ? ESP_TLS_POLL_READ : 0;
+    } else {
+        *sockfd = tls->sockfd;
+        *events = tls->poll_events;
+    }
+    return ESP_OK;
+}
+
+/* Waits until non-blocking connection can make progress, so that esp_tls_conn_new() doesn't spin */
+static void conn_wait(esp_tls_t *tls)
+{
+    int fd, events;
+    if (esp_tls_get_conn_poll_events(tls, &fd, &events) != ESP_OK || fd < 0) {
+        /* host name lookup has no loopback socket to wait for */
+        usleep(ESP_TLS_POLL_INTERVAL_MS * 1000);
+        return;
+    }
+    fd_set rset, wset;
+    struct timeval tv;
+    FD_ZERO(&rset);
+    FD_ZERO(&wset);
+    if (events & ESP_TLS_POLL_READ) {
+        FD_SET(fd, &rset);
+    }
+    if (events & ESP_TLS_POLL_WRITE) {
+        FD_SET(fd, &wset);
+    }
+    ms_to_timeval(ESP_TLS_POLL_INTERVAL_MS, &tv);
+    select(fd + 1, &rset, &wset, NULL, &tv);
+}
+
 /**
  * @brief      Create a new TLS/SSL connection
  */
@@ -481,6 +1352,8 @@ esp_tls_t *esp_tls_conn_new(const char *hostname, int hostlen, int port, const e
             esp_tls_conn_delete(tls);
             ESP_LOGE(TAG, "Failed to open new connection");
             return NULL;
+        } else if (cfg && cfg->non_block) {
+            conn_wait(tls);
         }
     }
     return NULL;
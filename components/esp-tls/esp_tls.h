@@ -40,6 +40,7 @@ typedef enum esp_tls_conn_state {
     ESP_TLS_HANDSHAKE,
     ESP_TLS_FAIL,
     ESP_TLS_DONE,
+    ESP_TLS_RESOLVING,              /*!< Host name is being resolved (non-blocking mode) */
 } esp_tls_conn_state_t;
 
 /**
@@ -78,14 +79,66 @@ typedef struct esp_tls_cfg {
 
     bool non_block;                         /*!< Configure non-blocking mode. If set to true the 
                                                  underneath socket will be configured in non 
-                                                 blocking mode after tls session is established */
+                                                 blocking mode after tls session is established.
+                                                 With CONFIG_ESP_TLS_ASYNC_DNS, esp_tls_conn_new_async()
+                                                 never blocks with this option, host name is resolved
+                                                 in background */
 
-    int timeout_ms;                         /*!< Network timeout in milliseconds */
+    int timeout_ms;                         /*!< Network timeout in milliseconds. In non-blocking mode
+                                                 it limits the time of whole connection establishment,
+                                                 0 means no limit. With CONFIG_ESP_TLS_ASYNC_DNS this
+                                                 includes host name resolution, which earlier versions
+                                                 did not limit */
 
     bool use_global_ca_store;               /*!< Use a global ca_store for all the connections in which
                                                  this bool is set. */
+
+    bool use_cert_cache;                    /*!< Share parsed certificates and TLS configuration
+                                                 with other connections which have the same settings,
+                                                 so that they are parsed only once. Client key is still
+                                                 parsed by every connection. Certificate and key buffers
+                                                 are identified by contents, ALPN list by address.
+                                                 Unused configurations are kept in the cache, see
+                                                 esp_tls_cache_clear() */
+
+    bool use_session_cache;                 /*!< Save TLS session after handshake and resume it on the
+                                                 next connection to the same host and port with the same
+                                                 settings (session ticket or session ID), which avoids
+                                                 full handshake if the server supports it */
 } esp_tls_cfg_t;
 
+/**
+ * @brief      TLS configuration shared by connections (internal)
+ */
+typedef struct esp_tls_shared_conf esp_tls_shared_conf_t;
+
+/**
+ * @brief      Host name lookup running in background (internal)
+ */
+typedef struct esp_tls_dns_req esp_tls_dns_req_t;
+
+/**
+ * @brief      Time spent in connection establishment phases, in microseconds
+ *
+ * In non-blocking mode it also includes the time between esp_tls_conn_new_async() calls.
+ */
+typedef struct esp_tls_conn_timing {
+    int64_t dns_us;                         /*!< Host name resolution */
+
+    int64_t tcp_connect_us;                 /*!< TCP connection */
+
+    int64_t tls_setup_us;                   /*!< Parsing certificates and keys or getting them from the cache,
+                                                 setting up TLS context */
+
+    int64_t handshake_us;                   /*!< TLS handshake */
+} esp_tls_conn_timing_t;
+
+/**
+ * @brief      Socket events awaited by non-blocking connection, see esp_tls_get_conn_poll_events()
+ */
+#define ESP_TLS_POLL_READ   (1 << 0)
+#define ESP_TLS_POLL_WRITE  (1 << 1)
+
 /**
  * @brief      ESP-TLS Connection Handle 
  */
@@ -126,6 +179,21 @@ typedef struct esp_tls {
     fd_set rset;                                                                /*!< read file descriptors */
 
     fd_set wset;                                                                /*!< write file descriptors */
+
+    esp_tls_shared_conf_t *shared_conf;                                         /*!< Cached configuration used instead of conf (its
+                                                                                     certificates only with client certificate),
+                                                                                     NULL if use_cert_cache is not set */
+
+    esp_tls_dns_req_t *dns_req;                                                 /*!< Host name lookup in progress (non-blocking mode) */
+
+    int poll_events;                                                            /*!< Socket events awaited by non-blocking connection,
+                                                                                     ESP_TLS_POLL_READ and/or ESP_TLS_POLL_WRITE */
+
+    int64_t conn_start_us;                                                      /*!< Time when connection establishment started */
+
+    int64_t phase_start_us;                                                     /*!< Time when current connection phase started */
+
+    esp_tls_conn_timing_t timing;                                               /*!< Duration of connection phases */
 } esp_tls_t;
 
 /**
@@ -163,6 +231,12 @@ esp_tls_t *esp_tls_conn_http_new(const char *url, const esp_tls_cfg_t *cfg);
  *
  * This function initiates a non-blocking TLS/SSL connection with the specified host, but due to
  * its non-blocking nature, it doesn't wait for the connection to get established.
+ * It should be called again until the connection is established or fails. Host name
+ * is resolved in background (with CONFIG_ESP_TLS_ASYNC_DNS, otherwise the first call
+ * blocks during the lookup), TCP connection and TLS handshake progress when the
+ * socket is ready, so many connections can be driven from one task: wait for socket events
+ * returned by esp_tls_get_conn_poll_events() with select() and call this function
+ * for connections which are ready.
  *
  * @param[in]  hostname  Hostname of the host.
  * @param[in]  hostlen   Length of hostname.
@@ -178,6 +252,24 @@ esp_tls_t *esp_tls_conn_http_new(const char *url, const esp_tls_cfg_t *cfg);
  */
 int esp_tls_conn_new_async(const char *hostname, int hostlen, int port, const esp_tls_cfg_t *cfg, esp_tls_t *tls);
 
+/**
+ * @brief      Get socket events awaited by non-blocking connection
+ *
+ * @param[in]  tls     pointer to esp-tls as esp-tls handle.
+ * @param[out] sockfd  Socket of the connection. While the host name is being resolved, it is
+ *                     a socket which becomes readable when the lookup is finished. -1 if the
+ *                     connection does not wait for socket events (lookup without loopback
+ *                     interface, CONFIG_LWIP_NETIF_LOOPBACK disabled), in that case
+ *                     esp_tls_conn_new_async() should be called again after a short delay.
+ * @param[out] events  ESP_TLS_POLL_READ and/or ESP_TLS_POLL_WRITE.
+ *
+ * @return
+ *             - ESP_OK                 on success.
+ *             - ESP_ERR_INVALID_ARG    if tls is NULL.
+ *             - ESP_ERR_INVALID_STATE  if the connection is already established or failed.
+ */
+esp_err_t esp_tls_get_conn_poll_events(esp_tls_t *tls, int *sockfd, int *events);
+
 /**
  * @brief      Create a new non-blocking TLS/SSL connection with a given "HTTP" url
  *
@@ -313,6 +405,16 @@ mbedtls_x509_crt *esp_tls_get_global_ca_store();
  */
 void esp_tls_free_global_ca_store();
 
+/**
+ * @brief      Free cached TLS configurations which are not in use and all saved sessions.
+ *
+ * Configurations are cached by connections opened with use_cert_cache set, and sessions are
+ * saved by connections opened with use_session_cache set. Configurations which are used by open
+ * connections are kept. The application can call this API to release memory or to force full
+ * handshake on the next connection.
+ */
+void esp_tls_cache_clear();
+
 
 #ifdef __cplusplus
 }
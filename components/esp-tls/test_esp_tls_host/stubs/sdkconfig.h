@@ -0,0 +1,5 @@
+#pragma once
+
+#define CONFIG_MBEDTLS_SSL_ALPN             1
+#define CONFIG_ESP_TLS_CONF_CACHE_SIZE      2
+#define CONFIG_ESP_TLS_SESSION_CACHE_SIZE   4
@@ -0,0 +1,558 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+
+extern "C" {
+#include "esp_tls.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+}
+
+using std::vector;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+static const char *HOST = "localhost";
+
+// Number of handshakes in which the server resumed a session
+static std::atomic<int> s_resumed;
+
+static int counting_cache_get(void *data, mbedtls_ssl_session *session)
+{
+    int ret = mbedtls_ssl_cache_get(data, session);
+    if (ret == 0) {
+        s_resumed++;
+    }
+    return ret;
+}
+
+static int counting_ticket_parse(void *p_ticket, mbedtls_ssl_session *session, unsigned char *buf, size_t len)
+{
+    int ret = mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0) {
+        s_resumed++;
+    }
+    return ret;
+}
+
+// Loopback TLS server which supports session ID cache and optionally session tickets.
+// Every connection echoes one message and is closed.
+class TlsServer
+{
+public:
+    TlsServer(bool tickets)
+    {
+        mbedtls_x509_crt_init(&m_crt);
+        mbedtls_pk_init(&m_key);
+        mbedtls_entropy_init(&m_entropy);
+        mbedtls_ctr_drbg_init(&m_ctr_drbg);
+        mbedtls_ssl_config_init(&m_conf);
+        mbedtls_ssl_cache_init(&m_cache);
+        mbedtls_ssl_ticket_init(&m_ticket);
+        mbedtls_net_init(&m_listen);
+
+        REQUIRE(mbedtls_x509_crt_parse(&m_crt, (const unsigned char *)mbedtls_test_srv_crt, mbedtls_test_srv_crt_len) == 0);
+        REQUIRE(mbedtls_pk_parse_key(&m_key, (const unsigned char *)mbedtls_test_srv_key, mbedtls_test_srv_key_len, NULL, 0) == 0);
+        REQUIRE(mbedtls_ctr_drbg_seed(&m_ctr_drbg, mbedtls_entropy_func, &m_entropy, NULL, 0) == 0);
+        REQUIRE(mbedtls_ssl_config_defaults(&m_conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                            MBEDTLS_SSL_PRESET_DEFAULT) == 0);
+        mbedtls_ssl_conf_rng(&m_conf, mbedtls_ctr_drbg_random, &m_ctr_drbg);
+        REQUIRE(mbedtls_ssl_conf_own_cert(&m_conf, &m_crt, &m_key) == 0);
+        mbedtls_ssl_conf_session_cache(&m_conf, &m_cache, counting_cache_get, mbedtls_ssl_cache_set);
+        if (tickets) {
+            REQUIRE(mbedtls_ssl_ticket_setup(&m_ticket, mbedtls_ctr_drbg_random, &m_ctr_drbg,
+                                             MBEDTLS_CIPHER_AES_256_GCM, 86400) == 0);
+            mbedtls_ssl_conf_session_tickets_cb(&m_conf, mbedtls_ssl_ticket_write, counting_ticket_parse, &m_ticket);
+        }
+
+        // the same address which esp_tls_conn_new() resolves for the host name
+        REQUIRE(mbedtls_net_bind(&m_listen, HOST, "0", MBEDTLS_NET_PROTO_TCP) == 0);
+        struct sockaddr_storage addr;
+        socklen_t addr_len = sizeof(addr);
+        REQUIRE(getsockname(m_listen.fd, (struct sockaddr *)&addr, &addr_len) == 0);
+        if (addr.ss_family == AF_INET6) {
+            m_port = ntohs(((struct sockaddr_in6 *)&addr)->sin6_port);
+        } else {
+            m_port = ntohs(((struct sockaddr_in *)&addr)->sin_port);
+        }
+        s_resumed = 0;
+        m_thread = std::thread(&TlsServer::run, this);
+    }
+
+    ~TlsServer()
+    {
+        // wakes up accept()
+        shutdown(m_listen.fd, SHUT_RDWR);
+        m_thread.join();
+        mbedtls_net_free(&m_listen);
+        mbedtls_ssl_ticket_free(&m_ticket);
+        mbedtls_ssl_cache_free(&m_cache);
+        mbedtls_ssl_config_free(&m_conf);
+        mbedtls_ctr_drbg_free(&m_ctr_drbg);
+        mbedtls_entropy_free(&m_entropy);
+        mbedtls_pk_free(&m_key);
+        mbedtls_x509_crt_free(&m_crt);
+    }
+
+    int port() const
+    {
+        return m_port;
+    }
+
+private:
+    void run()
+    {
+        while (true) {
+            mbedtls_net_context client;
+            mbedtls_net_init(&client);
+            if (mbedtls_net_accept(&m_listen, &client, NULL, 0, NULL) != 0) {
+                break;
+            }
+            mbedtls_ssl_context ssl;
+            mbedtls_ssl_init(&ssl);
+            if (mbedtls_ssl_setup(&ssl, &m_conf) == 0) {
+                mbedtls_ssl_set_bio(&ssl, &client, mbedtls_net_send, mbedtls_net_recv, NULL);
+                if (mbedtls_ssl_handshake(&ssl) == 0) {
+                    unsigned char buf[16];
+                    int len = mbedtls_ssl_read(&ssl, buf, sizeof(buf));
+                    if (len > 0) {
+                        mbedtls_ssl_write(&ssl, buf, len);
+                    }
+                    mbedtls_ssl_close_notify(&ssl);
+                }
+            }
+            mbedtls_ssl_free(&ssl);
+            mbedtls_net_free(&client);
+        }
+    }
+
+    mbedtls_x509_crt m_crt;
+    mbedtls_pk_context m_key;
+    mbedtls_entropy_context m_entropy;
+    mbedtls_ctr_drbg_context m_ctr_drbg;
+    mbedtls_ssl_config m_conf;
+    mbedtls_ssl_cache_context m_cache;
+    mbedtls_ssl_ticket_context m_ticket;
+    mbedtls_net_context m_listen;
+    int m_port;
+    std::thread m_thread;
+};
+
+static esp_tls_cfg_t make_cfg(bool session_cache, bool cert_cache)
+{
+    esp_tls_cfg_t cfg = {};
+    cfg.cacert_pem_buf = (const unsigned char *)mbedtls_test_cas_pem;
+    cfg.cacert_pem_bytes = mbedtls_test_cas_pem_len;
+    cfg.use_session_cache = session_cache;
+    cfg.use_cert_cache = cert_cache;
+    return cfg;
+}
+
+// Opens connection and exchanges a message, so that the server has completed the handshake.
+// The server handles one connection at a time and closes it after that.
+static esp_tls_t *open_conn(const TlsServer &server, const esp_tls_cfg_t &cfg)
+{
+    esp_tls_t *tls = esp_tls_conn_new(HOST, strlen(HOST), server.port(), &cfg);
+    REQUIRE(tls != NULL);
+    REQUIRE(esp_tls_conn_write(tls, "ping", 4) == 4);
+    char buf[4];
+    REQUIRE(esp_tls_conn_read(tls, buf, sizeof(buf)) == 4);
+    return tls;
+}
+
+static void connect_once(const TlsServer &server, const esp_tls_cfg_t &cfg)
+{
+    esp_tls_conn_delete(open_conn(server, cfg));
+}
+
+TEST_CASE("session is resumed with session ticket", "[esp_tls]")
+{
+    esp_tls_cache_clear();
+    TlsServer server(true);
+    esp_tls_cfg_t cfg = make_cfg(true, false);
+
+    for (int i = 0; i < 3; i++) {
+        connect_once(server, cfg);
+    }
+    CHECK(s_resumed.load() == 2);
+}
+
+TEST_CASE("session is resumed with session ID", "[esp_tls]")
+{
+    esp_tls_cache_clear();
+    TlsServer server(false);
+    esp_tls_cfg_t cfg = make_cfg(true, true);
+
+    for (int i = 0; i < 3; i++) {
+        connect_once(server, cfg);
+    }
+    CHECK(s_resumed.load() == 2);
+}
+
+TEST_CASE("session is not resumed unless enabled or with different settings", "[esp_tls]")
+{
+    esp_tls_cache_clear();
+    TlsServer server(true);
+    esp_tls_cfg_t cfg = make_cfg(false, false);
+
+    connect_once(server, cfg);
+    connect_once(server, cfg);
+    CHECK(s_resumed.load() == 0);
+
+    cfg.use_session_cache = true;
+    connect_once(server, cfg);
+    const char *alpn[] = { "http/1.1", NULL };
+    esp_tls_cfg_t alpn_cfg = cfg;
+    alpn_cfg.alpn_protos = alpn;
+    connect_once(server, alpn_cfg);
+    CHECK(s_resumed.load() == 0);
+
+    esp_tls_cache_clear();
+    connect_once(server, cfg);
+    CHECK(s_resumed.load() == 0);
+    connect_once(server, cfg);
+    CHECK(s_resumed.load() == 1);
+}
+
+TEST_CASE("connections with the same settings share configuration", "[esp_tls]")
+{
+    esp_tls_cache_clear();
+    TlsServer server(true);
+    esp_tls_cfg_t cfg = make_cfg(false, true);
+
+    esp_tls_t *tls1 = open_conn(server, cfg);
+    // the same contents in another buffer
+    std::string ca(mbedtls_test_cas_pem, mbedtls_test_cas_pem_len);
+    esp_tls_cfg_t cfg2 = cfg;
+    cfg2.cacert_pem_buf = (const unsigned char *)ca.data();
+    esp_tls_t *tls2 = open_conn(server, cfg2);
+    CHECK(tls1->shared_conf != NULL);
+    CHECK(tls1->shared_conf == tls2->shared_conf);
+    CHECK(tls1->ssl.conf == tls2->ssl.conf);
+    const esp_tls_shared_conf_t *shared = tls1->shared_conf;
+    esp_tls_conn_delete(tls1);
+    esp_tls_conn_delete(tls2);
+
+    // kept in cache when not in use
+    esp_tls_t *tls3 = open_conn(server, cfg);
+    CHECK(tls3->shared_conf == shared);
+
+    // without CA certificate
+    esp_tls_cfg_t cfg4 = cfg;
+    cfg4.cacert_pem_buf = NULL;
+    cfg4.cacert_pem_bytes = 0;
+    esp_tls_t *tls4 = open_conn(server, cfg4);
+    CHECK(tls4->shared_conf != shared);
+    esp_tls_conn_delete(tls4);
+
+    // configuration in use is not freed
+    esp_tls_cache_clear();
+    esp_tls_t *tls5 = open_conn(server, cfg);
+    CHECK(tls5->shared_conf == shared);
+    esp_tls_conn_delete(tls3);
+    esp_tls_conn_delete(tls5);
+}
+
+TEST_CASE("connection fails with invalid certificate in cache", "[esp_tls]")
+{
+    esp_tls_cache_clear();
+    TlsServer server(true);
+    esp_tls_cfg_t cfg = make_cfg(true, true);
+    const char bad_pem[] = "-----BEGIN CERTIFICATE-----\nAAAA\n-----END CERTIFICATE-----\n";
+    cfg.cacert_pem_buf = (const unsigned char *)bad_pem;
+    cfg.cacert_pem_bytes = sizeof(bad_pem);
+
+    CHECK(esp_tls_conn_new(HOST, strlen(HOST), server.port(), &cfg) == NULL);
+    CHECK(esp_tls_conn_new(HOST, strlen(HOST), server.port(), &cfg) == NULL);
+}
+
+// Drives non-blocking connections from one select() loop until all of them are established or failed,
+// returns the last result of esp_tls_conn_new_async() for each connection
+static vector<int> connect_all(const vector<esp_tls_t *> &conns, const vector<int> &ports,
+                               const esp_tls_cfg_t &cfg, const char *host)
+{
+    vector<int> result(conns.size(), 0);
+    size_t pending = conns.size();
+    while (pending) {
+        fd_set rset, wset;
+        FD_ZERO(&rset);
+        FD_ZERO(&wset);
+        int maxfd = -1;
+        bool resolving = false;
+        for (size_t i = 0; i < conns.size(); i++) {
+            if (result[i] != 0) {
+                continue;
+            }
+            auto start = steady_clock::now();
+            result[i] = esp_tls_conn_new_async(host, strlen(host), ports[i], &cfg, conns[i]);
+            // never waits for network
+            CHECK(steady_clock::now() - start < milliseconds(100));
+            if (result[i] != 0) {
+                pending--;
+                continue;
+            }
+            int fd, events;
+            REQUIRE(esp_tls_get_conn_poll_events(conns[i], &fd, &events) == ESP_OK);
+            if (fd < 0) {
+                resolving = true;
+                continue;
+            }
+            REQUIRE(events != 0);
+            if (events & ESP_TLS_POLL_READ) {
+                FD_SET(fd, &rset);
+            }
+            if (events & ESP_TLS_POLL_WRITE) {
+                FD_SET(fd, &wset);
+            }
+            maxfd = std::max(maxfd, fd);
+        }
+        if (pending) {
+            struct timeval tv = { 0, resolving ? 1000 : 100000 };
+            REQUIRE(select(maxfd + 1, &rset, &wset, NULL, &tv) >= 0);
+        }
+    }
+    return result;
+}
+
+// Exchanges a message over non-blocking connection
+static void ping(esp_tls_t *tls)
+{
+    ssize_t ret;
+    while ((ret = esp_tls_conn_write(tls, "ping", 4)) == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    REQUIRE(ret == 4);
+    char buf[4];
+    while ((ret = esp_tls_conn_read(tls, buf, sizeof(buf))) == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    REQUIRE(ret == 4);
+}
+
+// Listening socket on 127.0.0.1 which never accepts connections
+static int listen_socket(int *port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    REQUIRE(bind(fd, (struct sockaddr *)&addr, addr_len) == 0);
+    REQUIRE(listen(fd, 4) == 0);
+    REQUIRE(getsockname(fd, (struct sockaddr *)&addr, &addr_len) == 0);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static esp_tls_t *new_async_tls()
+{
+    esp_tls_t *tls = (esp_tls_t *)calloc(1, sizeof(esp_tls_t));
+    REQUIRE(tls != NULL);
+    return tls;
+}
+
+TEST_CASE("non-blocking connections are established from one select loop", "[esp_tls][async]")
+{
+    const int count = 4;
+    vector<std::unique_ptr<TlsServer> > servers;
+    vector<esp_tls_t *> conns;
+    vector<int> ports;
+    for (int i = 0; i < count; i++) {
+        servers.emplace_back(new TlsServer(false));
+        ports.push_back(servers.back()->port());
+        conns.push_back(new_async_tls());
+    }
+    esp_tls_cfg_t cfg = make_cfg(false, false);
+    cfg.non_block = true;
+    cfg.timeout_ms = 10000;
+
+    vector<int> result = connect_all(conns, ports, cfg, HOST);
+
+    for (int i = 0; i < count; i++) {
+        CHECK(result[i] == 1);
+        CHECK(conns[i]->conn_state == ESP_TLS_DONE);
+        CHECK(conns[i]->timing.dns_us >= 0);
+        CHECK(conns[i]->timing.tls_setup_us > 0);
+        CHECK(conns[i]->timing.handshake_us > 0);
+        int fd, events;
+        CHECK(esp_tls_get_conn_poll_events(conns[i], &fd, &events) == ESP_ERR_INVALID_STATE);
+        ping(conns[i]);
+        esp_tls_conn_delete(conns[i]);
+    }
+}
+
+TEST_CASE("non-blocking connection times out without blocking", "[esp_tls][async]")
+{
+    int port;
+    int listen_fd = listen_socket(&port);
+    esp_tls_cfg_t cfg = make_cfg(false, false);
+    cfg.non_block = true;
+    cfg.timeout_ms = 200;
+    esp_tls_t *tls = new_async_tls();
+
+    // numeric address is converted at once
+    CHECK(esp_tls_conn_new_async("127.0.0.1", 9, port, &cfg, tls) == 0);
+    int fd, events;
+    REQUIRE(esp_tls_get_conn_poll_events(tls, &fd, &events) == ESP_OK);
+    CHECK(fd >= 0);
+
+    // TCP connection is accepted by the kernel, server never responds to handshake
+    auto start = steady_clock::now();
+    vector<int> result = connect_all({ tls }, { port }, cfg, "127.0.0.1");
+    CHECK(result[0] == -1);
+    CHECK(tls->conn_state == ESP_TLS_FAIL);
+    CHECK(steady_clock::now() - start >= milliseconds(150));
+    esp_tls_conn_delete(tls);
+    close(listen_fd);
+}
+
+TEST_CASE("non-blocking connection to closed port fails", "[esp_tls][async]")
+{
+    int port;
+    close(listen_socket(&port));
+    esp_tls_cfg_t cfg = make_cfg(false, false);
+    cfg.non_block = true;
+    esp_tls_t *tls = new_async_tls();
+
+    vector<int> result = connect_all({ tls }, { port }, cfg, "127.0.0.1");
+    CHECK(result[0] == -1);
+    esp_tls_conn_delete(tls);
+}
+
+TEST_CASE("non-blocking connection waits for host name lookup on a socket", "[esp_tls][async]")
+{
+    TlsServer server(false);
+    esp_tls_cfg_t cfg = make_cfg(false, false);
+    cfg.non_block = true;
+    esp_tls_t *tls = new_async_tls();
+
+    int ret = esp_tls_conn_new_async(HOST, strlen(HOST), server.port(), &cfg, tls);
+    REQUIRE(ret == 0);
+    int fd, events;
+    REQUIRE(esp_tls_get_conn_poll_events(tls, &fd, &events) == ESP_OK);
+    if (tls->conn_state == ESP_TLS_RESOLVING) {
+        REQUIRE(fd >= 0);
+        CHECK(events == ESP_TLS_POLL_READ);
+        fd_set rset;
+        FD_ZERO(&rset);
+        FD_SET(fd, &rset);
+        struct timeval tv = { 5, 0 };
+        CHECK(select(fd + 1, &rset, NULL, NULL, &tv) == 1);
+        // lookup is finished, TCP connection starts
+        CHECK(esp_tls_conn_new_async(HOST, strlen(HOST), server.port(), &cfg, tls) == 0);
+        CHECK(tls->conn_state != ESP_TLS_RESOLVING);
+    }
+
+    CHECK(connect_all({ tls }, { server.port() }, cfg, HOST)[0] == 1);
+    esp_tls_conn_delete(tls);
+}
+
+TEST_CASE("non-blocking connection can be deleted while host name is resolved", "[esp_tls][async]")
+{
+    esp_tls_cfg_t cfg = make_cfg(false, false);
+    cfg.non_block = true;
+
+    for (int i = 0; i < 10; i++) {
+        esp_tls_t *tls = new_async_tls();
+        // usually still resolving, or the lookup has just finished and connection is refused
+        CHECK(esp_tls_conn_new_async(HOST, strlen(HOST), 443, &cfg, tls) != 1);
+        esp_tls_conn_delete(tls);
+    }
+    // lookups finish on their own
+    std::this_thread::sleep_for(milliseconds(100));
+}
+
+TEST_CASE("reconnection time", "[.][benchmark]")
+{
+    const int connections = 50;
+    struct {
+        const char *name;
+        bool session_cache;
+        bool cert_cache;
+    } modes[] = {
+        { "no caches", false, false },
+        { "cert cache", false, true },
+        { "session cache", true, false },
+        { "both", true, true },
+    };
+
+    TlsServer server(true);
+    double base = 0;
+    for (auto &mode : modes) {
+        esp_tls_cache_clear();
+        esp_tls_cfg_t cfg = make_cfg(mode.session_cache, mode.cert_cache);
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < connections; i++) {
+            connect_once(server, cfg);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / connections;
+        if (base == 0) {
+            base = ms;
+        }
+        printf("%-14s %7.3f ms per connection (%.0f%% of full handshake)\n", mode.name, ms, 100 * ms / base);
+    }
+}
+
+TEST_CASE("parallel connection time", "[.][benchmark]")
+{
+    const int count = 8;
+    vector<std::unique_ptr<TlsServer> > servers;
+    vector<int> ports;
+    for (int i = 0; i < count; i++) {
+        servers.emplace_back(new TlsServer(false));
+        ports.push_back(servers.back()->port());
+    }
+
+    // one after another with blocking API
+    esp_tls_cfg_t cfg = make_cfg(false, true);
+    auto start = steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        esp_tls_conn_delete(esp_tls_conn_new(HOST, strlen(HOST), ports[i], &cfg));
+    }
+    double blocking_ms = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+
+    // all at once from one loop
+    vector<esp_tls_t *> conns;
+    for (int i = 0; i < count; i++) {
+        conns.push_back(new_async_tls());
+    }
+    cfg.non_block = true;
+    start = steady_clock::now();
+    connect_all(conns, ports, cfg, HOST);
+    double async_ms = std::chrono::duration<double, std::milli>(steady_clock::now() - start).count();
+
+    printf("%d connections: blocking %.3f ms, non-blocking %.3f ms\n", count, blocking_ms, async_ms);
+    printf("phase times of non-blocking connections, ms:\n%6s %8s %8s %8s %10s\n", "conn", "dns", "tcp", "setup", "handshake");
+    for (int i = 0; i < count; i++) {
+        const esp_tls_conn_timing_t &t = conns[i]->timing;
+        printf("%6d %8.3f %8.3f %8.3f %10.3f\n", i, t.dns_us / 1e3, t.tcp_connect_us / 1e3,
+               t.tls_setup_us / 1e3, t.handshake_us / 1e3);
+        esp_tls_conn_delete(conns[i]);
+    }
+}
@@ -20,6 +20,7 @@
 #include "esp_himem.h"
 #include "soc/soc.h"
 #include "esp_log.h"
+#include "himem_lru.h"
 
 /*
 So, why does the API look this way and is so inflexible to not allow any maps beyond the full 32K chunks? Most of
@@ -96,6 +97,16 @@ typedef struct esp_himem_ramdata_t {
     uint16_t *block;
 } esp_himem_ramdata_t;
 
+//Handle for a cache of mappings of a range of physical memory
+typedef struct esp_himem_cachedata_t {
+    esp_himem_handle_t ram;
+    esp_himem_rangehandle_t range;
+    himem_lru_t lru;
+    himem_lru_run_t *runs;
+    uint32_t bank_writes;
+    uint32_t writebacks;
+} esp_himem_cachedata_t;
+
 static portMUX_TYPE spinlock = portMUX_INITIALIZER_UNLOCKED;
 
 static inline int ramblock_idx_valid(int ramblock_idx)
@@ -330,8 +341,14 @@ esp_err_t esp_himem_map(esp_himem_handle_t handle, esp_himem_rangehandle_t range
         s_range_descriptor[range->block_start + i + range_block].ram_block = handle->block[i + ram_block];
     }
     portEXIT_CRITICAL(&spinlock);
-    for (int i = 0; i < blockcount; i++) {
-        set_bank(VIRT_HIMEM_RANGE_BLOCKSTART + range->block_start + i + range_block, handle->block[i + ram_block] + PHYS_HIMEM_BLOCKSTART, 1);
+    for (int i = 0; i < blockcount; ) {
+        //Consecutive physical blocks are mapped with one MMU write
+        int ct = 1;
+        while (i + ct < blockcount && handle->block[i + ram_block + ct] == handle->block[i + ram_block] + ct) {
+            ct++;
+        }
+        set_bank(VIRT_HIMEM_RANGE_BLOCKSTART + range->block_start + i + range_block, handle->block[i + ram_block] + PHYS_HIMEM_BLOCKSTART, ct);
+        i += ct;
     }
 
     //Set out pointer
@@ -364,3 +381,122 @@ esp_err_t esp_himem_unmap(esp_himem_rangehandle_t range, void *ptr, size_t len)
 }
 
 
+esp_err_t esp_himem_cache_create(esp_himem_handle_t handle, size_t range_size, esp_himem_cache_handle_t *cache_out)
+{
+    HIMEM_CHECK(s_ram_descriptor == NULL, "Himem not available!", ESP_ERR_INVALID_STATE);
+    HIMEM_CHECK(range_size % CACHE_BLOCKSIZE != 0, "requested size not aligned to blocksize", ESP_ERR_INVALID_SIZE);
+    int windows = range_size / CACHE_BLOCKSIZE;
+    esp_err_t err = ESP_ERR_NO_MEM;
+    esp_himem_cachedata_t *c = calloc(sizeof(esp_himem_cachedata_t), 1);
+    if (!c) {
+        return ESP_ERR_NO_MEM;
+    }
+    c->lru.windows = calloc(sizeof(himem_lru_window_t), windows);
+    c->lru.window_of = calloc(sizeof(int16_t), handle->block_ct);
+    c->runs = calloc(sizeof(himem_lru_run_t), windows);
+    if (!c->lru.windows || !c->lru.window_of || !c->runs) {
+        goto fail;
+    }
+    err = esp_himem_alloc_map_range(range_size, &c->range);
+    if (err != ESP_OK) {
+        goto fail;
+    }
+
+    //The cache maps the blocks of the handle from now on, they can't be mapped or freed otherwise
+    portENTER_CRITICAL(&spinlock);
+    for (int i = 0; i < handle->block_ct; i++) {
+        if (s_ram_descriptor[handle->block[i]].is_mapped) {
+            portEXIT_CRITICAL(&spinlock);
+            esp_himem_free_map_range(c->range);
+            ESP_LOGE(TAG, "%s: %s", __FUNCTION__, "ram already mapped");
+            err = ESP_ERR_INVALID_STATE;
+            goto fail;
+        }
+    }
+    for (int i = 0; i < handle->block_ct; i++) {
+        s_ram_descriptor[handle->block[i]].is_mapped = 1;
+    }
+    portEXIT_CRITICAL(&spinlock);
+
+    c->ram = handle;
+    c->lru.phys = handle->block;
+    c->lru.window_ct = windows;
+    c->lru.block_ct = handle->block_ct;
+    himem_lru_init(&c->lru);
+    *cache_out = c;
+    return ESP_OK;
+fail:
+    free(c->lru.windows);
+    free(c->lru.window_of);
+    free(c->runs);
+    free(c);
+    return err;
+}
+
+esp_err_t esp_himem_cache_delete(esp_himem_cache_handle_t cache)
+{
+    //Data written through the windows has to reach the physical blocks before they are used otherwise
+    portENTER_CRITICAL(&spinlock);
+    esp_spiram_writeback_cache();
+    for (int i = 0; i < cache->ram->block_ct; i++) {
+        s_ram_descriptor[cache->ram->block[i]].is_mapped = 0;
+    }
+    portEXIT_CRITICAL(&spinlock);
+    esp_himem_free_map_range(cache->range);
+    free(cache->lru.windows);
+    free(cache->lru.window_of);
+    free(cache->runs);
+    free(cache);
+    return ESP_OK;
+}
+
+//Map count blocks from first into windows of the cache
+static void cache_map_blocks(esp_himem_cachedata_t *cache, int first, int count)
+{
+    bool evicted;
+    int run_ct = himem_lru_get(&cache->lru, first, count, cache->runs, &evicted);
+    if (evicted) {
+        //Windows given to other blocks may still have cached data of the blocks they had, one writeback for all
+        portENTER_CRITICAL(&spinlock);
+        esp_spiram_writeback_cache();
+        portEXIT_CRITICAL(&spinlock);
+        cache->writebacks++;
+    }
+    for (int i = 0; i < run_ct; i++) {
+        const himem_lru_run_t *run = &cache->runs[i];
+        set_bank(VIRT_HIMEM_RANGE_BLOCKSTART + cache->range->block_start + run->window, run->bank + PHYS_HIMEM_BLOCKSTART, run->count);
+    }
+    cache->bank_writes += run_ct;
+}
+
+esp_err_t esp_himem_cache_get(esp_himem_cache_handle_t cache, size_t ram_offset, void **out_ptr)
+{
+    int block = ram_offset / CACHE_BLOCKSIZE;
+    HIMEM_CHECK(block >= cache->lru.block_ct, "offset not in range of phys ram handle", ESP_ERR_INVALID_SIZE);
+    cache_map_blocks(cache, block, 1);
+    int window = cache->lru.window_of[block];
+    *out_ptr = (void *)(VIRT_HIMEM_RANGE_START + (cache->range->block_start + window) * CACHE_BLOCKSIZE + ram_offset % CACHE_BLOCKSIZE);
+    return ESP_OK;
+}
+
+esp_err_t esp_himem_cache_prefetch(esp_himem_cache_handle_t cache, size_t ram_offset, size_t len)
+{
+    if (len == 0) {
+        return ESP_OK;
+    }
+    int first = ram_offset / CACHE_BLOCKSIZE;
+    int count = (ram_offset + len - 1) / CACHE_BLOCKSIZE - first + 1;
+    HIMEM_CHECK(first + count > cache->lru.block_ct, "args not in range of phys ram handle", ESP_ERR_INVALID_SIZE);
+    HIMEM_CHECK(count > cache->lru.window_ct, "more blocks than windows in cache", ESP_ERR_INVALID_SIZE);
+    cache_map_blocks(cache, first, count);
+    return ESP_OK;
+}
+
+esp_err_t esp_himem_cache_get_stats(esp_himem_cache_handle_t cache, esp_himem_cache_stats_t *stats)
+{
+    stats->hits = cache->lru.hits;
+    stats->misses = cache->lru.misses;
+    stats->bank_writes = cache->bank_writes;
+    stats->writebacks = cache->writebacks;
+    return ESP_OK;
+}
@@ -0,0 +1,103 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <assert.h>
+#include <stddef.h>
+#include "himem_lru.h"
+
+static void unlink_window(himem_lru_t *lru, int w)
+{
+    himem_lru_window_t *win = &lru->windows[w];
+    if (win->prev >= 0) {
+        lru->windows[win->prev].next = win->next;
+    } else {
+        lru->mru = win->next;
+    }
+    if (win->next >= 0) {
+        lru->windows[win->next].prev = win->prev;
+    } else {
+        lru->lru = win->prev;
+    }
+}
+
+static void push_mru(himem_lru_t *lru, int w)
+{
+    himem_lru_window_t *win = &lru->windows[w];
+    win->prev = -1;
+    win->next = lru->mru;
+    if (lru->mru >= 0) {
+        lru->windows[lru->mru].prev = w;
+    } else {
+        lru->lru = w;
+    }
+    lru->mru = w;
+}
+
+void himem_lru_init(himem_lru_t *lru)
+{
+    lru->mru = -1;
+    lru->lru = -1;
+    //Window 0 ends up the least recently used one, so the first blocks mapped get consecutive windows
+    for (int w = 0; w < lru->window_ct; w++) {
+        lru->windows[w].block = -1;
+        push_mru(lru, w);
+    }
+    for (int b = 0; b < lru->block_ct; b++) {
+        lru->window_of[b] = -1;
+    }
+    lru->hits = 0;
+    lru->misses = 0;
+}
+
+int himem_lru_get(himem_lru_t *lru, int first, int count, himem_lru_run_t *runs, bool *evicted)
+{
+    int run_ct = 0;
+    assert(count <= lru->window_ct);
+    assert(first >= 0 && first + count <= lru->block_ct);
+
+    *evicted = false;
+    for (int b = first; b < first + count; b++) {
+        int w = lru->window_of[b];
+        if (w >= 0) {
+            lru->hits++;
+            unlink_window(lru, w);
+            push_mru(lru, w);
+            continue;
+        }
+
+        //Blocks mapped just before are the most recently used now, they are never taken here
+        lru->misses++;
+        w = lru->lru;
+        int old = lru->windows[w].block;
+        if (old >= 0) {
+            lru->window_of[old] = -1;
+            *evicted = true;
+        }
+        lru->windows[w].block = b;
+        lru->window_of[b] = w;
+        unlink_window(lru, w);
+        push_mru(lru, w);
+
+        himem_lru_run_t *run = (run_ct > 0) ? &runs[run_ct - 1] : NULL;
+        if (run != NULL && run->window + run->count == w && run->bank + run->count == lru->phys[b]) {
+            run->count++;
+        } else {
+            run = &runs[run_ct++];
+            run->window = w;
+            run->bank = lru->phys[b];
+            run->count = 1;
+        }
+    }
+    return run_ct;
+}
@@ -0,0 +1,67 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Assignment of the blocks of a himem allocation to the windows of a himem cache. Windows are kept in a list from the
+most to the least recently used one, a block which isn't mapped yet takes the least recently used window.
+
+Only the policy is here, the caller writes the banks. Blocks mapped together are given consecutive windows when
+possible, so consecutive physical banks can be mapped with one MMU write.
+*/
+
+//A window of the cache
+typedef struct {
+    int16_t block;      //Block mapped in the window, -1 if none
+    int16_t prev;       //More recently used window, -1 for the most recently used one
+    int16_t next;       //Less recently used window, -1 for the least recently used one
+} himem_lru_window_t;
+
+typedef struct {
+    himem_lru_window_t *windows;
+    int16_t *window_of;         //Window each block is mapped in, -1 if it isn't
+    const uint16_t *phys;       //Physical bank of each block
+    int window_ct;
+    int block_ct;
+    int mru;
+    int lru;
+    uint32_t hits;
+    uint32_t misses;
+} himem_lru_t;
+
+//Bank write mapping count consecutive physical banks into consecutive windows
+typedef struct {
+    int window;
+    int bank;
+    int count;
+} himem_lru_run_t;
+
+//Makes all windows empty. windows, window_of, phys, window_ct and block_ct are set by the caller.
+void himem_lru_init(himem_lru_t *lru);
+
+//Maps blocks first to first + count - 1 and makes them the most recently used ones, count is at most window_ct.
+//Returns the number of bank writes needed, stored in runs (at most count of them). *evicted is set to true if a
+//window had to be taken from a different block.
+int himem_lru_get(himem_lru_t *lru, int first, int count, himem_lru_run_t *runs, bool *evicted);
+
+#ifdef __cplusplus
+}
+#endif
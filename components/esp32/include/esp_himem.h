@@ -14,6 +14,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 #include "esp_err.h"
 
 #ifdef __cplusplus
@@ -23,6 +24,7 @@ extern "C" {
 //Opaque pointers as handles for ram/range data
 typedef struct esp_himem_ramdata_t *esp_himem_handle_t;
 typedef struct esp_himem_rangedata_t *esp_himem_rangehandle_t;
+typedef struct esp_himem_cachedata_t *esp_himem_cache_handle_t;
 
 //ESP32 MMU block size
 #define ESP_HIMEM_BLKSZ (0x8000)
@@ -145,6 +147,88 @@ size_t esp_himem_get_free_size();
  */
 size_t esp_himem_reserved_area_size();
 
+/**
+ * @brief Statistics of a himem cache
+ */
+typedef struct {
+    uint32_t hits;          /*!< Blocks accessed which were mapped already */
+    uint32_t misses;        /*!< Blocks accessed which had to be mapped */
+    uint32_t bank_writes;   /*!< MMU writes, one maps consecutive physical blocks into consecutive windows */
+    uint32_t writebacks;    /*!< Cache writebacks done before windows were given to different blocks */
+} esp_himem_cache_stats_t;
+
+/**
+ * @brief Create a cache of mappings of a block of high memory
+ *
+ * The cache maps the 32K blocks of physical memory into the windows of a range of address space as they are
+ * accessed. When all windows are in use, the block least recently accessed through the cache is unmapped. Mappings
+ * are only changed when a window is needed for a different block, and blocks mapped together with
+ * esp_himem_cache_prefetch() share MMU writes and the cache writeback.
+ *
+ * From this call until esp_himem_cache_delete(), blocks of the handle can only be accessed through the cache.
+ * The cache is not thread-safe: tasks sharing one need to serialize their calls.
+ *
+ * @param handle Handle to the block of memory, as given by esp_himem_alloc. None of it may be mapped.
+ * @param range_size Size of the address range used for the windows of the cache. Note this needs to be a
+ *                   multiple of the external RAM mmu block size (32K).
+ * @param[out] cache_out Handle to be returned
+ * @returns - ESP_OK if succesful
+ *          - ESP_ERR_NO_MEM if out of memory or address space
+ *          - ESP_ERR_INVALID_SIZE if range_size is not a multiple of 32K
+ *          - ESP_ERR_INVALID_STATE if a block of the handle is mapped
+ */
+esp_err_t esp_himem_cache_create(esp_himem_handle_t handle, size_t range_size, esp_himem_cache_handle_t *cache_out);
+
+/**
+ * @brief Get a pointer to high memory through a cache
+ *
+ * The block containing ram_offset is mapped if it isn't yet. The pointer may be used up to the end of that
+ * 32K block, and stays valid until the cache has mapped other blocks into all of its windows: at least while
+ * fewer than range_size / 32K other blocks are accessed through the cache.
+ *
+ * @param cache Handle of the cache, as given by esp_himem_cache_create
+ * @param ram_offset Offset into the block of physical memory
+ * @param[out] out_ptr Pointer to variable to store the pointer to ram_offset in
+ * @returns - ESP_OK if succesful
+ *          - ESP_ERR_INVALID_SIZE if ram_offset isn't in the memory of the cache
+ */
+esp_err_t esp_himem_cache_get(esp_himem_cache_handle_t cache, size_t ram_offset, void **out_ptr);
+
+/**
+ * @brief Map several blocks of high memory into a cache at once
+ *
+ * Mapping the blocks which are going to be accessed next together takes fewer MMU writes and cache
+ * writebacks than mapping them one by one in esp_himem_cache_get().
+ *
+ * @param cache Handle of the cache, as given by esp_himem_cache_create
+ * @param ram_offset Offset into the block of physical memory
+ * @param len Length of the region to map, the blocks it touches need to fit in the cache
+ * @returns - ESP_OK if succesful
+ *          - ESP_ERR_INVALID_SIZE if the region isn't in the memory of the cache or has more blocks than
+ *                                 the cache has windows
+ */
+esp_err_t esp_himem_cache_prefetch(esp_himem_cache_handle_t cache, size_t ram_offset, size_t len);
+
+/**
+ * @brief Get hit rate and mapping statistics of a cache
+ *
+ * @param cache Handle of the cache, as given by esp_himem_cache_create
+ * @param[out] stats Statistics since the cache was created
+ * @returns - ESP_OK
+ */
+esp_err_t esp_himem_cache_get_stats(esp_himem_cache_handle_t cache, esp_himem_cache_stats_t *stats);
+
+/**
+ * @brief Delete a cache
+ *
+ * The blocks of memory are unmapped and can be mapped with esp_himem_map() or freed again. Pointers given by
+ * esp_himem_cache_get() may not be used anymore.
+ *
+ * @param cache Handle of the cache, as given by esp_himem_cache_create
+ * @returns - ESP_OK
+ */
+esp_err_t esp_himem_cache_delete(esp_himem_cache_handle_t cache);
+
 
 #ifdef __cplusplus
 }
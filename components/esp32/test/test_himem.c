@@ -100,5 +100,46 @@ TEST_CASE("high psram memory test", "[himem]")
     vTaskDelay(100);
 }
 
+TEST_CASE("high psram memory through cache", "[himem]")
+{
+    const int size = 1024 * 1024;
+    const int blocks = size / ESP_HIMEM_BLKSZ;
+    esp_himem_handle_t mh;
+    esp_himem_cache_handle_t cache;
+    esp_himem_cache_stats_t stats;
+    void *ptr;
+
+    ESP_ERROR_CHECK(esp_himem_alloc(size, &mh));
+    ESP_ERROR_CHECK(esp_himem_cache_create(mh, ESP_HIMEM_BLKSZ * 4, &cache));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_himem_free(mh));
+
+    //Blocks are filled in batches of 4, each one mapped with the same writes
+    for (int i = 0; i < size; i += ESP_HIMEM_BLKSZ) {
+        if (i % (ESP_HIMEM_BLKSZ * 4) == 0) {
+            ESP_ERROR_CHECK(esp_himem_cache_prefetch(cache, i, ESP_HIMEM_BLKSZ * 4));
+        }
+        ESP_ERROR_CHECK(esp_himem_cache_get(cache, i, &ptr));
+        fill_mem_seed(i, ptr, ESP_HIMEM_BLKSZ);
+    }
+    ESP_ERROR_CHECK(esp_himem_cache_get_stats(cache, &stats));
+    TEST_ASSERT_EQUAL(blocks, stats.hits);
+    TEST_ASSERT_EQUAL(blocks, stats.misses);
+    TEST_ASSERT(stats.bank_writes <= blocks / 4);
+
+    //Going back over the last blocks only hits
+    for (int i = size - ESP_HIMEM_BLKSZ * 4; i < size; i += ESP_HIMEM_BLKSZ) {
+        ESP_ERROR_CHECK(esp_himem_cache_get(cache, i + 100, &ptr));
+        TEST_ASSERT(check_mem_seed(i, (uint8_t *)ptr - 100, ESP_HIMEM_BLKSZ));
+    }
+    ESP_ERROR_CHECK(esp_himem_cache_get_stats(cache, &stats));
+    TEST_ASSERT_EQUAL(blocks + 4, stats.hits);
+
+    for (int i = 0; i < size; i += ESP_HIMEM_BLKSZ) {
+        ESP_ERROR_CHECK(esp_himem_cache_get(cache, i, &ptr));
+        TEST_ASSERT(check_mem_seed(i, ptr, ESP_HIMEM_BLKSZ));
+    }
+    ESP_ERROR_CHECK(esp_himem_cache_delete(cache));
+    ESP_ERROR_CHECK(esp_himem_free(mh));
+}
 
 #endif
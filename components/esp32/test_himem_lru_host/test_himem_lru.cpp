@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <algorithm>
+#include <functional>
+#include <list>
+#include <random>
+#include <vector>
+#include "catch.hpp"
+#include "himem_lru.h"
+
+/* Cache policy writing banks to a simulated MMU, like esp_himem_cache does to the real one */
+class SimCache {
+public:
+    SimCache(int window_ct, const std::vector<uint16_t> &phys)
+        : bank_writes(0), writebacks(0), mmu(window_ct, -1), windows(window_ct), window_of(phys.size()),
+          phys(phys), runs(window_ct)
+    {
+        lru.windows = windows.data();
+        lru.window_of = window_of.data();
+        lru.phys = this->phys.data();
+        lru.window_ct = window_ct;
+        lru.block_ct = phys.size();
+        himem_lru_init(&lru);
+    }
+
+    int get(int first, int count)
+    {
+        bool evicted;
+        int run_ct = himem_lru_get(&lru, first, count, runs.data(), &evicted);
+        for (int i = 0; i < run_ct; i++) {
+            for (int j = 0; j < runs[i].count; j++) {
+                mmu[runs[i].window + j] = runs[i].bank + j;
+            }
+        }
+        bank_writes += run_ct;
+        writebacks += evicted;
+        return run_ct;
+    }
+
+    /* Blocks in the windows, from the most to the least recently used one */
+    std::vector<int> blocks()
+    {
+        std::vector<int> r;
+        int prev = -1;
+        for (int w = lru.mru; w >= 0; w = windows[w].next) {
+            REQUIRE( windows[w].prev == prev );
+            if (windows[w].block >= 0) {
+                int b = windows[w].block;
+                REQUIRE( window_of[b] == w );
+                REQUIRE( mmu[w] == phys[b] );
+                r.push_back(b);
+            }
+            prev = w;
+        }
+        REQUIRE( lru.lru == prev );
+        int mapped = 0;
+        for (size_t b = 0; b < window_of.size(); b++) {
+            mapped += (window_of[b] >= 0);
+        }
+        REQUIRE( mapped == (int)r.size() );
+        return r;
+    }
+
+    himem_lru_t lru;
+    uint32_t bank_writes;
+    uint32_t writebacks;
+    std::vector<int> mmu;   /* Bank mapped in each window */
+
+private:
+    std::vector<himem_lru_window_t> windows;
+    std::vector<int16_t> window_of;
+    std::vector<uint16_t> phys;
+    std::vector<himem_lru_run_t> runs;
+};
+
+static std::vector<uint16_t> consecutive_banks(int count, int first_bank = 0)
+{
+    std::vector<uint16_t> phys(count);
+    for (int i = 0; i < count; i++) {
+        phys[i] = first_bank + i;
+    }
+    return phys;
+}
+
+TEST_CASE("blocks are mapped in the least recently used windows", "[himem_lru]")
+{
+    const int WINDOWS = 8;
+    const int BLOCKS = 40;
+    std::mt19937 gen(1234);
+    /* banks of the allocation are mostly consecutive, with a few gaps */
+    std::vector<uint16_t> phys = consecutive_banks(BLOCKS, 16);
+    for (int i = 10; i < BLOCKS; i++) {
+        phys[i] += 3 + (i >= 25) * 7;
+    }
+    SimCache cache(WINDOWS, phys);
+    std::list<int> model;
+    uint32_t hits = 0, misses = 0;
+
+    for (int i = 0; i < 5000; i++) {
+        int count = std::uniform_int_distribution<int>(1, 4)(gen);
+        int first = std::uniform_int_distribution<int>(0, BLOCKS - count)(gen);
+        cache.get(first, count);
+
+        for (int b = first; b < first + count; b++) {
+            auto it = std::find(model.begin(), model.end(), b);
+            if (it != model.end()) {
+                hits++;
+                model.erase(it);
+            } else {
+                misses++;
+                if (model.size() == WINDOWS) {
+                    model.pop_back();
+                }
+            }
+            model.push_front(b);
+        }
+
+        std::vector<int> blocks = cache.blocks();
+        REQUIRE( std::vector<int>(model.begin(), model.end()) == blocks );
+        REQUIRE( cache.lru.hits == hits );
+        REQUIRE( cache.lru.misses == misses );
+    }
+}
+
+TEST_CASE("consecutive banks are mapped with one write", "[himem_lru]")
+{
+    SimCache cache(8, consecutive_banks(32));
+
+    REQUIRE( cache.get(0, 8) == 1 );
+    REQUIRE( cache.writebacks == 0 );
+    REQUIRE( cache.mmu == std::vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7 }) );
+
+    /* mapped blocks only need to be made recently used */
+    REQUIRE( cache.get(2, 3) == 0 );
+
+    /* windows of blocks 0, 1, 5, 6 are the least recently used ones now */
+    REQUIRE( cache.get(10, 2) == 1 );
+    REQUIRE( cache.get(12, 2) == 1 );
+    REQUIRE( cache.writebacks == 2 );
+    REQUIRE( cache.mmu == std::vector<int>({ 10, 11, 2, 3, 4, 12, 13, 7 }) );
+    REQUIRE( cache.lru.hits == 3 );
+    REQUIRE( cache.lru.misses == 12 );
+}
+
+TEST_CASE("banks which aren't consecutive are written separately", "[himem_lru]")
+{
+    std::vector<uint16_t> phys = consecutive_banks(8);
+    phys[2] = 20;
+    SimCache cache(4, phys);
+
+    REQUIRE( cache.get(0, 4) == 3 );
+    REQUIRE( cache.mmu == std::vector<int>({ 0, 1, 20, 3 }) );
+    cache.blocks();
+}
+
+/* Hit rate and MMU work of access patterns over 64 blocks with 8 windows. Mapping
+   blocks with esp_himem_map() and esp_himem_unmap() takes a bank write and a cache
+   writeback for every access. */
+TEST_CASE("hit rates of access patterns", "[.][benchmark]")
+{
+    const int WINDOWS = 8;
+    const int BLOCKS = 64;
+    const int ACCESSES = 100000;
+    std::mt19937 gen(42);
+    int walk = 0;
+    int scan = 0;
+
+    struct pattern {
+        const char *name;
+        std::function<int()> next;
+        int prefetch;   /* blocks mapped together ahead of the accesses */
+    };
+    std::vector<pattern> patterns = {
+        { "scan of 8 blocks", [&] { return scan++ % 8; }, 0 },
+        { "scan of 64 blocks", [&] { return scan++ % BLOCKS; }, 0 },
+        { "scan of 64 blocks, prefetch 8", [&] { return scan++ % BLOCKS; }, 8 },
+        { "random blocks", [&] { return std::uniform_int_distribution<int>(0, BLOCKS - 1)(gen); }, 0 },
+        { "random walk", [&] { walk = (walk + std::uniform_int_distribution<int>(-2, 2)(gen) + BLOCKS) % BLOCKS; return walk; }, 0 },
+        { "80% in 6 hot blocks", [&] {
+                return std::uniform_int_distribution<int>(0, 9)(gen) < 8 ? std::uniform_int_distribution<int>(0, 5)(gen)
+                    : std::uniform_int_distribution<int>(6, BLOCKS - 1)(gen);
+            }, 0
+        },
+    };
+
+    for (pattern &p : patterns) {
+        SimCache cache(WINDOWS, consecutive_banks(BLOCKS));
+        scan = 0;
+        for (int i = 0; i < ACCESSES; i++) {
+            int block = p.next();
+            if (p.prefetch && block % p.prefetch == 0) {
+                cache.get(block, std::min(p.prefetch, BLOCKS - block));
+            }
+            cache.get(block, 1);
+        }
+        printf("%-30s %5.1f%% hits, %.3f bank writes and %.3f writebacks per access\n", p.name,
+               100.0 * cache.lru.hits / ACCESSES, (double)cache.bank_writes / ACCESSES, (double)cache.writebacks / ACCESSES);
+    }
+}
@@ -61,6 +61,12 @@ struct httpd_ssl_config {
 
     /** Port used when transport mode is insecure (default 80) */
     uint16_t port_insecure;
+
+    /**
+     * Maximum TLS record fragment length: 512, 1024, 2048 or 4096 bytes, 0 for 16 kB (default).
+     * Server doesn't send larger records, so CONFIG_MBEDTLS_SSL_OUT_CONTENT_LEN can be reduced.
+     */
+    uint16_t max_fragment_len;
 };
 
 typedef struct httpd_ssl_config httpd_ssl_config_t;
@@ -104,6 +110,7 @@ typedef struct httpd_ssl_config httpd_ssl_config_t;
     .transport_mode = HTTPD_SSL_TRANSPORT_SECURE, \
     .port_secure = 443,                           \
     .port_insecure = 80,                          \
+    .max_fragment_len = 0,                        \
 }
 
 /**
@@ -146,6 +146,25 @@ static void free_secure_context(void *ctx)
     SSL_CTX_free(ctx);
 }
 
+/**
+ * Convert maximum fragment length in bytes to TLS extension mode, 0 if the length is not supported
+ */
+static uint8_t max_fragment_len_mode(uint16_t len)
+{
+    switch (len) {
+        case 512:
+            return TLSEXT_max_fragment_length_512;
+        case 1024:
+            return TLSEXT_max_fragment_length_1024;
+        case 2048:
+            return TLSEXT_max_fragment_length_2048;
+        case 4096:
+            return TLSEXT_max_fragment_length_4096;
+        default:
+            return TLSEXT_max_fragment_length_DISABLED;
+    }
+}
+
 /**
 * Create and perform basic init of a SSL_CTX, or return NULL on failure
 *
@@ -160,8 +179,12 @@ static SSL_CTX *create_secure_context(const struct httpd_ssl_config *config)
     if (NULL != ctx) {
         //region SSL ctx alloc'd
         ESP_LOGD(TAG, "SSL ctx set own cert");
+        // certificate and key are parsed once, sessions refer to them
         if (SSL_CTX_use_certificate_ASN1(ctx, config->cacert_len, config->cacert_pem)
             && SSL_CTX_use_PrivateKey_ASN1(0, ctx, config->prvtkey_pem, (long) config->prvtkey_len)) {
+            if (config->max_fragment_len) {
+                SSL_CTX_set_tlsext_max_fragment_length(ctx, max_fragment_len_mode(config->max_fragment_len));
+            }
             return ctx;
         }
         else {
@@ -184,6 +207,11 @@ esp_err_t httpd_ssl_start(httpd_handle_t *pHandle, struct httpd_ssl_config *conf
     ESP_LOGI(TAG, "Starting server");
 
     if (HTTPD_SSL_TRANSPORT_SECURE == config->transport_mode) {
+        if (config->max_fragment_len && !max_fragment_len_mode(config->max_fragment_len)) {
+            ESP_LOGE(TAG, "Unsupported max_fragment_len %d", config->max_fragment_len);
+            return ESP_ERR_INVALID_ARG;
+        }
+
         SSL_CTX *ctx = create_secure_context(config);
         if (!ctx) {
             return ESP_FAIL;
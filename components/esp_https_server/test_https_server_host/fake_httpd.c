@@ -0,0 +1,180 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <unistd.h>
+#include "fake_httpd.h"
+
+#define FAKE_HTTPD_MAX_SOCKETS  1024
+
+typedef struct {
+    bool open;
+    void *transport_ctx;
+    httpd_free_ctx_fn_t free_fn;
+    httpd_send_func_t send_fn;
+    httpd_recv_func_t recv_fn;
+    httpd_pending_func_t pending_fn;
+} fake_sess_t;
+
+typedef struct {
+    httpd_config_t config;
+    fake_sess_t sessions[FAKE_HTTPD_MAX_SOCKETS];
+} fake_httpd_t;
+
+static fake_sess_t *get_sess(httpd_handle_t handle, int sockfd)
+{
+    if (handle == NULL || sockfd < 0 || sockfd >= FAKE_HTTPD_MAX_SOCKETS) {
+        return NULL;
+    }
+    return &((fake_httpd_t *) handle)->sessions[sockfd];
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    fake_httpd_t *hd = calloc(1, sizeof(fake_httpd_t));
+    if (hd == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    hd->config = *config;
+    *handle = hd;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    fake_httpd_t *hd = handle;
+    if (hd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (int fd = 0; fd < FAKE_HTTPD_MAX_SOCKETS; fd++) {
+        if (hd->sessions[fd].open) {
+            fake_httpd_close(handle, fd);
+        }
+    }
+    if (hd->config.global_transport_ctx_free_fn) {
+        hd->config.global_transport_ctx_free_fn(hd->config.global_transport_ctx);
+    }
+    free(hd);
+    return ESP_OK;
+}
+
+void *httpd_get_global_transport_ctx(httpd_handle_t handle)
+{
+    return ((fake_httpd_t *) handle)->config.global_transport_ctx;
+}
+
+void *httpd_sess_get_transport_ctx(httpd_handle_t handle, int sockfd)
+{
+    fake_sess_t *sess = get_sess(handle, sockfd);
+    return sess ? sess->transport_ctx : NULL;
+}
+
+void httpd_sess_set_transport_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn)
+{
+    fake_sess_t *sess = get_sess(handle, sockfd);
+    if (sess) {
+        sess->transport_ctx = ctx;
+        sess->free_fn = free_fn;
+    }
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func)
+{
+    fake_sess_t *sess = get_sess(hd, sockfd);
+    if (sess == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sess->send_fn = send_func;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_recv_override(httpd_handle_t hd, int sockfd, httpd_recv_func_t recv_func)
+{
+    fake_sess_t *sess = get_sess(hd, sockfd);
+    if (sess == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sess->recv_fn = recv_func;
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_pending_override(httpd_handle_t hd, int sockfd, httpd_pending_func_t pending_func)
+{
+    fake_sess_t *sess = get_sess(hd, sockfd);
+    if (sess == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sess->pending_fn = pending_func;
+    return ESP_OK;
+}
+
+httpd_ssl_config_t fake_httpd_ssl_config(void)
+{
+    httpd_ssl_config_t config = HTTPD_SSL_CONFIG_DEFAULT();
+    return config;
+}
+
+esp_err_t fake_httpd_open(httpd_handle_t handle, int sockfd)
+{
+    fake_httpd_t *hd = handle;
+    fake_sess_t *sess = get_sess(handle, sockfd);
+    if (sess == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (hd->config.open_fn) {
+        esp_err_t ret = hd->config.open_fn(handle, sockfd);
+        if (ret != ESP_OK) {
+            close(sockfd);
+            return ret;
+        }
+    }
+    sess->open = true;
+    return ESP_OK;
+}
+
+int fake_httpd_recv(httpd_handle_t handle, int sockfd, char *buf, size_t buf_len)
+{
+    fake_sess_t *sess = get_sess(handle, sockfd);
+    if (sess == NULL || !sess->open) {
+        return -1;
+    }
+    if (sess->recv_fn) {
+        return sess->recv_fn(handle, sockfd, buf, buf_len, 0);
+    }
+    return read(sockfd, buf, buf_len);
+}
+
+int fake_httpd_send(httpd_handle_t handle, int sockfd, const char *buf, size_t buf_len)
+{
+    fake_sess_t *sess = get_sess(handle, sockfd);
+    if (sess == NULL || !sess->open) {
+        return -1;
+    }
+    if (sess->send_fn) {
+        return sess->send_fn(handle, sockfd, buf, buf_len, 0);
+    }
+    return write(sockfd, buf, buf_len);
+}
+
+void fake_httpd_close(httpd_handle_t handle, int sockfd)
+{
+    fake_sess_t *sess = get_sess(handle, sockfd);
+    if (sess == NULL || !sess->open) {
+        return;
+    }
+    if (sess->free_fn) {
+        sess->free_fn(sess->transport_ctx);
+    }
+    close(sockfd);
+    memset(sess, 0, sizeof(*sess));
+}
@@ -0,0 +1,42 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+// Replacement of esp_http_server for host tests: the test accepts connections itself
+// and the server only keeps per-socket transport functions set by esp_https_server.
+
+#include "esp_https_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default configuration, the initializer can not be used in C++ */
+httpd_ssl_config_t fake_httpd_ssl_config(void);
+
+/** Calls open function of the server for the accepted socket (performs TLS handshake) */
+esp_err_t fake_httpd_open(httpd_handle_t handle, int sockfd);
+
+/** Receives data via transport functions of the session */
+int fake_httpd_recv(httpd_handle_t handle, int sockfd, char *buf, size_t buf_len);
+
+/** Sends data via transport functions of the session */
+int fake_httpd_send(httpd_handle_t handle, int sockfd, const char *buf, size_t buf_len);
+
+/** Frees transport context of the session and closes the socket */
+void fake_httpd_close(httpd_handle_t handle, int sockfd);
+
+#ifdef __cplusplus
+}
+#endif
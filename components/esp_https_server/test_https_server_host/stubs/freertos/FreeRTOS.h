@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef unsigned int UBaseType_t;
@@ -0,0 +1,3 @@
+#pragma once
+
+#define tskIDLE_PRIORITY    ((UBaseType_t) 0U)
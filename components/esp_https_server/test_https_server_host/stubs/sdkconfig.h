@@ -0,0 +1,6 @@
+#pragma once
+
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN        512
+#define CONFIG_HTTPD_MAX_URI_LEN            512
+#define CONFIG_OPENSSL_ASSERT_EXIT          1
+#define CONFIG_OPENSSL_BUFFER_POOL_SIZE     2
@@ -0,0 +1,257 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <string>
+#include <thread>
+#include "catch.hpp"
+#include "fake_httpd.h"
+
+extern "C" {
+#include "openssl/ssl.h"
+#include "mbedtls/certs.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+}
+
+using std::string;
+
+static string make_data(size_t len, int seed)
+{
+    string data(len, 0);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = 'a' + (i * 7 + seed) % 26;
+    }
+    return data;
+}
+
+// TLS client on mbedTLS, handshake is performed in a separate thread
+// while the server accepts the connection
+class Client
+{
+public:
+    Client(int port, unsigned char mfl_code) : m_max_read(0)
+    {
+        mbedtls_net_init(&m_net);
+        mbedtls_ssl_init(&m_ssl);
+        mbedtls_ssl_config_init(&m_conf);
+        mbedtls_entropy_init(&m_entropy);
+        mbedtls_ctr_drbg_init(&m_ctr_drbg);
+
+        REQUIRE(mbedtls_ctr_drbg_seed(&m_ctr_drbg, mbedtls_entropy_func, &m_entropy, NULL, 0) == 0);
+        REQUIRE(mbedtls_ssl_config_defaults(&m_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                            MBEDTLS_SSL_PRESET_DEFAULT) == 0);
+        mbedtls_ssl_conf_authmode(&m_conf, MBEDTLS_SSL_VERIFY_NONE);
+        mbedtls_ssl_conf_rng(&m_conf, mbedtls_ctr_drbg_random, &m_ctr_drbg);
+        if (mfl_code) {
+            REQUIRE(mbedtls_ssl_conf_max_frag_len(&m_conf, mfl_code) == 0);
+        }
+        REQUIRE(mbedtls_ssl_setup(&m_ssl, &m_conf) == 0);
+
+        REQUIRE(mbedtls_net_connect(&m_net, "127.0.0.1", std::to_string(port).c_str(), MBEDTLS_NET_PROTO_TCP) == 0);
+        mbedtls_ssl_set_bio(&m_ssl, &m_net, mbedtls_net_send, mbedtls_net_recv, NULL);
+        m_handshake = std::thread([this]() {
+            int ret;
+            while ((ret = mbedtls_ssl_handshake(&m_ssl)) == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            }
+            m_handshake_ret = ret;
+        });
+    }
+
+    ~Client()
+    {
+        if (m_handshake.joinable()) {
+            m_handshake.join();
+        }
+        mbedtls_net_free(&m_net);
+        mbedtls_ssl_free(&m_ssl);
+        mbedtls_ssl_config_free(&m_conf);
+        mbedtls_ctr_drbg_free(&m_ctr_drbg);
+        mbedtls_entropy_free(&m_entropy);
+    }
+
+    void wait_handshake()
+    {
+        m_handshake.join();
+        REQUIRE(m_handshake_ret == 0);
+    }
+
+    void send(const string &data)
+    {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            int ret = mbedtls_ssl_write(&m_ssl, (const unsigned char *)data.data() + sent, data.size() - sent);
+            REQUIRE(ret > 0);
+            sent += ret;
+        }
+    }
+
+    string recv(size_t len)
+    {
+        string data(len, 0);
+        size_t received = 0;
+        while (received < len) {
+            int ret = mbedtls_ssl_read(&m_ssl, (unsigned char *)&data[received], len - received);
+            REQUIRE(ret > 0);
+            received += ret;
+            m_max_read = std::max(m_max_read, (size_t)ret);
+        }
+        return data;
+    }
+
+    // The largest amount of data returned by one read, it is not more than one record
+    size_t max_read() const
+    {
+        return m_max_read;
+    }
+
+private:
+    mbedtls_net_context m_net;
+    mbedtls_ssl_context m_ssl;
+    mbedtls_ssl_config m_conf;
+    mbedtls_entropy_context m_entropy;
+    mbedtls_ctr_drbg_context m_ctr_drbg;
+    std::thread m_handshake;
+    int m_handshake_ret;
+    size_t m_max_read;
+};
+
+// HTTPS server on loopback, sockets are accepted by the test and passed to the fake HTTP server
+class Server
+{
+public:
+    explicit Server(uint16_t max_fragment_len = 0) : m_handle(NULL)
+    {
+        m_listen = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(m_listen >= 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        REQUIRE(bind(m_listen, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+        socklen_t addr_len = sizeof(addr);
+        REQUIRE(getsockname(m_listen, (struct sockaddr *)&addr, &addr_len) == 0);
+        m_port = ntohs(addr.sin_port);
+        REQUIRE(listen(m_listen, 64) == 0);
+
+        httpd_ssl_config_t config = fake_httpd_ssl_config();
+        config.cacert_pem = (const uint8_t *)mbedtls_test_srv_crt;
+        config.cacert_len = mbedtls_test_srv_crt_len;
+        config.prvtkey_pem = (const uint8_t *)mbedtls_test_srv_key;
+        config.prvtkey_len = mbedtls_test_srv_key_len;
+        config.max_fragment_len = max_fragment_len;
+        REQUIRE(httpd_ssl_start(&m_handle, &config) == ESP_OK);
+    }
+
+    ~Server()
+    {
+        httpd_ssl_stop(m_handle);
+        close(m_listen);
+    }
+
+    // Connects the client and returns socket of the session on the server side
+    int connect(Client &client)
+    {
+        int fd = accept(m_listen, NULL, NULL);
+        REQUIRE(fd >= 0);
+        {
+                REQUIRE(fake_httpd_open(m_handle, fd) == ESP_OK);
+        }
+        client.wait_handshake();
+        return fd;
+    }
+
+    string recv(int fd, size_t len)
+    {
+        string data(len, 0);
+        size_t received = 0;
+        while (received < len) {
+            int ret = fake_httpd_recv(m_handle, fd, &data[received], len - received);
+            REQUIRE(ret > 0);
+            received += ret;
+        }
+        return data;
+    }
+
+    void send(int fd, const string &data)
+    {
+        REQUIRE(fake_httpd_send(m_handle, fd, data.data(), data.size()) == (int)data.size());
+    }
+
+    void close_session(int fd)
+    {
+        fake_httpd_close(m_handle, fd);
+    }
+
+    int port() const
+    {
+        return m_port;
+    }
+
+private:
+    httpd_handle_t m_handle;
+    int m_listen;
+    int m_port;
+};
+
+// Request and response of the specified sizes
+static void exchange(Server &server, int fd, Client &client, size_t req_len, size_t resp_len)
+{
+    string req = make_data(req_len, fd);
+    client.send(req);
+    CHECK(server.recv(fd, req_len) == req);
+    string resp = make_data(resp_len, fd + 1);
+    server.send(fd, resp);
+    CHECK(client.recv(resp_len) == resp);
+}
+
+TEST_CASE("maximum fragment length limits records", "[https_server]")
+{
+    Server server(512);
+    Client client(server.port(), 0);
+    int fd = server.connect(client);
+
+    exchange(server, fd, client, 100, 5000);
+    CHECK(client.max_read() <= 512);
+    server.close_session(fd);
+}
+
+TEST_CASE("client maximum fragment length is accepted", "[https_server]")
+{
+    Server server(1024);
+    Client client(server.port(), MBEDTLS_SSL_MAX_FRAG_LEN_512);
+    int fd = server.connect(client);
+
+    exchange(server, fd, client, 100, 5000);
+    CHECK(client.max_read() <= 512);
+    server.close_session(fd);
+}
+
+TEST_CASE("unsupported maximum fragment length is rejected", "[https_server]")
+{
+    httpd_handle_t handle = NULL;
+    httpd_ssl_config_t config = fake_httpd_ssl_config();
+    config.cacert_pem = (const uint8_t *)mbedtls_test_srv_crt;
+    config.cacert_len = mbedtls_test_srv_crt_len;
+    config.prvtkey_pem = (const uint8_t *)mbedtls_test_srv_key;
+    config.prvtkey_len = mbedtls_test_srv_key_len;
+    config.max_fragment_len = 1000;
+    CHECK(httpd_ssl_start(&handle, &config) == ESP_ERR_INVALID_ARG);
+    CHECK(handle == NULL);
+}
@@ -22,9 +22,10 @@ import subprocess
 import tempfile
 import struct
 import errno
-import base64
 import binascii
+import hashlib
 import logging
+import multiprocessing
 
 idf_path = os.getenv('IDF_PATH')
 if idf_path:
@@ -459,6 +460,8 @@ class ESPCoreDumpLoader(object):
     """Core dump loader base class
     """
     ESP32_COREDUMP_VESION       = 1
+    ESP32_COREDUMP_COMPRESSED_VERSION = 2
+    ESP32_COREDUMP_LZ_MIN_MATCH = 4
     ESP32_COREDUMP_HDR_FMT      = '<4L'
     ESP32_COREDUMP_HDR_SZ       = struct.calcsize(ESP32_COREDUMP_HDR_FMT)
     ESP32_COREDUMP_TSK_HDR_FMT  = '<3L'
@@ -577,14 +580,56 @@ class ESPCoreDumpLoader(object):
             if self.fcore_name:
                 self.remove_tmp_file(self.fcore_name)
 
+    def lz_decompress(self, data, size):
+        """Decompresses TCB or stack data compressed by the core dump writer, see esp_core_dump_lz_compress().
+           Returns decompressed data and the number of bytes consumed from 'data'
+        """
+        data = bytearray(data)
+        out = bytearray()
+        off = 0
+        try:
+            while len(out) < size:
+                token = data[off]
+                off += 1
+                if token < 0x80:
+                    if off + token + 1 > len(data):
+                        raise IndexError()
+                    out += data[off:off + token + 1]
+                    off += token + 1
+                else:
+                    n = token - 0x80 + self.ESP32_COREDUMP_LZ_MIN_MATCH
+                    dist = data[off] | (data[off + 1] << 8)
+                    off += 2
+                    if dist == 0 or dist > len(out):
+                        raise ESPCoreDumpLoaderError("Invalid match distance %d at offset %d of compressed data!" % (dist, off - 3))
+                    chunk = out[len(out) - dist:]
+                    # source and destination can overlap, chunk is repeated then
+                    out += (chunk * (n // dist + 1))[:n]
+        except IndexError:
+            raise ESPCoreDumpLoaderError("Compressed data are truncated!")
+        if len(out) != size:
+            raise ESPCoreDumpLoaderError("Decompressed data size %d does not match expected size %d!" % (len(out), size))
+        # compressed data are padded to 4 bytes
+        return bytes(out), (off + 3) & ~3
+
+    def read_compressed_data(self, off, size):
+        """Reads and decompresses TCB or stack data. Returns data and the offset of the data which follow them
+        """
+        # read enough data for the worst case, when nothing can be compressed
+        data = self.read_data(off, size + size // 128 + 4)
+        data, consumed = self.lz_decompress(data, size)
+        return data, off + consumed
+
     def create_corefile(self, core_fname=None, off=0, rom_elf=None):
         """Creates core dump ELF file
         """
         core_off = off
         data = self.read_data(core_off, self.ESP32_COREDUMP_HDR_SZ)
         tot_len,coredump_ver,task_num,tcbsz = struct.unpack_from(self.ESP32_COREDUMP_HDR_FMT, data)
-        if coredump_ver > self.ESP32_COREDUMP_VESION:
-            raise ESPCoreDumpLoaderError("Core dump version '%d' is not supported! Should be up to '%d'." % (coredump_ver, self.ESP32_COREDUMP_VESION))
+        if coredump_ver > self.ESP32_COREDUMP_COMPRESSED_VERSION:
+            raise ESPCoreDumpLoaderError("Core dump version '%d' is not supported! Should be up to '%d'." % (coredump_ver,
+                                         self.ESP32_COREDUMP_COMPRESSED_VERSION))
+        compressed = coredump_ver == self.ESP32_COREDUMP_COMPRESSED_VERSION
         tcbsz_aligned = tcbsz
         if tcbsz_aligned % 4:
             tcbsz_aligned = 4 * (old_div(tcbsz_aligned,4) + 1)
@@ -607,26 +652,34 @@ class ESPCoreDumpLoader(object):
 
             core_off += self.ESP32_COREDUMP_TSK_HDR_SZ
             logging.info("Read TCB %d bytes @ 0x%x" % (tcbsz_aligned, tcb_addr))
-            data = self.read_data(core_off, tcbsz_aligned)
+            if compressed:
+                data, next_off = self.read_compressed_data(core_off, tcbsz)
+            else:
+                data = self.read_data(core_off, tcbsz_aligned)
+                next_off = core_off + tcbsz_aligned
             try:
-                if tcbsz != tcbsz_aligned:
-                    core_elf.add_program_segment(tcb_addr, data[:tcbsz - tcbsz_aligned],
+                if len(data) != tcbsz:
+                    core_elf.add_program_segment(tcb_addr, data[:tcbsz],
                                                  ESPCoreDumpElfFile.PT_LOAD, ESPCoreDumpSegment.PF_R | ESPCoreDumpSegment.PF_W)
                 else:
                     core_elf.add_program_segment(tcb_addr, data, ESPCoreDumpElfFile.PT_LOAD, ESPCoreDumpSegment.PF_R | ESPCoreDumpSegment.PF_W)
             except ESPCoreDumpError as e:
                 logging.warning("Skip TCB %d bytes @ 0x%x. (Reason: %s)" % (tcbsz_aligned, tcb_addr, e))
 
-            core_off += tcbsz_aligned
+            core_off = next_off
             logging.info("Read stack %d bytes @ 0x%x" % (stack_len_aligned, stack_base))
-            data = self.read_data(core_off, stack_len_aligned)
-            if stack_len != stack_len_aligned:
-                data = data[:stack_len - stack_len_aligned]
+            if compressed:
+                data, next_off = self.read_compressed_data(core_off, stack_len)
+            else:
+                data = self.read_data(core_off, stack_len_aligned)
+                next_off = core_off + stack_len_aligned
+            if len(data) != stack_len:
+                data = data[:stack_len]
             try:
                 core_elf.add_program_segment(stack_base, data, ESPCoreDumpElfFile.PT_LOAD, ESPCoreDumpSegment.PF_R | ESPCoreDumpSegment.PF_W)
             except ESPCoreDumpError as e:
                 logging.warning("Skip task's (%x) stack %d bytes @ 0x%x. (Reason: %s)" % (tcb_addr, stack_len_aligned, stack_base, e))
-            core_off += stack_len_aligned
+            core_off = next_off
             try:
                 logging.info("Stack start_end: 0x%x @ 0x%x" % (stack_top, stack_end))
                 task_regs = self._get_registers_from_stack(data, stack_end > stack_top)
@@ -672,6 +725,63 @@ class ESPCoreDumpLoader(object):
         return data
 
 
+class ESPCoreDumpB64File(object):
+    """Base64-encoded core dump file, which is decoded while it is read.
+       Only the data from the current read position on are kept in memory, so core dumps of any size can be loaded.
+       Reading data before them starts decoding from the beginning of the file again.
+    """
+    DECODE_SIZE = 64 * 1024  # characters decoded at once, rounded up to whole lines
+
+    def __init__(self, path):
+        self.f = open(path, 'rb')
+        self.rewind()
+
+    def rewind(self):
+        self.f.seek(0)
+        self.buf = b''
+        self.buf_off = 0  # offset of self.buf in decoded data
+        self.pos = 0
+
+    def decode_lines(self):
+        """Decodes the next lines of the file, returns False at the end of the file
+        """
+        text = self.f.read(self.DECODE_SIZE)
+        if not text:
+            return False
+        text += self.f.readline()
+        if b'=' not in text:
+            # a single base64 stream, which is how core dumps are printed to UART
+            self.buf += binascii.a2b_base64(text)
+        else:
+            # lines are padded where the data of each write ended, in core dumps printed by older versions
+            self.buf += b''.join(binascii.a2b_base64(line) for line in text.split())
+        return True
+
+    def seek(self, off):
+        self.pos = off
+
+    def read(self, size):
+        if self.pos < self.buf_off:
+            pos = self.pos
+            self.rewind()
+            self.pos = pos
+        while True:
+            # forget data before the read position
+            if self.pos > self.buf_off:
+                drop = min(self.pos - self.buf_off, len(self.buf))
+                self.buf = self.buf[drop:]
+                self.buf_off += drop
+            if self.buf_off + len(self.buf) >= self.pos + size or not self.decode_lines():
+                break
+        start = self.pos - self.buf_off
+        data = self.buf[start:start + size]
+        self.pos += len(data)
+        return data
+
+    def close(self):
+        self.f.close()
+
+
 class ESPCoreDumpFileLoader(ESPCoreDumpLoader):
     """Core dump file loader class
     """
@@ -686,24 +796,7 @@ class ESPCoreDumpFileLoader(ESPCoreDumpLoader):
         """
         self.fcore_name = None
         if b64:
-            fhnd,self.fcore_name = tempfile.mkstemp()
-            fcore = os.fdopen(fhnd, 'wb')
-            fb64 = open(path, 'rb')
-            try:
-                while True:
-                    line = fb64.readline()
-                    if len(line) == 0:
-                        break
-                    data = base64.standard_b64decode(line.rstrip(b'\r\n'))
-                    fcore.write(data)
-                fcore.close()
-                fcore = open(self.fcore_name, 'rb')
-            except Exception as e:
-                if self.fcore_name:
-                    self.remove_tmp_file(self.fcore_name)
-                    raise e
-            finally:
-                fb64.close()
+            fcore = ESPCoreDumpB64File(path)
         else:
             fcore = open(path, 'rb')
         return fcore
@@ -879,13 +972,40 @@ class GDBMIStreamConsoleHandler(GDBMIOutStreamHandler):
     TAG = '~'
 
 
+class ESPCoreDumpElfCache(object):
+    """Cache of parsed ELF files indexed by SHA-256 of their contents, so that an ELF file
+       which is used for many core dumps is parsed once, and a rebuilt one is parsed again
+    """
+    def __init__(self):
+        """Constructor for ELF files cache
+        """
+        self.elfs = {}
+
+    def get(self, path):
+        """Returns parsed ELF file, the returned object must not be modified
+        """
+        sha = hashlib.sha256()
+        with open(path, 'rb') as f:
+            for chunk in iter(lambda: f.read(0x10000), b''):
+                sha.update(chunk)
+        key = sha.hexdigest()
+        elf = self.elfs.get(key)
+        if elf is None:
+            elf = ESPCoreDumpElfFile(path)
+            self.elfs[key] = elf
+        return elf
+
+
+elf_cache = ESPCoreDumpElfCache()
+
+
 def load_aux_elf(elf_path):
     """ Loads auxilary ELF file and composes GDB command to read its symbols
     """
     elf = None
     sym_cmd = ''
     if os.path.exists(elf_path):
-        elf = ESPCoreDumpElfFile(elf_path)
+        elf = elf_cache.get(elf_path)
         for s in elf.sections:
             if s.name == '.text':
                 sym_cmd = 'add-symbol-file %s 0x%x' % (elf_path, s.addr)
@@ -1006,7 +1126,7 @@ def info_corefile(args):
                 loader.cleanup()
                 return
 
-    exe_elf = ESPCoreDumpElfFile(args.prog)
+    exe_elf = elf_cache.get(args.prog)
     core_elf = ESPCoreDumpElfFile(core_fname)
     merged_segs = []
     core_segs = core_elf.program_segments
@@ -1104,6 +1224,79 @@ def info_corefile(args):
     print('Done!')
 
 
+# arguments of batch_corefile, set in every worker process
+batch_args = None
+
+
+def batch_init(args):
+    global batch_args
+    batch_args = args
+    logging.basicConfig(format='%(levelname)s:%(message)s', level=args.log_level)
+
+
+def batch_process_core(core):
+    """ Creates core ELF file and optionally info report for one core dump in the batch.
+        Returns error message or None
+    """
+    args = batch_args
+    name = os.path.join(args.output_dir, os.path.splitext(os.path.basename(core))[0])
+    loader = None
+    try:
+        # ROM and program ELF files are parsed once per worker process
+        rom_elf,_ = load_aux_elf(args.rom_elf)
+        loader = ESPCoreDumpFileLoader(core, args.core_format == 'b64')
+        if not loader.create_corefile(name + '.elf', rom_elf=rom_elf):
+            return "Failed to create corefile!"
+        if args.prog:
+            info_args = argparse.Namespace(core=name + '.elf', core_format='elf', save_core=None, gdb=args.gdb,
+                                           rom_elf=args.rom_elf, print_mem=args.print_mem, prog=args.prog)
+            # info_corefile() prints the report, workers are separate processes so stdout can be redirected
+            stdout = sys.stdout
+            sys.stdout = open(name + '.txt', 'w')
+            try:
+                info_corefile(info_args)
+            finally:
+                sys.stdout.close()
+                sys.stdout = stdout
+    except Exception as e:
+        return str(e)
+    finally:
+        if loader:
+            loader.cleanup()
+    return None
+
+
+def batch_corefile(args):
+    """ Command to create core ELF files (and info reports if program ELF is specified)
+        for many core dump files in parallel
+    """
+    cores = []
+    for path in args.cores:
+        if os.path.isdir(path):
+            cores += sorted(os.path.join(path, f) for f in os.listdir(path) if os.path.isfile(os.path.join(path, f)))
+        else:
+            cores.append(path)
+    if not os.path.isdir(args.output_dir):
+        os.makedirs(args.output_dir)
+
+    args.log_level = logging.getLogger().getEffectiveLevel()
+    pool = multiprocessing.Pool(args.jobs, batch_init, (args,))
+    failed = 0
+    try:
+        for core, err in zip(cores, pool.imap(batch_process_core, cores)):
+            if err:
+                print("%s: %s" % (core, err))
+                failed += 1
+            else:
+                print("%s: OK" % core)
+    finally:
+        pool.close()
+        pool.join()
+    print("Processed %d core dumps, %d failed" % (len(cores), failed))
+    if failed:
+        raise ESPCoreDumpError("Failed to process %d core dumps" % failed)
+
+
 def main():
     parser = argparse.ArgumentParser(description='espcoredump.py v%s - ESP32 Core Dump Utility' % __version__, prog='espcoredump')
 
@@ -1158,6 +1351,22 @@ def main():
     parser_info_coredump.add_argument('--print-mem', '-m', help='Print memory dump', action='store_true')
     parser_info_coredump.add_argument('prog', help='Path to program\'s ELF binary', type=str)
 
+    parser_batch_coredump = subparsers.add_parser(
+        'batch_corefile',
+        help='Create core ELF files for many core dump files in parallel')
+    parser_batch_coredump.add_argument('--debug', '-d', help='Log level (0..3)', type=int, default=2)
+    parser_batch_coredump.add_argument('--gdb', '-g', help='Path to gdb', default='xtensa-esp32-elf-gdb')
+    parser_batch_coredump.add_argument('--core-format', '-t', help='(raw or b64). Core dump files are raw (raw) or base64-encoded (b64) binaries',
+                                       choices=['raw', 'b64'], default='b64')
+    parser_batch_coredump.add_argument('--output-dir', '-o', help='Directory for core ELF files <name>.elf and info reports <name>.txt',
+                                       type=str, default='.')
+    parser_batch_coredump.add_argument('--jobs', '-j', help='Number of parallel jobs (default is the number of CPUs)', type=int)
+    parser_batch_coredump.add_argument('--rom-elf', '-r', help='Path to ROM ELF file.', type=str, default='esp32_rom.elf')
+    parser_batch_coredump.add_argument('--prog', '-e', help='Path to program\'s ELF binary. If specified, info report is '
+                                                            'created for every core dump, like with "info_corefile"', type=str)
+    parser_batch_coredump.add_argument('--print-mem', '-m', help='Print memory dump to info reports', action='store_true')
+    parser_batch_coredump.add_argument('cores', help='Core dump files or directories with core dump files', type=str, nargs='+')
+
     # internal sanity check - every operation matches a module function of the same name
     for operation in subparsers.choices:
         assert operation in globals(), "%s should be a module function" % operation
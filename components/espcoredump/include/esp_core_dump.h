@@ -46,7 +46,8 @@ void esp_core_dump_init();
  * The structure of core dump data is described below in details.
  * 1) Core dump starts with header:
  * 1.1) TOTAL_LEN is total length of core dump data in flash including CRC. Size is 4 bytes.
- * 1.2) VERSION field keeps 4 byte version of core dump. 
+ * 1.2) VERSION field keeps 4 byte version of core dump. It is 2 if core dump is compressed
+ *      (CONFIG_ESP32_CORE_DUMP_COMPRESS), 1 otherwise.
  * 1.2) TASKS_NUM is the number of tasks for which data are stored. Size is 4 bytes.
  * 1.3) TCB_SIZE is the size of task's TCB structure. Size is 4 bytes.
  * 2) Core dump header is followed by the data for every task in the system.
@@ -57,6 +58,8 @@ void esp_core_dump_init();
  * 3) Task header is followed by TCB data. Size is TCB_SIZE bytes.
  * 4) Task's stack is placed after TCB data. Size is (STACK_END - STACK_TOP) bytes.
  * 5) CRC is placed at the end of the data.
+ * TCB and stack data are padded with zeros to a multiple of 4 bytes. If core dump is compressed, every TCB and stack
+ * is replaced with its compressed data, padded the same way.
  */
 void esp_core_dump_to_flash(XtExcFrame *frame);
 
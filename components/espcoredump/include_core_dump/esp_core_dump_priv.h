@@ -17,6 +17,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "sdkconfig.h"
+#include "esp_err.h"
 #include "esp_log.h"
 
 #define ESP_COREDUMP_LOG( level, format, ... )  if (LOG_LOCAL_LEVEL >= level)   { ets_printf(DRAM_STR(format), esp_log_early_timestamp(), (const char *)TAG, ##__VA_ARGS__); }
@@ -34,6 +35,17 @@
 
 #define COREDUMP_MAX_TASK_STACK_SIZE        (64*1024)
 #define COREDUMP_VERSION                    1
+// Same as COREDUMP_VERSION, but TCBs and stacks are compressed, see esp_core_dump_lz_compress()
+#define COREDUMP_VERSION_COMPRESSED         2
+
+// Shortest and longest match, and largest match distance of the core dump compression format
+#define COREDUMP_LZ_MIN_MATCH               4
+#define COREDUMP_LZ_MAX_MATCH               (COREDUMP_LZ_MIN_MATCH + 0x7F)
+#define COREDUMP_LZ_MAX_DISTANCE            0xFFFF
+// Longest literal run of one token
+#define COREDUMP_LZ_MAX_LITERALS            0x80
+// Compressed length of 'len' bytes in the worst case, when nothing matches, without padding
+#define COREDUMP_LZ_MAX_LEN(len)            ((len) + ((len) + COREDUMP_LZ_MAX_LITERALS - 1) / COREDUMP_LZ_MAX_LITERALS)
 
 typedef uint32_t core_dump_crc_t;
 
@@ -74,7 +86,7 @@ typedef struct _core_dump_header_t
 /** core dump task data header */
 typedef struct _core_dump_task_header_t
 {
-    void *   tcb_addr;    // TCB address
+    uint32_t tcb_addr;    // TCB address
     uint32_t stack_start; // stack start address
     uint32_t stack_end;   // stack end address
 } core_dump_task_header_t;
@@ -89,6 +101,17 @@ void esp_core_dump_flash_init();
 // Common core dump write function
 void esp_core_dump_write(void *frame, core_dump_write_config_t *write_cfg);
 
+// Compresses data and passes the result to 'write' in chunks which are a multiple of 4 bytes long.
+// The compressed data are a sequence of tokens:
+// - 0x00..0x7F: literal run, followed by (token + 1) bytes of data
+// - 0x80..0xFF: match of (token - 0x80 + COREDUMP_LZ_MIN_MATCH) bytes, followed by 16-bit little-endian
+//   distance back into the uncompressed data. Source and destination of the copy can overlap.
+// The tokens are padded with zeros to a multiple of 4 bytes. Decompression stops when 'data_len' bytes
+// are produced, so the padding is not interpreted. If 'write' is NULL only the length is calculated.
+// Compressed length (including padding) is returned in 'out_len'.
+esp_err_t esp_core_dump_lz_compress(const void *data, uint32_t data_len,
+                        esp_core_dump_flash_write_data_t write, void *priv, uint32_t *out_len);
+
 // Gets RTOS tasks snapshot
 uint32_t esp_core_dump_get_tasks_snapshot(core_dump_task_header_t* const tasks,
                         const uint32_t snapshot_size, uint32_t* const tcb_sz);
@@ -22,11 +22,37 @@ const static DRAM_ATTR char TAG[] __attribute__((unused)) = "esp_core_dump_commo
 
 #if CONFIG_ESP32_ENABLE_COREDUMP
 
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+#define COREDUMP_DATA_VERSION   COREDUMP_VERSION_COMPRESSED
+#else
+#define COREDUMP_DATA_VERSION   COREDUMP_VERSION
+#endif
+
+// Returns the number of bytes TCB or stack data take in the core dump. Compressed data are not compressed
+// twice to find out their length, the worst case is returned and the length of the dump is known at the end.
+static uint32_t esp_core_dump_block_len(uint32_t data_len)
+{
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+    data_len = COREDUMP_LZ_MAX_LEN(data_len);
+#endif
+    return (data_len + sizeof(uint32_t) - 1) & ~(sizeof(uint32_t) - 1);
+}
+
+static esp_err_t esp_core_dump_write_block(core_dump_write_config_t *write_cfg, void *data, uint32_t data_len)
+{
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+    uint32_t len = 0;
+    return esp_core_dump_lz_compress(data, data_len, write_cfg->write, write_cfg->priv, &len);
+#else
+    return write_cfg->write(write_cfg->priv, data, data_len);
+#endif
+}
+
 static esp_err_t esp_core_dump_write_binary(void *frame, core_dump_write_config_t *write_cfg)
 {
     esp_err_t err;
     core_dump_task_header_t tasks[CONFIG_ESP32_CORE_DUMP_MAX_TASKS_NUM];
-    uint32_t tcb_sz, task_num, tcb_sz_padded;
+    uint32_t tcb_sz, task_num;
     bool task_is_valid = false;
     uint32_t data_len = 0, i;
     union
@@ -38,12 +64,6 @@ static esp_err_t esp_core_dump_write_binary(void *frame, core_dump_write_config_
     task_num = esp_core_dump_get_tasks_snapshot(tasks, CONFIG_ESP32_CORE_DUMP_MAX_TASKS_NUM, &tcb_sz);
     ESP_COREDUMP_LOGI("Found tasks: (%d)!", task_num);
   
-    // Take TCB padding into account, actual TCB size will be stored in header
-    if (tcb_sz % sizeof(uint32_t))
-        tcb_sz_padded = (tcb_sz / sizeof(uint32_t) + 1) * sizeof(uint32_t);
-    else
-        tcb_sz_padded = tcb_sz;
-   
     // Verifies all tasks in the snapshot
     for (i = 0; i < task_num; i++) {        
         task_is_valid = esp_core_dump_process_tcb(frame, &tasks[i], tcb_sz);
@@ -51,16 +71,16 @@ static esp_err_t esp_core_dump_write_binary(void *frame, core_dump_write_config_
         if (!task_is_valid) {
             write_cfg->bad_tasks_num++;
             continue;
-        } else {
-            data_len += (tcb_sz_padded + sizeof(core_dump_task_header_t));
         }
         uint32_t len = 0;
         task_is_valid = esp_core_dump_process_stack(&tasks[i], &len);
         if (task_is_valid) {
-            // Increase core dump size by task stack size
-            data_len += len;
+            // Increase core dump size by task header, TCB and stack size.
+            // Take TCB padding into account, actual TCB size will be stored in header
+            data_len += sizeof(core_dump_task_header_t) + esp_core_dump_block_len(tcb_sz);
+            data_len += esp_core_dump_block_len(tasks[i].stack_end - tasks[i].stack_start);
         } else {
-            // If task tcb is ok but stack is corrupted
+            // If task tcb is ok but stack is corrupted, the task is not saved
             write_cfg->bad_tasks_num++;
         }
     }
@@ -84,9 +104,9 @@ static esp_err_t esp_core_dump_write_binary(void *frame, core_dump_write_config_
             return err;
         }
     }
-    // Write header
+    // Write header. Length of compressed dump is an upper bound, flash writer stores the actual length
     dump_data.hdr.data_len  = data_len;
-    dump_data.hdr.version   = COREDUMP_VERSION;
+    dump_data.hdr.version   = COREDUMP_DATA_VERSION;
     dump_data.hdr.tasks_num = task_num - write_cfg->bad_tasks_num;
     dump_data.hdr.tcb_sz    = tcb_sz;
     err = write_cfg->write(write_cfg->priv, &dump_data, sizeof(core_dump_header_t));
@@ -96,7 +116,7 @@ static esp_err_t esp_core_dump_write_binary(void *frame, core_dump_write_config_
     }
     // Write tasks
     for (i = 0; i < task_num; i++) {
-        if (!esp_tcb_addr_is_sane((uint32_t)tasks[i].tcb_addr, tcb_sz)) {
+        if (!esp_tcb_addr_is_sane(tasks[i].tcb_addr, tcb_sz)) {
             ESP_COREDUMP_LOG_PROCESS("Skip TCB with bad addr %x!", tasks[i].tcb_addr);
             continue;
         }
@@ -111,14 +131,14 @@ static esp_err_t esp_core_dump_write_binary(void *frame, core_dump_write_config_
             return err;
         }
         // Save TCB
-        err = write_cfg->write(write_cfg->priv, tasks[i].tcb_addr, tcb_sz);
+        err = esp_core_dump_write_block(write_cfg, (void *)(uintptr_t)tasks[i].tcb_addr, tcb_sz);
         if (err != ESP_OK) {
             ESP_COREDUMP_LOGE("Failed to write TCB (%d)!", err);
             return err;
         }
         // Save task stack
         if (tasks[i].stack_start != 0 && tasks[i].stack_end != 0) {
-            err = write_cfg->write(write_cfg->priv, (void*)tasks[i].stack_start,
+            err = esp_core_dump_write_block(write_cfg, (void *)(uintptr_t)tasks[i].stack_start,
                     tasks[i].stack_end - tasks[i].stack_start);
             if (err != ESP_OK) {
                 ESP_COREDUMP_LOGE("Failed to write task stack (%d)!", err);
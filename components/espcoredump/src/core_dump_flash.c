@@ -20,10 +20,20 @@ const static DRAM_ATTR char TAG[] __attribute__((unused)) = "esp_core_dump_flash
 
 #if CONFIG_ESP32_ENABLE_COREDUMP_TO_FLASH
 
+// Data are programmed in whole flash pages where possible
+#define COREDUMP_FLASH_PAGE_SIZE    256
+
 typedef struct _core_dump_write_flash_data_t
 {
-    uint32_t        off; // current offset in partition
-    core_dump_crc_t crc; // CRC of dumped data
+    uint32_t        off;      // offset in partition of the data in page buffer
+    uint32_t        data_len; // space for core dump data, including CRC
+    uint32_t        erased;   // number of bytes erased at the start of partition
+    uint32_t        buf_len;  // number of bytes in page buffer
+    union
+    {
+        uint8_t     data8[COREDUMP_FLASH_PAGE_SIZE];
+        uint32_t    data32[COREDUMP_FLASH_PAGE_SIZE / sizeof(uint32_t)];
+    } buf;                    // page buffer, padded data which have not been written yet
 } core_dump_write_flash_data_t;
 
 typedef struct _core_dump_partition_t
@@ -66,99 +76,152 @@ void esp_core_dump_flash_init()
     s_core_flash_config.partition_config_crc = esp_core_dump_calc_flash_config_crc();
 }
 
-static uint32_t esp_core_dump_write_flash_padded(size_t off, uint8_t *data, uint32_t data_size)
+static esp_err_t esp_core_dump_flash_program(core_dump_write_flash_data_t *wr_data, const void *data, uint32_t data_len)
 {
     esp_err_t err;
-    uint32_t data_len = 0, k, len;
-    union
-    {
-        uint8_t    data8[4];
-        uint32_t   data32;
-    } rom_data;
-
-    data_len = (data_size / sizeof(uint32_t)) * sizeof(uint32_t);
-
-    assert(off >= s_core_flash_config.partition.start);
-    assert((off + data_len + (data_size % sizeof(uint32_t) ? sizeof(uint32_t) : 0)) <=
-        s_core_flash_config.partition.start + s_core_flash_config.partition.size);
 
-    err = spi_flash_write(off, data, data_len);
+    if (wr_data->off + data_len > wr_data->data_len) {
+        ESP_COREDUMP_LOGE("Not enough space to save core dump!");
+        return ESP_ERR_NO_MEM;
+    }
+    // Sectors are erased when they are reached, compressed dump needs fewer of them than reserved
+    if (wr_data->off + data_len > wr_data->erased) {
+        uint32_t len = (wr_data->off + data_len - wr_data->erased + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE - 1);
+        assert(wr_data->erased + len <= s_core_flash_config.partition.size);
+        err = spi_flash_erase_range(s_core_flash_config.partition.start + wr_data->erased, len);
+        if (err != ESP_OK) {
+            ESP_COREDUMP_LOGE("Failed to erase flash (%d)!", err);
+            return err;
+        }
+        wr_data->erased += len;
+    }
+    err = spi_flash_write(s_core_flash_config.partition.start + wr_data->off, data, data_len);
     if (err != ESP_OK) {
         ESP_COREDUMP_LOGE("Failed to write data to flash (%d)!", err);
-        return 0;
+        return err;
     }
+    wr_data->off += data_len;
+    return ESP_OK;
+}
 
-    len = data_size % sizeof(uint32_t);
-    if (len) {
-        // write last bytes with padding, actual TCB len can be retrieved by esptool from core dump header
-        rom_data.data32 = 0;
-        for (k = 0; k < len; k++) {
-            rom_data.data8[k] = *(data + data_len + k);
+static esp_err_t esp_core_dump_flash_write_buffered(core_dump_write_flash_data_t *wr_data, const uint8_t *data, uint32_t data_len)
+{
+    esp_err_t err;
+    uint32_t len;
+
+    // Fill up the page in buffer first
+    if (wr_data->buf_len) {
+        len = COREDUMP_FLASH_PAGE_SIZE - wr_data->buf_len;
+        if (len > data_len) {
+            len = data_len;
+        }
+        memcpy(&wr_data->buf.data8[wr_data->buf_len], data, len);
+        wr_data->buf_len += len;
+        data += len;
+        data_len -= len;
+        if (wr_data->buf_len < COREDUMP_FLASH_PAGE_SIZE) {
+            return ESP_OK;
         }
-        err = spi_flash_write(off + data_len, &rom_data, sizeof(uint32_t));
+        err = esp_core_dump_flash_program(wr_data, wr_data->buf.data8, COREDUMP_FLASH_PAGE_SIZE);
         if (err != ESP_OK) {
-            ESP_COREDUMP_LOGE("Failed to finish write data to flash (%d)!", err);
-            return 0;
+            return err;
         }
-        data_len += sizeof(uint32_t);
+        wr_data->buf_len = 0;
     }
-
-    return data_len;
+    // Whole pages are written directly from the source
+    len = data_len & ~(COREDUMP_FLASH_PAGE_SIZE - 1);
+    if (len) {
+        err = esp_core_dump_flash_program(wr_data, data, len);
+        if (err != ESP_OK) {
+            return err;
+        }
+        data += len;
+        data_len -= len;
+    }
+    memcpy(wr_data->buf.data8, data, data_len);
+    wr_data->buf_len = data_len;
+    return ESP_OK;
 }
 
 static esp_err_t esp_core_dump_flash_write_prepare(void *priv, uint32_t *data_len)
 {
-    esp_err_t err;
-    uint32_t sec_num;
     core_dump_write_flash_data_t *wr_data = (core_dump_write_flash_data_t *)priv;
 
-    // check for available space in partition
-    if ((*data_len + sizeof(uint32_t)) > s_core_flash_config.partition.size) {
-        ESP_COREDUMP_LOGE("Not enough space to save core dump!");
-        return ESP_ERR_NO_MEM;
-    }
     // add space for CRC
     *data_len += sizeof(core_dump_crc_t);
 
     memset(wr_data, 0, sizeof(*wr_data));
+    wr_data->data_len = *data_len;
 
-    sec_num = *data_len / SPI_FLASH_SEC_SIZE;
-    if (*data_len % SPI_FLASH_SEC_SIZE) {
-        sec_num++;
-    }
-    assert(sec_num * SPI_FLASH_SEC_SIZE <= s_core_flash_config.partition.size);
-    err = spi_flash_erase_range(s_core_flash_config.partition.start + 0, sec_num * SPI_FLASH_SEC_SIZE);
-    if (err != ESP_OK) {
-        ESP_COREDUMP_LOGE("Failed to erase flash (%d)!", err);
-        return err;
+    // check for available space in partition
+    if (*data_len > s_core_flash_config.partition.size) {
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+        // length of compressed data is an upper bound, they usually fit
+        ESP_COREDUMP_LOGW("Core dump may not fit in partition (%d bytes uncompressed)!", *data_len);
+        wr_data->data_len = s_core_flash_config.partition.size;
+#else
+        ESP_COREDUMP_LOGE("Not enough space to save core dump!");
+        return ESP_ERR_NO_MEM;
+#endif
     }
-    return err;
+    return ESP_OK;
 }
 
-static esp_err_t esp_core_dump_flash_write_word(core_dump_write_flash_data_t *wr_data, uint32_t word)
+static esp_err_t esp_core_dump_flash_write_start(void *priv)
 {
-    esp_err_t err = ESP_OK;
-    uint32_t  data32 = word;
-
-    assert(wr_data->off + sizeof(uint32_t) <= s_core_flash_config.partition.size);
-    err = spi_flash_write(s_core_flash_config.partition.start + wr_data->off, &data32, sizeof(uint32_t));
-    if (err != ESP_OK) {
-        ESP_COREDUMP_LOGE("Failed to write to flash (%d)!", err);
-        return err;
-    }
-    wr_data->off += sizeof(uint32_t);
-
-    return err;
+    return ESP_OK;
 }
 
-static esp_err_t esp_core_dump_flash_write_start(void *priv)
+// Calculates CRC of the data in flash and page buffer, with 'data_len' in place of the length field
+static esp_err_t esp_core_dump_flash_calc_crc(core_dump_write_flash_data_t *wr_data, uint32_t data_len, core_dump_crc_t *crc)
 {
+    uint8_t buf[64];
+    uint32_t off = sizeof(data_len);
+
+    *crc = crc32_le(0, (const uint8_t *)&data_len, sizeof(data_len));
+    while (off < wr_data->off) {
+        uint32_t len = wr_data->off - off;
+        if (len > sizeof(buf)) {
+            len = sizeof(buf);
+        }
+        esp_err_t err = spi_flash_read(s_core_flash_config.partition.start + off, buf, len);
+        if (err != ESP_OK) {
+            ESP_COREDUMP_LOGE("Failed to read flash (%d)!", err);
+            return err;
+        }
+        *crc = crc32_le(*crc, buf, len);
+        off += len;
+    }
+    *crc = crc32_le(*crc, &wr_data->buf.data8[off - wr_data->off], wr_data->off + wr_data->buf_len - off);
     return ESP_OK;
 }
 
 static esp_err_t esp_core_dump_flash_write_end(void *priv)
 {
     core_dump_write_flash_data_t *wr_data = (core_dump_write_flash_data_t *)priv;
+    uint32_t data_len = wr_data->off + wr_data->buf_len + sizeof(core_dump_crc_t);
+    core_dump_crc_t crc;
+
+    esp_err_t err = esp_core_dump_flash_calc_crc(wr_data, data_len, &crc);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // write core dump CRC and the rest of data
+    ESP_COREDUMP_LOG_PROCESS("Dump data CRC = 0x%x", crc);
+    err = esp_core_dump_flash_write_buffered(wr_data, (const uint8_t *)&crc, sizeof(crc));
+    if (err == ESP_OK && wr_data->buf_len) {
+        err = esp_core_dump_flash_program(wr_data, wr_data->buf.data8, wr_data->buf_len);
+        wr_data->buf_len = 0;
+    }
+    if (err != ESP_OK) {
+        return err;
+    }
+    // length field was left erased, so that it can be programmed now
+    err = spi_flash_write(s_core_flash_config.partition.start + 0, &data_len, sizeof(data_len));
+    if (err != ESP_OK) {
+        ESP_COREDUMP_LOGE("Failed to write data to flash (%d)!", err);
+        return err;
+    }
 #if LOG_LOCAL_LEVEL >= ESP_LOG_DEBUG
     union
     {
@@ -166,7 +229,7 @@ static esp_err_t esp_core_dump_flash_write_end(void *priv)
         uint32_t   data32[4];
     } rom_data;
 
-    esp_err_t err = spi_flash_read(s_core_flash_config.partition.start + 0, &rom_data, sizeof(rom_data));
+    err = spi_flash_read(s_core_flash_config.partition.start + 0, &rom_data, sizeof(rom_data));
     if (err != ESP_OK) {
         ESP_COREDUMP_LOGE("Failed to read flash (%d)!", err);
         return err;
@@ -177,31 +240,35 @@ static esp_err_t esp_core_dump_flash_write_end(void *priv)
         }
     }
 #endif
-    // write core dump CRC
-    ESP_COREDUMP_LOG_PROCESS("Dump data CRC = 0x%x", wr_data->crc);
-    return esp_core_dump_flash_write_word(wr_data, wr_data->crc);
+    return err;
 }
 
 static esp_err_t esp_core_dump_flash_write_data(void *priv, void * data, uint32_t data_len)
 {
-    esp_err_t err = ESP_OK;
+    const static DRAM_ATTR uint8_t padding[sizeof(uint32_t)] = {0};
     core_dump_write_flash_data_t *wr_data = (core_dump_write_flash_data_t *)priv;
-
-    uint32_t len = esp_core_dump_write_flash_padded(s_core_flash_config.partition.start + wr_data->off, data, data_len);
-    if (len != data_len) {
-        return ESP_FAIL;
+    core_dump_header_t hdr;
+
+    if (wr_data->off + wr_data->buf_len == 0) {
+        // Header is written first. Its length field is programmed at the end, when length of compressed data is known
+        assert(data_len == sizeof(hdr));
+        memcpy(&hdr, data, sizeof(hdr));
+        hdr.data_len = UINT32_MAX;
+        data = &hdr;
     }
-
-    wr_data->off += len;
-    wr_data->crc = crc32_le(wr_data->crc, data, data_len);
-
-    return err;
+    esp_err_t err = esp_core_dump_flash_write_buffered(wr_data, data, data_len);
+    if (err != ESP_OK) {
+        return err;
+    }
+    // pad last bytes, actual TCB len can be retrieved by esptool from core dump header
+    return esp_core_dump_flash_write_buffered(wr_data, padding, (0 - data_len) & (sizeof(uint32_t) - 1));
 }
 
 void esp_core_dump_to_flash(XtExcFrame *frame)
 {
     core_dump_write_config_t wr_cfg;
-    core_dump_write_flash_data_t wr_data;
+    // Page buffer is too big for the stack of the crashed task
+    static core_dump_write_flash_data_t wr_data;
 
     core_dump_crc_t crc = esp_core_dump_calc_flash_config_crc();
     if (s_core_flash_config.partition_config_crc != crc) {
@@ -0,0 +1,182 @@
+// Copyright 2015-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+#include "esp_core_dump_priv.h"
+
+const static DRAM_ATTR char TAG[] __attribute__((unused)) = "esp_core_dump_lz";
+
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+
+#define COREDUMP_LZ_HASH_BITS       9
+// Multiple of 48 bytes, so that UART output is made of full base64 lines
+#define COREDUMP_LZ_OUT_BUF_SIZE    192
+// Positions in the hash table are 16 bit, longer data are compressed in independent segments
+#define COREDUMP_LZ_SEGMENT_SIZE    0x10000
+
+typedef struct _core_dump_lz_state_t
+{
+    // position of the last occurrence of 4 byte sequences, indexed by their hash
+    uint16_t                            table[1 << COREDUMP_LZ_HASH_BITS];
+    uint8_t                             out[COREDUMP_LZ_OUT_BUF_SIZE];
+    uint32_t                            out_pos;
+    uint32_t                            out_len;
+    esp_core_dump_flash_write_data_t    write;
+    void *                              priv;
+} core_dump_lz_state_t;
+
+// Compressor runs in the panic handler, so keep its state off the stack
+static core_dump_lz_state_t s_lz;
+
+static inline uint32_t esp_core_dump_lz_read32(const uint8_t *p)
+{
+    // data are not necessarily aligned, and unaligned loads are not allowed
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t esp_core_dump_lz_hash(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - COREDUMP_LZ_HASH_BITS);
+}
+
+static esp_err_t esp_core_dump_lz_flush(void)
+{
+    esp_err_t err = ESP_OK;
+
+    if (s_lz.write && s_lz.out_pos) {
+        err = s_lz.write(s_lz.priv, s_lz.out, s_lz.out_pos);
+    }
+    s_lz.out_len += s_lz.out_pos;
+    s_lz.out_pos = 0;
+    return err;
+}
+
+static esp_err_t esp_core_dump_lz_put(const uint8_t *data, uint32_t len)
+{
+    esp_err_t err;
+
+    while (len) {
+        uint32_t n = COREDUMP_LZ_OUT_BUF_SIZE - s_lz.out_pos;
+        if (n > len) {
+            n = len;
+        }
+        if (s_lz.write) {
+            memcpy(&s_lz.out[s_lz.out_pos], data, n);
+        }
+        s_lz.out_pos += n;
+        data += n;
+        len -= n;
+        if (s_lz.out_pos == COREDUMP_LZ_OUT_BUF_SIZE) {
+            err = esp_core_dump_lz_flush();
+            if (err != ESP_OK) {
+                return err;
+            }
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t esp_core_dump_lz_put_literals(const uint8_t *data, uint32_t len)
+{
+    esp_err_t err;
+
+    while (len) {
+        uint32_t n = len > COREDUMP_LZ_MAX_LITERALS ? COREDUMP_LZ_MAX_LITERALS : len;
+        uint8_t token = n - 1;
+        err = esp_core_dump_lz_put(&token, 1);
+        if (err == ESP_OK) {
+            err = esp_core_dump_lz_put(data, n);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        data += n;
+        len -= n;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t esp_core_dump_lz_put_match(uint32_t len, uint32_t dist)
+{
+    uint8_t match[3];
+
+    match[0] = 0x80 | (len - COREDUMP_LZ_MIN_MATCH);
+    match[1] = dist & 0xFF;
+    match[2] = dist >> 8;
+    return esp_core_dump_lz_put(match, sizeof(match));
+}
+
+static esp_err_t esp_core_dump_lz_compress_segment(const uint8_t *src, uint32_t len)
+{
+    esp_err_t err;
+    uint32_t pos = 0, lit_start = 0;
+
+    memset(s_lz.table, 0, sizeof(s_lz.table));
+    while (pos + COREDUMP_LZ_MIN_MATCH <= len) {
+        uint32_t v = esp_core_dump_lz_read32(&src[pos]);
+        uint32_t h = esp_core_dump_lz_hash(v);
+        uint32_t cand = s_lz.table[h];
+        s_lz.table[h] = pos;
+        // entry may be unset or belong to another sequence with the same hash
+        if (cand >= pos || esp_core_dump_lz_read32(&src[cand]) != v) {
+            pos++;
+            continue;
+        }
+        uint32_t match_len = COREDUMP_LZ_MIN_MATCH;
+        while (pos + match_len < len && match_len < COREDUMP_LZ_MAX_MATCH &&
+                src[cand + match_len] == src[pos + match_len]) {
+            match_len++;
+        }
+        err = esp_core_dump_lz_put_literals(&src[lit_start], pos - lit_start);
+        if (err == ESP_OK) {
+            err = esp_core_dump_lz_put_match(match_len, pos - cand);
+        }
+        if (err != ESP_OK) {
+            return err;
+        }
+        pos += match_len;
+        lit_start = pos;
+    }
+    return esp_core_dump_lz_put_literals(&src[lit_start], len - lit_start);
+}
+
+esp_err_t esp_core_dump_lz_compress(const void *data, uint32_t data_len,
+                        esp_core_dump_flash_write_data_t write, void *priv, uint32_t *out_len)
+{
+    const static DRAM_ATTR uint8_t padding[sizeof(uint32_t)] = {0};
+    const uint8_t *src = (const uint8_t *)data;
+    esp_err_t err = ESP_OK;
+
+    s_lz.write = write;
+    s_lz.priv = priv;
+    s_lz.out_pos = 0;
+    s_lz.out_len = 0;
+
+    while (data_len) {
+        uint32_t n = data_len > COREDUMP_LZ_SEGMENT_SIZE ? COREDUMP_LZ_SEGMENT_SIZE : data_len;
+        err = esp_core_dump_lz_compress_segment(src, n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        src += n;
+        data_len -= n;
+    }
+    err = esp_core_dump_lz_put(padding, (0 - (s_lz.out_len + s_lz.out_pos)) & (sizeof(uint32_t) - 1));
+    if (err == ESP_OK) {
+        err = esp_core_dump_lz_flush();
+    }
+    *out_len = s_lz.out_len;
+    return err;
+}
+
+#endif
@@ -42,11 +42,11 @@ bool esp_core_dump_process_tcb(void *frame, core_dump_task_header_t *task_snapho
 {
     XtExcFrame *exc_frame = (XtExcFrame*)frame;
      
-    if (!esp_tcb_addr_is_sane((uint32_t)task_snaphort->tcb_addr, tcb_sz)) {
+    if (!esp_tcb_addr_is_sane(task_snaphort->tcb_addr, tcb_sz)) {
         ESP_COREDUMP_LOG_PROCESS("Bad TCB addr %x!", task_snaphort->tcb_addr);
         return false;
     }
-    if (task_snaphort->tcb_addr == xTaskGetCurrentTaskHandleForCPU(xPortGetCoreID())) {
+    if (task_snaphort->tcb_addr == (uint32_t)xTaskGetCurrentTaskHandleForCPU(xPortGetCoreID())) {
         // Set correct stack top for current task
         task_snaphort->stack_start = (uint32_t)exc_frame;
         // This field is not initialized for crashed task, but stack frame has the structure of interrupt one,
@@ -83,7 +83,7 @@ bool esp_core_dump_process_stack(core_dump_task_header_t* task_snaphort, uint32_
         !esp_task_stack_start_is_sane((uint32_t)task_snaphort->stack_end) ||
         (len > COREDUMP_MAX_TASK_STACK_SIZE)) {
         // Check if current task stack corrupted
-        if (task_snaphort->tcb_addr == xTaskGetCurrentTaskHandleForCPU(xPortGetCoreID())) {
+        if (task_snaphort->tcb_addr == (uint32_t)xTaskGetCurrentTaskHandleForCPU(xPortGetCoreID())) {
             ESP_COREDUMP_LOG_PROCESS("Crashed task will be skipped!");
         }
         ESP_COREDUMP_LOG_PROCESS("Corrupted TCB %x: stack len %lu, top %x, end %x!",
@@ -22,34 +22,72 @@ const static DRAM_ATTR char TAG[] __attribute__((unused)) = "esp_core_dump_uart"
 
 #if CONFIG_ESP32_ENABLE_COREDUMP_TO_UART
 
-static void esp_core_dump_b64_encode(const uint8_t *src, uint32_t src_len, uint8_t *dst) {
-    const static DRAM_ATTR char b64[] =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-    int i, j, a, b, c;
-
-    for (i = j = 0; i < src_len; i += 3) {
-        a = src[i];
-        b = i + 1 >= src_len ? 0 : src[i + 1];
-        c = i + 2 >= src_len ? 0 : src[i + 2];
-
-        dst[j++] = b64[a >> 2];
-        dst[j++] = b64[((a & 3) << 4) | (b >> 4)];
-        if (i + 1 < src_len) {
-            dst[j++] = b64[(b & 0x0F) << 2 | (c >> 6)];
-        }
-        if (i + 2 < src_len) {
-            dst[j++] = b64[c & 0x3F];
-        }
+// Each line of output has the base64 encoding of this many bytes, 64 characters
+#define COREDUMP_UART_LINE_BYTES    48
+#define COREDUMP_UART_LINE_CHARS    (COREDUMP_UART_LINE_BYTES / 3 * 4)
+// Number of lines printed at once
+#define COREDUMP_UART_LINES         4
+
+typedef struct _core_dump_write_uart_data_t
+{
+    uint32_t    buf_len;  // number of bytes in line buffer
+    uint8_t     buf[COREDUMP_UART_LINE_BYTES];  // data of the next line, which have not been encoded yet
+    uint32_t    text_len; // number of characters in text buffer
+    char        text[COREDUMP_UART_LINES * (COREDUMP_UART_LINE_CHARS + 2) + 1];  // encoded lines
+} core_dump_write_uart_data_t;
+
+static const DRAM_ATTR char s_b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Encodes 'src_len' bytes, which is a multiple of 3 except for the last line of the core dump
+static char *esp_core_dump_b64_encode(const uint8_t *src, uint32_t src_len, char *dst)
+{
+    const uint8_t *end = src + src_len - src_len % 3;
+
+    for (; src < end; src += 3) {
+        uint32_t v = (src[0] << 16) | (src[1] << 8) | src[2];
+        *dst++ = s_b64[v >> 18];
+        *dst++ = s_b64[(v >> 12) & 0x3F];
+        *dst++ = s_b64[(v >> 6) & 0x3F];
+        *dst++ = s_b64[v & 0x3F];
+    }
+    if (src_len % 3) {
+        uint32_t v = (src[0] << 16) | ((src_len % 3 == 2) ? src[1] << 8 : 0);
+        *dst++ = s_b64[v >> 18];
+        *dst++ = s_b64[(v >> 12) & 0x3F];
+        *dst++ = (src_len % 3 == 2) ? s_b64[(v >> 6) & 0x3F] : '=';
+        *dst++ = '=';
     }
-    while (j % 4 != 0) {
-        dst[j++] = '=';
+    return dst;
+}
+
+static void esp_core_dump_uart_print(core_dump_write_uart_data_t *wr_data)
+{
+    wr_data->text[wr_data->text_len] = '\0';
+    ets_printf(DRAM_STR("%s"), wr_data->text);
+    wr_data->text_len = 0;
+}
+
+// Encodes the data in line buffer to a line of output, lines are printed when the text buffer is full
+static void esp_core_dump_uart_encode_line(core_dump_write_uart_data_t *wr_data)
+{
+    char *end = esp_core_dump_b64_encode(wr_data->buf, wr_data->buf_len, &wr_data->text[wr_data->text_len]);
+    *end++ = '\r';
+    *end++ = '\n';
+    wr_data->text_len = end - wr_data->text;
+    wr_data->buf_len = 0;
+    if (wr_data->text_len + COREDUMP_UART_LINE_CHARS + 2 >= sizeof(wr_data->text)) {
+        esp_core_dump_uart_print(wr_data);
     }
-    dst[j++] = '\0';
 }
 
 static esp_err_t esp_core_dump_uart_write_start(void *priv)
 {
     esp_err_t err = ESP_OK;
+    core_dump_write_uart_data_t *wr_data = (core_dump_write_uart_data_t *)priv;
+
+    wr_data->buf_len = 0;
+    wr_data->text_len = 0;
     ets_printf(DRAM_STR("================= CORE DUMP START =================\r\n"));
     return err;
 }
@@ -57,6 +95,14 @@ static esp_err_t esp_core_dump_uart_write_start(void *priv)
 static esp_err_t esp_core_dump_uart_write_end(void *priv)
 {
     esp_err_t err = ESP_OK;
+    core_dump_write_uart_data_t *wr_data = (core_dump_write_uart_data_t *)priv;
+
+    if (wr_data->buf_len) {
+        esp_core_dump_uart_encode_line(wr_data);
+    }
+    if (wr_data->text_len) {
+        esp_core_dump_uart_print(wr_data);
+    }
     ets_printf(DRAM_STR("================= CORE DUMP END =================\r\n"));
     return err;
 }
@@ -64,18 +110,23 @@ static esp_err_t esp_core_dump_uart_write_end(void *priv)
 static esp_err_t esp_core_dump_uart_write_data(void *priv, void * data, uint32_t data_len)
 {
     esp_err_t err = ESP_OK;
-    char buf[64 + 4], *addr = data;
-    char *end = addr + data_len;
-
-    while (addr < end) {
-        size_t len = end - addr;
-        if (len > 48) len = 48;
-        /* Copy to stack to avoid alignment restrictions. */
-        char *tmp = buf + (sizeof(buf) - len);
-        memcpy(tmp, addr, len);
-        esp_core_dump_b64_encode((const uint8_t *)tmp, len, (uint8_t *)buf);
+    core_dump_write_uart_data_t *wr_data = (core_dump_write_uart_data_t *)priv;
+    const uint8_t *addr = data;
+
+    // Output is one base64 stream, only the last line can be shorter and padded
+    while (data_len) {
+        uint32_t len = COREDUMP_UART_LINE_BYTES - wr_data->buf_len;
+        if (len > data_len) {
+            len = data_len;
+        }
+        /* Copy to line buffer to avoid alignment restrictions. */
+        memcpy(&wr_data->buf[wr_data->buf_len], addr, len);
+        wr_data->buf_len += len;
         addr += len;
-        ets_printf(DRAM_STR("%s\r\n"), buf);
+        data_len -= len;
+        if (wr_data->buf_len == COREDUMP_UART_LINE_BYTES) {
+            esp_core_dump_uart_encode_line(wr_data);
+        }
     }
 
     return err;
@@ -95,6 +146,7 @@ static int esp_core_dump_uart_get_char() {
 void esp_core_dump_to_uart(XtExcFrame *frame)
 {
     core_dump_write_config_t wr_cfg;
+    core_dump_write_uart_data_t wr_data;
     uint32_t tm_end, tm_cur;
     int ch;
 
@@ -103,7 +155,7 @@ void esp_core_dump_to_uart(XtExcFrame *frame)
     wr_cfg.start = esp_core_dump_uart_write_start;
     wr_cfg.end = esp_core_dump_uart_write_end;
     wr_cfg.write = esp_core_dump_uart_write_data;
-    wr_cfg.priv = NULL;
+    wr_cfg.priv = &wr_data;
 
     //Make sure txd/rxd are enabled
     // use direct reg access instead of gpio_pullup_dis which can cause exception when flash cache is disabled
@@ -16,6 +16,11 @@
 
 import sys
 import os
+import base64
+import random
+import shutil
+import subprocess
+import tempfile
 import unittest
 
 try:
@@ -46,6 +51,149 @@ class TestESPCoreDumpFileLoader(unittest.TestCase):
 
     def test_create_corefile(self):
         self.assertEqual(self.dloader.create_corefile(core_fname=self.tmp_file, off=0, rom_elf=None), self.tmp_file)
+        with open(self.tmp_file, 'rb') as f, open('expected_corefile.elf', 'rb') as f_exp:
+            self.assertEqual(f.read(), f_exp.read())
+
+    def test_create_corefile_compressed(self):
+        # coredump_lz.b64 is the same core dump as coredump.b64, compressed by the core dump writer (see test_espcoredump_host)
+        loader = espcoredump.ESPCoreDumpFileLoader(path='coredump_lz.b64', b64=True)
+        try:
+            self.assertEqual(loader.create_corefile(core_fname=self.tmp_file + '_lz'), self.tmp_file + '_lz')
+        finally:
+            loader.cleanup()
+        self.dloader.create_corefile(core_fname=self.tmp_file)
+        with open(self.tmp_file, 'rb') as f, open(self.tmp_file + '_lz', 'rb') as f_lz:
+            self.assertEqual(f.read(), f_lz.read())
+        os.remove(self.tmp_file + '_lz')
+
+    def test_lz_decompress(self):
+        # literal run, then overlapping match
+        data, consumed = self.dloader.lz_decompress(b'\x01ab\x82\x02\x00', 8)
+        self.assertEqual(data, b'abababab')
+        self.assertEqual(consumed, 8)
+        with self.assertRaises(espcoredump.ESPCoreDumpLoaderError):
+            self.dloader.lz_decompress(b'\x01ab\x82\x03\x00', 8)  # distance before start of data
+        with self.assertRaises(espcoredump.ESPCoreDumpLoaderError):
+            self.dloader.lz_decompress(b'\x07abc', 8)  # truncated
+
+
+class TestESPCoreDumpElfCache(unittest.TestCase):
+    def setUp(self):
+        self.tmp_dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.tmp_dir)
+
+    def test_cache(self):
+        cache = espcoredump.ESPCoreDumpElfCache()
+        elf = cache.get('expected_corefile.elf')
+        self.assertIs(elf, cache.get('expected_corefile.elf'))
+        # same contents at another path
+        path = os.path.join(self.tmp_dir, 'core.elf')
+        shutil.copy('expected_corefile.elf', path)
+        self.assertIs(elf, cache.get(path))
+        # changed contents at the same path
+        shutil.copy('test.elf', path)
+        self.assertIsNot(elf, cache.get(path))
+        self.assertEqual([(s.name, s.addr, len(s.data)) for s in cache.get(path).sections],
+                         [(s.name, s.addr, len(s.data)) for s in espcoredump.ESPCoreDumpElfFile('test.elf').sections])
+
+
+class TestESPCoreDumpBatch(unittest.TestCase):
+    def setUp(self):
+        self.tmp_dir = tempfile.mkdtemp()
+        self.cores_dir = os.path.join(self.tmp_dir, 'cores')
+        self.out_dir = os.path.join(self.tmp_dir, 'out')
+        os.mkdir(self.cores_dir)
+        for i in range(4):
+            shutil.copy('coredump.b64', os.path.join(self.cores_dir, 'plain%d.b64' % i))
+            shutil.copy('coredump_lz.b64', os.path.join(self.cores_dir, 'lz%d.b64' % i))
+
+    def tearDown(self):
+        shutil.rmtree(self.tmp_dir)
+
+    def _batch(self, *args):
+        return subprocess.call([sys.executable, espcoredump.__file__, 'batch_corefile', '-j', '3', '-o', self.out_dir] + list(args))
+
+    def test_batch(self):
+        self.assertEqual(self._batch(self.cores_dir), 0)
+        with open('expected_corefile.elf', 'rb') as f:
+            expected = f.read()
+        names = sorted(os.listdir(self.out_dir))
+        self.assertEqual(names, sorted(['plain%d.elf' % i for i in range(4)] + ['lz%d.elf' % i for i in range(4)]))
+        for name in names:
+            with open(os.path.join(self.out_dir, name), 'rb') as f:
+                self.assertEqual(f.read(), expected)
+
+    def test_batch_failed(self):
+        bad = os.path.join(self.tmp_dir, 'bad.b64')
+        with open(bad, 'w') as f:
+            f.write('AAAA\n')
+        self.assertNotEqual(self._batch(bad, self.cores_dir), 0)
+        self.assertEqual(len(os.listdir(self.out_dir)), 8)
+
+
+class TestESPCoreDumpB64File(unittest.TestCase):
+    def setUp(self):
+        self.tmp_dir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        shutil.rmtree(self.tmp_dir)
+
+    def _write_b64(self, data, line_len=64):
+        # the same as the core dump is printed to UART, one base64 stream in lines of 'line_len' characters
+        path = os.path.join(self.tmp_dir, 'core%d.b64' % line_len)
+        text = base64.standard_b64encode(data)
+        with open(path, 'wb') as f:
+            for i in range(0, len(text), line_len):
+                f.write(text[i:i + line_len] + b'\r\n')
+        return path
+
+    def _decode_lines(self, path):
+        with open(path, 'rb') as f:
+            return b''.join(base64.standard_b64decode(line.strip()) for line in f)
+
+    def test_random_reads(self):
+        rand = random.Random(1)
+        for path in ['coredump.b64', self._write_b64(os.urandom(100000), 76)]:
+            data = self._decode_lines(path)
+            f = espcoredump.ESPCoreDumpB64File(path)
+            f.DECODE_SIZE = 1000
+            try:
+                for i in range(200):
+                    off = rand.randint(0, len(data) + 10)
+                    size = rand.randint(0, 3000)
+                    f.seek(off)
+                    self.assertEqual(f.read(size), data[off:off + size])
+            finally:
+                f.close()
+
+    def test_bounded_memory(self):
+        data = os.urandom(4 * 1024 * 1024)
+        f = espcoredump.ESPCoreDumpB64File(self._write_b64(data))
+        try:
+            max_buf = 0
+            for off in range(0, len(data), 4096):
+                self.assertEqual(f.read(4096), data[off:off + 4096])
+                max_buf = max(max_buf, len(f.buf))
+            self.assertEqual(f.read(4096), b'')
+            self.assertLess(max_buf, 4096 + f.DECODE_SIZE)
+        finally:
+            f.close()
+
+    def test_create_corefile(self):
+        # the test core dumps were printed by older versions, where each write was padded
+        with open('expected_corefile.elf', 'rb') as f:
+            expected = f.read()
+        for name in ['coredump.b64', 'coredump_lz.b64']:
+            for path in [name, self._write_b64(self._decode_lines(name))]:
+                loader = espcoredump.ESPCoreDumpFileLoader(path=path, b64=True)
+                try:
+                    core_fname = loader.create_corefile(core_fname=os.path.join(self.tmp_dir, 'core.elf'))
+                finally:
+                    loader.cleanup()
+                with open(core_fname, 'rb') as f:
+                    self.assertEqual(f.read(), expected)
 
 
 if __name__ == '__main__':
@@ -11,6 +11,8 @@ fi
     && coverage erase \
     && coverage run -a --source=espcoredump ../espcoredump.py info_corefile -m -t b64 -c coredump.b64 test.elf &> output \
     && diff ${EXPECTED_OUTPUT} output \
+    && coverage run -a --source=espcoredump ../espcoredump.py info_corefile -m -t b64 -c coredump_lz.b64 test.elf &> output \
+    && diff ${EXPECTED_OUTPUT} output \
     && coverage run -a --source=espcoredump ./test_espcoredump.py \
     && coverage report \
 ; } || { echo 'The test for espcoredump has failed!'; exit 1; }
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "esp_attr.h"
+
+typedef struct XtExcFrame XtExcFrame;
+
+/* declared by xtensa/hal.h, via portmacro.h */
+unsigned xthal_get_ccount(void);
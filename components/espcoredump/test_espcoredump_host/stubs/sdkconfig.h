@@ -0,0 +1,8 @@
+#pragma once
+
+#define CONFIG_ESP32_ENABLE_COREDUMP            1
+#define CONFIG_ESP32_ENABLE_COREDUMP_TO_FLASH   1
+#define CONFIG_ESP32_ENABLE_COREDUMP_TO_UART    1
+#define CONFIG_ESP32_CORE_DUMP_UART_DELAY       0
+#define CONFIG_ESP32_CORE_DUMP_MAX_TASKS_NUM    64
+#define CONFIG_LOG_DEFAULT_LEVEL                3
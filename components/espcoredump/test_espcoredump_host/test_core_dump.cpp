@@ -0,0 +1,489 @@
+#include <sys/mman.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "catch.hpp"
+#include "esp_partition.h"
+#include "spi_flash_emulation.h"
+
+extern "C" {
+#include "esp_core_dump_priv.h"
+
+void esp_core_dump_to_flash(XtExcFrame *frame);
+void esp_core_dump_to_uart(XtExcFrame *frame);
+esp_err_t esp_core_dump_image_get(size_t* out_addr, size_t *out_size);
+}
+
+using namespace std;
+
+/* Core dump fixtures are loaded to their original addresses, the range accepted by esp_tcb_addr_is_sane */
+static const uint32_t DRAM_START = 0x3ffae000;
+static const uint32_t DRAM_END = 0x40000000;
+
+/* UART and IO MUX registers, which the UART core dump writer accesses directly */
+static const uint32_t PERIPH_START = 0x3ff40000;
+static const uint32_t PERIPH_END = 0x3ff50000;
+
+static const uint32_t PARTITION_OFFSET = 0x10000;
+static const uint32_t PARTITION_SIZE = 0x10000;
+static const size_t FLASH_SECTORS = (PARTITION_OFFSET + PARTITION_SIZE) / SPI_FLASH_SEC_SIZE;
+
+static const uint32_t PAGE_SIZE = 256;
+
+/* Task data of test/coredump.b64, which is provided to the core dump writer by the port functions below */
+static vector<core_dump_task_header_t> s_tasks;
+static uint32_t s_tcb_sz;
+
+static SpiFlashEmulator *s_flash;
+
+/* Everything printed with ets_printf */
+static string s_uart_output;
+
+static esp_partition_t s_partition = {
+    .type = ESP_PARTITION_TYPE_DATA,
+    .subtype = ESP_PARTITION_SUBTYPE_DATA_COREDUMP,
+    .address = PARTITION_OFFSET,
+    .size = PARTITION_SIZE,
+    .label = "coredump",
+    .encrypted = false,
+};
+
+static uint32_t align4(uint32_t len)
+{
+    return (len + 3) & ~3;
+}
+
+static uint32_t read32(const vector<uint8_t> &data, size_t off)
+{
+    uint32_t v;
+    memcpy(&v, &data[off], sizeof(v));
+    return v;
+}
+
+static vector<uint8_t> decode_b64(istream &f)
+{
+    static const string chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    vector<uint8_t> out;
+    string line;
+    while (getline(f, line)) {
+        uint32_t acc = 0;
+        int bits = 0;
+        for (char c : line) {
+            size_t v = chars.find(c);
+            if (v == string::npos) {
+                continue; /* padding and line endings */
+            }
+            acc = (acc << 6) | v;
+            bits += 6;
+            if (bits >= 8) {
+                bits -= 8;
+                out.push_back((acc >> bits) & 0xff);
+            }
+        }
+    }
+    return out;
+}
+
+static vector<uint8_t> load_b64(const char *path)
+{
+    ifstream f(path);
+    REQUIRE(f.good());
+    return decode_b64(f);
+}
+
+/* Places TCBs and stacks from an uncompressed core dump to their addresses in memory */
+static void load_tasks(const vector<uint8_t> &dump)
+{
+    static uint8_t *dram;
+    if (!dram) {
+        dram = (uint8_t *) mmap((void *) DRAM_START, DRAM_END - DRAM_START, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        REQUIRE(dram == (uint8_t *) DRAM_START);
+    }
+
+    REQUIRE(read32(dump, 4) == COREDUMP_VERSION);
+    uint32_t tasks_num = read32(dump, 8);
+    s_tcb_sz = read32(dump, 12);
+    s_tasks.clear();
+    size_t off = sizeof(core_dump_header_t);
+    for (uint32_t i = 0; i < tasks_num; i++) {
+        core_dump_task_header_t task;
+        memcpy(&task, &dump[off], sizeof(task));
+        off += sizeof(task);
+        memcpy((void *)(uintptr_t) task.tcb_addr, &dump[off], s_tcb_sz);
+        off += align4(s_tcb_sz);
+        uint32_t stack_len = task.stack_end - task.stack_start;
+        memcpy((void *)(uintptr_t) task.stack_start, &dump[off], stack_len);
+        off += align4(stack_len);
+        s_tasks.push_back(task);
+    }
+    REQUIRE(off == dump.size());
+}
+
+/* Reference decompressor, same as the one in espcoredump.py */
+static vector<uint8_t> lz_decompress(const uint8_t *data, size_t avail, size_t size, size_t *consumed)
+{
+    vector<uint8_t> out;
+    size_t off = 0;
+    while (out.size() < size) {
+        REQUIRE(off < avail);
+        uint8_t token = data[off++];
+        if (token < 0x80) {
+            REQUIRE(off + token + 1 <= avail);
+            out.insert(out.end(), data + off, data + off + token + 1);
+            off += token + 1;
+        } else {
+            REQUIRE(off + 2 <= avail);
+            size_t len = token - 0x80 + COREDUMP_LZ_MIN_MATCH;
+            size_t dist = data[off] | (data[off + 1] << 8);
+            off += 2;
+            REQUIRE(dist > 0);
+            REQUIRE(dist <= out.size());
+            for (size_t i = 0; i < len; i++) {
+                out.push_back(out[out.size() - dist]);
+            }
+        }
+    }
+    CHECK(out.size() == size);
+    *consumed = align4(off);
+    return out;
+}
+
+/* Converts core dump data to the uncompressed format, with padding */
+static vector<uint8_t> expand_dump(const vector<uint8_t> &dump)
+{
+    vector<uint8_t> out(dump.begin(), dump.begin() + sizeof(core_dump_header_t));
+    bool compressed = read32(dump, 4) == COREDUMP_VERSION_COMPRESSED;
+    uint32_t tasks_num = read32(dump, 8);
+    uint32_t tcb_sz = read32(dump, 12);
+    size_t off = sizeof(core_dump_header_t);
+
+    auto copy_block = [&](uint32_t len) {
+        if (compressed) {
+            size_t consumed;
+            vector<uint8_t> data = lz_decompress(&dump[off], dump.size() - off, len, &consumed);
+            data.resize(align4(len), 0);
+            out.insert(out.end(), data.begin(), data.end());
+            off += consumed;
+        } else {
+            out.insert(out.end(), dump.begin() + off, dump.begin() + off + align4(len));
+            off += align4(len);
+        }
+    };
+
+    for (uint32_t i = 0; i < tasks_num; i++) {
+        core_dump_task_header_t task;
+        memcpy(&task, &dump[off], sizeof(task));
+        out.insert(out.end(), dump.begin() + off, dump.begin() + off + sizeof(task));
+        off += sizeof(task);
+        copy_block(tcb_sz);
+        copy_block(task.stack_end - task.stack_start);
+    }
+    REQUIRE(off == dump.size());
+    return out;
+}
+
+/* Checks the core dump data against the fixture they were written from, the length field differs */
+static void check_core_dump(const vector<uint8_t> &data, const vector<uint8_t> &fixture)
+{
+    vector<uint8_t> expanded = expand_dump(data);
+    REQUIRE(expanded.size() == fixture.size());
+    CHECK(memcmp(&expanded[8], &fixture[8], fixture.size() - 8) == 0);
+}
+
+/* Runs the core dump writer, returns the core dump data in flash, without CRC */
+static vector<uint8_t> write_core_dump(uint32_t partition_size = PARTITION_SIZE)
+{
+    vector<uint8_t> fixture = load_b64("../test/coredump.b64");
+    load_tasks(fixture);
+    s_partition.size = partition_size;
+
+    SpiFlashEmulator flash(FLASH_SECTORS);
+    s_flash = &flash;
+    esp_core_dump_flash_init();
+    flash.clearStats();
+    esp_core_dump_to_flash(NULL);
+
+    const uint8_t *part = flash.bytes() + PARTITION_OFFSET;
+    uint32_t data_len;
+    memcpy(&data_len, part, sizeof(data_len));
+    REQUIRE(data_len > sizeof(core_dump_header_t));
+    REQUIRE(data_len <= partition_size);
+
+    size_t addr, size;
+    CHECK(esp_core_dump_image_get(&addr, &size) == ESP_OK);
+    CHECK(addr == PARTITION_OFFSET);
+    CHECK(size == data_len);
+
+    /* Data are programmed in whole pages, only the last write can be shorter. Length field is programmed again
+       at the end, and only the sectors which hold the data are erased. */
+    size_t pages = (data_len + PAGE_SIZE - 1) / PAGE_SIZE;
+    CHECK(flash.getWriteOps() <= pages + 1);
+    CHECK(flash.getWriteBytes() == data_len + sizeof(uint32_t));
+    CHECK(flash.getEraseOps() == (data_len + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE);
+    printf("core dump version %u: %u bytes (uncompressed %u), %zu flash writes, %zu erases, ~%zu us\n",
+           part[4], data_len, (unsigned) fixture.size() + 4, flash.getWriteOps(), flash.getEraseOps(), flash.getTotalTime());
+
+    vector<uint8_t> data(part, part + data_len - sizeof(core_dump_crc_t));
+    s_flash = NULL;
+
+    /* Contents are the same as in the fixture, only the length includes the CRC */
+    check_core_dump(data, fixture);
+    return data;
+}
+
+TEST_CASE("core dump is printed to UART as base64 lines", "[espcoredump]")
+{
+    static uint8_t *periph;
+    if (!periph) {
+        periph = (uint8_t *) mmap((void *) PERIPH_START, PERIPH_END - PERIPH_START, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        REQUIRE(periph == (uint8_t *) PERIPH_START);
+    }
+    vector<uint8_t> fixture = load_b64("../test/coredump.b64");
+    load_tasks(fixture);
+
+    s_uart_output.clear();
+    esp_core_dump_to_uart(NULL);
+
+    const string start = "================= CORE DUMP START =================\r\n";
+    const string end = "================= CORE DUMP END =================\r\n";
+    size_t start_pos = s_uart_output.find(start);
+    size_t end_pos = s_uart_output.find(end);
+    REQUIRE(start_pos != string::npos);
+    REQUIRE(end_pos != string::npos);
+    string b64 = s_uart_output.substr(start_pos + start.size(), end_pos - start_pos - start.size());
+
+    /* Data are one base64 stream in lines of 64 characters, only the last line is shorter */
+    istringstream lines(b64);
+    string line;
+    size_t chars = 0;
+    while (getline(lines, line)) {
+        REQUIRE(line.back() == '\r');
+        line.pop_back();
+        CHECK(line.size() % 4 == 0);
+        CHECK(line.find('=') >= line.size() - 2);
+        if (chars + line.size() + 2 < b64.size()) {
+            CHECK(line.size() == 64);
+        }
+        chars += line.size() + 2;
+    }
+    CHECK(chars == b64.size());
+
+    istringstream f(b64);
+    vector<uint8_t> data = decode_b64(f);
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+    /* Length of compressed data is not known yet when the header is printed */
+    CHECK(read32(data, 0) >= data.size());
+#else
+    CHECK(read32(data, 0) == data.size());
+#endif
+    check_core_dump(data, fixture);
+}
+
+#if CONFIG_ESP32_CORE_DUMP_COMPRESS
+
+static esp_err_t collect_output(void *priv, void *data, uint32_t data_len)
+{
+    vector<uint8_t> *out = (vector<uint8_t> *) priv;
+    /* Core dump writers pad every chunk to 4 bytes */
+    CHECK(data_len % 4 == 0);
+    out->insert(out->end(), (uint8_t *) data, (uint8_t *) data + data_len);
+    return ESP_OK;
+}
+
+static vector<uint8_t> round_trip(const vector<uint8_t> &data)
+{
+    vector<uint8_t> out;
+    uint32_t len = 0, size_only = 0;
+    REQUIRE(esp_core_dump_lz_compress(data.data(), data.size(), collect_output, &out, &len) == ESP_OK);
+    REQUIRE(esp_core_dump_lz_compress(data.data(), data.size(), NULL, NULL, &size_only) == ESP_OK);
+    CHECK(len == out.size());
+    CHECK(size_only == len);
+    CHECK(len % 4 == 0);
+    /* Worst case, when there is nothing to compress */
+    CHECK(len <= align4(COREDUMP_LZ_MAX_LEN(data.size())));
+
+    size_t consumed;
+    CHECK(lz_decompress(out.data(), out.size(), data.size(), &consumed) == data);
+    CHECK(consumed == out.size());
+    return out;
+}
+
+TEST_CASE("compressed data can be decompressed", "[espcoredump]")
+{
+    srand(1);
+    for (size_t len = 0; len < 300; len += (len < 16) ? 1 : 37) {
+        vector<uint8_t> random(len);
+        for (auto &b : random) {
+            b = rand();
+        }
+        round_trip(random);
+        round_trip(vector<uint8_t>(len, 0xa5));
+    }
+
+    /* Like a task stack: fill pattern, then stack frames */
+    vector<uint8_t> stack(8192, 0xa5);
+    for (size_t i = 6000; i < stack.size(); i++) {
+        stack[i] = (i % 16 < 8) ? rand() : i / 16;
+    }
+    vector<uint8_t> compressed = round_trip(stack);
+    CHECK(compressed.size() < stack.size() / 3);
+
+    /* Longer than a segment, matches can't refer to the previous segment */
+    vector<uint8_t> large(0x10000 * 2 + 123);
+    for (size_t i = 0; i < large.size(); i++) {
+        large[i] = (i % 1000 < 10) ? rand() : i % 7;
+    }
+    round_trip(large);
+}
+
+TEST_CASE("write errors are returned", "[espcoredump]")
+{
+    vector<uint8_t> data(1000, 0x12);
+    auto fail = [](void *priv, void *data, uint32_t data_len) {
+        return ESP_FAIL;
+    };
+    uint32_t len;
+    CHECK(esp_core_dump_lz_compress(data.data(), data.size(), fail, NULL, &len) == ESP_FAIL);
+}
+
+TEST_CASE("compressed core dump is written to flash", "[espcoredump]")
+{
+    vector<uint8_t> data = write_core_dump();
+    CHECK(read32(data, 4) == COREDUMP_VERSION_COMPRESSED);
+
+    /* espcoredump.py is tested with the same data, uncompressed test/coredump.b64 has 8544 bytes */
+    vector<uint8_t> expected = load_b64("../test/coredump_lz.b64");
+    CHECK(data.size() + sizeof(core_dump_crc_t) == expected.size());
+    CHECK(memcmp(data.data(), expected.data(), data.size()) == 0);
+}
+
+TEST_CASE("compressed core dump is written to a partition too small for uncompressed one", "[espcoredump]")
+{
+    vector<uint8_t> data = write_core_dump(SPI_FLASH_SEC_SIZE);
+    CHECK(data.size() + sizeof(core_dump_crc_t) == load_b64("../test/coredump_lz.b64").size());
+}
+
+#else
+
+TEST_CASE("core dump is written to flash", "[espcoredump]")
+{
+    vector<uint8_t> data = write_core_dump();
+    CHECK(read32(data, 4) == COREDUMP_VERSION);
+}
+
+#endif
+
+/* Port layer, provides the tasks of the fixture */
+
+extern "C" uint32_t esp_core_dump_get_tasks_snapshot(core_dump_task_header_t* const tasks,
+        const uint32_t snapshot_size, uint32_t* const tcb_sz)
+{
+    REQUIRE(s_tasks.size() <= snapshot_size);
+    copy(s_tasks.begin(), s_tasks.end(), tasks);
+    *tcb_sz = s_tcb_sz;
+    return s_tasks.size();
+}
+
+extern "C" bool esp_tcb_addr_is_sane(uint32_t addr, uint32_t sz)
+{
+    return !(addr < DRAM_START || (addr + sz) > DRAM_END);
+}
+
+extern "C" bool esp_core_dump_process_tcb(void *frame, core_dump_task_header_t *task_snaphort, uint32_t tcb_sz)
+{
+    return esp_tcb_addr_is_sane(task_snaphort->tcb_addr, tcb_sz);
+}
+
+extern "C" bool esp_core_dump_process_stack(core_dump_task_header_t* task_snaphort, uint32_t *length)
+{
+    *length = align4(task_snaphort->stack_end - task_snaphort->stack_start);
+    return true;
+}
+
+/* Flash and partition functions used by the core dump code */
+
+extern "C" esp_err_t spi_flash_erase_range(size_t start_address, size_t size)
+{
+    REQUIRE(start_address % SPI_FLASH_SEC_SIZE == 0);
+    REQUIRE(size % SPI_FLASH_SEC_SIZE == 0);
+    for (size_t sec = start_address / SPI_FLASH_SEC_SIZE; sec < (start_address + size) / SPI_FLASH_SEC_SIZE; sec++) {
+        esp_err_t err = spi_flash_erase_sector(sec);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+extern "C" const spi_flash_guard_funcs_t g_flash_guard_no_os_ops = {};
+
+extern "C" void spi_flash_guard_set(const spi_flash_guard_funcs_t* funcs)
+{
+}
+
+extern "C" const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+        const char* label)
+{
+    return &s_partition;
+}
+
+extern "C" esp_err_t esp_partition_mmap(const esp_partition_t* partition, uint32_t offset, uint32_t size,
+                                        spi_flash_mmap_memory_t memory, const void** out_ptr, spi_flash_mmap_handle_t* out_handle)
+{
+    REQUIRE(s_flash != NULL);
+    REQUIRE(offset + size <= partition->size);
+    *out_ptr = s_flash->bytes() + partition->address + offset;
+    *out_handle = 0;
+    return ESP_OK;
+}
+
+extern "C" void spi_flash_munmap(spi_flash_mmap_handle_t handle)
+{
+}
+
+/* Clocks used by the UART core dump writer */
+
+extern "C" int esp_clk_cpu_freq(void)
+{
+    return 240000000;
+}
+
+extern "C" unsigned xthal_get_ccount(void)
+{
+    static unsigned ccount;
+    return ccount += 1000;
+}
+
+/* Logging */
+
+extern "C" int ets_printf(const char *fmt, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    REQUIRE(len < (int) sizeof(buf));
+    s_uart_output += buf;
+    return len;
+}
+
+extern "C" uint32_t esp_log_early_timestamp(void)
+{
+    return 0;
+}
+
+extern "C" uint32_t esp_log_timestamp(void)
+{
+    return 0;
+}
+
+extern "C" void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+}
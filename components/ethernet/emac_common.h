@@ -21,6 +21,7 @@ extern "C" {
 
 #include "esp_eth.h"
 #include "emac_dev.h"
+#include "emac_tx.h"
 
 typedef uint32_t emac_sig_t;
 typedef uint32_t emac_par_t;
@@ -52,9 +53,7 @@ struct emac_config_data {
     eth_mode_t mac_mode;
     eth_clock_mode_t clock_mode;
     struct dma_extended_desc *dma_etx;
-    uint32_t cur_tx;
-    uint32_t dirty_tx;
-    int32_t cnt_tx;
+    emac_tx_ring_t tx_ring;
     struct dma_extended_desc *dma_erx;
     uint32_t cur_rx;
     uint32_t dirty_rx;
@@ -64,6 +64,7 @@ static dma_extended_desc_t *emac_dma_rx_chain_buf;
 static dma_extended_desc_t *emac_dma_tx_chain_buf;
 static uint8_t *emac_dma_rx_buf[DMA_RX_BUF_NUM];
 static uint8_t *emac_dma_tx_buf[DMA_TX_BUF_NUM];
+static struct emac_tx_free emac_tx_free_list[DMA_TX_BUF_NUM];
 
 static SemaphoreHandle_t emac_g_sem = NULL;
 static portMUX_TYPE g_emac_mux = portMUX_INITIALIZER_UNLOCKED;
@@ -108,19 +109,6 @@ eth_speed_mode_t esp_eth_get_speed(void)
     return emac_config.emac_phy_get_speed_mode();
 }
 
-static void emac_setup_tx_desc(dma_extended_desc_t *tx_desc, uint32_t size)
-{
-    tx_desc->basic.desc1 = size & 0xfff;
-    tx_desc->basic.desc0 = EMAC_DESC_TX_OWN | EMAC_DESC_INT_COMPL | EMAC_DESC_LAST_SEGMENT |
-                           EMAC_DESC_FIRST_SEGMENT | EMAC_DESC_SECOND_ADDR_CHAIN;
-}
-
-static void emac_clean_tx_desc(dma_extended_desc_t *tx_desc)
-{
-    tx_desc->basic.desc1 = 0;
-    tx_desc->basic.desc0 = 0;
-}
-
 static void emac_clean_rx_desc(dma_extended_desc_t *rx_desc, uint32_t buf_ptr)
 {
     if (buf_ptr != 0) {
@@ -172,9 +160,7 @@ static void emac_set_rx_base_reg(void)
 */
 static void emac_reset_dma_chain(void)
 {
-    emac_config.cnt_tx = 0;
-    emac_config.cur_tx = 0;
-    emac_config.dirty_tx = 0;
+    emac_tx_ring_reset(&emac_config.tx_ring);
 
     emac_config.cnt_rx = 0;
     emac_config.cur_rx = 0;
@@ -189,23 +175,15 @@ static void emac_init_dma_chain(void)
 
     //init tx chain
     emac_config.dma_etx = emac_dma_tx_chain_buf;
-    emac_config.cnt_tx = 0;
-    emac_config.cur_tx = 0;
-    emac_config.dirty_tx = 0;
-
-    dma_phy = (uint32_t)(emac_config.dma_etx);
-    p = emac_config.dma_etx;
-
-    for (i = 0; i < (DMA_TX_BUF_NUM - 1); i++) {
-        dma_phy += sizeof(dma_extended_desc_t);
-        emac_clean_tx_desc(p);
-        p->basic.desc2 = (uint32_t)(emac_dma_tx_buf[i]);
-        p->basic.desc3 = dma_phy;
-        p++;
-    }
-    emac_clean_tx_desc(p);
-    p->basic.desc2 = (uint32_t)(emac_dma_tx_buf[i]);
-    p->basic.desc3 = (uint32_t)(emac_config.dma_etx);
+    emac_config.tx_ring.desc = emac_dma_tx_chain_buf;
+    emac_config.tx_ring.buf = emac_dma_tx_buf;
+    emac_config.tx_ring.free = emac_tx_free_list;
+    emac_config.tx_ring.num = DMA_TX_BUF_NUM;
+    emac_config.tx_ring.buf_size = DMA_TX_BUF_SIZE;
+#if CONFIG_EMAC_TX_ZERO_COPY
+    emac_config.tx_ring.direct = true;
+#endif
+    emac_tx_ring_init(&emac_config.tx_ring);
 
     //init rx chain
     emac_config.dma_erx = emac_dma_rx_chain_buf;
@@ -406,24 +384,14 @@ static esp_err_t emac_verify_args(void)
 
 static void emac_process_tx(void)
 {
-    uint32_t cur_tx_desc = emac_read_tx_cur_reg();
-
     if (emac_config.emac_status == EMAC_RUNTIME_STOP) {
         return;
     }
 
     xSemaphoreTakeRecursive(emac_tx_xMutex, portMAX_DELAY);
 
-    while (((uint32_t) & (emac_config.dma_etx[emac_config.dirty_tx])) != cur_tx_desc) {
-        emac_clean_tx_desc(&(emac_config.dma_etx[emac_config.dirty_tx]));
-        emac_config.dirty_tx = (emac_config.dirty_tx + 1) % DMA_TX_BUF_NUM;
-        emac_config.cnt_tx--;
-
-        if (emac_config.cnt_tx < 0) {
-            ESP_LOGE(TAG, "emac tx chain err");
-        }
-        cur_tx_desc = emac_read_tx_cur_reg();
-    }
+    uint32_t cur_tx_desc = (emac_read_tx_cur_reg() - (uint32_t)emac_config.dma_etx) / sizeof(dma_extended_desc_t);
+    emac_tx_ring_clean(&emac_config.tx_ring, cur_tx_desc);
 
     xSemaphoreGiveRecursive(emac_tx_xMutex);
 }
@@ -705,6 +673,16 @@ static void emac_hw_init(void)
 }
 
 esp_err_t esp_eth_tx(uint8_t *buf, uint16_t size)
+{
+    eth_tx_seg_t seg = {
+        .buf = buf,
+        .len = size,
+        .no_ref = true,
+    };
+    return esp_eth_tx_segs(&seg, 1, NULL, NULL);
+}
+
+esp_err_t esp_eth_tx_segs(const eth_tx_seg_t *segs, uint32_t count, eth_tx_free_func free_cb, void *free_arg)
 {
     esp_err_t ret = ESP_OK;
 
@@ -715,23 +693,12 @@ esp_err_t esp_eth_tx(uint8_t *buf, uint16_t size)
     }
 
     xSemaphoreTakeRecursive(emac_tx_xMutex, portMAX_DELAY);
-    if (emac_config.cnt_tx == DMA_TX_BUF_NUM - 1) {
+    ret = emac_tx_ring_put(&emac_config.tx_ring, segs, count, free_cb, free_arg);
+    if (ret == ESP_OK) {
+        emac_poll_tx_cmd();
+    } else if (ret == ESP_ERR_NO_MEM) {
         ESP_LOGD(TAG, "tx buf full");
-        ret = ESP_ERR_NO_MEM;
-        goto _exit;
     }
-
-    memcpy((void *)(emac_config.dma_etx[emac_config.cur_tx].basic.desc2), buf, size);
-
-    emac_setup_tx_desc(&(emac_config.dma_etx[emac_config.cur_tx]), size);
-
-    emac_config.cnt_tx++;
-    emac_config.cur_tx = (emac_config.cur_tx + 1) % DMA_TX_BUF_NUM;
-
-    emac_poll_tx_cmd();
-
-_exit:
-
     xSemaphoreGiveRecursive(emac_tx_xMutex);
     return ret;
 }
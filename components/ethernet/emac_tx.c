@@ -0,0 +1,172 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+
+#include "soc/soc_memory_layout.h"
+
+#include "emac_desc.h"
+#include "emac_tx.h"
+
+/* Address of a buffer or descriptor as seen by DMA */
+#ifndef EMAC_DMA_ADDR
+#define EMAC_DMA_ADDR(ptr) ((uint32_t)(ptr))
+#endif
+
+static inline bool emac_tx_seg_direct(const emac_tx_ring_t *ring, const eth_tx_seg_t *seg)
+{
+    return ring->direct && !seg->no_ref && seg->len >= EMAC_TX_DIRECT_MIN_LEN && esp_ptr_dma_capable(seg->buf);
+}
+
+static void emac_tx_ring_release(emac_tx_ring_t *ring, uint32_t i)
+{
+    dma_extended_desc_t *desc = &ring->desc[i];
+    struct emac_tx_free *free = &ring->free[i];
+
+    desc->basic.desc0 = 0;
+    desc->basic.desc1 = 0;
+    desc->basic.desc2 = EMAC_DMA_ADDR(ring->buf[i]);
+    if (free->cb) {
+        free->cb(free->arg);
+        free->cb = NULL;
+        free->arg = NULL;
+    }
+}
+
+void emac_tx_ring_init(emac_tx_ring_t *ring)
+{
+    for (uint32_t i = 0; i < ring->num; i++) {
+        ring->free[i].cb = NULL;
+        ring->free[i].arg = NULL;
+        emac_tx_ring_release(ring, i);
+        ring->desc[i].basic.desc3 = EMAC_DMA_ADDR(&ring->desc[(i + 1) % ring->num]);
+    }
+    ring->cur = 0;
+    ring->dirty = 0;
+    ring->cnt = 0;
+}
+
+void emac_tx_ring_reset(emac_tx_ring_t *ring)
+{
+    while (ring->cnt > 0) {
+        emac_tx_ring_release(ring, ring->dirty);
+        ring->dirty = (ring->dirty + 1) % ring->num;
+        ring->cnt--;
+    }
+    for (uint32_t i = 0; i < ring->num; i++) {
+        emac_tx_ring_release(ring, i);
+    }
+    ring->cur = 0;
+    ring->dirty = 0;
+    ring->cnt = 0;
+}
+
+esp_err_t emac_tx_ring_put(emac_tx_ring_t *ring, const eth_tx_seg_t *segs, uint32_t count,
+                           eth_tx_free_func free_cb, void *free_arg)
+{
+    uint32_t total = 0;
+    uint32_t needed = 0;
+    bool copying = false;
+
+    // consecutive copied segments share a descriptor
+    for (uint32_t i = 0; i < count; i++) {
+        total += segs[i].len;
+        if (emac_tx_seg_direct(ring, &segs[i])) {
+            needed++;
+            copying = false;
+        } else if (segs[i].len > 0 && !copying) {
+            needed++;
+            copying = true;
+        }
+    }
+    if (total == 0 || total > ring->buf_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // one descriptor is always left free to not reach dirty one
+    uint32_t available = ring->num - 1 - ring->cnt;
+    if (available == 0) {
+        return ESP_ERR_NO_MEM;
+    }
+    // without enough descriptors the whole frame is copied to one
+    bool direct = needed <= available;
+
+    uint32_t used = 0;
+    uint32_t fill = 0;
+    bool referenced = false;
+    copying = false;
+    for (uint32_t i = 0; i < count; i++) {
+        const eth_tx_seg_t *seg = &segs[i];
+        uint32_t cur = (ring->cur + used) % ring->num;
+        if (seg->len == 0) {
+            continue;
+        }
+        if (direct && emac_tx_seg_direct(ring, seg)) {
+            if (copying) {
+                ring->desc[cur].basic.desc1 = fill & EMAC_DESC_TX_BUFFER1_SIZE;
+                used++;
+                cur = (ring->cur + used) % ring->num;
+                copying = false;
+            }
+            ring->desc[cur].basic.desc1 = seg->len & EMAC_DESC_TX_BUFFER1_SIZE;
+            ring->desc[cur].basic.desc2 = EMAC_DMA_ADDR(seg->buf);
+            used++;
+            referenced = true;
+        } else {
+            if (!copying) {
+                fill = 0;
+                copying = true;
+            }
+            memcpy(ring->buf[cur] + fill, seg->buf, seg->len);
+            fill += seg->len;
+        }
+    }
+    if (copying) {
+        ring->desc[(ring->cur + used) % ring->num].basic.desc1 = fill & EMAC_DESC_TX_BUFFER1_SIZE;
+        used++;
+    }
+
+    uint32_t last = (ring->cur + used - 1) % ring->num;
+    if (referenced) {
+        ring->free[last].cb = free_cb;
+        ring->free[last].arg = free_arg;
+    }
+    // DMA may start on the first descriptor as soon as it owns it, the frame is complete by then
+    for (uint32_t i = used; i-- > 0;) {
+        uint32_t desc0 = EMAC_DESC_TX_OWN | EMAC_DESC_SECOND_ADDR_CHAIN;
+        if (i == 0) {
+            desc0 |= EMAC_DESC_FIRST_SEGMENT;
+        }
+        if (i == used - 1) {
+            desc0 |= EMAC_DESC_LAST_SEGMENT | EMAC_DESC_INT_COMPL;
+        }
+        ring->desc[(ring->cur + i) % ring->num].basic.desc0 = desc0;
+    }
+    ring->cur = (ring->cur + used) % ring->num;
+    ring->cnt += used;
+
+    if (!referenced && free_cb) {
+        free_cb(free_arg);
+    }
+    return ESP_OK;
+}
+
+void emac_tx_ring_clean(emac_tx_ring_t *ring, uint32_t hw_cur)
+{
+    while (ring->cnt > 0 && ring->dirty != hw_cur &&
+            !(ring->desc[ring->dirty].basic.desc0 & EMAC_DESC_TX_OWN)) {
+        emac_tx_ring_release(ring, ring->dirty);
+        ring->dirty = (ring->dirty + 1) % ring->num;
+        ring->cnt--;
+    }
+}
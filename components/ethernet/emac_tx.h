@@ -0,0 +1,71 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _EMAC_TX_H_
+#define _EMAC_TX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "esp_eth.h"
+#include "emac_dev.h"
+
+/* Smaller segments are copied, a descriptor per small segment costs more than the copy */
+#define EMAC_TX_DIRECT_MIN_LEN 256
+
+struct emac_tx_free {
+    eth_tx_free_func cb;
+    void *arg;
+};
+
+/*
+* TX descriptors are chained in a ring. Every descriptor has its own buffer, data of
+* several small segments are copied to one buffer. Large segments in DMA capable memory
+* are sent directly: descriptor points to the segment until it is transmitted.
+*
+* A frame takes one or several consecutive descriptors from cur, the first one is given
+* to DMA the last. Segment buffers are released when the last descriptor of the frame is
+* cleaned, cleaning goes from dirty up to the descriptor DMA is working on.
+*/
+typedef struct {
+    dma_extended_desc_t *desc;
+    uint8_t **buf;                  /* Own buffer of each descriptor */
+    struct emac_tx_free *free;      /* Release of segment buffers, set in the last descriptor of a frame */
+    uint32_t num;
+    uint32_t buf_size;
+    uint32_t cur;
+    uint32_t dirty;
+    int32_t cnt;
+    bool direct;                    /* Large segments may be sent without copy */
+} emac_tx_ring_t;
+
+/* Links descriptors of the ring to their buffers and each other, desc, buf, free, num and buf_size are set by caller */
+void emac_tx_ring_init(emac_tx_ring_t *ring);
+
+/* Releases all frames which are not cleaned and makes descriptors free */
+void emac_tx_ring_reset(emac_tx_ring_t *ring);
+
+/* Gives the frame to DMA, returns ESP_ERR_NO_MEM if there are no free descriptors */
+esp_err_t emac_tx_ring_put(emac_tx_ring_t *ring, const eth_tx_seg_t *segs, uint32_t count,
+                           eth_tx_free_func free_cb, void *free_arg);
+
+/* Cleans transmitted descriptors up to hw_cur, the index of descriptor DMA is working on */
+void emac_tx_ring_clean(emac_tx_ring_t *ring, uint32_t hw_cur);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -108,6 +108,16 @@ typedef esp_err_t (*eth_tcpip_input_func)(void *buffer, uint16_t len, void *eb);
 typedef void (*eth_gpio_config_func)(void);
 typedef bool (*eth_phy_get_partner_pause_enable_func)(void);
 typedef void (*eth_phy_power_enable_func)(bool enable);
+typedef void (*eth_tx_free_func)(void *arg);
+
+/**
+ * @brief Segment of a packet sent with esp_eth_tx_segs()
+ */
+typedef struct {
+    const void *buf;                        /*!< Segment data */
+    uint16_t len;                           /*!< Segment size (bytes) */
+    bool no_ref;                            /*!< Data can be changed once esp_eth_tx_segs() returns, they must be copied */
+} eth_tx_seg_t;
 
 /**
  * @brief ethernet configuration
@@ -186,6 +196,31 @@ esp_err_t esp_eth_init_internal(eth_config_t *config);
  */
 esp_err_t esp_eth_tx(uint8_t *buf, uint16_t size);
 
+/**
+ * @brief  Send packet made of several segments from tcp/ip to mac
+ *
+ * Large segments in DMA capable memory are sent directly from their buffers (see CONFIG_EMAC_TX_ZERO_COPY),
+ * other segments are copied to DMA buffers of the driver. Data are copied at most once.
+ *
+ * @note   total size of segments must be less than 1580
+ *
+ * @param[in] segs:  segments of packet data.
+ *
+ * @param[in] count:  number of segments.
+ *
+ * @param[in] free_cb:  called with free_arg when the driver does not use segment buffers anymore,
+ *                      it can be called before the function returns. Not called if an error is returned.
+ *
+ * @param[in] free_arg:  argument of free_cb.
+ *
+ * @return
+ *      - ESP_OK
+ *      - ESP_ERR_INVALID_STATE: driver is not started
+ *      - ESP_ERR_NO_MEM: no free DMA descriptors
+ *      - ESP_ERR_INVALID_SIZE: packet is empty or too large
+ */
+esp_err_t esp_eth_tx_segs(const eth_tx_seg_t *segs, uint32_t count, eth_tx_free_func free_cb, void *free_arg);
+
 /**
  * @brief  Enable ethernet interface
  *
@@ -0,0 +1,62 @@
+#include <stdbool.h>
+#include <assert.h>
+
+#include "fake_dma.h"
+
+#define FAKE_DMA_CAPABLE_SIZE (FAKE_DMA_MEM_SIZE / 2)
+
+static uint8_t s_mem[FAKE_DMA_MEM_SIZE] __attribute__((aligned(8)));
+static size_t s_dma_used;
+static size_t s_other_used;
+static size_t s_dma_saved;
+static size_t s_other_saved;
+
+void fake_dma_mem_reset(void)
+{
+    s_dma_used = 0;
+    s_other_used = 0;
+}
+
+void fake_dma_mem_save(void)
+{
+    s_dma_saved = s_dma_used;
+    s_other_saved = s_other_used;
+}
+
+void fake_dma_mem_restore(void)
+{
+    s_dma_used = s_dma_saved;
+    s_other_used = s_other_saved;
+}
+
+void *fake_dma_alloc(size_t size, int dma_capable)
+{
+    size = (size + 7) & ~7;
+    if (dma_capable) {
+        assert(s_dma_used + size <= FAKE_DMA_CAPABLE_SIZE);
+        s_dma_used += size;
+        return s_mem + s_dma_used - size;
+    }
+    assert(s_other_used + size <= FAKE_DMA_MEM_SIZE - FAKE_DMA_CAPABLE_SIZE);
+    s_other_used += size;
+    return s_mem + FAKE_DMA_CAPABLE_SIZE + s_other_used - size;
+}
+
+uint32_t fake_dma_addr(const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    assert(p >= s_mem && p <= s_mem + FAKE_DMA_MEM_SIZE);
+    return (uint32_t)(p - s_mem);
+}
+
+void *fake_dma_ptr(uint32_t addr)
+{
+    assert(addr <= FAKE_DMA_MEM_SIZE);
+    return s_mem + addr;
+}
+
+bool esp_ptr_dma_capable(const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    return p >= s_mem && p < s_mem + FAKE_DMA_CAPABLE_SIZE;
+}
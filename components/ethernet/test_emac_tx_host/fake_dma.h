@@ -0,0 +1,33 @@
+#pragma once
+
+/*
+ * Descriptors, buffers and packet data used in the tests are allocated in a fake
+ * memory, DMA addresses are 32 bit offsets in it. The first half of the memory is
+ * DMA capable, the second half is not.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FAKE_DMA_MEM_SIZE (256 * 1024)
+
+void fake_dma_mem_reset(void);
+
+/* Saves current allocation, restore frees everything allocated after it */
+void fake_dma_mem_save(void);
+
+void fake_dma_mem_restore(void);
+
+void *fake_dma_alloc(size_t size, int dma_capable);
+
+uint32_t fake_dma_addr(const void *ptr);
+
+void *fake_dma_ptr(uint32_t addr);
+
+#ifdef __cplusplus
+}
+#endif
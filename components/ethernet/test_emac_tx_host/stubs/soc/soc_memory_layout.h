@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdbool.h>
+
+/* Implemented by the fake DMA memory, see fake_dma.h */
+bool esp_ptr_dma_capable(const void *p);
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "catch.hpp"
+#include "fake_dma.h"
+#include "emac_desc.h"
+#include "emac_tx.h"
+
+typedef std::vector<uint8_t> Frame;
+
+/* TX ring with fake DMA engine which follows the descriptor chain like EMAC does */
+class FakeEmac {
+public:
+    FakeEmac(uint32_t num = 10, bool direct = true) : hw_cur(0), bufs(num), frees(num)
+    {
+        fake_dma_mem_reset();
+        desc = (dma_extended_desc_t *)fake_dma_alloc(num * sizeof(dma_extended_desc_t), 1);
+        for (uint32_t i = 0; i < num; i++) {
+            bufs[i] = (uint8_t *)fake_dma_alloc(1600, 1);
+        }
+        memset(&ring, 0, sizeof(ring));
+        ring.desc = desc;
+        ring.buf = bufs.data();
+        ring.free = frees.data();
+        ring.num = num;
+        ring.buf_size = 1600;
+        ring.direct = direct;
+        emac_tx_ring_init(&ring);
+        fake_dma_mem_save();
+    }
+
+    /* Sends frames until DMA reaches a descriptor it does not own */
+    void transmit()
+    {
+        while (desc[hw_cur].basic.desc0 & EMAC_DESC_TX_OWN) {
+            dma_extended_desc_t *d = &desc[hw_cur];
+            if (d->basic.desc0 & EMAC_DESC_FIRST_SEGMENT) {
+                CHECK(partial.empty());
+                partial.clear();
+            }
+            const uint8_t *data = (const uint8_t *)fake_dma_ptr(d->basic.desc2);
+            partial.insert(partial.end(), data, data + (d->basic.desc1 & EMAC_DESC_TX_BUFFER1_SIZE));
+            if (d->basic.desc0 & EMAC_DESC_LAST_SEGMENT) {
+                frames.push_back(partial);
+                partial.clear();
+            }
+            d->basic.desc0 &= ~EMAC_DESC_TX_OWN;
+            hw_cur = (dma_extended_desc_t *)fake_dma_ptr(d->basic.desc3) - desc;
+        }
+    }
+
+    /* Same as transmit() without keeping frames */
+    void complete()
+    {
+        while (desc[hw_cur].basic.desc0 & EMAC_DESC_TX_OWN) {
+            desc[hw_cur].basic.desc0 &= ~EMAC_DESC_TX_OWN;
+            hw_cur = (dma_extended_desc_t *)fake_dma_ptr(desc[hw_cur].basic.desc3) - desc;
+        }
+    }
+
+    void clean()
+    {
+        emac_tx_ring_clean(&ring, hw_cur);
+    }
+
+    emac_tx_ring_t ring;
+    dma_extended_desc_t *desc;
+    uint32_t hw_cur;
+    std::vector<Frame> frames;
+    Frame partial;
+
+private:
+    std::vector<uint8_t *> bufs;
+    std::vector<struct emac_tx_free> frees;
+};
+
+static int s_freed;
+
+static void count_free(void *arg)
+{
+    s_freed++;
+}
+
+/* Segment data in fake memory, filled with a pattern */
+static eth_tx_seg_t make_seg(uint16_t len, uint8_t seed, bool dma_capable = true, bool no_ref = false)
+{
+    uint8_t *data = (uint8_t *)fake_dma_alloc(len, dma_capable);
+    for (uint16_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)(seed + i);
+    }
+    eth_tx_seg_t seg = { data, len, no_ref };
+    return seg;
+}
+
+static Frame join(const std::vector<eth_tx_seg_t> &segs)
+{
+    Frame frame;
+    for (const eth_tx_seg_t &seg : segs) {
+        const uint8_t *data = (const uint8_t *)seg.buf;
+        frame.insert(frame.end(), data, data + seg.len);
+    }
+    return frame;
+}
+
+static esp_err_t put(FakeEmac &emac, const std::vector<eth_tx_seg_t> &segs)
+{
+    return emac_tx_ring_put(&emac.ring, segs.data(), segs.size(), count_free, NULL);
+}
+
+TEST_CASE("single segment is copied to one descriptor", "[emac_tx]")
+{
+    FakeEmac emac;
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> segs = { make_seg(1000, 1, true, true) };
+
+    CHECK(put(emac, segs) == ESP_OK);
+    CHECK(s_freed == 1);
+    CHECK(emac.ring.cnt == 1);
+    CHECK(emac.desc[0].basic.desc2 == fake_dma_addr(emac.ring.buf[0]));
+
+    emac.transmit();
+    REQUIRE(emac.frames.size() == 1);
+    CHECK(emac.frames[0] == join(segs));
+    emac.clean();
+    CHECK(emac.ring.cnt == 0);
+    CHECK(s_freed == 1);
+}
+
+TEST_CASE("small segments share a descriptor", "[emac_tx]")
+{
+    FakeEmac emac;
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> segs = { make_seg(14, 1), make_seg(20, 2), make_seg(0, 3), make_seg(200, 4) };
+
+    CHECK(put(emac, segs) == ESP_OK);
+    CHECK(emac.ring.cnt == 1);
+    CHECK(s_freed == 1);
+    emac.transmit();
+    REQUIRE(emac.frames.size() == 1);
+    CHECK(emac.frames[0] == join(segs));
+}
+
+TEST_CASE("large segments are sent from their buffers", "[emac_tx]")
+{
+    FakeEmac emac;
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> segs = { make_seg(14, 1), make_seg(300, 2), make_seg(40, 3),
+                                       make_seg(20, 4), make_seg(700, 5)
+                                     };
+
+    CHECK(put(emac, segs) == ESP_OK);
+    CHECK(emac.ring.cnt == 4);
+    CHECK(emac.desc[1].basic.desc2 == fake_dma_addr(segs[1].buf));
+    CHECK(emac.desc[3].basic.desc2 == fake_dma_addr(segs[4].buf));
+    CHECK((emac.desc[0].basic.desc0 & EMAC_DESC_FIRST_SEGMENT) != 0);
+    CHECK((emac.desc[0].basic.desc0 & EMAC_DESC_LAST_SEGMENT) == 0);
+    CHECK((emac.desc[3].basic.desc0 & EMAC_DESC_LAST_SEGMENT) != 0);
+    CHECK(s_freed == 0);
+
+    emac.transmit();
+    REQUIRE(emac.frames.size() == 1);
+    CHECK(emac.frames[0] == join(segs));
+    CHECK(s_freed == 0);
+    emac.clean();
+    CHECK(s_freed == 1);
+    CHECK(emac.ring.cnt == 0);
+    // descriptors are given their own buffers back
+    CHECK(emac.desc[1].basic.desc2 == fake_dma_addr(emac.ring.buf[1]));
+    CHECK(emac.desc[3].basic.desc2 == fake_dma_addr(emac.ring.buf[3]));
+}
+
+TEST_CASE("volatile segments and segments out of DMA memory are copied", "[emac_tx]")
+{
+    FakeEmac emac;
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> segs = { make_seg(14, 1), make_seg(500, 2, false), make_seg(500, 3, true, true) };
+
+    CHECK(put(emac, segs) == ESP_OK);
+    CHECK(emac.ring.cnt == 1);
+    CHECK(s_freed == 1);
+    emac.transmit();
+    REQUIRE(emac.frames.size() == 1);
+    CHECK(emac.frames[0] == join(segs));
+}
+
+TEST_CASE("direct send can be disabled", "[emac_tx]")
+{
+    FakeEmac emac(10, false);
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> segs = { make_seg(14, 1), make_seg(700, 2), make_seg(700, 3) };
+
+    CHECK(put(emac, segs) == ESP_OK);
+    CHECK(emac.ring.cnt == 1);
+    CHECK(s_freed == 1);
+    emac.transmit();
+    REQUIRE(emac.frames.size() == 1);
+    CHECK(emac.frames[0] == join(segs));
+}
+
+TEST_CASE("frame is copied when there are not enough free descriptors", "[emac_tx]")
+{
+    FakeEmac emac(4);
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> first = { make_seg(60, 1) };
+    std::vector<eth_tx_seg_t> second = { make_seg(14, 2), make_seg(600, 3), make_seg(600, 4) };
+
+    CHECK(put(emac, first) == ESP_OK);
+    CHECK(put(emac, second) == ESP_OK);
+    CHECK(emac.ring.cnt == 2);
+    CHECK(s_freed == 2);
+    emac.transmit();
+    REQUIRE(emac.frames.size() == 2);
+    CHECK(emac.frames[1] == join(second));
+}
+
+TEST_CASE("full ring and invalid frames are refused", "[emac_tx]")
+{
+    FakeEmac emac(4);
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> frame = { make_seg(100, 1) };
+
+    for (int i = 0; i < 3; i++) {
+        CHECK(put(emac, frame) == ESP_OK);
+    }
+    s_freed = 0;
+    CHECK(put(emac, frame) == ESP_ERR_NO_MEM);
+    CHECK(s_freed == 0);
+
+    emac.transmit();
+    emac.clean();
+    CHECK(put(emac, frame) == ESP_OK);
+
+    std::vector<eth_tx_seg_t> empty = { make_seg(0, 1) };
+    std::vector<eth_tx_seg_t> large = { make_seg(1000, 1), make_seg(601, 2) };
+    s_freed = 0;
+    CHECK(put(emac, empty) == ESP_ERR_INVALID_SIZE);
+    CHECK(put(emac, large) == ESP_ERR_INVALID_SIZE);
+    CHECK(s_freed == 0);
+}
+
+TEST_CASE("descriptors owned by DMA are not cleaned", "[emac_tx]")
+{
+    FakeEmac emac;
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> frame = { make_seg(14, 1), make_seg(1000, 2) };
+
+    CHECK(put(emac, frame) == ESP_OK);
+    emac.clean();
+    CHECK(emac.ring.cnt == 2);
+    CHECK(s_freed == 0);
+    emac.transmit();
+    CHECK(put(emac, frame) == ESP_OK);
+    emac.clean();
+    CHECK(emac.ring.cnt == 2);
+    CHECK(s_freed == 1);
+}
+
+TEST_CASE("reset releases frames which are not sent", "[emac_tx]")
+{
+    FakeEmac emac;
+    s_freed = 0;
+    std::vector<eth_tx_seg_t> frame = { make_seg(14, 1), make_seg(1000, 2) };
+
+    CHECK(put(emac, frame) == ESP_OK);
+    CHECK(put(emac, frame) == ESP_OK);
+    emac_tx_ring_reset(&emac.ring);
+    CHECK(s_freed == 2);
+    CHECK(emac.ring.cnt == 0);
+    CHECK(emac.ring.cur == 0);
+    for (uint32_t i = 0; i < emac.ring.num; i++) {
+        CHECK(emac.desc[i].basic.desc0 == 0);
+        CHECK(emac.desc[i].basic.desc2 == fake_dma_addr(emac.ring.buf[i]));
+    }
+}
+
+TEST_CASE("random frames go around the ring", "[emac_tx]")
+{
+    FakeEmac emac(6);
+    std::mt19937 rng(1234);
+    std::vector<Frame> sent;
+    int callbacks = 0;
+    s_freed = 0;
+
+    for (int i = 0; i < 2000; i++) {
+        std::vector<eth_tx_seg_t> segs;
+        uint32_t total = 0;
+        int count = 1 + rng() % 5;
+        for (int j = 0; j < count; j++) {
+            uint16_t len = rng() % 2 ? rng() % 64 : 200 + rng() % 400;
+            if (total + len > 1600) {
+                break;
+            }
+            total += len;
+            segs.push_back(make_seg(len, rng(), rng() % 4 != 0, rng() % 8 == 0));
+        }
+        esp_err_t ret = put(emac, segs);
+        if (ret == ESP_OK) {
+            sent.push_back(join(segs));
+            callbacks++;
+        } else if (ret == ESP_ERR_NO_MEM) {
+            i--;
+        } else {
+            CHECK(total == 0);
+        }
+        if (rng() % 3 == 0) {
+            emac.transmit();
+        }
+        if (rng() % 2 == 0) {
+            emac.clean();
+        }
+        if (i % 20 == 19) {
+            // segment data are not needed once all frames are sent
+            emac.transmit();
+            emac.clean();
+            CHECK(emac.ring.cnt == 0);
+            std::vector<Frame> frames;
+            frames.swap(emac.frames);
+            CHECK(frames == sent);
+            sent.clear();
+            fake_dma_mem_restore();
+        }
+    }
+    emac.transmit();
+    emac.clean();
+    CHECK(s_freed == callbacks);
+}
+
+TEST_CASE("chained frame send", "[.][benchmark]")
+{
+    const int frames = 200000;
+    std::vector<eth_tx_seg_t> segs;
+    FakeEmac emac(10, true);
+    segs = { make_seg(14, 1), make_seg(40, 2), make_seg(1446, 3) };
+    uint8_t *linear = (uint8_t *)fake_dma_alloc(1600, 1);
+
+    // previous path: the chain was copied to a new buffer, then to DMA buffer
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        size_t off = 0;
+        for (const eth_tx_seg_t &seg : segs) {
+            memcpy(linear + off, seg.buf, seg.len);
+            off += seg.len;
+        }
+        eth_tx_seg_t seg = { linear, (uint16_t)off, true };
+        emac_tx_ring_put(&emac.ring, &seg, 1, NULL, NULL);
+        emac.complete();
+            emac.clean();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("linearized and copied: %.3f us per frame\n", secs * 1e6 / frames);
+
+    for (bool direct : { false, true }) {
+        emac.ring.direct = direct;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            emac_tx_ring_put(&emac.ring, segs.data(), segs.size(), count_free, NULL);
+            emac.complete();
+            emac.clean();
+        }
+        secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("%s: %.3f us per frame\n", direct ? "large segment sent directly" : "gathered in one copy",
+               secs * 1e6 / frames);
+    }
+}
@@ -1,3 +1,3 @@
 COMPONENT_ADD_INCLUDEDIRS := modbus/include modbus_controller
-COMPONENT_PRIV_INCLUDEDIRS := . modbus port modbus/ascii modbus/functions modbus/rtu modbus/include 
-COMPONENT_SRCDIRS := . modbus port modbus/ascii modbus/functions modbus/rtu modbus_controller
\ No newline at end of file
+COMPONENT_PRIV_INCLUDEDIRS := . modbus port modbus/ascii modbus/functions modbus/rtu modbus/tcp modbus/include 
+COMPONENT_SRCDIRS := . modbus port modbus/ascii modbus/functions modbus/rtu modbus/tcp modbus_controller
\ No newline at end of file
@@ -39,6 +39,7 @@
 #include "mb.h"
 #include "mbconfig.h"
 #include "mbascii.h"
+#include "mbrtu.h"
 #include "mbframe.h"
 
 #include "mbcrc.h"
@@ -91,8 +92,7 @@ static volatile eMBRcvState eRcvState;
 
 /* We reuse the Modbus RTU buffer because only one buffer is needed and the
  * RTU buffer is bigger. */
-extern volatile UCHAR ucRTUBuf[];
-static volatile UCHAR *ucASCIIBuf = ucRTUBuf;
+static volatile UCHAR *ucASCIIBuf = xMBRTUBuf.ucBuf;
 
 static volatile USHORT usRcvBufferPos;
 static volatile eMBBytePos eBytePos;
@@ -31,6 +31,8 @@
 #ifndef _MB_CONFIG_H
 #define _MB_CONFIG_H
 
+#include "sdkconfig.h"              /* for CONFIG_MB_TCP_SUPPORT */
+
 #ifdef __cplusplus
 PR_BEGIN_EXTERN_C
 #endif
@@ -53,7 +55,11 @@ PR_BEGIN_EXTERN_C
 #define MB_RTU_ENABLED                          (  1 )
 
 /*! \brief If Modbus TCP support is enabled. */
+#ifdef CONFIG_MB_TCP_SUPPORT
+#define MB_TCP_ENABLED                          (  1 )
+#else
 #define MB_TCP_ENABLED                          (  0 )
+#endif
 
 /*! \brief The character timeout value for Modbus ASCII.
  *
@@ -31,6 +31,8 @@
 #ifndef _MB_PORT_H
 #define _MB_PORT_H
 
+#include "mbconfig.h"               /* for MB_TCP_ENABLED */
+
 #ifdef __cplusplus
 PR_BEGIN_EXTERN_C
 #endif
@@ -45,7 +45,7 @@
 
 /* ----------------------- Defines ------------------------------------------*/
 #define MB_SER_PDU_SIZE_MIN     4       /*!< Minimum size of a Modbus RTU frame. */
-#define MB_SER_PDU_SIZE_MAX     256     /*!< Maximum size of a Modbus RTU frame. */
+#define MB_SER_PDU_SIZE_MAX     MB_RTU_BUF_SIZE /*!< Maximum size of a Modbus RTU frame. */
 #define MB_SER_PDU_SIZE_CRC     2       /*!< Size of CRC field in PDU. */
 #define MB_SER_PDU_ADDR_OFF     0       /*!< Offset of slave address in Ser-PDU. */
 #define MB_SER_PDU_PDU_OFF      1       /*!< Offset of Modbus-PDU in Ser-PDU. */
@@ -69,7 +69,9 @@ typedef enum
 static volatile eMBSndState eSndState;
 static volatile eMBRcvState eRcvState;
 
-volatile UCHAR ucRTUBuf[MB_SER_PDU_SIZE_MAX];
+xMBRTUBufType xMBRTUBuf __attribute__( ( aligned( 4 ) ) );
+
+#define ucRTUBuf                ( xMBRTUBuf.ucBuf )
 
 static volatile UCHAR *pucSndBufferCur;
 static volatile USHORT usSndBufferCount;
@@ -45,6 +45,21 @@ BOOL            xMBRTUTransmitFSM( void );
 BOOL            xMBRTUTimerT15Expired( void );
 BOOL            xMBRTUTimerT35Expired( void );
 
+/* Frame buffer of Modbus RTU, also used by Modbus ASCII. It starts one byte after
+ * a word boundary: register values in PDUs (after address, function code and byte
+ * count or request header) are word aligned then and register callbacks can copy
+ * them a word at a time.
+ */
+#define MB_RTU_BUF_SIZE         256
+
+typedef struct
+{
+    UCHAR           ucPad;
+    volatile UCHAR  ucBuf[MB_RTU_BUF_SIZE];
+} xMBRTUBufType;
+
+extern xMBRTUBufType xMBRTUBuf;
+
 #ifdef __cplusplus
 PR_END_EXTERN_C
 #endif
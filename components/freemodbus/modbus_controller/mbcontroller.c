@@ -17,8 +17,10 @@
 // The modbus controller is responsible for processing of modbus packet and transfer data
 // into parameter instance.
 
+#include <string.h>                 // for memset, memcpy
 #include <sys/time.h>               // for calculation of time stamp in milliseconds
 #include "esp_log.h"                // for log_write
+#include "esp_timer.h"              // for esp_timer_get_time
 #include "freertos/FreeRTOS.h"      // for task creation and queue access
 #include "freertos/task.h"          // for task api access
 #include "freertos/event_groups.h"  // for event groups
@@ -30,37 +32,48 @@
 
 static const char* TAG = "MB_CONTROLLER";
 
+// Time to wait for Modbus TCP requests before the stack state is checked again
+#define MB_TCP_POLL_TIMEOUT (CONFIG_MB_EVENT_QUEUE_TIMEOUT)
+
+// Controller task events, used by mbcontroller_destroy() to stop the task polling the stack
+#define MB_EVENT_STACK_STOP     (BIT8)  // request to stop polling
+#define MB_EVENT_STACK_STOPPED  (BIT9)  // the task has stopped polling
+
 #define MB_CHECK(a, ret_val, str, ...) \
     if (!(a)) { \
         ESP_LOGE(TAG, "%s(%u): " str, __FUNCTION__, __LINE__, ##__VA_ARGS__); \
         return (ret_val); \
     }
 
-// The Macros below handle the endianness while transfer N byte data into buffer
-#define _XFER_4_RD(dst, src) { \
-    *(uint8_t *)(dst)++ = *(uint8_t*)(src + 1); \
-    *(uint8_t *)(dst)++ = *(uint8_t*)(src + 0); \
-    *(uint8_t *)(dst)++ = *(uint8_t*)(src + 3); \
-    *(uint8_t *)(dst)++ = *(uint8_t*)(src + 2); \
-    (src) += 4; \
-}
-
-#define _XFER_2_RD(dst, src) { \
-    *(uint8_t *)(dst)++ = *(uint8_t *)(src + 1); \
-    *(uint8_t *)(dst)++ = *(uint8_t *)(src + 0); \
-    (src) += 2; \
-}
-
-#define _XFER_4_WR(dst, src) { \
-    *(uint8_t *)(dst + 1) = *(uint8_t *)(src)++; \
-    *(uint8_t *)(dst + 0) = *(uint8_t *)(src)++; \
-    *(uint8_t *)(dst + 3) = *(uint8_t *)(src)++; \
-    *(uint8_t *)(dst + 2) = *(uint8_t *)(src)++ ; \
-}
-
-#define _XFER_2_WR(dst, src) { \
-    *(uint8_t *)(dst + 1) = *(uint8_t *)(src)++; \
-    *(uint8_t *)(dst + 0) = *(uint8_t *)(src)++; \
+// Copies registers between the PDU and a register area swapping bytes of each register
+// (Modbus data are big endian). Two registers are swapped at once when both buffers
+// have the same alignment. Words are accessed with memcpy(), the buffers may be of
+// any type and the compiler emits aligned word loads and stores for them.
+static void mb_copy_regs(uint8_t* dst, const uint8_t* src, uint16_t regs)
+{
+    if (((((uintptr_t)dst ^ (uintptr_t)src) & 3) == 0) && (((uintptr_t)src & 1) == 0)) {
+        if (((uintptr_t)src & 2) && (regs > 0)) {
+            dst[0] = src[1];
+            dst[1] = src[0];
+            dst += 2;
+            src += 2;
+            regs--;
+        }
+        for (; regs >= 2; regs -= 2) {
+            uint32_t word;
+            memcpy(&word, __builtin_assume_aligned(src, 4), sizeof(word));
+            word = ((word & 0x00FF00FF) << 8) | ((word >> 8) & 0x00FF00FF);
+            memcpy(__builtin_assume_aligned(dst, 4), &word, sizeof(word));
+            dst += 4;
+            src += 4;
+        }
+    }
+    for (; regs > 0; regs--) {
+        dst[0] = src[1];
+        dst[1] = src[0];
+        dst += 2;
+        src += 2;
+    }
 }
 
 #ifdef CONFIG_MB_CONTROLLER_SLAVE_ID_SUPPORT
@@ -90,10 +103,14 @@ static uint8_t mb_address = 0;
 static uint8_t mb_port = 0;
 static uint32_t mb_speed = 0;
 static uint16_t mb_parity = 0;
+static uint16_t mb_tcp_port = 0;
 
 // This is array of Modbus address area descriptors
 static mb_register_area_descriptor_t mb_area_descriptors[MB_PARAM_COUNT] = { 0 };
 
+// The last parameter information sent to application task
+static mb_param_info_t mb_last_param_info = { 0 };
+
 // The helper function to get time stamp in microseconds
 static uint64_t get_time_stamp()
 {
@@ -107,6 +124,16 @@ static esp_err_t send_param_info(mb_event_group_t par_type, uint16_t mb_offset,
 {
     esp_err_t error = ESP_FAIL;
     mb_param_info_t par_info;
+    // Repeated access to the same parameter is not queued again while application task has
+    // not received the previous notification (the newest item in the queue is the last sent one)
+    if ((uxQueueMessagesWaiting(mb_controller_notification_queue_handle) > 0)
+            && (mb_last_param_info.type == par_type)
+            && (mb_last_param_info.mb_offset == mb_offset)
+            && (mb_last_param_info.address == par_address)
+            && (mb_last_param_info.size == par_size)) {
+        ESP_LOGD(TAG, "Parameter info is merged with the queued one.");
+        return ESP_OK;
+    }
     // Check if queue is not full the send parameter information
     par_info.type = par_type;
     par_info.size = par_size;
@@ -115,6 +142,7 @@ static esp_err_t send_param_info(mb_event_group_t par_type, uint16_t mb_offset,
     par_info.mb_offset = mb_offset;
     BaseType_t status = xQueueSend(mb_controller_notification_queue_handle, &par_info, MB_PAR_INFO_TOUT);
     if (pdTRUE == status) {
+        mb_last_param_info = par_info;
         ESP_LOGD(TAG, "Queue send parameter info (type, address, size): %d, 0x%.4x, %d",
                 par_type, (uint32_t)par_address, par_size);
         error = ESP_OK;
@@ -127,6 +155,10 @@ static esp_err_t send_param_info(mb_event_group_t par_type, uint16_t mb_offset,
 static esp_err_t send_param_access_notification(mb_event_group_t event)
 {
     esp_err_t err = ESP_FAIL;
+    // Do not set the bits again while application task has not cleared them
+    if ((xEventGroupGetBits(mb_controller_event_group) & event) == event) {
+        return ESP_OK;
+    }
     mb_event_group_t bits = (mb_event_group_t)xEventGroupSetBits(mb_controller_event_group, (EventBits_t)event);
     if (bits & event) {
         ESP_LOGD(TAG, "The MB_REG_CHANGE_EVENT = 0x%.2x is set.", (uint8_t)event);
@@ -140,12 +172,29 @@ static void modbus_task(void *pvParameters) {
     // Main Modbus stack processing cycle
     for (;;) {
         BaseType_t status = xEventGroupWaitBits(mb_controller_event_group,
-                                                (BaseType_t)(MB_EVENT_STACK_STARTED),
+                                                (BaseType_t)(MB_EVENT_STACK_STARTED | MB_EVENT_STACK_STOP),
                                                 pdFALSE, // do not clear bits
                                                 pdFALSE,
                                                 portMAX_DELAY);
+        if (status & MB_EVENT_STACK_STOP) {
+            // The current poll is finished, the stack can be disabled now
+            xEventGroupClearBits(mb_controller_event_group, (EventBits_t)MB_EVENT_STACK_STOP);
+            xEventGroupSetBits(mb_controller_event_group, (EventBits_t)MB_EVENT_STACK_STOPPED);
+            continue;
+        }
         // Check if stack started then poll for data
         if (status & MB_EVENT_STACK_STARTED) {
+#if MB_TCP_ENABLED > 0
+            if (mb_type == MB_MODE_TCP) {
+                // Requests of all clients are processed one at a time,
+                // the stack receives the frame and then executes it and sends response
+                if (xMBTCPPortPoll(MB_TCP_POLL_TIMEOUT)) {
+                    (void)eMBPoll();
+                    (void)eMBPoll();
+                }
+                continue;
+            }
+#endif
             (void)eMBPoll(); // allow stack to process data
             (void)xMBPortSerialTxPoll(); // Send response buffer if ready
         }
@@ -185,6 +234,8 @@ esp_err_t mbcontroller_init(void) {
     mb_port = MB_UART_PORT;
     mb_speed = MB_DEVICE_SPEED;
     mb_parity = MB_PARITY_NONE;
+    // Notifications of a previous controller instance are not merged with the new ones
+    memset(&mb_last_param_info, 0, sizeof(mb_last_param_info));
 
     // Initialization of active context of the modbus controller
     BaseType_t status = 0;
@@ -235,8 +286,15 @@ esp_err_t mbcontroller_start(void)
 {
     eMBErrorCode status = MB_EIO;
     // Initialize Modbus stack using mbcontroller parameters
-    status = eMBInit((eMBMode)mb_type, (UCHAR)mb_address, (UCHAR)mb_port,
+#if MB_TCP_ENABLED > 0
+    if (mb_type == MB_MODE_TCP) {
+        status = eMBTCPInit((USHORT)mb_tcp_port);
+    } else
+#endif
+    {
+        status = eMBInit((eMBMode)mb_type, (UCHAR)mb_address, (UCHAR)mb_port,
                             (ULONG)mb_speed, (eMBParity)mb_parity);
+    }
     MB_CHECK((status == MB_ENOERR), ESP_ERR_INVALID_STATE,
             "mb stack initialization failure, eMBInit() returns (0x%x).", status);
 #ifdef CONFIG_MB_CONTROLLER_SLAVE_ID_SUPPORT
@@ -263,22 +321,35 @@ esp_err_t mbcontroller_destroy(void)
                                     (EventBits_t)MB_EVENT_STACK_STARTED);
     MB_CHECK((flag & MB_EVENT_STACK_STARTED),
                 ESP_ERR_INVALID_STATE, "mb stack stop event failure.");
+    // Wait until the task finishes the current poll, then neither the stack
+    // nor the client sockets are used by it
+    xEventGroupSetBits(mb_controller_event_group, (EventBits_t)MB_EVENT_STACK_STOP);
+    (void)xEventGroupWaitBits(mb_controller_event_group, (EventBits_t)MB_EVENT_STACK_STOPPED,
+                                pdTRUE, pdFALSE, portMAX_DELAY);
     // Desable and then destroy the Modbus stack
     mb_error = eMBDisable();
     MB_CHECK((mb_error == MB_ENOERR), ESP_ERR_INVALID_STATE, "mb stack disable failure.");
     (void)vTaskDelete(mb_controller_task_handle);
     (void)vQueueDelete(mb_controller_notification_queue_handle);
     (void)vEventGroupDelete(mb_controller_event_group);
+    memset(&mb_last_param_info, 0, sizeof(mb_last_param_info));
     mb_error = eMBClose();
     MB_CHECK((mb_error == MB_ENOERR), ESP_ERR_INVALID_STATE,
             "mb stack close failure returned (0x%x).", (uint32_t)mb_error);
+#if MB_TCP_ENABLED > 0
+    if (mb_type == MB_MODE_TCP) {
+        // The stack does not close the port (MB_PORT_HAS_CLOSE is not set), release the listening socket
+        vMBTCPPortClose();
+    }
+#endif
     return ESP_OK;
 }
 
 // Setup modbus controller parameters
 esp_err_t mbcontroller_setup(const mb_communication_info_t comm_info)
 {
-    MB_CHECK(((comm_info.mode == MB_MODE_RTU) || (comm_info.mode == MB_MODE_ASCII)),
+    MB_CHECK(((comm_info.mode == MB_MODE_RTU) || (comm_info.mode == MB_MODE_ASCII)
+                || ((comm_info.mode == MB_MODE_TCP) && (MB_TCP_ENABLED > 0))),
                 ESP_ERR_INVALID_ARG, "mb incorrect mode = (0x%x).",
                 (uint32_t)comm_info.mode);
     MB_CHECK((comm_info.slave_addr <= MB_ADDRESS_MAX),
@@ -293,6 +364,7 @@ esp_err_t mbcontroller_setup(const mb_communication_info_t comm_info)
     mb_port = (uint8_t)comm_info.port;
     mb_speed = (uint32_t)comm_info.baudrate;
     mb_parity = (uint8_t)comm_info.parity;
+    mb_tcp_port = comm_info.tcp_port;
     return ESP_OK;
 }
 
@@ -323,11 +395,7 @@ eMBErrorCode eMBRegInputCB(UCHAR * pucRegBuffer, USHORT usAddress,
         iRegIndex <<= 1; // register Address to byte address
         pucInputBuffer += iRegIndex;
         UCHAR* pucBufferStart = pucInputBuffer;
-        while (usRegs > 0) {
-            _XFER_2_RD(pucRegBuffer, pucInputBuffer);
-            iRegIndex += 2;
-            usRegs -= 1;
-        }
+        mb_copy_regs(pucRegBuffer, pucInputBuffer, usRegs);
         // Send access notification
         (void)send_param_access_notification(MB_EVENT_INPUT_REG_RD);
         // Send parameter info to application task
@@ -363,11 +431,7 @@ eMBErrorCode eMBRegHoldingCB(UCHAR * pucRegBuffer, USHORT usAddress,
         UCHAR* pucBufferStart = pucHoldingBuffer;
         switch (eMode) {
             case MB_REG_READ:
-                while (usRegs > 0) {
-                    _XFER_2_RD(pucRegBuffer, pucHoldingBuffer);
-                    iRegIndex += 2;
-                    usRegs -= 1;
-                };
+                mb_copy_regs(pucRegBuffer, pucHoldingBuffer, usRegs);
                 // Send access notification
                 (void)send_param_access_notification(MB_EVENT_HOLDING_REG_RD);
                 // Send parameter info
@@ -375,12 +439,7 @@ eMBErrorCode eMBRegHoldingCB(UCHAR * pucRegBuffer, USHORT usAddress,
                                 (uint8_t*)pucBufferStart, (uint16_t)usNRegs);
                 break;
             case MB_REG_WRITE:
-                while (usRegs > 0) {
-                    _XFER_2_WR(pucHoldingBuffer, pucRegBuffer);
-                    pucHoldingBuffer += 2;
-                    iRegIndex += 2;
-                    usRegs -= 1;
-                };
+                mb_copy_regs(pucHoldingBuffer, pucRegBuffer, usRegs);
                 // Send access notification
                 (void)send_param_access_notification(MB_EVENT_HOLDING_REG_WR);
                 // Send parameter info
@@ -415,11 +474,14 @@ eMBErrorCode eMBRegCoilsCB(UCHAR* pucRegBuffer, USHORT usAddress,
         CHAR* pucCoilsDataBuf = (CHAR*)(pucRegCoilsBuf + (iRegIndex >> 3));
         switch (eMode) {
             case MB_REG_READ:
+                // Unused bits of the last byte are zero
+                memset(pucRegBuffer, 0, (usNCoils + 7) >> 3);
                 while (usCoils > 0) {
-                    UCHAR ucResult = xMBUtilGetBits((UCHAR*)pucRegCoilsBuf, iRegIndex, 1);
-                    xMBUtilSetBits(pucRegBuffer, iRegIndex - (usAddress - usRegCoilsStart), 1, ucResult);
-                    iRegIndex++;
-                    usCoils--;
+                    UCHAR ucBits = (UCHAR)((usCoils > 8) ? 8 : usCoils);
+                    UCHAR ucResult = xMBUtilGetBits((UCHAR*)pucRegCoilsBuf, iRegIndex, ucBits);
+                    xMBUtilSetBits(pucRegBuffer, iRegIndex - (usAddress - usRegCoilsStart), ucBits, ucResult);
+                    iRegIndex += ucBits;
+                    usCoils -= ucBits;
                 }
                 // Send an event to notify application task about event
                 (void)send_param_access_notification(MB_EVENT_COILS_WR);
@@ -428,11 +490,12 @@ eMBErrorCode eMBRegCoilsCB(UCHAR* pucRegBuffer, USHORT usAddress,
                 break;
             case MB_REG_WRITE:
                 while (usCoils > 0) {
+                    UCHAR ucBits = (UCHAR)((usCoils > 8) ? 8 : usCoils);
                     UCHAR ucResult = xMBUtilGetBits(pucRegBuffer,
-                            iRegIndex - (usAddress - usRegCoilsStart), 1);
-                    xMBUtilSetBits((uint8_t*)pucRegCoilsBuf, iRegIndex, 1, ucResult);
-                    iRegIndex++;
-                    usCoils--;
+                            iRegIndex - (usAddress - usRegCoilsStart), ucBits);
+                    xMBUtilSetBits((uint8_t*)pucRegCoilsBuf, iRegIndex, ucBits, ucResult);
+                    iRegIndex += ucBits;
+                    usCoils -= ucBits;
                 }
                 // Send an event to notify application task about event
                 (void)send_param_access_notification(MB_EVENT_COILS_WR);
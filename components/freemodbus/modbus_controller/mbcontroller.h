@@ -108,6 +108,7 @@ typedef struct {
     uart_port_t port;                       /*!< Modbus communication port (UART) number */
     uint32_t baudrate;                      /*!< Modbus baudrate */
     uart_parity_t parity;                   /*!< Modbus UART parity settings */
+    uint16_t tcp_port;                      /*!< Modbus TCP port to listen on (MB_MODE_TCP), 0 for the default port 502 */
 } mb_communication_info_t;
 
 /**
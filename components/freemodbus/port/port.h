@@ -93,6 +93,10 @@ void vMBPortExitCritical(void);
 
 BOOL xMBPortSerialTxPoll();
 
+// Waits for client requests up to the timeout and passes the next one to the stack (Modbus TCP),
+// returns TRUE if the request is posted to the stack
+BOOL xMBTCPPortPoll( ULONG ulTimeoutMs );
+
 
 #ifdef __cplusplus
 }
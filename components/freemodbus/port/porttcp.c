@@ -0,0 +1,425 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// porttcp.c
+// Modbus TCP port of the stack: one listening socket and several client connections
+// served from the controller task. Clients may send next requests before they get
+// responses (pipelining), the requests are buffered and passed to the stack one at
+// a time, round robin between clients.
+
+/* ----------------------- System includes ----------------------------------*/
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lwip/sockets.h"
+#include "esp_log.h"
+
+/* ----------------------- Modbus includes ----------------------------------*/
+#include "sdkconfig.h"
+#include "mb.h"
+#include "mbport.h"
+#include "mbframe.h"
+
+#if MB_TCP_ENABLED > 0
+
+/* ----------------------- Defines ------------------------------------------*/
+#define MB_TCP_DEFAULT_PORT     (502)
+#define MB_TCP_MAX_CLIENTS      (CONFIG_MB_TCP_MAX_CLIENTS)
+
+// MBAP header fields, see mbtcp.c
+#define MB_TCP_PID              (2)
+#define MB_TCP_LEN              (4)
+#define MB_TCP_UID              (6)
+#define MB_TCP_FUNC             (7)
+
+#define MB_TCP_FRAME_SIZE_MAX   (MB_TCP_FUNC + MB_PDU_SIZE_MAX)
+// Room for one maximum size request and following pipelined requests
+#define MB_TCP_RX_BUF_SIZE      (MB_TCP_FRAME_SIZE_MAX * 2)
+
+/* ----------------------- Type definitions ---------------------------------*/
+typedef struct
+{
+    int             xSock;                          // Client socket, -1 if the slot is free
+    USHORT          usRxLen;                        // Received bytes which are not processed yet
+    USHORT          usTxPos;                        // Position of not sent part of the response
+    USHORT          usTxLen;                        // Length of the response being sent
+    UCHAR           ucRxBuf[MB_TCP_RX_BUF_SIZE];
+    UCHAR           ucTxBuf[MB_TCP_FRAME_SIZE_MAX];
+} xMBTCPClient;
+
+/* ----------------------- Variables ----------------------------------------*/
+static const CHAR *TAG = "MB_TCP";
+
+static int xListenSock = -1;
+static xMBTCPClient xClients[MB_TCP_MAX_CLIENTS];
+static USHORT usNextClient = 0;                     // The first client checked for requests
+
+// The request being processed by the stack and the client it came from.
+// The response is built in the same buffer.
+static xMBTCPClient *pxCurClient = NULL;
+static UCHAR ucTCPFrame[MB_TCP_FRAME_SIZE_MAX];
+static USHORT usTCPFrameLen = 0;
+
+/* ----------------------- Static functions ---------------------------------*/
+static BOOL
+xMBTCPPortSetNonBlocking( int xSock )
+{
+    int iFlags = fcntl( xSock, F_GETFL, 0 );
+    return ( iFlags >= 0 ) && ( fcntl( xSock, F_SETFL, iFlags | O_NONBLOCK ) >= 0 );
+}
+
+static void
+vMBTCPPortCloseClient( xMBTCPClient *pxClient )
+{
+    if( pxClient->xSock >= 0 )
+    {
+        ESP_LOGD( TAG, "Close client socket %d.", pxClient->xSock );
+        close( pxClient->xSock );
+    }
+    pxClient->xSock = -1;
+    pxClient->usRxLen = 0;
+    pxClient->usTxPos = 0;
+    pxClient->usTxLen = 0;
+    if( pxCurClient == pxClient )
+    {
+        pxCurClient = NULL;
+    }
+}
+
+static void
+vMBTCPPortAccept( void )
+{
+    int xSock = accept( xListenSock, NULL, NULL );
+    if( xSock < 0 )
+    {
+        return;
+    }
+    for( USHORT i = 0; i < MB_TCP_MAX_CLIENTS; i++ )
+    {
+        if( xClients[i].xSock < 0 )
+        {
+            // Responses are sent at once, Nagle's algorithm would delay pipelined ones
+            int iNoDelay = 1;
+            (void)setsockopt( xSock, IPPROTO_TCP, TCP_NODELAY, &iNoDelay, sizeof( iNoDelay ) );
+            if( !xMBTCPPortSetNonBlocking( xSock ) )
+            {
+                break;
+            }
+            xClients[i].xSock = xSock;
+            ESP_LOGD( TAG, "Client socket %d is accepted.", xSock );
+            return;
+        }
+    }
+    ESP_LOGW( TAG, "Client connection is rejected." );
+    close( xSock );
+}
+
+// Returns length of the complete request at the start of receive buffer, 0 if it is
+// not received yet or -1 if MBAP header is invalid
+static int
+iMBTCPPortFrameLen( const xMBTCPClient *pxClient )
+{
+    if( pxClient->usRxLen < MB_TCP_FUNC )
+    {
+        return 0;
+    }
+    const UCHAR *pucBuf = pxClient->ucRxBuf;
+    USHORT usPID = ( pucBuf[MB_TCP_PID] << 8U ) | pucBuf[MB_TCP_PID + 1];
+    USHORT usLen = ( pucBuf[MB_TCP_LEN] << 8U ) | pucBuf[MB_TCP_LEN + 1];
+    // The length includes unit identifier and PDU
+    if( ( usPID != 0 ) || ( usLen < 2 ) || ( usLen > MB_TCP_FRAME_SIZE_MAX - MB_TCP_UID ) )
+    {
+        return -1;
+    }
+    return ( pxClient->usRxLen >= MB_TCP_UID + usLen ) ? MB_TCP_UID + usLen : 0;
+}
+
+static void
+vMBTCPPortReceive( xMBTCPClient *pxClient )
+{
+    int iLen = recv( pxClient->xSock, &pxClient->ucRxBuf[pxClient->usRxLen],
+                     MB_TCP_RX_BUF_SIZE - pxClient->usRxLen, 0 );
+    if( iLen > 0 )
+    {
+        pxClient->usRxLen += iLen;
+    }
+    else if( ( iLen == 0 ) || ( ( errno != EAGAIN ) && ( errno != EWOULDBLOCK ) && ( errno != EINTR ) ) )
+    {
+        vMBTCPPortCloseClient( pxClient );
+    }
+}
+
+static void
+vMBTCPPortFlush( xMBTCPClient *pxClient )
+{
+    while( pxClient->usTxPos < pxClient->usTxLen )
+    {
+        int iLen = send( pxClient->xSock, &pxClient->ucTxBuf[pxClient->usTxPos],
+                         pxClient->usTxLen - pxClient->usTxPos, 0 );
+        if( iLen > 0 )
+        {
+            pxClient->usTxPos += iLen;
+        }
+        else
+        {
+            if( ( iLen < 0 ) && ( ( errno == EAGAIN ) || ( errno == EWOULDBLOCK ) ) )
+            {
+                // The rest is sent when the socket is writable
+                return;
+            }
+            if( ( iLen < 0 ) && ( errno == EINTR ) )
+            {
+                continue;
+            }
+            vMBTCPPortCloseClient( pxClient );
+            return;
+        }
+    }
+    pxClient->usTxPos = 0;
+    pxClient->usTxLen = 0;
+}
+
+static BOOL
+xMBTCPPortHasRequest( void )
+{
+    for( USHORT i = 0; i < MB_TCP_MAX_CLIENTS; i++ )
+    {
+        if( ( xClients[i].xSock >= 0 ) && ( xClients[i].usTxLen == 0 )
+            && ( iMBTCPPortFrameLen( &xClients[i] ) != 0 ) )
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+// Passes the next buffered request to the stack. Requests of a client are processed
+// in order, the next one waits until the response to the previous one is sent.
+static BOOL
+xMBTCPPortNextRequest( void )
+{
+    for( USHORT n = 0; n < MB_TCP_MAX_CLIENTS; n++ )
+    {
+        USHORT i = ( usNextClient + n ) % MB_TCP_MAX_CLIENTS;
+        xMBTCPClient *pxClient = &xClients[i];
+        if( ( pxClient->xSock < 0 ) || ( pxClient->usTxLen > 0 ) )
+        {
+            continue;
+        }
+        int iFrameLen = iMBTCPPortFrameLen( pxClient );
+        if( iFrameLen < 0 )
+        {
+            ESP_LOGW( TAG, "Invalid MBAP header from socket %d.", pxClient->xSock );
+            vMBTCPPortCloseClient( pxClient );
+        }
+        if( iFrameLen <= 0 )
+        {
+            continue;
+        }
+        memcpy( ucTCPFrame, pxClient->ucRxBuf, iFrameLen );
+        usTCPFrameLen = (USHORT)iFrameLen;
+        pxClient->usRxLen -= iFrameLen;
+        memmove( pxClient->ucRxBuf, &pxClient->ucRxBuf[iFrameLen], pxClient->usRxLen );
+        pxCurClient = pxClient;
+        usNextClient = ( i + 1 ) % MB_TCP_MAX_CLIENTS;
+        if( !xMBPortEventPost( EV_FRAME_RECEIVED ) )
+        {
+            // The request is lost, the client is disconnected as it would wait for the
+            // response forever. This also releases pxCurClient, so other requests are served.
+            ESP_LOGE( TAG, "Frame event post failed, close socket %d.", pxClient->xSock );
+            vMBTCPPortCloseClient( pxClient );
+            return FALSE;
+        }
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* ----------------------- Start implementation -----------------------------*/
+BOOL
+xMBTCPPortInit( USHORT usTCPPort )
+{
+    struct sockaddr_in xAddr;
+    int iReuse = 1;
+
+    for( USHORT i = 0; i < MB_TCP_MAX_CLIENTS; i++ )
+    {
+        xClients[i].xSock = -1;
+        xClients[i].usRxLen = 0;
+        xClients[i].usTxPos = 0;
+        xClients[i].usTxLen = 0;
+    }
+    pxCurClient = NULL;
+    usNextClient = 0;
+
+    xListenSock = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+    if( xListenSock < 0 )
+    {
+        ESP_LOGE( TAG, "socket() failed (errno %d).", errno );
+        return FALSE;
+    }
+    memset( &xAddr, 0, sizeof( xAddr ) );
+    xAddr.sin_family = AF_INET;
+    xAddr.sin_addr.s_addr = htonl( INADDR_ANY );
+    xAddr.sin_port = htons( ( usTCPPort == MB_TCP_PORT_USE_DEFAULT ) ? MB_TCP_DEFAULT_PORT : usTCPPort );
+    (void)setsockopt( xListenSock, SOL_SOCKET, SO_REUSEADDR, &iReuse, sizeof( iReuse ) );
+    if( ( bind( xListenSock, ( struct sockaddr * )&xAddr, sizeof( xAddr ) ) < 0 )
+        || ( listen( xListenSock, MB_TCP_MAX_CLIENTS ) < 0 )
+        || !xMBTCPPortSetNonBlocking( xListenSock ) )
+    {
+        ESP_LOGE( TAG, "Listening on port %u failed (errno %d).", ntohs( xAddr.sin_port ), errno );
+        close( xListenSock );
+        xListenSock = -1;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void
+vMBTCPPortClose( void )
+{
+    vMBTCPPortDisable( );
+    if( xListenSock >= 0 )
+    {
+        close( xListenSock );
+        xListenSock = -1;
+    }
+}
+
+void
+vMBTCPPortDisable( void )
+{
+    for( USHORT i = 0; i < MB_TCP_MAX_CLIENTS; i++ )
+    {
+        vMBTCPPortCloseClient( &xClients[i] );
+    }
+}
+
+BOOL
+xMBTCPPortPoll( ULONG ulTimeoutMs )
+{
+    fd_set xReadSet;
+    fd_set xWriteSet;
+    struct timeval xTimeout;
+    int xMaxSock = -1;
+    BOOL bFreeSlot = FALSE;
+
+    if( ( xListenSock < 0 ) || ( pxCurClient != NULL ) )
+    {
+        return FALSE;
+    }
+    FD_ZERO( &xReadSet );
+    FD_ZERO( &xWriteSet );
+    for( USHORT i = 0; i < MB_TCP_MAX_CLIENTS; i++ )
+    {
+        xMBTCPClient *pxClient = &xClients[i];
+        if( pxClient->xSock < 0 )
+        {
+            bFreeSlot = TRUE;
+            continue;
+        }
+        // A client which does not read responses is not read either
+        if( pxClient->usTxLen > 0 )
+        {
+            FD_SET( pxClient->xSock, &xWriteSet );
+        }
+        else if( pxClient->usRxLen < MB_TCP_RX_BUF_SIZE )
+        {
+            FD_SET( pxClient->xSock, &xReadSet );
+        }
+        else
+        {
+            continue;
+        }
+        xMaxSock = ( pxClient->xSock > xMaxSock ) ? pxClient->xSock : xMaxSock;
+    }
+    // New connections wait in the backlog while all slots are busy
+    if( bFreeSlot )
+    {
+        FD_SET( xListenSock, &xReadSet );
+        xMaxSock = ( xListenSock > xMaxSock ) ? xListenSock : xMaxSock;
+    }
+
+    // Do not wait for the network while buffered requests are waiting for the stack
+    if( xMBTCPPortHasRequest( ) )
+    {
+        ulTimeoutMs = 0;
+    }
+    xTimeout.tv_sec = ulTimeoutMs / 1000;
+    xTimeout.tv_usec = ( ulTimeoutMs % 1000 ) * 1000;
+    int iReady = select( xMaxSock + 1, &xReadSet, &xWriteSet, NULL, &xTimeout );
+    if( iReady < 0 )
+    {
+        if( errno != EINTR )
+        {
+            ESP_LOGE( TAG, "select() failed (errno %d).", errno );
+        }
+    }
+    else if( iReady > 0 )
+    {
+        for( USHORT i = 0; i < MB_TCP_MAX_CLIENTS; i++ )
+        {
+            xMBTCPClient *pxClient = &xClients[i];
+            if( pxClient->xSock < 0 )
+            {
+                continue;
+            }
+            if( FD_ISSET( pxClient->xSock, &xWriteSet ) )
+            {
+                vMBTCPPortFlush( pxClient );
+            }
+            else if( FD_ISSET( pxClient->xSock, &xReadSet ) )
+            {
+                vMBTCPPortReceive( pxClient );
+            }
+        }
+        if( bFreeSlot && FD_ISSET( xListenSock, &xReadSet ) )
+        {
+            vMBTCPPortAccept( );
+        }
+    }
+    return xMBTCPPortNextRequest( );
+}
+
+BOOL
+xMBTCPPortGetRequest( UCHAR **ppucMBTCPFrame, USHORT *usTCPLength )
+{
+    if( pxCurClient == NULL )
+    {
+        return FALSE;
+    }
+    *ppucMBTCPFrame = ucTCPFrame;
+    *usTCPLength = usTCPFrameLen;
+    return TRUE;
+}
+
+BOOL
+xMBTCPPortSendResponse( const UCHAR *pucMBTCPFrame, USHORT usTCPLength )
+{
+    xMBTCPClient *pxClient = pxCurClient;
+
+    pxCurClient = NULL;
+    if( ( pxClient == NULL ) || ( pxClient->xSock < 0 ) || ( usTCPLength > MB_TCP_FRAME_SIZE_MAX ) )
+    {
+        return FALSE;
+    }
+    memcpy( pxClient->ucTxBuf, pucMBTCPFrame, usTCPLength );
+    pxClient->usTxPos = 0;
+    pxClient->usTxLen = usTCPLength;
+    vMBTCPPortFlush( pxClient );
+    return ( pxClient->xSock >= 0 ) ? TRUE : FALSE;
+}
+
+#endif
@@ -0,0 +1,359 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "mb.h"
+#include "mbport.h"
+#include "fake_port.h"
+
+#define FAKE_PORT_EVENTS    4
+#define FAKE_PORT_TX_SIZE   256
+
+static eMBEventType s_events[FAKE_PORT_EVENTS];
+static size_t s_events_head;
+static size_t s_events_len;
+static int s_events_to_fail;
+
+static BOOL s_rx_enabled;
+static BOOL s_tx_enabled;
+static BOOL s_timer_enabled;
+static CHAR s_rx_byte;
+static uint8_t s_tx_buf[FAKE_PORT_TX_SIZE];
+static size_t s_tx_len;
+
+/* ----------------------- Modbus port ----------------------------------*/
+BOOL xMBPortEventInit(void)
+{
+    s_events_head = 0;
+    s_events_len = 0;
+    return TRUE;
+}
+
+BOOL xMBPortEventPost(eMBEventType eEvent)
+{
+    if (__atomic_load_n(&s_events_to_fail, __ATOMIC_SEQ_CST) > 0) {
+        __atomic_sub_fetch(&s_events_to_fail, 1, __ATOMIC_SEQ_CST);
+        return FALSE;
+    }
+    assert(s_events_len < FAKE_PORT_EVENTS);
+    s_events[(s_events_head + s_events_len++) % FAKE_PORT_EVENTS] = eEvent;
+    return TRUE;
+}
+
+BOOL xMBPortEventGet(eMBEventType *eEvent)
+{
+    if (s_events_len == 0) {
+        return FALSE;
+    }
+    *eEvent = s_events[s_events_head];
+    s_events_head = (s_events_head + 1) % FAKE_PORT_EVENTS;
+    s_events_len--;
+    return TRUE;
+}
+
+BOOL xMBPortSerialInit(UCHAR ucPort, ULONG ulBaudRate, UCHAR ucDataBits, eMBParity eParity)
+{
+    return TRUE;
+}
+
+BOOL xMBPortSerialTxPoll(void)
+{
+    // the test sends responses in fake_port_transfer()
+    return FALSE;
+}
+
+void vMBPortClose(void)
+{
+}
+
+void xMBPortSerialClose(void)
+{
+}
+
+void vMBPortSerialEnable(BOOL xRxEnable, BOOL xTxEnable)
+{
+    s_rx_enabled = xRxEnable;
+    s_tx_enabled = xTxEnable;
+}
+
+BOOL xMBPortSerialGetByte(CHAR *pucByte)
+{
+    *pucByte = s_rx_byte;
+    return TRUE;
+}
+
+BOOL xMBPortSerialPutByte(CHAR ucByte)
+{
+    assert(s_tx_len < FAKE_PORT_TX_SIZE);
+    s_tx_buf[s_tx_len++] = (uint8_t)ucByte;
+    return TRUE;
+}
+
+BOOL xMBPortTimersInit(USHORT usTimeOut50us)
+{
+    return TRUE;
+}
+
+void xMBPortTimersClose(void)
+{
+}
+
+void vMBPortTimersEnable(void)
+{
+    s_timer_enabled = TRUE;
+}
+
+void vMBPortTimersDisable(void)
+{
+    s_timer_enabled = FALSE;
+}
+
+void vMBPortTimersDelay(USHORT usTimeOutMS)
+{
+}
+
+static void poll_stack(void)
+{
+    while (s_events_len > 0) {
+        (void)eMBPoll();
+    }
+}
+
+size_t fake_port_transfer(const uint8_t *frame, size_t len, uint8_t *resp, size_t resp_size)
+{
+    // bus is idle since the previous transfer
+    if (s_timer_enabled) {
+        (void)pxMBPortCBTimerExpired();
+        poll_stack();
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        if (s_rx_enabled) {
+            s_rx_byte = (CHAR)frame[i];
+            (void)pxMBFrameCBByteReceived();
+        }
+    }
+    if (s_timer_enabled) {
+        (void)pxMBPortCBTimerExpired();
+    }
+    poll_stack();
+
+    s_tx_len = 0;
+    while (s_tx_enabled) {
+        (void)pxMBFrameCBTransmitterEmpty();
+    }
+    poll_stack();
+
+    size_t resp_len = (s_tx_len < resp_size) ? s_tx_len : resp_size;
+    memcpy(resp, s_tx_buf, resp_len);
+    return resp_len;
+}
+
+/* ----------------------- FreeRTOS ----------------------------------*/
+// Queues and event groups are shared by the test and the task threads
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool s_run_tasks;
+
+struct fake_task {
+    pthread_t thread;
+    bool started;
+    void (*func)(void *);
+    void *arg;
+};
+
+struct fake_queue {
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t items[];
+};
+
+struct fake_event_group {
+    EventBits_t bits;
+};
+
+void fake_port_run_tasks(bool enable)
+{
+    s_run_tasks = enable;
+}
+
+void fake_port_fail_events(int count)
+{
+    __atomic_store_n(&s_events_to_fail, count, __ATOMIC_SEQ_CST);
+}
+
+static void *task_thread(void *arg)
+{
+    struct fake_task *task = arg;
+    task->func(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(void (*func)(void *), const char *name, uint32_t stack_size, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    struct fake_task *task = calloc(1, sizeof(struct fake_task));
+    if (!task) {
+        return pdFALSE;
+    }
+    task->func = func;
+    task->arg = arg;
+    // otherwise the test polls the stack itself
+    if (s_run_tasks) {
+        if (pthread_create(&task->thread, NULL, task_thread, task) != 0) {
+            free(task);
+            return pdFALSE;
+        }
+        task->started = true;
+    }
+    *handle = task;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    struct fake_task *task = handle;
+    if (task->started) {
+        pthread_cancel(task->thread);
+        pthread_join(task->thread, NULL);
+    }
+    free(task);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct fake_queue) + length * item_size);
+    if (queue) {
+        queue->length = length;
+        queue->item_size = item_size;
+    }
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout)
+{
+    BaseType_t ret = errQUEUE_FULL;
+    pthread_mutex_lock(&s_lock);
+    if (queue->count < queue->length) {
+        UBaseType_t pos = (queue->head + queue->count++) % queue->length;
+        memcpy(&queue->items[pos * queue->item_size], item, queue->item_size);
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout)
+{
+    BaseType_t ret = pdFALSE;
+    pthread_mutex_lock(&s_lock);
+    if (queue->count > 0) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        ret = pdTRUE;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&s_lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&s_lock);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue);
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return calloc(1, sizeof(struct fake_event_group));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&s_lock);
+    EventBits_t new_bits = (group->bits |= bits);
+    pthread_mutex_unlock(&s_lock);
+    return new_bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    pthread_mutex_lock(&s_lock);
+    EventBits_t old_bits = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&s_lock);
+    return old_bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    pthread_mutex_lock(&s_lock);
+    EventBits_t cur_bits = group->bits;
+    pthread_mutex_unlock(&s_lock);
+    return cur_bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t timeout)
+{
+    for (;;) {
+        pthread_mutex_lock(&s_lock);
+        EventBits_t old_bits = group->bits;
+        // never blocks when the stack runs in the calling thread
+        bool done = !s_run_tasks || (timeout == 0)
+                    || (wait_for_all ? ((old_bits & bits) == bits) : (old_bits & bits));
+        if (done && clear_on_exit) {
+            group->bits &= ~bits;
+        }
+        pthread_mutex_unlock(&s_lock);
+        if (done) {
+            return old_bits;
+        }
+        // task threads are cancelled here
+        usleep(1000);
+    }
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    free(group);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
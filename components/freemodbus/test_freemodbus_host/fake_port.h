@@ -0,0 +1,47 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#pragma once
+
+// Serial port of the Modbus stack and FreeRTOS objects used by the controller,
+// the stack is polled by the test instead of the controller task unless
+// fake_port_run_tasks() is enabled
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sends the frame to the slave byte by byte, signals the end of frame (t3.5 timer expiry),
+ * polls the stack until it is idle and returns the length of the response (0 if none)
+ */
+size_t fake_port_transfer(const uint8_t *frame, size_t len, uint8_t *resp, size_t resp_size);
+
+/**
+ * Tasks created after this call run in their own threads (e.g. the controller task
+ * serving Modbus TCP clients), otherwise they are not started
+ */
+void fake_port_run_tasks(bool enable);
+
+/**
+ * The next count events posted by the stack or the TCP port fail, as if the event queue was full
+ */
+void fake_port_fail_events(int count);
+
+#ifdef __cplusplus
+}
+#endif
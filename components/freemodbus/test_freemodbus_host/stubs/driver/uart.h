@@ -0,0 +1,16 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum {
+    UART_NUM_0 = 0x0,
+    UART_NUM_1 = 0x1,
+    UART_NUM_2 = 0x2,
+    UART_NUM_MAX,
+} uart_port_t;
+
+typedef enum {
+    UART_PARITY_DISABLE = 0x0,
+    UART_PARITY_EVEN = 0x2,
+    UART_PARITY_ODD = 0x3
+} uart_parity_t;
@@ -0,0 +1,24 @@
+#pragma once
+
+// Minimal FreeRTOS API used by mbcontroller.c, implemented in fake_port.c
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE         0
+#define pdTRUE          1
+#define pdPASS          pdTRUE
+#define errQUEUE_FULL   0
+#define portMAX_DELAY   ((TickType_t) 0xffffffffUL)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,10 @@
+#pragma once
+
+// BSD sockets of the host are used instead of lwIP
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
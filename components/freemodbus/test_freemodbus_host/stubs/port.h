@@ -0,0 +1,43 @@
+#pragma once
+
+// Replaces port/port.h: the stack runs in one thread driven by the test
+
+#include <assert.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INLINE                      inline
+#define PR_BEGIN_EXTERN_C           extern "C" {
+#define PR_END_EXTERN_C             }
+
+#define ENTER_CRITICAL_SECTION( )
+#define EXIT_CRITICAL_SECTION( )
+
+typedef char    BOOL;
+
+typedef unsigned char UCHAR;
+typedef char    CHAR;
+
+typedef unsigned short USHORT;
+typedef short   SHORT;
+
+typedef unsigned long ULONG;
+typedef long    LONG;
+
+#ifndef TRUE
+#define TRUE            1
+#endif
+
+#ifndef FALSE
+#define FALSE           0
+#endif
+
+BOOL xMBPortSerialTxPoll(void);
+BOOL xMBTCPPortPoll(ULONG ulTimeoutMs);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#define CONFIG_MB_CONTROLLER_NOTIFY_QUEUE_SIZE  20
+#define CONFIG_MB_CONTROLLER_NOTIFY_TIMEOUT     20
+#define CONFIG_MB_CONTROLLER_STACK_SIZE         4096
+#define CONFIG_MB_SERIAL_TASK_PRIO              10
+#define CONFIG_MB_EVENT_QUEUE_TIMEOUT           20
+// TEST_MB_NO_TCP is the configuration without Modbus TCP, where the options are not defined
+#ifndef TEST_MB_NO_TCP
+#define CONFIG_MB_TCP_SUPPORT                   1
+#define CONFIG_MB_TCP_MAX_CLIENTS               8
+#endif
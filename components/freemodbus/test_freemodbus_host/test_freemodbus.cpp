@@ -0,0 +1,577 @@
+// Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+#include "fake_port.h"
+
+extern "C" {
+#include "port.h"
+#include "mbcontroller.h"
+#include "mbcrc.h"
+#include "mbconfig.h"
+}
+
+using std::vector;
+
+typedef vector<uint8_t> Frame;
+
+static const uint8_t SLAVE_ADDR = 1;
+
+// Parallel test runs on the same host listen on different ports
+static const uint16_t TCP_PORT = 20000 + getpid() % 10000;
+
+// Bitwise Modbus CRC, independent of the table used by the stack
+static uint16_t crc16(const uint8_t *data, size_t len)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+// Serial line frame: the PDU with address and CRC
+static Frame rtu(Frame frame)
+{
+    uint16_t crc = crc16(frame.data(), frame.size());
+    frame.push_back(crc & 0xFF);
+    frame.push_back(crc >> 8);
+    return frame;
+}
+
+static Frame transfer(const Frame &request)
+{
+    uint8_t resp[256];
+    size_t len = fake_port_transfer(request.data(), request.size(), resp, sizeof(resp));
+    return Frame(resp, resp + len);
+}
+
+// Bits of the area packed into bytes as they are sent in responses
+static Frame pack_bits(const uint8_t *area, int start, int count)
+{
+    Frame bytes((count + 7) / 8, 0);
+    for (int i = 0; i < count; i++) {
+        if (area[(start + i) / 8] & (1 << ((start + i) % 8))) {
+            bytes[i / 8] |= 1 << (i % 8);
+        }
+    }
+    return bytes;
+}
+
+// Slave with all register areas mapped, started and stopped by the test.
+// Serial slave is polled by the test, TCP slave is served by the controller task.
+struct Slave {
+    alignas(4) uint16_t holding[200];
+    alignas(4) uint16_t input[200];
+    alignas(4) uint8_t coils[32];
+    alignas(4) uint8_t discrete[32];
+
+    Slave(mb_mode_type_t mode = MB_MODE_RTU)
+    {
+        for (int i = 0; i < 200; i++) {
+            holding[i] = 0x1000 + i;
+            input[i] = 0x2000 + i;
+        }
+        memset(coils, 0xA5, sizeof(coils));
+        memset(discrete, 0x3C, sizeof(discrete));
+
+        fake_port_run_tasks(mode == MB_MODE_TCP);
+        REQUIRE(mbcontroller_init() == ESP_OK);
+        mb_communication_info_t comm = {};
+        comm.mode = mode;
+        comm.tcp_port = TCP_PORT;
+        comm.slave_addr = SLAVE_ADDR;
+        comm.port = UART_NUM_2;
+        comm.baudrate = 115200;
+        comm.parity = UART_PARITY_DISABLE;
+        REQUIRE(mbcontroller_setup(comm) == ESP_OK);
+        map(MB_PARAM_HOLDING, holding, sizeof(holding));
+        map(MB_PARAM_INPUT, input, sizeof(input));
+        map(MB_PARAM_COIL, coils, sizeof(coils));
+        map(MB_PARAM_DISCRETE, discrete, sizeof(discrete));
+        REQUIRE(mbcontroller_start() == ESP_OK);
+    }
+
+    ~Slave()
+    {
+        mbcontroller_destroy();
+        fake_port_run_tasks(false);
+    }
+
+    void map(mb_param_type_t type, void *area, size_t size)
+    {
+        mb_register_area_descriptor_t descr = {};
+        descr.type = type;
+        descr.start_offset = 0;
+        descr.address = area;
+        descr.size = size;
+        REQUIRE(mbcontroller_set_descriptor(descr) == ESP_OK);
+    }
+
+    int pending_notifications()
+    {
+        mb_param_info_t info;
+        int count = 0;
+        while (mbcontroller_get_param_info(&info, 0) == ESP_OK) {
+            count++;
+        }
+        return count;
+    }
+};
+
+TEST_CASE("CRC matches reference", "[freemodbus]")
+{
+    uint8_t frame[] = { 0x01, 0x03, 0x00, 0x00, 0x00, 0x0A };
+    CHECK(usMBCRC16(frame, sizeof(frame)) == 0xCDC5);
+
+    uint8_t data[256];
+    for (int i = 0; i < 1000; i++) {
+        size_t len = rand() % sizeof(data);
+        for (size_t j = 0; j < len; j++) {
+            data[j] = rand();
+        }
+        REQUIRE(usMBCRC16(data, len) == crc16(data, len));
+    }
+}
+
+TEST_CASE("frame corpus is processed by slave", "[freemodbus]")
+{
+    Slave slave;
+
+    struct Case {
+        const char *name;
+        Frame request;
+        Frame response;
+    };
+    const Case corpus[] = {
+        { "read holding, aligned", rtu({ 0x01, 0x03, 0x00, 0x00, 0x00, 0x03 }),
+          rtu({ 0x01, 0x03, 0x06, 0x10, 0x00, 0x10, 0x01, 0x10, 0x02 }) },
+        { "read holding, unaligned", rtu({ 0x01, 0x03, 0x00, 0x05, 0x00, 0x02 }),
+          rtu({ 0x01, 0x03, 0x04, 0x10, 0x05, 0x10, 0x06 }) },
+        { "read input", rtu({ 0x01, 0x04, 0x00, 0x04, 0x00, 0x04 }),
+          rtu({ 0x01, 0x04, 0x08, 0x20, 0x04, 0x20, 0x05, 0x20, 0x06, 0x20, 0x07 }) },
+        { "write single holding", rtu({ 0x01, 0x06, 0x00, 0x0A, 0xBE, 0xEF }),
+          rtu({ 0x01, 0x06, 0x00, 0x0A, 0xBE, 0xEF }) },
+        { "write multiple holding", rtu({ 0x01, 0x10, 0x00, 0x14, 0x00, 0x03, 0x06, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 }),
+          rtu({ 0x01, 0x10, 0x00, 0x14, 0x00, 0x03 }) },
+        { "read/write multiple holding", rtu({ 0x01, 0x17, 0x00, 0x00, 0x00, 0x02, 0x00, 0x1E, 0x00, 0x02, 0x04, 0xAA, 0xBB, 0xCC, 0xDD }),
+          rtu({ 0x01, 0x17, 0x04, 0x10, 0x00, 0x10, 0x01 }) },
+        { "illegal address", rtu({ 0x01, 0x03, 0x01, 0x2C, 0x00, 0x02 }),
+          rtu({ 0x01, 0x83, 0x02 }) },
+        { "illegal function", rtu({ 0x01, 0x2B, 0x00 }),
+          rtu({ 0x01, 0xAB, 0x01 }) },
+        { "bad CRC", { 0x01, 0x03, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00 }, {} },
+        { "other slave", rtu({ 0x02, 0x03, 0x00, 0x00, 0x00, 0x03 }), {} },
+        { "broadcast write", rtu({ 0x00, 0x06, 0x00, 0x28, 0x12, 0x34 }), {} },
+    };
+
+    for (const Case &c : corpus) {
+        INFO(c.name);
+        CHECK(transfer(c.request) == c.response);
+    }
+
+    CHECK(slave.holding[10] == 0xBEEF);
+    CHECK(slave.holding[20] == 0x1122);
+    CHECK(slave.holding[21] == 0x3344);
+    CHECK(slave.holding[22] == 0x5566);
+    CHECK(slave.holding[23] == 0x1000 + 23);
+    CHECK(slave.holding[30] == 0xAABB);
+    CHECK(slave.holding[31] == 0xCCDD);
+    CHECK(slave.holding[40] == 0x1234);
+}
+
+TEST_CASE("bit areas are transferred in bulk", "[freemodbus]")
+{
+    Slave slave;
+
+    for (int start : { 0, 3, 13 }) {
+        for (int count : { 1, 8, 10, 37 }) {
+            INFO("start " << start << " count " << count);
+            Frame bits = pack_bits(slave.coils, start, count);
+            Frame expected = { 0x01, 0x01, (uint8_t)bits.size() };
+            expected.insert(expected.end(), bits.begin(), bits.end());
+            CHECK(transfer(rtu({ 0x01, 0x01, 0x00, (uint8_t)start, 0x00, (uint8_t)count })) == rtu(expected));
+
+            bits = pack_bits(slave.discrete, start, count);
+            expected = { 0x01, 0x02, (uint8_t)bits.size() };
+            expected.insert(expected.end(), bits.begin(), bits.end());
+            CHECK(transfer(rtu({ 0x01, 0x02, 0x00, (uint8_t)start, 0x00, (uint8_t)count })) == rtu(expected));
+        }
+    }
+
+    // 12 coils starting from 5: 0xFF, 0x0A
+    uint8_t coils[sizeof(slave.coils)];
+    memcpy(coils, slave.coils, sizeof(coils));
+    CHECK(transfer(rtu({ 0x01, 0x0F, 0x00, 0x05, 0x00, 0x0C, 0x02, 0xFF, 0x0A }))
+          == rtu({ 0x01, 0x0F, 0x00, 0x05, 0x00, 0x0C }));
+    for (int i = 0; i < 12; i++) {
+        bool value = (i < 8) || ((0x0A >> (i - 8)) & 1);
+        coils[(5 + i) / 8] = (coils[(5 + i) / 8] & ~(1 << ((5 + i) % 8))) | (value << ((5 + i) % 8));
+    }
+    CHECK(memcmp(coils, slave.coils, sizeof(coils)) == 0);
+}
+
+TEST_CASE("repeated access notifications are merged", "[freemodbus]")
+{
+    Slave slave;
+    Frame read = rtu({ 0x01, 0x03, 0x00, 0x00, 0x00, 0x04 });
+
+    for (int i = 0; i < 10; i++) {
+        REQUIRE(transfer(read).size() == 13);
+    }
+    CHECK((mbcontroller_check_event(MB_EVENT_HOLDING_REG_RD) & MB_EVENT_HOLDING_REG_RD) != 0);
+    mb_param_info_t info;
+    REQUIRE(mbcontroller_get_param_info(&info, 0) == ESP_OK);
+    CHECK(info.type == MB_EVENT_HOLDING_REG_RD);
+    CHECK(info.mb_offset == 1);
+    CHECK(info.size == 4);
+    CHECK(slave.pending_notifications() == 0);
+
+    // a different range or type is reported separately
+    transfer(read);
+    transfer(rtu({ 0x01, 0x03, 0x00, 0x00, 0x00, 0x05 }));
+    transfer(rtu({ 0x01, 0x04, 0x00, 0x00, 0x00, 0x04 }));
+    transfer(read);
+    CHECK(slave.pending_notifications() == 4);
+
+    // the next access is reported after the previous notification was received
+    transfer(read);
+    CHECK(slave.pending_notifications() == 1);
+}
+
+TEST_CASE("random frames get valid responses", "[freemodbus]")
+{
+    Slave slave;
+    const uint8_t functions[] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x0F, 0x10, 0x17, 0x2B };
+
+    srand(1);
+    for (int i = 0; i < 5000; i++) {
+        Frame frame = { SLAVE_ADDR, functions[rand() % sizeof(functions)] };
+        int len = rand() % 20;
+        for (int j = 0; j < len; j++) {
+            frame.push_back(rand() % 4 ? rand() % 8 : rand());
+        }
+        Frame resp = transfer(rtu(frame));
+        INFO("request " << i << ": " << Catch::toString(frame) << " response " << Catch::toString(resp));
+        // address, function code and CRC at least (some short requests are echoed)
+        REQUIRE(resp.size() >= 4);
+        CHECK(resp[0] == SLAVE_ADDR);
+        CHECK((resp[1] & 0x7F) == frame[1]);
+        CHECK(crc16(resp.data(), resp.size()) == 0);
+        slave.pending_notifications();
+    }
+}
+
+#if MB_TCP_ENABLED == 0
+
+TEST_CASE("TCP mode is rejected without TCP support", "[freemodbus]")
+{
+    mb_communication_info_t comm = {};
+    comm.mode = MB_MODE_TCP;
+    comm.tcp_port = TCP_PORT;
+    comm.port = UART_NUM_2;
+    CHECK(mbcontroller_setup(comm) == ESP_ERR_INVALID_ARG);
+}
+
+#else
+
+// Modbus TCP client, requests are sent without waiting for responses to previous ones
+class Client
+{
+public:
+    Client() : m_tid(0)
+    {
+        m_sock = socket(AF_INET, SOCK_STREAM, 0);
+        REQUIRE(m_sock >= 0);
+        int nodelay = 1;
+        setsockopt(m_sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(TCP_PORT);
+        REQUIRE(connect(m_sock, (sockaddr *)&addr, sizeof(addr)) == 0);
+    }
+
+    ~Client()
+    {
+        close(m_sock);
+    }
+
+    // MBAP header and the PDU, returns the transaction ID
+    uint16_t send_request(const Frame &pdu, uint16_t pid = 0)
+    {
+        Frame adu = frame(++m_tid, pdu, pid);
+        REQUIRE(send(m_sock, adu.data(), adu.size(), 0) == (ssize_t)adu.size());
+        return m_tid;
+    }
+
+    void send_raw(const Frame &data)
+    {
+        REQUIRE(send(m_sock, data.data(), data.size(), 0) == (ssize_t)data.size());
+    }
+
+    // Whole response ADU, empty if nothing is received within the timeout or connection is closed
+    Frame receive(int timeout_ms = 2000)
+    {
+        Frame adu(7);
+        if (!receive_exact(&adu[0], 7, timeout_ms)) {
+            return Frame();
+        }
+        size_t len = (adu[4] << 8 | adu[5]) - 1;
+        adu.resize(7 + len);
+        if (!receive_exact(&adu[7], len, timeout_ms)) {
+            return Frame();
+        }
+        return adu;
+    }
+
+    bool closed_by_server()
+    {
+        uint8_t byte;
+        pollfd pfd = { m_sock, POLLIN, 0 };
+        return (poll(&pfd, 1, 2000) == 1) && (recv(m_sock, &byte, 1, 0) <= 0);
+    }
+
+    static Frame frame(uint16_t tid, const Frame &pdu, uint16_t pid = 0)
+    {
+        uint16_t len = pdu.size() + 1;
+        Frame adu = { (uint8_t)(tid >> 8), (uint8_t)tid, (uint8_t)(pid >> 8), (uint8_t)pid,
+                      (uint8_t)(len >> 8), (uint8_t)len, 0xFF };
+        adu.insert(adu.end(), pdu.begin(), pdu.end());
+        return adu;
+    }
+
+private:
+    bool receive_exact(uint8_t *buf, size_t len, int timeout_ms)
+    {
+        while (len > 0) {
+            pollfd pfd = { m_sock, POLLIN, 0 };
+            if (poll(&pfd, 1, timeout_ms) != 1) {
+                return false;
+            }
+            ssize_t ret = recv(m_sock, buf, len, 0);
+            if (ret <= 0) {
+                return false;
+            }
+            buf += ret;
+            len -= ret;
+        }
+        return true;
+    }
+
+    int m_sock;
+    uint16_t m_tid;
+};
+
+TEST_CASE("TCP clients share register areas", "[freemodbus][tcp]")
+{
+    Slave slave(MB_MODE_TCP);
+    Client writer, reader, other;
+
+    uint16_t tid = writer.send_request({ 0x06, 0x00, 0x0A, 0xBE, 0xEF });
+    CHECK(writer.receive() == Client::frame(tid, { 0x06, 0x00, 0x0A, 0xBE, 0xEF }));
+    CHECK(slave.holding[10] == 0xBEEF);
+
+    tid = reader.send_request({ 0x03, 0x00, 0x09, 0x00, 0x02 });
+    CHECK(reader.receive() == Client::frame(tid, { 0x03, 0x04, 0x10, 0x09, 0xBE, 0xEF }));
+
+    tid = other.send_request({ 0x04, 0x00, 0x00, 0x00, 0x01 });
+    CHECK(other.receive() == Client::frame(tid, { 0x04, 0x02, 0x20, 0x00 }));
+    tid = other.send_request({ 0x03, 0x01, 0x2C, 0x00, 0x02 });
+    CHECK(other.receive() == Client::frame(tid, { 0x83, 0x02 }));
+}
+
+TEST_CASE("pipelined TCP requests are answered in order", "[freemodbus][tcp]")
+{
+    Slave slave(MB_MODE_TCP);
+    const int clients = 4, depth = 30;
+    std::vector<std::unique_ptr<Client> > conns;
+    for (int i = 0; i < clients; i++) {
+        conns.emplace_back(new Client());
+    }
+
+    // each client writes its own registers and reads them back, all requests are sent at once
+    Frame all[clients];
+    for (int c = 0; c < clients; c++) {
+        for (int i = 0; i < depth; i++) {
+            uint8_t reg = c * 40 + i;
+            Frame adu = Client::frame(2 * i + 1, { 0x06, 0x00, reg, (uint8_t)c, (uint8_t)i });
+            all[c].insert(all[c].end(), adu.begin(), adu.end());
+            adu = Client::frame(2 * i + 2, { 0x03, 0x00, reg, 0x00, 0x01 });
+            all[c].insert(all[c].end(), adu.begin(), adu.end());
+        }
+        conns[c]->send_raw(all[c]);
+    }
+    for (int c = 0; c < clients; c++) {
+        for (int i = 0; i < depth; i++) {
+            uint8_t reg = c * 40 + i;
+            INFO("client " << c << " request " << i);
+            REQUIRE(conns[c]->receive() == Client::frame(2 * i + 1, { 0x06, 0x00, reg, (uint8_t)c, (uint8_t)i }));
+            REQUIRE(conns[c]->receive() == Client::frame(2 * i + 2, { 0x03, 0x02, (uint8_t)c, (uint8_t)i }));
+        }
+    }
+    CHECK(slave.holding[3 * 40 + 5] == 0x0305);
+}
+
+TEST_CASE("TCP requests split into segments are reassembled", "[freemodbus][tcp]")
+{
+    Slave slave(MB_MODE_TCP);
+    Client client;
+
+    Frame adu = Client::frame(7, { 0x03, 0x00, 0x00, 0x00, 0x7D });
+    for (uint8_t byte : adu) {
+        client.send_raw({ byte });
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    Frame resp = client.receive();
+    REQUIRE(resp.size() == 7 + 2 + 250);
+    CHECK(resp[1] == 7);
+    CHECK(resp[9] == 0x10);
+    CHECK(resp[10] == 0x00);
+}
+
+TEST_CASE("invalid MBAP header closes only its connection", "[freemodbus][tcp]")
+{
+    Slave slave(MB_MODE_TCP);
+    Client bad_pid, bad_len, good;
+
+    bad_pid.send_request({ 0x03, 0x00, 0x00, 0x00, 0x01 }, 1);
+    CHECK(bad_pid.closed_by_server());
+    bad_len.send_raw({ 0x00, 0x01, 0x00, 0x00, 0x04, 0x00, 0xFF, 0x03 });
+    CHECK(bad_len.closed_by_server());
+
+    uint16_t tid = good.send_request({ 0x03, 0x00, 0x00, 0x00, 0x01 });
+    CHECK(good.receive() == Client::frame(tid, { 0x03, 0x02, 0x10, 0x00 }));
+}
+
+TEST_CASE("TCP client waits for a free connection slot", "[freemodbus][tcp]")
+{
+    Slave slave(MB_MODE_TCP);
+    std::vector<std::unique_ptr<Client> > conns;
+    for (int i = 0; i < CONFIG_MB_TCP_MAX_CLIENTS; i++) {
+        conns.emplace_back(new Client());
+        conns.back()->send_request({ 0x04, 0x00, 0x00, 0x00, 0x01 });
+        REQUIRE(conns.back()->receive().size() == 11);
+    }
+
+    // connection is established by the network stack but not served
+    Client waiting;
+    waiting.send_request({ 0x04, 0x00, 0x00, 0x00, 0x01 });
+    CHECK(waiting.receive(200).empty());
+
+    conns.erase(conns.begin());
+    CHECK(waiting.receive().size() == 11);
+}
+
+TEST_CASE("TCP request lost by the stack closes its connection", "[freemodbus][tcp]")
+{
+    Slave slave(MB_MODE_TCP);
+    Client lost, other;
+
+    fake_port_fail_events(1);
+    lost.send_request({ 0x03, 0x00, 0x00, 0x00, 0x01 });
+    CHECK(lost.closed_by_server());
+
+    // requests of other clients are still served
+    uint16_t tid = other.send_request({ 0x03, 0x00, 0x00, 0x00, 0x01 });
+    CHECK(other.receive() == Client::frame(tid, { 0x03, 0x02, 0x10, 0x00 }));
+}
+
+#endif // MB_TCP_ENABLED
+
+TEST_CASE("register read throughput", "[.][benchmark]")
+{
+    Slave slave;
+    const int frames = 200000;
+    Frame read = rtu({ 0x01, 0x03, 0x00, 0x00, 0x00, 125 });
+    uint8_t resp[256];
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        fake_port_transfer(read.data(), read.size(), resp, sizeof(resp));
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("read of 125 holding registers: %.2f us per frame\n", secs * 1e6 / frames);
+
+    uint8_t data[256] = { 0 };
+    const int crcs = 200000;
+    volatile uint16_t crc = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < crcs; i++) {
+        crc = crc + usMBCRC16(data, sizeof(data));
+    }
+    secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("CRC of 256 byte frames: %.1f MB/s\n", crcs * sizeof(data) / secs / 1e6);
+}
+
+#if MB_TCP_ENABLED > 0
+
+TEST_CASE("TCP request throughput", "[.][benchmark]")
+{
+    Slave slave(MB_MODE_TCP);
+    const auto duration = std::chrono::milliseconds(500);
+
+    for (int clients : { 1, 4, 8 }) {
+        for (int depth : { 1, 8 }) {
+            std::vector<std::thread> threads;
+            std::vector<size_t> done(clients, 0);
+            for (int c = 0; c < clients; c++) {
+                threads.emplace_back([&, c]() {
+                    Client client;
+                    Frame read = { 0x03, 0x00, 0x00, 0x00, 0x10 };
+                    auto start = std::chrono::steady_clock::now();
+                    int pending = 0;
+                    while (std::chrono::steady_clock::now() - start < duration) {
+                        while (pending < depth) {
+                            client.send_request(read);
+                            pending++;
+                        }
+                        if (client.receive().size() != 7 + 2 + 32) {
+                            break;
+                        }
+                        pending--;
+                        done[c]++;
+                    }
+                    while (pending-- > 0) {
+                        client.receive();
+                    }
+                });
+            }
+            size_t total = 0;
+            for (int c = 0; c < clients; c++) {
+                threads[c].join();
+                total += done[c];
+            }
+            double secs = std::chrono::duration<double>(duration).count();
+            printf("%d clients, %d requests in flight each: %.0f requests/s\n", clients, depth, total / secs);
+        }
+    }
+}
+
+#endif // MB_TCP_ENABLED
@@ -21,6 +21,7 @@
 #include "multi_heap.h"
 #include "esp_log.h"
 #include "heap_private.h"
+#include "multi_heap_internal.h"
 
 /*
 This file, combined with a region allocator that supports multiple heaps, solves the problem that the ESP32 has RAM
@@ -60,6 +61,29 @@ bool heap_caps_match(const heap_t *heap, uint32_t caps)
     return heap->heap != NULL && ((get_all_caps(heap) & caps) == caps);
 }
 
+/*
+Try to allocate from a heap which can satisfy all the requested capabilities.
+*/
+IRAM_ATTR static inline void *heap_caps_malloc_from(heap_t *heap, size_t size, uint32_t caps)
+{
+    //If the heap is in DRAM and executable memory is requested, what we're going to get back is a DRAM address. If so,
+    //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and add a pointer to
+    //the DRAM equivalent before the address we're going to return.
+    bool dram_as_iram = (caps & MALLOC_CAP_EXEC) && heap->start >= SOC_DIRAM_DRAM_LOW && heap->start < SOC_DIRAM_DRAM_HIGH;
+    if (dram_as_iram) {
+        size += 4;
+    }
+    //Skip heaps which are known to be too full or fragmented without taking their lock
+    if (heap->heap == NULL || size > multi_heap_largest_free_hint(heap->heap)) {
+        return NULL;
+    }
+    void *ret = multi_heap_malloc(heap->heap, size);
+    if (ret != NULL && dram_as_iram) {
+        return dram_alloc_to_iram_addr(ret, size);
+    }
+    return ret;
+}
+
 /*
 Routine to allocate a bit of memory with certain capabilities. caps is a bitfield of MALLOC_CAP_* bits.
 */
@@ -85,6 +109,32 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
         size = (size + 3) & (~3);
     }
 
+    const heap_caps_index_t *index = &heap_caps_index;
+    if ((caps >> HEAP_CAPS_INDEX_CAPS) == 0 && !index->overflow) {
+        //Heaps which have all the requested capabilities
+        uint32_t all_heaps = UINT32_MAX;
+        for (uint32_t c = caps; c != 0; c &= c - 1) {
+            all_heaps &= index->all_heaps[__builtin_ctz(c)];
+        }
+        for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS && all_heaps != 0; prio++) {
+            //Of them, heaps which have at least one of the caps requested at this priority
+            uint32_t prio_heaps = 0;
+            for (uint32_t c = caps; c != 0; c &= c - 1) {
+                prio_heaps |= index->prio_heaps[prio][__builtin_ctz(c)];
+            }
+            prio_heaps &= all_heaps;
+            while (prio_heaps != 0) {
+                int i = 31 - __builtin_clz(prio_heaps);
+                ret = heap_caps_malloc_from(index->heaps[i], size, caps);
+                if (ret != NULL) {
+                    return ret;
+                }
+                prio_heaps &= ~(1U << i);
+            }
+        }
+        return NULL;
+    }
+
     for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
         //Iterate over heaps and check capabilities at this priority
         heap_t *heap;
@@ -96,21 +146,9 @@ IRAM_ATTR void *heap_caps_malloc( size_t size, uint32_t caps )
                 //Heap has at least one of the caps requested. If caps has other bits set that this prio
                 //doesn't cover, see if they're available in other prios.
                 if ((get_all_caps(heap) & caps) == caps) {
-                    //This heap can satisfy all the requested capabilities. See if we can grab some memory using it.
-                    if ((caps & MALLOC_CAP_EXEC) && heap->start >= SOC_DIRAM_DRAM_LOW && heap->start < SOC_DIRAM_DRAM_HIGH) {
-                        //This is special, insofar that what we're going to get back is a DRAM address. If so,
-                        //we need to 'invert' it (lowest address in DRAM == highest address in IRAM and vice-versa) and
-                        //add a pointer to the DRAM equivalent before the address we're going to return.
-                        ret = multi_heap_malloc(heap->heap, size + 4);
-                        if (ret != NULL) {
-                            return dram_alloc_to_iram_addr(ret, size + 4);
-                        }
-                    } else {
-                        //Just try to alloc, nothing special.
-                        ret = multi_heap_malloc(heap->heap, size);
-                        if (ret != NULL) {
-                            return ret;
-                        }
+                    ret = heap_caps_malloc_from(heap, size, caps);
+                    if (ret != NULL) {
+                        return ret;
                     }
                 }
             }
@@ -29,6 +29,30 @@ static const char *TAG = "heap_init";
 /* Linked-list of registered heaps */
 struct registered_heap_ll registered_heaps;
 
+heap_caps_index_t heap_caps_index;
+
+/* Add a heap to heap_caps_index, before it is added to registered_heaps */
+static void index_heap(heap_t *heap)
+{
+    heap_caps_index_t *index = &heap_caps_index;
+    if (index->num_heaps == HEAP_CAPS_INDEX_MAX_HEAPS) {
+        index->overflow = true;
+        return;
+    }
+    /* heap_caps_malloc() may be reading the index, so the heap is stored before its bit is set */
+    uint32_t bit = 1U << index->num_heaps;
+    index->heaps[index->num_heaps] = heap;
+    for (int cap = 0; cap < HEAP_CAPS_INDEX_CAPS; cap++) {
+        for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+            if (heap->caps[prio] & (1 << cap)) {
+                index->prio_heaps[prio][cap] |= bit;
+                index->all_heaps[cap] |= bit;
+            }
+        }
+    }
+    index->num_heaps++;
+}
+
 static void register_heap(heap_t *region)
 {
     region->heap = multi_heap_register((void *)region->start, region->end - region->start);
@@ -47,6 +71,9 @@ void heap_caps_enable_nonos_stack_heaps()
             register_heap(heap);
             if (heap->heap != NULL) {
                 multi_heap_set_lock(heap->heap, &heap->heap_mux);
+#ifdef CONFIG_HEAP_TASK_TRACKING
+                multi_heap_set_task_table(heap->heap, &heap->task_table);
+#endif
             }
         }
     }
@@ -139,10 +166,18 @@ void heap_caps_init()
 
     memcpy(heaps_array, temp_heaps, sizeof(heap_t)*num_heaps);
 
+    /* The first heap of the list is tried first, so it gets the highest bit of the index */
+    for (int i = num_heaps - 1; i >= 0; i--) {
+        index_heap(&heaps_array[i]);
+    }
+
     /* Iterate the heaps and set their locks, also add them to the linked list. */
     for (int i = 0; i < num_heaps; i++) {
         if (heaps_array[i].heap != NULL) {
             multi_heap_set_lock(heaps_array[i].heap, &heaps_array[i].heap_mux);
+#ifdef CONFIG_HEAP_TASK_TRACKING
+            multi_heap_set_task_table(heaps_array[i].heap, &heaps_array[i].task_table);
+#endif
         }
         if (i == 0) {
             SLIST_INSERT_HEAD(&registered_heaps, &heaps_array[0], next);
@@ -222,12 +257,16 @@ esp_err_t heap_caps_add_region_with_caps(const uint32_t caps[], intptr_t start,
         goto done;
     }
     multi_heap_set_lock(p_new->heap, &p_new->heap_mux);
+#ifdef CONFIG_HEAP_TASK_TRACKING
+    multi_heap_set_task_table(p_new->heap, &p_new->task_table);
+#endif
 
     /* (This insertion is atomic to registered_heaps, so
        we don't need to worry about thread safety for readers,
        only for writers. */
     static _lock_t registered_heaps_write_lock;
     _lock_acquire(&registered_heaps_write_lock);
+    index_heap(p_new);
     SLIST_INSERT_HEAD(&registered_heaps, p_new, next);
     _lock_release(&registered_heaps_write_lock);
 
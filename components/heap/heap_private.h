@@ -18,6 +18,7 @@
 #include <freertos/FreeRTOS.h>
 #include <soc/soc_memory_layout.h>
 #include "multi_heap.h"
+#include "multi_heap_internal.h"
 #include "rom/queue.h"
 
 #ifdef __cplusplus
@@ -35,6 +36,9 @@ typedef struct heap_t_ {
     intptr_t end;
     portMUX_TYPE heap_mux;
     multi_heap_handle_t heap;
+#ifdef CONFIG_HEAP_TASK_TRACKING
+    multi_heap_task_table_t task_table; ///< Allocation totals per task, kept by multi_heap
+#endif
     SLIST_ENTRY(heap_t_) next;
 } heap_t;
 
@@ -46,6 +50,27 @@ typedef struct heap_t_ {
 */
 extern SLIST_HEAD(registered_heap_ll, heap_t_) registered_heaps;
 
+/* Registered heaps indexed by capability, so heap_caps_malloc() finds the heaps which can satisfy a request without
+   walking registered_heaps and testing each heap.
+
+   Every heap gets a bit in the masks below, in order of registration. registered_heaps has the latest registered heap
+   first, so heaps are tried from the highest bit down to keep the order of the list. Requests with capabilities
+   outside of the index, and all requests once more than HEAP_CAPS_INDEX_MAX_HEAPS heaps are registered, walk
+   registered_heaps instead.
+*/
+#define HEAP_CAPS_INDEX_MAX_HEAPS 32
+#define HEAP_CAPS_INDEX_CAPS 13 /* MALLOC_CAP_EXEC up to MALLOC_CAP_DEFAULT */
+
+typedef struct {
+    heap_t *heaps[HEAP_CAPS_INDEX_MAX_HEAPS];
+    uint32_t prio_heaps[SOC_MEMORY_TYPE_NO_PRIOS][HEAP_CAPS_INDEX_CAPS]; ///< Heaps which have each capability at each priority
+    uint32_t all_heaps[HEAP_CAPS_INDEX_CAPS]; ///< Heaps which have each capability at any priority
+    size_t num_heaps;
+    bool overflow; ///< More heaps are registered than the index can hold
+} heap_caps_index_t;
+
+extern heap_caps_index_t heap_caps_index;
+
 bool heap_caps_match(const heap_t *heap, uint32_t caps);
 
 /* return all possible capabilities (across all priorities) for a given heap */
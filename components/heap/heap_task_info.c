@@ -21,6 +21,34 @@
 
 #ifdef CONFIG_HEAP_TASK_TRACKING
 
+/*
+ * Add allocations of a task in a heap of the given type to the totals,
+ * 'count' is the number of tasks in the totals array.
+ */
+static void add_task_totals(heap_task_info_params_t *params, size_t *count, TaskHandle_t task,
+                            uint32_t type, size_t size, size_t blocks)
+{
+    size_t i;
+    for (i = 0; i < *count; ++i) {
+        if (params->totals[i].task == task) {
+            break;
+        }
+    }
+    if (i == *count) {
+        if (*count == params->max_totals) {
+            return;
+        }
+        params->totals[i].task = task;
+        for (size_t t = 0; t < NUM_HEAP_TASK_CAPS; ++t) {
+            params->totals[i].size[t] = 0;
+            params->totals[i].count[t] = 0;
+        }
+        ++*count;
+    }
+    params->totals[i].size[type] += size;
+    params->totals[i].count[type] += blocks;
+}
+
 /*
  * Return per-task heap allocation totals and lists of blocks.
  *
@@ -68,8 +96,25 @@ size_t heap_caps_get_per_task_info(heap_task_info_params_t *params)
             continue;
         }
 
-        multi_heap_block_handle_t b = multi_heap_get_first_block(heap);
         multi_heap_internal_lock(heap);
+
+        // Totals are counted as blocks are allocated and freed, the heap only
+        // has to be walked for block details.
+        multi_heap_task_table_t *table = multi_heap_get_task_table(heap);
+        if (!(blocks && remaining > 0) && table != NULL && !table->overflow) {
+            if (params->totals) {
+                for (size_t i = 0; i < CONFIG_HEAP_TASK_TRACKING_TASKS; ++i) {
+                    const multi_heap_task_totals_t *t = &table->totals[i];
+                    if (t->count > 0) {
+                        add_task_totals(params, &count, (TaskHandle_t)t->task, type, t->size, t->count);
+                    }
+                }
+            }
+            multi_heap_internal_unlock(heap);
+            continue;
+        }
+
+        multi_heap_block_handle_t b = multi_heap_get_first_block(heap);
         for ( ; b ; b = multi_heap_get_next_block(heap, b)) {
             if (multi_heap_is_free(b)) {
                 continue;
@@ -80,24 +125,7 @@ size_t heap_caps_get_per_task_info(heap_task_info_params_t *params)
 
             // Accumulate per-task allocation totals.
             if (params->totals) {
-                size_t i;
-                for (i = 0; i < count; ++i) {
-                    if (params->totals[i].task == btask) {
-                        break;
-                    }
-                }
-                if (i < count) {
-                    params->totals[i].size[type] += bsize;
-                    params->totals[i].count[type] += 1;
-                }
-                else {
-                    if (count < params->max_totals) {
-                        params->totals[count].task = btask;
-                        params->totals[count].size[type] = bsize;
-                        params->totals[i].count[type] = 1;
-                        ++count;
-                    }
-                }
+                add_task_totals(params, &count, btask, type, bsize, 1);
             }
 
             // Return details about allocated blocks for selected tasks.
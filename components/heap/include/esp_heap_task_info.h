@@ -85,6 +85,11 @@ typedef struct {
  * Optionally also return an array of structs providing details about each
  * block allocated by one or more requested tasks, or by all tasks.
  *
+ * Totals are counted in each heap as blocks are allocated and freed, so
+ * returning only totals doesn't walk the heaps (unless more tasks have blocks
+ * in a heap than CONFIG_HEAP_TASK_TRACKING_TASKS). Block details always walk
+ * the heaps.
+ *
  * @param params Structure to hold all the parameters for the function
  * (@see heap_task_info_params_t).
  * @return Number of block detail structs returned (@see heap_task_block_t).
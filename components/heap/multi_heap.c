@@ -96,12 +96,26 @@ typedef struct heap_block {
 
    'last_block' is a pointer to a final free block of length 0, which is added at the end of the heap when it is
    registered. This block is also never allocated or merged into an adjacent block.
+
+   'free_blocks' and 'allocated_blocks' count blocks between these two, so multi_heap_get_info() doesn't have to walk
+   the heap.
+
+   'largest_free' is the data size of the largest free block, or 0 if it is not known and has to be found by walking
+   the free list (see find_largest_free()).
+
+   'task_table' holds allocation totals per task, kept by the heap poisoning functions when task tracking is enabled.
  */
 typedef struct multi_heap_info {
     void *lock;
     size_t free_bytes;
     size_t minimum_free_bytes;
+    size_t free_blocks;
+    size_t allocated_blocks;
+    size_t largest_free;
     heap_block_t *last_block;
+#ifdef CONFIG_HEAP_TASK_TRACKING
+    multi_heap_task_table_t *task_table;
+#endif
     heap_block_t first_block; /* initial 'free block', never allocated */
 } heap_t;
 
@@ -170,6 +184,35 @@ static void assert_valid_block(const heap_t *heap, const heap_block_t *block)
     }
 }
 
+/* Update the largest free block hint when the data size of a free block changes from 'old_size' to 'new_size'.
+   Size 0 means the block doesn't exist (is created or removed).
+*/
+static inline void free_block_resized(heap_t *heap, size_t old_size, size_t new_size)
+{
+    if (new_size >= heap->largest_free) {
+        if (heap->largest_free != 0) {
+            heap->largest_free = new_size;
+        }
+    } else if (old_size == heap->largest_free) {
+        /* the largest block shrinks or is gone, another one may be larger now */
+        heap->largest_free = 0;
+    }
+}
+
+/* Find the largest free block if it's not known. Only free blocks are walked. */
+static void find_largest_free(heap_t *heap)
+{
+    if (heap->largest_free != 0) {
+        return;
+    }
+    for (heap_block_t *b = heap->first_block.next_free; b != NULL && !is_last_block(b); b = b->next_free) {
+        size_t s = block_data_size(b);
+        if (s > heap->largest_free) {
+            heap->largest_free = s;
+        }
+    }
+}
+
 /* Get the first free block before 'block' in the heap. 'block' can be a free block or in use.
 
    Result is always the closest free block to 'block' in the heap, that is located before 'block'. There may be multiple
@@ -203,6 +246,9 @@ static heap_block_t *get_prev_free_block(heap_t *heap, const heap_block_t *block
 
    This operation may fail if block 'a' is the first block or 'b' is the last block,
    the caller should check block_data_size() to know if anything happened here or not.
+
+   If only one block is free, the caller accounts for its size in the largest free block hint
+   (see split_if_necessary()).
 */
 static heap_block_t *merge_adjacent(heap_t *heap, heap_block_t *a, heap_block_t *b)
 {
@@ -219,7 +265,14 @@ static heap_block_t *merge_adjacent(heap_t *heap, heap_block_t *a, heap_block_t
     MULTI_HEAP_ASSERT(get_next_block(a) == b, a); // Blocks should be in order
 
     bool free = is_free(a) && is_free(b); /* merging two free blocks creates a free block */
-    if (!free && (is_free(a) || is_free(b))) {
+    if (is_free(a) || is_free(b)) {
+        heap->free_blocks--;
+    }
+    if (free) {
+        size_t b_size = block_data_size(b);
+        free_block_resized(heap, block_data_size(a), block_data_size(a) + sizeof(b->header) + b_size);
+        free_block_resized(heap, b_size, 0);
+    } else if (is_free(a) || is_free(b)) {
         /* only one of these blocks is free, so resulting block will be a used block.
            means we need to take the free block out of the free list
          */
@@ -261,8 +314,11 @@ static heap_block_t *merge_adjacent(heap_t *heap, heap_block_t *a, heap_block_t
 
    'prev_free_block' is the free block before 'block', if already known. Can be NULL if not yet known.
    (This is a performance optimisation to avoid walking the freelist twice when possible.)
+
+   'used_free_size' is the data size of a free block which was just taken into 'block', or 0.
 */
-static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size, heap_block_t *prev_free_block)
+static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size, heap_block_t *prev_free_block,
+                               size_t used_free_size)
 {
     const size_t block_size = block_data_size(block);
     MULTI_HEAP_ASSERT(!is_free(block), block); // split block shouldn't be free
@@ -278,6 +334,7 @@ static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size, h
 
     if (is_free(next_block) && !is_last_block(next_block)) {
         /* The next block is free, just extend it upwards. */
+        size_t next_size = block_data_size(next_block);
         new_block->header = next_block->header;
         new_block->next_free = next_block->next_free;
         if (prev_free_block == NULL) {
@@ -288,6 +345,8 @@ static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size, h
                           &prev_free_block->next_free); // free blocks should be in order
         /* Note: We have not introduced a new block header, hence the simple math. */
         heap->free_bytes += block_size - size;
+        free_block_resized(heap, next_size, next_size + block_size - size);
+        free_block_resized(heap, used_free_size, 0);
 #ifdef MULTI_HEAP_POISONING_SLOW
         /* next_block header needs to be replaced with a fill pattern */
         multi_heap_internal_poison_fill_region(next_block, sizeof(heap_block_t), true /* free */);
@@ -296,6 +355,7 @@ static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size, h
         /* Insert a free block between the current and the next one. */
         if (block_data_size(block) < size + sizeof(heap_block_t)) {
             /* Can't split 'block' if we're not going to get a usable free block afterwards */
+            free_block_resized(heap, used_free_size, 0);
             return;
         }
         if (prev_free_block == NULL) {
@@ -307,6 +367,8 @@ static void split_if_necessary(heap_t *heap, heap_block_t *block, size_t size, h
         MULTI_HEAP_ASSERT(prev_free_block->next_free > new_block,
                           &prev_free_block->next_free); // free blocks should be in order
         heap->free_bytes += block_data_size(new_block);
+        heap->free_blocks++;
+        free_block_resized(heap, used_free_size, block_data_size(new_block));
     }
     block->header = (intptr_t)new_block;
     prev_free_block->next_free = new_block;
@@ -337,6 +399,9 @@ multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
         return NULL; /* 'size' is too small to fit a heap here */
     }
     heap->lock = NULL;
+#ifdef CONFIG_HEAP_TASK_TRACKING
+    heap->task_table = NULL;
+#endif
     heap->last_block = (heap_block_t *)(end - sizeof(heap_block_t));
 
     /* first 'real' (allocatable) free block goes after the heap structure */
@@ -361,6 +426,9 @@ multi_heap_handle_t multi_heap_register_impl(void *start_ptr, size_t size)
     */
     heap->free_bytes = size - sizeof(heap_t) - sizeof(first_free_block->header) - sizeof(heap_block_t);
     heap->minimum_free_bytes = heap->free_bytes;
+    heap->free_blocks = 1;
+    heap->allocated_blocks = 0;
+    heap->largest_free = heap->free_bytes;
 
     return heap;
 }
@@ -370,6 +438,26 @@ void multi_heap_set_lock(multi_heap_handle_t heap, void *lock)
     heap->lock = lock;
 }
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+void multi_heap_set_task_table(multi_heap_handle_t heap, multi_heap_task_table_t *table)
+{
+    memset(table, 0, sizeof(multi_heap_task_table_t));
+    multi_heap_internal_lock(heap);
+    heap->task_table = table;
+    for (heap_block_t *b = get_next_block(&heap->first_block); !is_last_block(b); b = get_next_block(b)) {
+        if (!is_free(b)) {
+            multi_heap_internal_count_task_block(heap, b->data, true);
+        }
+    }
+    multi_heap_internal_unlock(heap);
+}
+
+multi_heap_task_table_t *multi_heap_get_task_table(multi_heap_handle_t heap)
+{
+    return heap->task_table;
+}
+#endif
+
 void inline multi_heap_internal_lock(multi_heap_handle_t heap)
 {
     MULTI_HEAP_LOCK(heap->lock);
@@ -407,6 +495,8 @@ void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
     heap_block_t *prev_free = NULL;
     heap_block_t *prev = NULL;
     size_t best_size = SIZE_MAX;
+    size_t best_count = 0;
+    size_t largest_seen = 0;
     size = ALIGN_UP(size);
 
     if (size == 0 || heap == NULL) {
@@ -420,7 +510,7 @@ void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
        before they split a large block. This can result in false negatives,
        especially if the heap is unfragmented.
     */
-    if (heap->free_bytes < size) {
+    if (heap->free_bytes < size || (heap->largest_free != 0 && heap->largest_free < size)) {
         MULTI_HEAP_UNLOCK(heap->lock);
         return NULL;
     }
@@ -434,15 +524,22 @@ void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
         if (bs >= size && bs < best_size) {
             best_block = b;
             best_size = bs;
+            best_count = 1;
             prev_free = prev;
             if (bs == size) {
                 break; /* we've found a perfect sized block */
             }
+        } else if (bs == best_size) {
+            best_count++;
+        } else if (bs > largest_seen) {
+            largest_seen = bs;
         }
         prev = b;
     }
 
     if (best_block == NULL) {
+        /* All free blocks were seen, later requests this large fail without walking them again */
+        heap->largest_free = largest_seen;
         multi_heap_internal_unlock(heap);
         return NULL; /* No room in heap */
     }
@@ -451,8 +548,19 @@ void *multi_heap_malloc_impl(multi_heap_handle_t heap, size_t size)
     best_block->header &= ~BLOCK_FREE_FLAG;
 
     heap->free_bytes -= block_data_size(best_block);
-
-    split_if_necessary(heap, best_block, size, prev_free);
+    heap->free_blocks--;
+    heap->allocated_blocks++;
+
+    bool from_largest = (best_size == heap->largest_free && best_count == 1);
+    split_if_necessary(heap, best_block, size, prev_free, best_size);
+    if (from_largest) {
+        /* Best fit took the largest block, so all other free blocks are smaller than 'size'.
+           If the spare space split off is not, it's the largest block now. */
+        heap_block_t *spare = get_next_block(best_block);
+        if (is_free(spare) && !is_last_block(spare) && block_data_size(spare) >= size) {
+            heap->largest_free = block_data_size(spare);
+        }
+    }
 
     if (heap->free_bytes < heap->minimum_free_bytes) {
         heap->minimum_free_bytes = heap->free_bytes;
@@ -491,6 +599,9 @@ void multi_heap_free_impl(multi_heap_handle_t heap, void *p)
     pb->header |= BLOCK_FREE_FLAG;
 
     heap->free_bytes += block_data_size(pb);
+    heap->allocated_blocks--;
+    heap->free_blocks++;
+    free_block_resized(heap, 0, block_data_size(pb));
 
     /* Try and merge previous free block into this one */
     if (get_next_block(prev_free) == pb) {
@@ -538,7 +649,7 @@ void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size)
 
     if (size <= block_data_size(pb)) {
         // Shrinking....
-        split_if_necessary(heap, pb, size, NULL);
+        split_if_necessary(heap, pb, size, NULL, 0);
         result = pb->data;
     }
     else if (heap->free_bytes < size - block_data_size(pb)) {
@@ -549,31 +660,33 @@ void *multi_heap_realloc_impl(multi_heap_handle_t heap, void *p, size_t size)
 
     // New size is larger than existing block
     if (result == NULL) {
-        // See if we can grow into one or both adjacent blocks
-        heap_block_t *orig_pb = pb;
-        size_t orig_size = block_data_size(orig_pb);
+        // See if we can grow into one or both adjacent blocks. Growing into the next
+        // block keeps the data in place, growing into the previous one moves it down
+        // within the merged block, both avoid having two copies of the data in the heap.
+        size_t orig_size = block_data_size(pb);
         heap_block_t *next = get_next_block(pb);
         heap_block_t *prev = get_prev_free_block(heap, pb);
 
+        // Merging a block also gives its header to the data
+        size_t next_size = (is_free(next) && !is_last_block(next)) ? block_data_size(next) : 0;
+        size_t next_grow_size = next_size > 0 ? sizeof(next->header) + next_size : 0;
         // Can only grow into the previous free block if it's adjacent
-        size_t prev_grow_size = (get_next_block(prev) == pb) ? block_data_size(prev) : 0;
+        size_t prev_size = (!is_first_block(heap, prev) && get_next_block(prev) == pb) ? block_data_size(prev) : 0;
+        size_t prev_grow_size = prev_size > 0 ? sizeof(pb->header) + prev_size : 0;
 
-        // Can grow into next block? (we may also need to grow into 'prev' to get to our desired size)
-        if (is_free(next) && (block_data_size(pb) + block_data_size(next) + prev_grow_size >= size)) {
+        if (orig_size + next_grow_size >= size) {
             pb = merge_adjacent(heap, pb, next);
-        }
-
-        // Can grow into previous block?
-        // (try this even if we're already big enough from growing into 'next', as it reduces fragmentation)
-        if (prev_grow_size > 0 && (block_data_size(pb) + prev_grow_size >= size)) {
+            split_if_necessary(heap, pb, size, prev, next_size);
+            result = pb->data;
+        } else if (orig_size + next_grow_size + prev_grow_size >= size) {
+            heap_block_t *orig_pb = pb;
+            if (next_size > 0) {
+                pb = merge_adjacent(heap, pb, next);
+            }
             pb = merge_adjacent(heap, prev, pb);
-            // this doesn't guarantee we'll be left with a big enough block, as it's
-            // possible for the merge to fail if prev == heap->first_block
-        }
-
-        if (block_data_size(pb) >= size) {
             memmove(pb->data, orig_pb->data, orig_size);
-            split_if_necessary(heap, pb, size, NULL);
+            split_if_necessary(heap, pb, size, NULL, prev_size);
+            free_block_resized(heap, next_size, 0);
             result = pb->data;
         }
     }
@@ -610,6 +723,9 @@ bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
 {
     bool valid = true;
     size_t total_free_bytes = 0;
+    size_t free_blocks = 0;
+    size_t allocated_blocks = 0;
+    size_t largest_free = 0;
     assert(heap != NULL);
 
     multi_heap_internal_lock(heap);
@@ -642,9 +758,16 @@ bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
             }
             prev_free = b;
             expected_free = b->next_free;
-            if (!is_first_block(heap, b)) {
-                total_free_bytes += block_data_size(b);
+            if (!is_first_block(heap, b) && !is_last_block(b)) {
+                size_t s = block_data_size(b);
+                total_free_bytes += s;
+                free_blocks++;
+                if (s > largest_free) {
+                    largest_free = s;
+                }
             }
+        } else {
+            allocated_blocks++;
         }
         prev = b;
 
@@ -675,6 +798,15 @@ bool multi_heap_check(multi_heap_handle_t heap, bool print_errors)
     if (heap->free_bytes != total_free_bytes) {
         FAIL_PRINT("CORRUPT HEAP: Expected %u free bytes counted %u\n", (unsigned)heap->free_bytes, (unsigned)total_free_bytes);
     }
+    if (heap->free_blocks != free_blocks || heap->allocated_blocks != allocated_blocks) {
+        FAIL_PRINT("CORRUPT HEAP: Expected %u free and %u allocated blocks counted %u and %u\n",
+                   (unsigned)heap->free_blocks, (unsigned)heap->allocated_blocks,
+                   (unsigned)free_blocks, (unsigned)allocated_blocks);
+    }
+    if (heap->largest_free != 0 && heap->largest_free != largest_free) {
+        FAIL_PRINT("CORRUPT HEAP: Expected largest free block %u found %u\n",
+                   (unsigned)heap->largest_free, (unsigned)largest_free);
+    }
 
  done:
     multi_heap_internal_unlock(heap);
@@ -715,6 +847,17 @@ size_t multi_heap_minimum_free_size_impl(multi_heap_handle_t heap)
     return heap->minimum_free_bytes;
 }
 
+size_t multi_heap_largest_free_hint(multi_heap_handle_t heap)
+{
+    if (heap == NULL) {
+        return 0;
+    }
+    /* Read without locking the heap, the result is the size of a free block which existed at some point during the
+       call */
+    size_t largest_free = heap->largest_free;
+    return largest_free != 0 ? largest_free : SIZE_MAX;
+}
+
 void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
 {
     memset(info, 0, sizeof(multi_heap_info_t));
@@ -724,24 +867,17 @@ void multi_heap_get_info_impl(multi_heap_handle_t heap, multi_heap_info_t *info)
     }
 
     multi_heap_internal_lock(heap);
-    for(heap_block_t *b = get_next_block(&heap->first_block); !is_last_block(b); b = get_next_block(b)) {
-        info->total_blocks++;
-        if (is_free(b)) {
-            size_t s = block_data_size(b);
-            info->total_free_bytes += s;
-            if (s > info->largest_free_block) {
-                info->largest_free_block = s;
-            }
-            info->free_blocks++;
-        } else {
-            info->total_allocated_bytes += block_data_size(b);
-            info->allocated_blocks++;
-        }
-    }
-
+    find_largest_free(heap);
+    /* all bytes between first and last block are either headers or data of used or free blocks */
+    size_t blocks_bytes = (intptr_t)heap->last_block - (intptr_t)get_next_block(&heap->first_block);
+
+    info->total_free_bytes = heap->free_bytes;
+    info->free_blocks = heap->free_blocks;
+    info->allocated_blocks = heap->allocated_blocks;
+    info->total_blocks = heap->free_blocks + heap->allocated_blocks;
+    info->total_allocated_bytes = blocks_bytes - info->total_blocks * sizeof(heap->first_block.header) - heap->free_bytes;
+    info->largest_free_block = heap->largest_free;
     info->minimum_free_bytes = heap->minimum_free_bytes;
-    // heap has wrong total size (address printed here is not indicative of the real error)
-    MULTI_HEAP_ASSERT(info->total_free_bytes == heap->free_bytes, heap);
 
     multi_heap_internal_unlock(heap);
 
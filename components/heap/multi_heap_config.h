@@ -27,3 +27,10 @@
 #define MULTI_HEAP_POISONING
 #define MULTI_HEAP_POISONING_SLOW
 #endif
+
+/* Freed memory is verified when it is allocated again, by 1 in this many allocations */
+#ifdef CONFIG_HEAP_POISONING_VERIFY_INTERVAL
+#define MULTI_HEAP_POISONING_VERIFY_INTERVAL CONFIG_HEAP_POISONING_VERIFY_INTERVAL
+#else
+#define MULTI_HEAP_POISONING_VERIFY_INTERVAL 1
+#endif
@@ -13,6 +13,8 @@
 // limitations under the License.
 #pragma once
 
+#include "multi_heap_config.h"
+
 /* Opaque handle to a heap block */
 typedef const struct heap_block *multi_heap_block_handle_t;
 
@@ -43,6 +45,12 @@ bool multi_heap_internal_check_block_poisoning(void *start, size_t size, bool is
 */
 void multi_heap_internal_poison_fill_region(void *start, size_t size, bool is_free);
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+/* Add an allocated block (starting with the poison head) to the task table of the heap, or remove a freed one.
+   Called with the heap locked. */
+void multi_heap_internal_count_task_block(multi_heap_handle_t heap, void *start, bool allocated);
+#endif
+
 /* Allow heap poisoning to lock/unlock the heap to avoid race conditions
    if multi_heap_check() is running concurrently.
 */
@@ -50,6 +58,41 @@ void multi_heap_internal_lock(multi_heap_handle_t heap);
 
 void multi_heap_internal_unlock(multi_heap_handle_t heap);
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+
+/* Allocation totals of one task in a heap */
+typedef struct {
+    void *task;
+    size_t size;    ///< Bytes in blocks allocated by the task, as multi_heap_get_allocated_size() returns them
+    size_t count;   ///< Number of blocks allocated by the task
+} multi_heap_task_totals_t;
+
+/* Allocation totals of the tasks which have blocks in a heap, counted as blocks are allocated and freed.
+
+   Entries with no blocks left are given to other tasks. If a task finds no entry, 'overflow' is set and the totals
+   can't be used anymore.
+*/
+typedef struct {
+    multi_heap_task_totals_t totals[CONFIG_HEAP_TASK_TRACKING_TASKS];
+    bool overflow;
+} multi_heap_task_table_t;
+
+/* Start counting allocations of each task in 'table', blocks allocated so far are counted.
+   The table must stay valid as long as the heap is used. */
+void multi_heap_set_task_table(multi_heap_handle_t heap, multi_heap_task_table_t *table);
+
+/* Get the task table of a heap, or NULL if allocations are not counted. Lock the heap to read it. */
+multi_heap_task_table_t *multi_heap_get_task_table(multi_heap_handle_t heap);
+
+#endif // CONFIG_HEAP_TASK_TRACKING
+
+/* Size of the largest free block of a heap, or SIZE_MAX if the heap doesn't know it without walking the free blocks.
+
+   Used by heap_caps_malloc() to skip heaps which cannot satisfy a request without taking their lock. Allocations
+   larger than the result fail (with poisoning enabled, allocations slightly smaller than it may fail as well).
+*/
+size_t multi_heap_largest_free_hint(multi_heap_handle_t heap);
+
 /* Some internal functions for heap debugging code to use */
 
 /* Get the handle to the first (fixed free) block in a heap */
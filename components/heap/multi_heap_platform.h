@@ -84,8 +84,16 @@ inline static void multi_heap_assert(bool condition, const char *format, int lin
 
 #define MULTI_HEAP_ASSERT(CONDITION, ADDRESS) assert((CONDITION) && "Heap corrupt")
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+/* Host tests tell which "task" is allocating */
+void *multi_heap_host_current_task(void);
+#define MULTI_HEAP_BLOCK_OWNER void *task;
+#define MULTI_HEAP_SET_BLOCK_OWNER(HEAD) (HEAD)->task = multi_heap_host_current_task()
+#define MULTI_HEAP_GET_BLOCK_OWNER(HEAD) ((HEAD)->task)
+#else
 #define MULTI_HEAP_BLOCK_OWNER
 #define MULTI_HEAP_SET_BLOCK_OWNER(HEAD)
 #define MULTI_HEAP_GET_BLOCK_OWNER(HEAD) (NULL)
+#endif
 
 #endif
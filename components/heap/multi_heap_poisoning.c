@@ -119,7 +119,48 @@ static poison_head_t *verify_allocated_region(void *data, bool print_errors)
     return head;
 }
 
+/* Size of an allocated block as multi_heap_get_allocated_size() returns it */
+static inline size_t allocated_size(multi_heap_handle_t heap, poison_head_t *head)
+{
+    return multi_heap_get_allocated_size_impl(heap, head) - POISON_OVERHEAD;
+}
+
+#ifdef CONFIG_HEAP_TASK_TRACKING
+#define count_task_block(HEAP, HEAD, ALLOCATED) multi_heap_internal_count_task_block((HEAP), (HEAD), (ALLOCATED))
+#else
+#define count_task_block(HEAP, HEAD, ALLOCATED)
+#endif
+
 #ifdef SLOW
+/* Fill pattern repeated in each byte of a word */
+#define FILL_WORD(PATTERN) ((uint32_t)(PATTERN) * 0x01010101)
+
+/* Fill a region with the byte 'pattern', using 4-byte writes between the unaligned ends */
+static void fill_pattern(void *data, size_t size, uint8_t pattern)
+{
+    const uint32_t word = FILL_WORD(pattern);
+    uint8_t *p = data;
+
+    while (size > 0 && (intptr_t)p % 4 != 0) {
+        *p++ = pattern;
+        size--;
+    }
+    uint32_t *w = (uint32_t *)p;
+    for (; size >= 16; size -= 16, w += 4) {
+        w[0] = word;
+        w[1] = word;
+        w[2] = word;
+        w[3] = word;
+    }
+    for (; size >= 4; size -= 4) {
+        *w++ = word;
+    }
+    p = (uint8_t *)w;
+    while (size-- > 0) {
+        *p++ = pattern;
+    }
+}
+
 /* Go through a region that should have the specified fill byte 'pattern',
    verify it.
 
@@ -131,8 +172,8 @@ static poison_head_t *verify_allocated_region(void *data, bool print_errors)
 */
 static bool verify_fill_pattern(void *data, size_t size, bool print_errors, bool expect_free, bool swap_pattern)
 {
-    const uint32_t FREE_FILL_WORD = (FREE_FILL_PATTERN << 24) | (FREE_FILL_PATTERN << 16) | (FREE_FILL_PATTERN << 8) | FREE_FILL_PATTERN;
-    const uint32_t MALLOC_FILL_WORD = (MALLOC_FILL_PATTERN << 24) | (MALLOC_FILL_PATTERN << 16) | (MALLOC_FILL_PATTERN << 8) | MALLOC_FILL_PATTERN;
+    const uint32_t FREE_FILL_WORD = FILL_WORD(FREE_FILL_PATTERN);
+    const uint32_t MALLOC_FILL_WORD = FILL_WORD(MALLOC_FILL_PATTERN);
 
     const uint32_t EXPECT_WORD = expect_free ? FREE_FILL_WORD : MALLOC_FILL_WORD;
     const uint32_t REPLACE_WORD = expect_free ? MALLOC_FILL_WORD : FREE_FILL_WORD;
@@ -141,6 +182,19 @@ static bool verify_fill_pattern(void *data, size_t size, bool print_errors, bool
     /* Use 4-byte operations as much as possible */
     if ((intptr_t)data % 4 == 0) {
         uint32_t *p = data;
+        /* 4 words at a time, up to the first 16 bytes which don't match */
+        for (; size >= 16; size -= 16, p += 4) {
+            if (((p[0] ^ EXPECT_WORD) | (p[1] ^ EXPECT_WORD) | (p[2] ^ EXPECT_WORD) | (p[3] ^ EXPECT_WORD)) != 0) {
+                break;
+            }
+            if (swap_pattern) {
+                p[0] = REPLACE_WORD;
+                p[1] = REPLACE_WORD;
+                p[2] = REPLACE_WORD;
+                p[3] = REPLACE_WORD;
+            }
+        }
+        /* one word at a time for the rest, reporting each bad word */
         while (size >= 4) {
             if (*p != EXPECT_WORD) {
                 if (print_errors) {
@@ -167,7 +221,7 @@ static bool verify_fill_pattern(void *data, size_t size, bool print_errors, bool
     for (int i = 0; i < size; i++) {
         if (p[i] != (uint8_t)EXPECT_WORD) {
             if (print_errors) {
-                MULTI_HEAP_STDERR_PRINTF("CORRUPT HEAP: Invalid data at %p. Expected 0x%02x got 0x%02x\n", p, (uint8_t)EXPECT_WORD, *p);
+                MULTI_HEAP_STDERR_PRINTF("CORRUPT HEAP: Invalid data at %p. Expected 0x%02x got 0x%02x\n", &p[i], (uint8_t)EXPECT_WORD, p[i]);
             }
             valid = false;
 #ifndef NDEBUG
@@ -180,6 +234,25 @@ static bool verify_fill_pattern(void *data, size_t size, bool print_errors, bool
     }
     return valid;
 }
+
+#if MULTI_HEAP_POISONING_VERIFY_INTERVAL > 1
+/* State of a xorshift generator picking the allocations which are verified. It is shared by
+   heaps with different locks, a race only changes which allocation is picked.
+*/
+static uint32_t verify_sample_state = 1;
+
+static inline bool verify_sample(void)
+{
+    uint32_t x = verify_sample_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    verify_sample_state = x;
+    return x % MULTI_HEAP_POISONING_VERIFY_INTERVAL == 0;
+}
+#else
+#define verify_sample() true
+#endif
 #endif
 
 void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
@@ -192,10 +265,15 @@ void *multi_heap_malloc(multi_heap_handle_t heap, size_t size)
     uint8_t *data = NULL;
     if (head != NULL) {
         data = poison_allocated_region(head, size);
+        count_task_block(heap, head, true);
 #ifdef SLOW
-        /* check everything we got back is FREE_FILL_PATTERN & swap for MALLOC_FILL_PATTERN */
-        bool ret = verify_fill_pattern(data, size, true, true, true);
-        assert( ret );
+        if (verify_sample()) {
+            /* check everything we got back is FREE_FILL_PATTERN & swap for MALLOC_FILL_PATTERN */
+            bool ret = verify_fill_pattern(data, size, true, true, true);
+            assert( ret );
+        } else {
+            fill_pattern(data, size, MALLOC_FILL_PATTERN);
+        }
 #endif
     }
 
@@ -212,11 +290,11 @@ void multi_heap_free(multi_heap_handle_t heap, void *p)
 
     poison_head_t *head = verify_allocated_region(p, true);
     assert(head != NULL);
+    count_task_block(heap, head, false);
 
     #ifdef SLOW
     /* replace everything with FREE_FILL_PATTERN, including the poison head/tail */
-    memset(head, FREE_FILL_PATTERN,
-           head->alloc_size + POISON_OVERHEAD);
+    fill_pattern(head, head->alloc_size + POISON_OVERHEAD, FREE_FILL_PATTERN);
     #endif
     multi_heap_free_impl(heap, head);
 
@@ -247,12 +325,17 @@ void *multi_heap_realloc(multi_heap_handle_t heap, void *p, size_t size)
     multi_heap_internal_lock(heap);
 
 #ifndef SLOW
+    /* the block is counted again after realloc, it may have moved, changed size or owner */
+    count_task_block(heap, head, false);
     new_head = multi_heap_realloc_impl(heap, head, size + POISON_OVERHEAD);
     if (new_head != NULL) {
         /* For "fast" poisoning, we only overwrite the head/tail of the new block so it's safe
            to poison, so no problem doing this even if realloc resized in place.
         */
         result = poison_allocated_region(new_head, size);
+        count_task_block(heap, new_head, true);
+    } else {
+        count_task_block(heap, head, true);
     }
 #else // SLOW
     /* When slow poisoning is enabled, it becomes very fiddly to try and correctly fill memory when resizing in place
@@ -268,6 +351,7 @@ void *multi_heap_realloc(multi_heap_handle_t heap, void *p, size_t size)
     new_head = multi_heap_malloc_impl(heap, size + POISON_OVERHEAD);
     if (new_head != NULL) {
         result = poison_allocated_region(new_head, size);
+        count_task_block(heap, new_head, true);
         memcpy(result, p, MIN(size, orig_alloc_size));
         multi_heap_free(heap, p);
     }
@@ -374,10 +458,61 @@ void multi_heap_internal_poison_fill_region(void *start, size_t size, bool is_fr
     memset(start, is_free ? FREE_FILL_PATTERN : MALLOC_FILL_PATTERN, size);
 }
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+void multi_heap_internal_count_task_block(multi_heap_handle_t heap, void *start, bool allocated)
+{
+    poison_head_t *head = (poison_head_t *)start;
+    multi_heap_task_table_t *table = multi_heap_get_task_table(heap);
+    if (table == NULL || table->overflow) {
+        return;
+    }
+    void *task = MULTI_HEAP_GET_BLOCK_OWNER(head);
+    size_t size = allocated_size(heap, head);
+    multi_heap_task_totals_t *totals = NULL;
+    multi_heap_task_totals_t *unused = NULL;
+    for (int i = 0; i < CONFIG_HEAP_TASK_TRACKING_TASKS; i++) {
+        multi_heap_task_totals_t *t = &table->totals[i];
+        if (t->count == 0) {
+            if (unused == NULL) {
+                unused = t;
+            }
+        } else if (t->task == task) {
+            totals = t;
+            break;
+        }
+    }
+
+    if (allocated) {
+        if (totals == NULL) {
+            if (unused == NULL) {
+                table->overflow = true; /* no entry left for this task */
+                return;
+            }
+            totals = unused;
+            totals->task = task;
+            totals->size = 0;
+        }
+        totals->size += size;
+        totals->count++;
+    } else {
+        if (totals == NULL || totals->size < size) {
+            table->overflow = true; /* totals don't match the blocks, stop using them */
+            return;
+        }
+        totals->size -= size;
+        totals->count--;
+    }
+}
+#endif
+
 #else // !MULTI_HEAP_POISONING
 
 #ifdef MULTI_HEAP_POISONING_SLOW
 #error "MULTI_HEAP_POISONING_SLOW requires MULTI_HEAP_POISONING"
 #endif
 
+#ifdef CONFIG_HEAP_TASK_TRACKING
+#error "CONFIG_HEAP_TASK_TRACKING requires MULTI_HEAP_POISONING"
+#endif
+
 #endif  // MULTI_HEAP_POISONING
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdarg.h>
+
+#define ESP_EARLY_LOGI(TAG, ...) (void)(TAG)
+#define ESP_EARLY_LOGD(TAG, ...) (void)(TAG)
@@ -0,0 +1,8 @@
+#pragma once
+
+/* Heaps are not locked on host */
+typedef int portMUX_TYPE;
+
+static inline void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+}
@@ -0,0 +1,311 @@
+#include "catch.hpp"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+extern "C" {
+#include "soc/soc_memory_layout.h"
+#include "esp_heap_caps.h"
+#include "esp_heap_caps_init.h"
+#include "heap_private.h"
+}
+
+/* ESP32 memory types, D/IRAM is the startup stack and is registered by heap_caps_enable_nonos_stack_heaps() */
+extern "C" const soc_memory_type_desc_t soc_memory_types[] = {
+    { "DRAM", { MALLOC_CAP_8BIT|MALLOC_CAP_DEFAULT, MALLOC_CAP_INTERNAL|MALLOC_CAP_DMA|MALLOC_CAP_32BIT, 0 }, false, false},
+    { "D/IRAM", { 0, MALLOC_CAP_DMA|MALLOC_CAP_8BIT|MALLOC_CAP_INTERNAL|MALLOC_CAP_DEFAULT, MALLOC_CAP_32BIT|MALLOC_CAP_EXEC }, true, true},
+    { "IRAM", { MALLOC_CAP_EXEC|MALLOC_CAP_32BIT|MALLOC_CAP_INTERNAL, 0, 0 }, false, false},
+    { "SPIRAM", { MALLOC_CAP_SPIRAM|MALLOC_CAP_DEFAULT, 0, MALLOC_CAP_8BIT|MALLOC_CAP_32BIT}, false, false},
+};
+
+extern "C" const size_t soc_memory_type_count = sizeof(soc_memory_types) / sizeof(soc_memory_type_desc_t);
+
+/* Regions are REGION_SPACING apart in host memory, so regions of the same type are not merged */
+#define REGION_SPACING 0x8000
+#define DRAM_REGIONS 8
+
+static const struct {
+    size_t size;
+    size_t type;
+} test_regions[] = {
+    { 0x2000, 0 }, { 0x2000, 0 }, { 0x2000, 0 }, { 0x2000, 0 },
+    { 0x2000, 0 }, { 0x2000, 0 }, { 0x2000, 0 }, { 0x2000, 0 },
+    { 0x4000, 1 }, { 0x4000, 1 },
+    { 0x4000, 2 }, { 0x4000, 2 },
+    { 0x8000, 3 },
+};
+
+#define NUM_REGIONS (sizeof(test_regions) / sizeof(test_regions[0]))
+
+static uint32_t memory[NUM_REGIONS * REGION_SPACING / sizeof(uint32_t)];
+
+/* Only used by heap_caps_add_region(), which isn't tested */
+extern "C" const soc_memory_region_t soc_memory_regions[] = { { 0, 0, 0, 0 } };
+extern "C" const size_t soc_memory_region_count = 0;
+
+extern "C" size_t soc_get_available_memory_region_max_count()
+{
+    return NUM_REGIONS;
+}
+
+extern "C" size_t soc_get_available_memory_regions(soc_memory_region_t *regions)
+{
+    for (size_t i = 0; i < NUM_REGIONS; i++) {
+        regions[i].start = (intptr_t)memory + i * REGION_SPACING;
+        regions[i].size = test_regions[i].size;
+        regions[i].type = test_regions[i].type;
+        regions[i].iram_address = 0;
+    }
+    return NUM_REGIONS;
+}
+
+static void init_heaps()
+{
+    static bool done;
+    if (!done) {
+        heap_caps_init();
+        heap_caps_enable_nonos_stack_heaps();
+        done = true;
+    }
+}
+
+static heap_t *containing_heap(void *p)
+{
+    heap_t *heap;
+    SLIST_FOREACH(heap, &registered_heaps, next) {
+        if ((intptr_t)p >= heap->start && (intptr_t)p < heap->end) {
+            return heap;
+        }
+    }
+    return NULL;
+}
+
+/* Allocations tried in a heap, on the target each one takes the heap's lock */
+static int heap_mallocs;
+
+extern "C" void *__real_multi_heap_malloc(multi_heap_handle_t heap, size_t size);
+
+extern "C" void *__wrap_multi_heap_malloc(multi_heap_handle_t heap, size_t size)
+{
+    heap_mallocs++;
+    return __real_multi_heap_malloc(heap, size);
+}
+
+static heap_t *region_heap(int region)
+{
+    return containing_heap((uint8_t *)memory + region * REGION_SPACING);
+}
+
+/* heap_caps_malloc() before the capability index, for comparison */
+static void *walk_malloc(size_t size, uint32_t caps)
+{
+    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+        heap_t *heap;
+        SLIST_FOREACH(heap, &registered_heaps, next) {
+            if (heap->heap != NULL && (heap->caps[prio] & caps) != 0 && (get_all_caps(heap) & caps) == caps) {
+                void *p = multi_heap_malloc(heap->heap, size);
+                if (p != NULL) {
+                    return p;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Heap an allocation comes from when registered_heaps is walked in order of priority, the way heap_caps_malloc()
+   did before it had the capability index */
+static heap_t *expected_heap(size_t size, uint32_t caps)
+{
+    if (caps & MALLOC_CAP_EXEC) {
+        caps |= MALLOC_CAP_32BIT;
+    }
+    size = (size + 3) & ~3;
+    for (int prio = 0; prio < SOC_MEMORY_TYPE_NO_PRIOS; prio++) {
+        heap_t *heap;
+        SLIST_FOREACH(heap, &registered_heaps, next) {
+            if (heap->heap != NULL && (heap->caps[prio] & caps) != 0 && (get_all_caps(heap) & caps) == caps) {
+                multi_heap_info_t info;
+                multi_heap_get_info(heap->heap, &info);
+                if (info.largest_free_block >= size) {
+                    return heap;
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static const uint32_t test_caps[] = {
+    MALLOC_CAP_8BIT,
+    MALLOC_CAP_32BIT,
+    MALLOC_CAP_DMA,
+    MALLOC_CAP_EXEC,
+    MALLOC_CAP_DEFAULT,
+    MALLOC_CAP_DEFAULT | MALLOC_CAP_INTERNAL,
+    MALLOC_CAP_DEFAULT | MALLOC_CAP_SPIRAM,
+    MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT,
+    MALLOC_CAP_DMA | MALLOC_CAP_32BIT,
+    MALLOC_CAP_SPIRAM | MALLOC_CAP_INTERNAL,
+    MALLOC_CAP_PID2,
+    1 << 20,
+};
+
+#define NUM_TEST_CAPS (sizeof(test_caps) / sizeof(test_caps[0]))
+
+/* Random allocations, each one checked against the heap it would have come from */
+static void check_random_allocations(int rounds)
+{
+    std::vector<void *> allocated;
+
+    for (int i = 0; i < rounds; i++) {
+        if (allocated.size() > 0 && rand() % 3 == 0) {
+            size_t n = rand() % allocated.size();
+            heap_caps_free(allocated[n]);
+            allocated.erase(allocated.begin() + n);
+            continue;
+        }
+        uint32_t caps = test_caps[rand() % NUM_TEST_CAPS];
+        size_t size = 1 + rand() % 3000;
+        heap_t *expected = expected_heap(size, caps);
+        void *p = heap_caps_malloc(size, caps);
+        if (expected == NULL) {
+            REQUIRE( p == NULL );
+        } else {
+            REQUIRE( p != NULL );
+            REQUIRE( containing_heap(p) == expected );
+            allocated.push_back(p);
+        }
+    }
+
+    for (void *p : allocated) {
+        heap_caps_free(p);
+    }
+    REQUIRE( heap_caps_check_integrity_all(true) );
+}
+
+TEST_CASE("heap_caps_malloc() picks heaps in order of priority", "[heap_caps]")
+{
+    init_heaps();
+
+    REQUIRE( heap_caps_index.num_heaps == NUM_REGIONS );
+    REQUIRE( !heap_caps_index.overflow );
+
+    srand(1);
+    check_random_allocations(20000);
+}
+
+TEST_CASE("heap_caps_malloc() skips full heaps", "[heap_caps]")
+{
+    init_heaps();
+    std::vector<void *> allocated;
+
+    /* Fill the first DRAM heaps with small blocks, every other one freed */
+    for (int i = 0; i < DRAM_REGIONS - 1; i++) {
+        heap_t *heap = region_heap(i);
+        void *p;
+        while ((p = multi_heap_malloc(heap->heap, 32)) != NULL) {
+            allocated.push_back(p);
+        }
+    }
+    for (size_t i = 0; i < allocated.size(); i += 2) {
+        heap_caps_free(allocated[i]);
+    }
+
+    void *p = heap_caps_malloc(64, MALLOC_CAP_8BIT);
+    REQUIRE( containing_heap(p) == region_heap(DRAM_REGIONS - 1) );
+    heap_caps_free(p);
+
+    /* The failed attempts found the largest free block of each heap, they are not tried again */
+    heap_mallocs = 0;
+    p = heap_caps_malloc(64, MALLOC_CAP_8BIT);
+    REQUIRE( containing_heap(p) == region_heap(DRAM_REGIONS - 1) );
+    REQUIRE( heap_mallocs == 1 );
+    heap_caps_free(p);
+
+    /* Small requests still fit in the first heap */
+    p = heap_caps_malloc(32, MALLOC_CAP_8BIT);
+    REQUIRE( containing_heap(p) == region_heap(0) );
+    heap_caps_free(p);
+
+    for (size_t i = 1; i < allocated.size(); i += 2) {
+        heap_caps_free(allocated[i]);
+    }
+    REQUIRE( heap_caps_check_integrity_all(true) );
+}
+
+TEST_CASE("heap_caps_malloc() time when the first heaps are fragmented", "[.][benchmark]")
+{
+    const int rounds = 100000;
+    init_heaps();
+    std::vector<void *> allocated;
+
+    for (int fragmented = 0; fragmented < DRAM_REGIONS; fragmented++) {
+        if (fragmented > 0) {
+            /* 32 byte blocks, every other one free */
+            heap_t *heap = region_heap(fragmented - 1);
+            std::vector<void *> blocks;
+            void *p;
+            while ((p = multi_heap_malloc(heap->heap, 32)) != NULL) {
+                blocks.push_back(p);
+            }
+            for (size_t i = 0; i < blocks.size(); i++) {
+                if (i % 2 == 0) {
+                    heap_caps_free(blocks[i]);
+                } else {
+                    allocated.push_back(blocks[i]);
+                }
+            }
+        }
+
+        heap_mallocs = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            heap_caps_free(walk_malloc(64, MALLOC_CAP_8BIT));
+        }
+        double walk_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double walk_locks = (double)heap_mallocs / rounds;
+
+        heap_mallocs = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            heap_caps_free(heap_caps_malloc(64, MALLOC_CAP_8BIT));
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double locks = (double)heap_mallocs / rounds;
+
+        printf("%d fragmented heaps: walking the heaps %.3f us, %.2f heaps locked; index %.3f us, %.2f heaps locked\n",
+               fragmented, walk_secs * 1e6 / rounds, walk_locks, secs * 1e6 / rounds, locks);
+    }
+
+    for (void *p : allocated) {
+        heap_caps_free(p);
+    }
+}
+
+/* Changes the registered heaps, so runs last */
+TEST_CASE("heap_caps_malloc() tries added regions first", "[heap_caps]")
+{
+    static uint32_t extra_memory[40][256];
+    const uint32_t caps[] = { MALLOC_CAP_8BIT|MALLOC_CAP_DEFAULT, MALLOC_CAP_INTERNAL|MALLOC_CAP_DMA|MALLOC_CAP_32BIT, 0 };
+
+    init_heaps();
+
+    for (int i = 0; i < 40; i++) {
+        intptr_t start = (intptr_t)extra_memory[i];
+        REQUIRE( heap_caps_add_region_with_caps(caps, start, start + sizeof(extra_memory[i])) == ESP_OK );
+        REQUIRE( heap_caps_index.overflow == (NUM_REGIONS + i + 1 > HEAP_CAPS_INDEX_MAX_HEAPS) );
+
+        void *p = heap_caps_malloc(16, MALLOC_CAP_8BIT);
+        REQUIRE( containing_heap(p) == containing_heap(extra_memory[i]) );
+        heap_caps_free(p);
+        p = heap_caps_malloc(16, MALLOC_CAP_EXEC);
+        REQUIRE( containing_heap(p) == region_heap(NUM_REGIONS - 3) );
+        heap_caps_free(p);
+    }
+
+    srand(2);
+    check_random_allocations(5000);
+}
@@ -10,6 +10,14 @@ for FLAGS in "CONFIG_HEAP_POISONING_NONE" "CONFIG_HEAP_POISONING_LIGHT" "CONFIG_
     CPPFLAGS="-D${FLAGS}" make clean test || FAIL=1
 done
 
+echo "==== Testing with config: CONFIG_HEAP_POISONING_COMPREHENSIVE CONFIG_HEAP_POISONING_VERIFY_INTERVAL ===="
+CPPFLAGS="-DCONFIG_HEAP_POISONING_COMPREHENSIVE -DCONFIG_HEAP_POISONING_VERIFY_INTERVAL=8" make clean test || FAIL=1
+
+for FLAGS in "CONFIG_HEAP_POISONING_LIGHT" "CONFIG_HEAP_POISONING_COMPREHENSIVE"; do
+    echo "==== Testing with config: ${FLAGS} CONFIG_HEAP_TASK_TRACKING ===="
+    CPPFLAGS="-D${FLAGS} -DCONFIG_HEAP_TASK_TRACKING -DCONFIG_HEAP_TASK_TRACKING_TASKS=4" make clean test || FAIL=1
+done
+
 make clean
 
 if [ $FAIL == 0 ]; then
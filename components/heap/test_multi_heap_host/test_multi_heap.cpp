@@ -2,10 +2,153 @@
 #include "multi_heap.h"
 
 #include "../multi_heap_config.h"
+extern "C" {
+#include "../multi_heap_internal.h"
+}
 
 #include <string.h>
+#include <chrono>
+#include <initializer_list>
 #include <assert.h>
 
+/* The heap structure, the block headers and the poisoning take more or less room depending on the configuration
+   and on the pointer size. Tests which rely on the layout of a heap register it with the size this returns: blocks
+   of each of 'sizes' can be allocated one after another, then 'free_after' bytes are left for one more allocation.
+*/
+static size_t heap_size_for(std::initializer_list<size_t> sizes, size_t free_after)
+{
+    static uint8_t scratch[4096] __attribute__((aligned(sizeof(void *))));
+    for (size_t heap_size = free_after; heap_size <= sizeof(scratch); heap_size += sizeof(void *)) {
+        multi_heap_handle_t heap = multi_heap_register(scratch, heap_size);
+        if (heap == NULL) {
+            continue;
+        }
+        bool fits = true;
+        for (size_t size : sizes) {
+            fits = fits && multi_heap_malloc(heap, size) != NULL;
+        }
+        if (fits && multi_heap_free_size(heap) >= free_after) {
+            return heap_size;
+        }
+    }
+    assert(0 && "scratch heap too small");
+    return 0;
+}
+
+#ifdef CONFIG_HEAP_TASK_TRACKING
+
+/* Task the blocks are allocated by. If the test doesn't set one, allocations take turns between as many
+   tasks as a task table holds, so blocks (realloc'd ones too) change owners. */
+static void *current_task;
+
+extern "C" void *multi_heap_host_current_task(void)
+{
+    static unsigned next_task;
+    if (current_task != NULL) {
+        return current_task;
+    }
+    next_task = (next_task + 1) % CONFIG_HEAP_TASK_TRACKING_TASKS;
+    return (void *)(intptr_t)(0x10000 * (next_task + 1));
+}
+
+/* Check the task table against the owners of the blocks in the heap */
+static void check_task_table(multi_heap_handle_t heap, const multi_heap_task_table_t *table, void **tasks, int num_tasks)
+{
+    REQUIRE( !table->overflow );
+
+    for (int i = 0; i < num_tasks; i++) {
+        size_t size = 0;
+        size_t count = 0;
+        multi_heap_block_handle_t b = multi_heap_get_first_block(heap);
+        for (; b != NULL; b = multi_heap_get_next_block(heap, b)) {
+            if (!multi_heap_is_free(b) && multi_heap_get_block_owner(b) == tasks[i]) {
+                size += multi_heap_get_allocated_size(heap, multi_heap_get_block_address(b));
+                count++;
+            }
+        }
+
+        const multi_heap_task_totals_t *totals = NULL;
+        for (int j = 0; j < CONFIG_HEAP_TASK_TRACKING_TASKS; j++) {
+            if (table->totals[j].count > 0 && table->totals[j].task == tasks[i]) {
+                REQUIRE( totals == NULL );
+                totals = &table->totals[j];
+            }
+        }
+        if (count == 0) {
+            REQUIRE( totals == NULL );
+        } else {
+            REQUIRE( totals != NULL );
+            REQUIRE( totals->size == size );
+            REQUIRE( totals->count == count );
+        }
+    }
+}
+
+/* All heaps of the tests count the allocations of each task, and multi_heap_check() checks the counts as well */
+static multi_heap_handle_t register_counted_heap(void *start, size_t size)
+{
+    static multi_heap_task_table_t tables[8];
+    static unsigned next_table;
+    multi_heap_handle_t heap = multi_heap_register(start, size);
+    if (heap != NULL) {
+        multi_heap_task_table_t *table = &tables[next_table++ % 8];
+        memset(table, 0, sizeof(*table));
+        multi_heap_set_task_table(heap, table);
+    }
+    return heap;
+}
+
+static bool check_counted_heap(multi_heap_handle_t heap, bool print_errors)
+{
+    if (!multi_heap_check(heap, print_errors)) {
+        return false;
+    }
+    const multi_heap_task_table_t *table = multi_heap_get_task_table(heap);
+    if (table == NULL || table->overflow) {
+        return true;
+    }
+
+    size_t counted = 0;
+    for (int i = 0; i < CONFIG_HEAP_TASK_TRACKING_TASKS; i++) {
+        const multi_heap_task_totals_t *totals = &table->totals[i];
+        if (totals->count == 0) {
+            continue;
+        }
+        size_t size = 0;
+        size_t count = 0;
+        multi_heap_block_handle_t b = multi_heap_get_first_block(heap);
+        for (; b != NULL; b = multi_heap_get_next_block(heap, b)) {
+            if (!multi_heap_is_free(b) && multi_heap_get_block_owner(b) == totals->task) {
+                size += multi_heap_get_allocated_size(heap, multi_heap_get_block_address(b));
+                count++;
+            }
+        }
+        if (size != totals->size || count != totals->count) {
+            if (print_errors) {
+                printf("task %p counted %zu blocks (%zu bytes) but owns %zu (%zu bytes)\n",
+                       totals->task, totals->count, totals->size, count, size);
+            }
+            return false;
+        }
+        counted += count;
+    }
+
+    multi_heap_info_t info;
+    multi_heap_get_info(heap, &info);
+    if (counted != info.allocated_blocks) {
+        if (print_errors) {
+            printf("%zu blocks counted, %zu allocated\n", counted, info.allocated_blocks);
+        }
+        return false;
+    }
+    return true;
+}
+
+#define multi_heap_register register_counted_heap
+#define multi_heap_check check_counted_heap
+
+#endif // CONFIG_HEAP_TASK_TRACKING
+
 /* Insurance against accidentally using libc heap functions in tests */
 #undef free
 #define free #error
@@ -18,9 +161,11 @@
 
 TEST_CASE("multi_heap simple allocations", "[multi_heap]")
 {
-    uint8_t small_heap[128];
+    uint8_t small_heap[512] __attribute__((aligned(sizeof(void *))));
+    const size_t heap_size = heap_size_for({}, 64);
+    REQUIRE( heap_size <= sizeof(small_heap) );
 
-    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    multi_heap_handle_t heap = multi_heap_register(small_heap, heap_size);
 
     size_t test_alloc_size = (multi_heap_free_size(heap) + 4) / 2;
 
@@ -33,7 +178,7 @@ TEST_CASE("multi_heap simple allocations", "[multi_heap]")
     printf("small_heap %p buf %p\n", small_heap, buf);
     REQUIRE( buf != NULL );
     REQUIRE((intptr_t)buf >= (intptr_t)small_heap);
-    REQUIRE( (intptr_t)buf < (intptr_t)(small_heap + sizeof(small_heap)));
+    REQUIRE( (intptr_t)buf < (intptr_t)(small_heap + heap_size));
 
     REQUIRE( multi_heap_get_allocated_size(heap, buf) >= test_alloc_size );
     REQUIRE( multi_heap_get_allocated_size(heap, buf) < test_alloc_size + 16);
@@ -59,10 +204,13 @@ TEST_CASE("multi_heap simple allocations", "[multi_heap]")
 
 TEST_CASE("multi_heap fragmentation", "[multi_heap]")
 {
-    uint8_t small_heap[256];
-    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    const size_t alloc_size = 64;
 
-    const size_t alloc_size = 24;
+    /* room for 4 allocations, then for 2 more (but not 4) alloc_size bytes */
+    uint8_t small_heap[1024] __attribute__((aligned(sizeof(void *))));
+    const size_t heap_size = heap_size_for({ alloc_size, alloc_size, alloc_size, alloc_size }, alloc_size * 2);
+    REQUIRE( heap_size <= sizeof(small_heap) );
+    multi_heap_handle_t heap = multi_heap_register(small_heap, heap_size);
 
     void *p[4];
     for (int i = 0; i < 4; i++) {
@@ -326,7 +474,8 @@ TEST_CASE("multi_heap_get_info() function", "[multi_heap]")
            after.total_blocks);
 
     REQUIRE( 1 == after.allocated_blocks );
-    REQUIRE( 32 == after.total_allocated_bytes );
+    REQUIRE( 32 <= after.total_allocated_bytes );
+    REQUIRE( multi_heap_get_allocated_size(heap, x) == after.total_allocated_bytes );
     REQUIRE( after.minimum_free_bytes < before.minimum_free_bytes);
     REQUIRE( after.minimum_free_bytes > 0 );
 
@@ -347,10 +496,109 @@ TEST_CASE("multi_heap_get_info() function", "[multi_heap]")
     REQUIRE( after.minimum_free_bytes == freed.minimum_free_bytes );
 }
 
+/* Statistics are kept up to date by malloc, free and realloc, check them against what the heap can actually do */
+TEST_CASE("multi_heap_get_info() follows random allocations", "[multi_heap]")
+{
+    uint8_t big_heap[4096];
+    const int NUM_POINTERS = 32;
+    void *p[NUM_POINTERS] = { 0 };
+    multi_heap_handle_t heap = multi_heap_register(big_heap, sizeof(big_heap));
+    multi_heap_info_t info;
+
+    srand(92);
+    for (int i = 0; i < 20000; i++) {
+        int n = rand() % NUM_POINTERS;
+        switch (rand() % 3) {
+        case 0:
+            multi_heap_free(heap, p[n]);
+            p[n] = multi_heap_malloc(heap, rand() % 400);
+            break;
+        case 1: {
+            size_t size = rand() % 400;
+            void *r = multi_heap_realloc(heap, p[n], size);
+            if (r != NULL || size == 0) {
+                p[n] = r;
+            }
+            break;
+        }
+        default:
+            multi_heap_free(heap, p[n]);
+            p[n] = NULL;
+            break;
+        }
+        REQUIRE( multi_heap_check(heap, true) );
+
+        if (i % 16 == 0) {
+            multi_heap_get_info(heap, &info);
+            REQUIRE( info.total_blocks == info.free_blocks + info.allocated_blocks );
+            REQUIRE( info.total_free_bytes == multi_heap_free_size(heap) );
+            REQUIRE( info.largest_free_block <= info.total_free_bytes );
+            /* largest free block can be allocated, anything larger can't */
+            void *largest = multi_heap_malloc(heap, info.largest_free_block);
+            REQUIRE( (largest != NULL || info.largest_free_block == 0) );
+            REQUIRE( multi_heap_malloc(heap, info.largest_free_block + 1) == NULL );
+            multi_heap_free(heap, largest);
+            REQUIRE( multi_heap_check(heap, true) );
+        }
+    }
+
+    for (int n = 0; n < NUM_POINTERS; n++) {
+        multi_heap_free(heap, p[n]);
+    }
+    multi_heap_get_info(heap, &info);
+    REQUIRE( 0 == info.allocated_blocks );
+    REQUIRE( 0 == info.total_allocated_bytes );
+    REQUIRE( 1 == info.free_blocks );
+    REQUIRE( info.largest_free_block == info.total_free_bytes );
+}
+
+/* Time of multi_heap_get_info() as the heap gets fragmented */
+TEST_CASE("multi_heap_get_info() query time", "[.][benchmark]")
+{
+    static uint8_t big_heap[4 * 1024 * 1024];
+    static void *p[100 * 1024];
+    const int queries = 1000;
+
+    for (size_t blocks : { 100, 1000, 10000, 100000 }) {
+        multi_heap_handle_t heap = multi_heap_register(big_heap, sizeof(big_heap));
+        multi_heap_info_t info;
+
+        /* every other block is freed */
+        for (size_t i = 0; i < blocks; i++) {
+            p[i] = multi_heap_malloc(heap, 8 + (i % 8) * 4);
+            REQUIRE( p[i] != NULL );
+        }
+        for (size_t i = 0; i < blocks; i += 2) {
+            multi_heap_free(heap, p[i]);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < queries; i++) {
+            multi_heap_get_info(heap, &info);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        /* allocating the largest block makes the next query look for the largest one left */
+        double secs_find = 0;
+        for (int i = 0; i < queries / 10; i++) {
+            void *largest = multi_heap_malloc(heap, info.largest_free_block);
+            REQUIRE( largest != NULL );
+            start = std::chrono::steady_clock::now();
+            multi_heap_get_info(heap, &info);
+            secs_find += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            multi_heap_free(heap, largest);
+            multi_heap_get_info(heap, &info);
+        }
+
+        printf("%u blocks: %.3f us per multi_heap_get_info(), %.3f us after the largest block is allocated\n",
+               (unsigned)info.total_blocks, secs * 1e6 / queries, secs_find * 1e6 / (queries / 10));
+    }
+}
+
 TEST_CASE("multi_heap minimum-size allocations", "[multi_heap]")
 {
     uint8_t heapdata[16384];
-    void *p[sizeof(heapdata) / sizeof(void *)];
+    void *p[sizeof(heapdata) / sizeof(void *)] = { 0 };
     const size_t NUM_P = sizeof(p) / sizeof(void *);
     multi_heap_handle_t heap = multi_heap_register(heapdata, sizeof(heapdata));
 
@@ -391,8 +639,10 @@ TEST_CASE("multi_heap minimum-size allocations", "[multi_heap]")
 TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 {
     const uint32_t PATTERN = 0xABABDADA;
-    uint8_t small_heap[300];
-    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    uint8_t small_heap[1024] __attribute__((aligned(sizeof(void *))));
+    const size_t heap_size = heap_size_for({ 64, 32, 72 }, 32);
+    REQUIRE( heap_size <= sizeof(small_heap) );
+    multi_heap_handle_t heap = multi_heap_register(small_heap, heap_size);
 
     uint32_t *a = (uint32_t *)multi_heap_malloc(heap, 64);
     uint32_t *b = (uint32_t *)multi_heap_malloc(heap, 32);
@@ -426,13 +676,10 @@ TEST_CASE("multi_heap_realloc()", "[multi_heap]")
     REQUIRE( multi_heap_check(heap, true) );
     REQUIRE( f == b ); /* 'b' should be extended in-place, over space formerly occupied by 'd' */
 
-#ifdef MULTI_HEAP_POISONING
-#define TOO_MUCH 92 + 1
-#else
-#define TOO_MUCH 128 + 1
-#endif
     /* not enough contiguous space left in the heap */
-    uint32_t *g = (uint32_t *)multi_heap_realloc(heap, e, TOO_MUCH);
+    multi_heap_info_t info;
+    multi_heap_get_info(heap, &info);
+    uint32_t *g = (uint32_t *)multi_heap_realloc(heap, e, info.largest_free_block + 1);
     REQUIRE( g == NULL );
 
     multi_heap_free(heap, f);
@@ -443,6 +690,199 @@ TEST_CASE("multi_heap_realloc()", "[multi_heap]")
 #endif
 }
 
+#ifndef MULTI_HEAP_POISONING_SLOW
+/* "Slow" poisoning implementation doesn't reallocate in place */
+TEST_CASE("multi_heap_realloc() grows and shrinks in place", "[multi_heap]")
+{
+    uint8_t small_heap[1024];
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+
+    uint8_t *a = (uint8_t *)multi_heap_malloc(heap, 64);
+    uint8_t *b = (uint8_t *)multi_heap_malloc(heap, 256);
+    uint8_t *c = (uint8_t *)multi_heap_malloc(heap, 32);
+    REQUIRE( a != NULL );
+    REQUIRE( b > a );
+    REQUIRE( c > b );
+    memset(a, 0xA5, 64);
+    multi_heap_free(heap, b);
+
+    /* grows into the free block after it, which is split */
+    uint8_t *d = (uint8_t *)multi_heap_realloc(heap, a, 128);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( d == a );
+    for (int i = 0; i < 64; i++) {
+        REQUIRE( d[i] == 0xA5 );
+    }
+
+    /* takes all of the free block, the last bytes of it were its header */
+    size_t all = (c - a) - (b - a - 64) - sizeof(void *);
+    d = (uint8_t *)multi_heap_realloc(heap, a, all);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( d == a );
+    REQUIRE( d[63] == 0xA5 );
+    REQUIRE( multi_heap_get_allocated_size(heap, d) >= all );
+
+    /* shrinking leaves a free block usable by malloc before 'c' */
+    d = (uint8_t *)multi_heap_realloc(heap, a, 64);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( d == a );
+    REQUIRE( d[63] == 0xA5 );
+    uint8_t *e = (uint8_t *)multi_heap_malloc(heap, 128);
+    REQUIRE( e > a );
+    REQUIRE( e < c );
+
+    multi_heap_free(heap, a);
+    multi_heap_free(heap, c);
+    multi_heap_free(heap, e);
+    REQUIRE( multi_heap_check(heap, true) );
+}
+
+TEST_CASE("multi_heap_realloc() grows into previous block only if needed", "[multi_heap]")
+{
+    uint8_t small_heap[1024];
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+
+    uint8_t *x = (uint8_t *)multi_heap_malloc(heap, 128);
+    uint8_t *a = (uint8_t *)multi_heap_malloc(heap, 64);
+    uint8_t *y = (uint8_t *)multi_heap_malloc(heap, 64);
+    uint8_t *z = (uint8_t *)multi_heap_malloc(heap, 32);
+    REQUIRE( z != NULL );
+    for (int i = 0; i < 64; i++) {
+        a[i] = i;
+    }
+    multi_heap_free(heap, x);
+    multi_heap_free(heap, y);
+
+    /* next free block is large enough, data stay in place */
+    uint8_t *b = (uint8_t *)multi_heap_realloc(heap, a, 96);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( b == a );
+
+    /* previous and next free blocks together are large enough, data move down */
+    b = (uint8_t *)multi_heap_realloc(heap, a, 256);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( b == x );
+    for (int i = 0; i < 64; i++) {
+        REQUIRE( b[i] == i );
+    }
+
+    /* no room around the block, it's allocated elsewhere */
+    uint8_t *c = (uint8_t *)multi_heap_realloc(heap, b, 400);
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( c > z );
+    for (int i = 0; i < 64; i++) {
+        REQUIRE( c[i] == i );
+    }
+
+    multi_heap_free(heap, c);
+    multi_heap_free(heap, z);
+    REQUIRE( multi_heap_check(heap, true) );
+}
+#endif
+
+/* Fill and verify every byte of the blocks, so a realloc which loses data or overlaps
+   another block is found */
+TEST_CASE("multi_heap_realloc() keeps data of random blocks", "[multi_heap]")
+{
+    uint8_t big_heap[4096];
+    const int NUM_POINTERS = 16;
+    uint8_t *p[NUM_POINTERS] = { 0 };
+    size_t s[NUM_POINTERS] = { 0 };
+    multi_heap_handle_t heap = multi_heap_register(big_heap, sizeof(big_heap));
+    const size_t initial_free = multi_heap_free_size(heap);
+
+    srand(91);
+    for (int i = 0; i < 20000; i++) {
+        int n = rand() % NUM_POINTERS;
+        size_t new_size = rand() % 2 ? rand() % 64 : rand() % 600;
+        uint8_t *new_p = (uint8_t *)multi_heap_realloc(heap, p[n], new_size);
+        REQUIRE( multi_heap_check(heap, true) );
+        if (new_size == 0) {
+            REQUIRE( new_p == NULL );
+            p[n] = NULL;
+            s[n] = 0;
+            continue;
+        }
+        if (new_p == NULL) {
+            /* failed realloc leaves the block as it was */
+            new_size = s[n];
+            new_p = p[n];
+        }
+        for (size_t j = 0; j < s[n] && j < new_size; j++) {
+            REQUIRE( new_p[j] == (uint8_t)(n + j) );
+        }
+        for (size_t j = s[n]; j < new_size; j++) {
+            new_p[j] = (uint8_t)(n + j);
+        }
+        p[n] = new_p;
+        s[n] = new_size;
+    }
+
+    for (int n = 0; n < NUM_POINTERS; n++) {
+        for (size_t j = 0; j < s[n]; j++) {
+            REQUIRE( p[n][j] == (uint8_t)(n + j) );
+        }
+        multi_heap_free(heap, p[n]);
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+    REQUIRE( initial_free == multi_heap_free_size(heap) );
+}
+
+/* Bytes copied when buffers grow step by step, as cJSON print buffers or HTTP bodies do */
+TEST_CASE("multi_heap_realloc() grow sequences", "[.][benchmark]")
+{
+    static uint8_t big_heap[256 * 1024];
+    const size_t FINAL_SIZE = 16 * 1024;
+
+    for (int buffers = 1; buffers <= 4; buffers *= 2) {
+        for (bool small_allocs : { false, true }) {
+            multi_heap_handle_t heap = multi_heap_register(big_heap, sizeof(big_heap));
+            uint8_t *p[4] = { 0 };
+            size_t s[4] = { 0 };
+            void *small[1024];
+            int small_count = 0;
+            size_t copied = 0;
+            int moves = 0;
+            int reallocs = 0;
+
+            srand(1);
+            bool done = false;
+            while (!done) {
+                done = true;
+                for (int n = 0; n < buffers; n++) {
+                    if (s[n] >= FINAL_SIZE) {
+                        continue;
+                    }
+                    done = false;
+                    size_t new_size = s[n] + 16 + rand() % 256;
+                    uint8_t *new_p = (uint8_t *)multi_heap_realloc(heap, p[n], new_size);
+                    REQUIRE( new_p != NULL );
+                    if (p[n] != NULL && new_p != p[n]) {
+                        copied += s[n];
+                        moves++;
+                    }
+                    reallocs++;
+                    p[n] = new_p;
+                    s[n] = new_size;
+                    if (small_allocs && small_count < 1024 && rand() % 4 == 0) {
+                        small[small_count++] = multi_heap_malloc(heap, 8 + rand() % 32);
+                    }
+                }
+            }
+            REQUIRE( multi_heap_check(heap, true) );
+            printf("%d buffer(s) grown to %u bytes%s: %d reallocs, %d moved, %u bytes copied\n",
+                   buffers, (unsigned)FINAL_SIZE, small_allocs ? " between small allocations" : "",
+                   reallocs, moves, (unsigned)copied);
+            for (int n = 0; n < buffers; n++) {
+                multi_heap_free(heap, p[n]);
+            }
+            for (int i = 0; i < small_count; i++) {
+                multi_heap_free(heap, small[i]);
+            }
+        }
+    }
+}
+
 TEST_CASE("corrupt heap block", "[multi_heap]")
 {
     uint8_t small_heap[256];
@@ -454,18 +894,73 @@ TEST_CASE("corrupt heap block", "[multi_heap]")
     REQUIRE( !multi_heap_check(heap, true) );
 }
 
+#ifdef MULTI_HEAP_POISONING_SLOW
+TEST_CASE("poison fill patterns at any size and alignment", "[multi_heap]")
+{
+    uint8_t small_heap[1024];
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+
+    for (size_t size = 1; size < 70; size++) {
+        uint8_t *a = (uint8_t *)multi_heap_malloc(heap, size);
+        void *b = multi_heap_malloc(heap, 4); /* keeps a from joining the free space after it */
+        REQUIRE( a != NULL );
+        REQUIRE( b != NULL );
+        for (size_t i = 0; i < size; i++) {
+            REQUIRE( a[i] == 0xce );
+        }
+
+        /* a write to any byte of freed memory is found */
+        multi_heap_free(heap, a);
+        for (size_t i = 0; i < size; i++) {
+            REQUIRE( a[i] == 0xfe );
+            a[i] = 0x00;
+            REQUIRE( !multi_heap_check(heap, false) );
+            a[i] = 0xfe;
+        }
+        REQUIRE( multi_heap_check(heap, true) );
+        multi_heap_free(heap, b);
+    }
+}
+#endif
+
+/* Time of a malloc and free of the same block, which poisoning makes depend on its size */
+TEST_CASE("multi_heap malloc and free time against size", "[.][benchmark]")
+{
+    static uint8_t big_heap[256 * 1024];
+    const int rounds = 10000;
+    multi_heap_handle_t heap = multi_heap_register(big_heap, sizeof(big_heap));
+
+    for (size_t size : { 16, 64, 256, 1024, 4096, 16384, 65536 }) {
+        int failed = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            void *p = multi_heap_malloc(heap, size);
+            failed += (p == NULL);
+            multi_heap_free(heap, p);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        REQUIRE( failed == 0 );
+        printf("%6u bytes: %.3f us per malloc and free\n", (unsigned)size, secs * 1e6 / rounds);
+    }
+}
+
 TEST_CASE("unaligned heaps", "[multi_heap]")
 {
     const size_t CHUNK_LEN = 256;
     const size_t CANARY_LEN = 16;
     const uint8_t CANARY_BYTE = 0x3E;
-    uint8_t heap_chunk[CHUNK_LEN + CANARY_LEN * 2];
+    uint8_t heap_chunk[CHUNK_LEN + CANARY_LEN * 2] __attribute__((aligned(sizeof(void *))));
 
     /* Put some canary bytes before and after the bytes we intend to use for
        the heap, make sure they aren't ever overwritten */
     memset(heap_chunk, CANARY_BYTE, CANARY_LEN);
     memset(heap_chunk + CANARY_LEN + CHUNK_LEN, CANARY_BYTE, CANARY_LEN);
 
+    /* the bytes an aligned heap takes for itself, a heap at an offset loses up to an alignment more */
+    multi_heap_info_t aligned_info;
+    multi_heap_get_info(multi_heap_register(heap_chunk + CANARY_LEN, CHUNK_LEN), &aligned_info);
+    const size_t overhead = CHUNK_LEN - aligned_info.total_free_bytes;
+
     for (int i = 0; i < 8; i++) {
         printf("Testing with offset %d\n", i);
         multi_heap_handle_t heap = multi_heap_register(heap_chunk + CANARY_LEN + i, CHUNK_LEN - i);
@@ -475,8 +970,8 @@ TEST_CASE("unaligned heaps", "[multi_heap]")
 
         multi_heap_get_info(heap, &info);
 
-        REQUIRE( info.total_free_bytes > CHUNK_LEN - 64 - i );
-        REQUIRE( info.largest_free_block > CHUNK_LEN - 64 - i );
+        REQUIRE( info.total_free_bytes >= CHUNK_LEN - overhead - i - sizeof(void *) );
+        REQUIRE( info.largest_free_block >= CHUNK_LEN - overhead - i - sizeof(void *) );
 
         void *a = multi_heap_malloc(heap, info.largest_free_block);
         REQUIRE( a != NULL );
@@ -494,3 +989,115 @@ TEST_CASE("unaligned heaps", "[multi_heap]")
         }
     }
 }
+
+#ifdef CONFIG_HEAP_TASK_TRACKING
+
+TEST_CASE("multi_heap task totals follow allocations", "[task_tracking]")
+{
+    uint8_t small_heap[4 * 1024];
+    multi_heap_task_table_t table;
+    void *tasks[CONFIG_HEAP_TASK_TRACKING_TASKS];
+    void *p[32] = { 0 };
+
+    for (int i = 0; i < CONFIG_HEAP_TASK_TRACKING_TASKS; i++) {
+        tasks[i] = (void *)(intptr_t)(0x1000 * (i + 1));
+    }
+
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    multi_heap_set_task_table(heap, &table);
+    srand(5);
+
+    for (int i = 0; i < 5000; i++) {
+        size_t n = rand() % 32;
+        current_task = tasks[rand() % CONFIG_HEAP_TASK_TRACKING_TASKS];
+
+        switch (rand() % 3) {
+        case 0:
+            if (p[n] == NULL) {
+                p[n] = multi_heap_malloc(heap, 1 + rand() % 300);
+            }
+            break;
+        case 1: {
+            /* realloc'd blocks belong to the task which reallocated them */
+            size_t size = rand() % 300;
+            void *r = multi_heap_realloc(heap, p[n], size);
+            if (r != NULL || size == 0) {
+                p[n] = r;
+            }
+            break;
+        }
+        default:
+            multi_heap_free(heap, p[n]);
+            p[n] = NULL;
+            break;
+        }
+
+        REQUIRE( multi_heap_check(heap, true) );
+        check_task_table(heap, &table, tasks, CONFIG_HEAP_TASK_TRACKING_TASKS);
+    }
+
+    for (int i = 0; i < 32; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+    for (int i = 0; i < CONFIG_HEAP_TASK_TRACKING_TASKS; i++) {
+        REQUIRE( table.totals[i].count == 0 );
+        REQUIRE( table.totals[i].size == 0 );
+    }
+    REQUIRE( !table.overflow );
+}
+
+TEST_CASE("multi_heap task table overflow", "[task_tracking]")
+{
+    uint8_t small_heap[4 * 1024];
+    multi_heap_task_table_t table;
+    void *p[CONFIG_HEAP_TASK_TRACKING_TASKS + 1];
+
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    multi_heap_set_task_table(heap, &table);
+
+    for (int i = 0; i < CONFIG_HEAP_TASK_TRACKING_TASKS; i++) {
+        current_task = (void *)(intptr_t)(0x1000 * (i + 1));
+        p[i] = multi_heap_malloc(heap, 32);
+        REQUIRE( p[i] != NULL );
+    }
+    REQUIRE( !table.overflow );
+
+    /* a task with no blocks left gives its entry to the next one */
+    multi_heap_free(heap, p[0]);
+    current_task = (void *)0x100000;
+    p[0] = multi_heap_malloc(heap, 32);
+    REQUIRE( !table.overflow );
+
+    current_task = (void *)0x200000;
+    p[CONFIG_HEAP_TASK_TRACKING_TASKS] = multi_heap_malloc(heap, 32);
+    REQUIRE( table.overflow );
+
+    for (int i = 0; i <= CONFIG_HEAP_TASK_TRACKING_TASKS; i++) {
+        multi_heap_free(heap, p[i]);
+    }
+    REQUIRE( multi_heap_check(heap, true) );
+}
+
+TEST_CASE("multi_heap task table set after allocations", "[task_tracking]")
+{
+    uint8_t small_heap[4 * 1024];
+    multi_heap_task_table_t table;
+    void *tasks[] = { (void *)0x1000, (void *)0x2000 };
+
+    multi_heap_handle_t heap = multi_heap_register(small_heap, sizeof(small_heap));
+    current_task = tasks[0];
+    void *a = multi_heap_malloc(heap, 64);
+    current_task = tasks[1];
+    void *b = multi_heap_malloc(heap, 100);
+
+    /* blocks allocated so far are counted when the table is set */
+    multi_heap_set_task_table(heap, &table);
+    check_task_table(heap, &table, tasks, 2);
+
+    multi_heap_free(heap, a);
+    check_task_table(heap, &table, tasks, 2);
+    multi_heap_free(heap, b);
+    check_task_table(heap, &table, tasks, 2);
+}
+
+#endif // CONFIG_HEAP_TASK_TRACKING
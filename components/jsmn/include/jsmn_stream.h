@@ -0,0 +1,121 @@
+// Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file jsmn_stream.h
+ * @brief Resumable, callback based variant of the JSMN tokenizer.
+ *
+ * Unlike jsmn_parse(), the document does not have to be held in memory as
+ * a whole. It is fed to the parser in chunks of any size (e.g. as received
+ * from esp_http_client) and tokens are reported through a callback as soon
+ * as they are recognised. Parser state is a few bytes and independent of
+ * document size.
+ */
+
+#ifndef __JSMN_STREAM_H_
+#define __JSMN_STREAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "jsmn.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum nesting depth of objects and arrays
+ */
+#define JSMN_STREAM_MAX_DEPTH	32
+
+/**
+ * Returned by jsmn_stream_feed() when the callback requested to stop parsing
+ */
+#define JSMN_STREAM_ERROR_ABORTED	(-4)
+
+/**
+ * Token events reported to the callback
+ */
+typedef enum {
+	JSMN_STREAM_OBJECT_START,	/* '{', no data */
+	JSMN_STREAM_OBJECT_END,		/* '}', no data */
+	JSMN_STREAM_ARRAY_START,	/* '[', no data */
+	JSMN_STREAM_ARRAY_END,		/* ']', no data */
+	JSMN_STREAM_KEY,			/* Object member name, without quotes */
+	JSMN_STREAM_STRING,			/* String value, without quotes */
+	JSMN_STREAM_PRIMITIVE		/* Number, boolean or null */
+} jsmn_stream_event_t;
+
+/**
+ * Token callback.
+ *
+ * For keys, strings and primitives, data points to the raw token text
+ * (escape sequences are not decoded) inside the chunk passed to
+ * jsmn_stream_feed(). A token which spans several chunks is reported in
+ * several pieces: all but the last have partial set to 1.
+ *
+ * @param		arg		user argument passed to jsmn_stream_init()
+ * @param		event	token type
+ * @param		data	token text, NULL for structural events
+ * @param		len		length of token text
+ * @param		partial	1 if more text of the same token follows
+ * @return		0 to continue, any other value stops parsing
+ */
+typedef int (*jsmn_stream_cb_t)(void *arg, jsmn_stream_event_t event,
+		const char *data, size_t len, int partial);
+
+/**
+ * Streaming JSON parser state
+ */
+typedef struct {
+	jsmn_stream_cb_t cb;
+	void *arg;
+	size_t pos; /* total number of bytes consumed */
+	uint32_t objects; /* bit per nesting level, set if level is an object */
+	uint8_t depth; /* current nesting depth */
+	uint8_t state; /* lexer state */
+	uint8_t expect; /* grammar state */
+	uint8_t hex_left; /* hex digits left in a \uXXXX escape */
+	uint8_t in_key; /* string being parsed is an object key */
+} jsmn_stream_parser;
+
+/**
+ * Initialise a streaming parser
+ */
+void jsmn_stream_init(jsmn_stream_parser *parser, jsmn_stream_cb_t cb, void *arg);
+
+/**
+ * Feed the next chunk of the document to the parser.
+ *
+ * @return	0 on success, JSMN_ERROR_INVAL on malformed input, JSMN_ERROR_NOMEM
+ *			if JSMN_STREAM_MAX_DEPTH is exceeded or JSMN_STREAM_ERROR_ABORTED
+ *			if the callback stopped parsing
+ */
+int jsmn_stream_feed(jsmn_stream_parser *parser, const char *js, size_t len);
+
+/**
+ * Signal the end of the document.
+ *
+ * Reports a trailing top level primitive, if any.
+ *
+ * @return	0 if the document is complete, JSMN_ERROR_PART if more bytes were
+ *			expected, or an error code as for jsmn_stream_feed()
+ */
+int jsmn_stream_finish(jsmn_stream_parser *parser);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __JSMN_STREAM_H_ */
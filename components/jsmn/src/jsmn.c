@@ -29,6 +29,7 @@
  */
 
 #include "jsmn.h"
+#include "jsmn_scan.h"
 
 /**
  * Allocates a fresh unused token from the token pull.
@@ -120,8 +121,18 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
 	parser->pos++;
 
 	/* Skip starting quote */
-	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
-		char c = js[parser->pos];
+	for (; parser->pos < len; parser->pos++) {
+		char c;
+
+		/* Skip to the next quote, backslash or NUL */
+		parser->pos = jsmn_scan_string(js, parser->pos, len);
+		if (parser->pos >= len) {
+			break;
+		}
+		c = js[parser->pos];
+		if (c == '\0') {
+			break;
+		}
 
 		/* Quote: end of string */
 		if (c == '\"') {
@@ -262,7 +273,11 @@ int jsmn_parse(jsmn_parser *parser, const char *js, size_t len,
 				if (parser->toksuper != -1 && tokens != NULL)
 					tokens[parser->toksuper].size++;
 				break;
-			case '\t' : case '\r' : case '\n' : case ' ':
+			case ' ':
+				/* Skip the rest of the run, leaving pos on its last space */
+				parser->pos = jsmn_scan_spaces(js, parser->pos, len) - 1;
+				break;
+			case '\t' : case '\r' : case '\n' :
 				break;
 			case ':':
 				parser->toksuper = parser->toknext - 1;
@@ -0,0 +1,105 @@
+// Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file jsmn_scan.h
+ * @brief Word-at-a-time scanning helpers shared by the JSMN parsers.
+ *
+ * Define JSMN_BYTEWISE_SCAN to fall back to plain byte-at-a-time scanning,
+ * e.g. to benchmark against it.
+ */
+
+#ifndef __JSMN_SCAN_H_
+#define __JSMN_SCAN_H_
+
+#include <stddef.h>
+#include <string.h>
+
+/* Locating a match within a word relies on little endian byte order */
+#if !defined(JSMN_BYTEWISE_SCAN) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#define JSMN_BYTEWISE_SCAN
+#endif
+
+typedef unsigned long jsmn_word_t;
+
+#define JSMN_WORD_ONES		((jsmn_word_t)~0UL / 0xFF)
+#define JSMN_WORD_HIGHS		(JSMN_WORD_ONES * 0x80)
+
+/* Non-zero if any byte of the word is zero */
+#define JSMN_WORD_HAS_ZERO(w)	(((w) - JSMN_WORD_ONES) & ~(w) & JSMN_WORD_HIGHS)
+
+/* Non-zero if any byte of the word is equal to c */
+#define JSMN_WORD_HAS_BYTE(w, c)	JSMN_WORD_HAS_ZERO((w) ^ (JSMN_WORD_ONES * (unsigned char)(c)))
+
+#define JSMN_IS_WORD_ALIGNED(p)	(((size_t)(p) & (sizeof(jsmn_word_t) - 1)) == 0)
+
+/* Load a word from an aligned address (Xtensa has no unaligned loads) */
+static inline jsmn_word_t jsmn_load_word(const char *p) {
+	jsmn_word_t w;
+	memcpy(&w, __builtin_assume_aligned(p, sizeof(jsmn_word_t)), sizeof(w));
+	return w;
+}
+
+/**
+ * Returns the position of the first quote, backslash or NUL character at or
+ * after pos, or len if there is none.
+ */
+static inline size_t jsmn_scan_string(const char *js, size_t pos, size_t len) {
+#ifndef JSMN_BYTEWISE_SCAN
+	for (; pos < len && !JSMN_IS_WORD_ALIGNED(js + pos); pos++) {
+		if (js[pos] == '\"' || js[pos] == '\\' || js[pos] == '\0') {
+			return pos;
+		}
+	}
+	while (pos + sizeof(jsmn_word_t) <= len) {
+		jsmn_word_t w = jsmn_load_word(js + pos);
+		jsmn_word_t m = JSMN_WORD_HAS_ZERO(w) | JSMN_WORD_HAS_BYTE(w, '\"') |
+				JSMN_WORD_HAS_BYTE(w, '\\');
+		if (m) {
+			/* Lowest flagged byte is always a real match */
+			return pos + (__builtin_ctzl(m) >> 3);
+		}
+		pos += sizeof(jsmn_word_t);
+	}
+#endif
+	while (pos < len && js[pos] != '\"' && js[pos] != '\\' && js[pos] != '\0') {
+		pos++;
+	}
+	return pos;
+}
+
+/**
+ * Returns the position after a run of space characters starting at pos,
+ * skipping whole words of spaces (typical indentation of pretty-printed
+ * documents).
+ */
+static inline size_t jsmn_scan_spaces(const char *js, size_t pos, size_t len) {
+#ifndef JSMN_BYTEWISE_SCAN
+	for (; pos < len && !JSMN_IS_WORD_ALIGNED(js + pos); pos++) {
+		if (js[pos] != ' ') {
+			return pos;
+		}
+	}
+	while (pos + sizeof(jsmn_word_t) <= len &&
+			jsmn_load_word(js + pos) == JSMN_WORD_ONES * ' ') {
+		pos += sizeof(jsmn_word_t);
+	}
+#endif
+	while (pos < len && js[pos] == ' ') {
+		pos++;
+	}
+	return pos;
+}
+
+#endif /* __JSMN_SCAN_H_ */
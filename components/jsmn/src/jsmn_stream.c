@@ -0,0 +1,294 @@
+// Copyright 2018 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**
+ * @file jsmn_stream.c
+ * @brief Implementation of the resumable, callback based JSMN tokenizer.
+ */
+
+#include "jsmn_stream.h"
+#include "jsmn_scan.h"
+
+/* Lexer states */
+enum {
+	ST_VALUE = 0,	/* between tokens */
+	ST_STRING,		/* inside a string */
+	ST_ESCAPE,		/* after a backslash inside a string */
+	ST_UNICODE,		/* inside a \uXXXX escape */
+	ST_PRIMITIVE,	/* inside a primitive */
+	ST_ERROR		/* malformed input seen, parser must be re-initialised */
+};
+
+/* What the grammar allows next */
+enum {
+	EXP_VALUE = 0,
+	EXP_VALUE_OR_END,	/* just after '[' */
+	EXP_KEY,
+	EXP_KEY_OR_END,		/* just after '{' */
+	EXP_COLON,
+	EXP_COMMA_OR_END
+};
+
+static int jsmn_stream_in_object(const jsmn_stream_parser *parser) {
+	return parser->depth > 0 && (parser->objects & (1UL << (parser->depth - 1)));
+}
+
+static void jsmn_stream_value_done(jsmn_stream_parser *parser) {
+	parser->expect = parser->depth > 0 ? EXP_COMMA_OR_END : EXP_VALUE;
+}
+
+static int jsmn_stream_emit(jsmn_stream_parser *parser, jsmn_stream_event_t event,
+		const char *data, size_t len, int partial) {
+	if (parser->cb(parser->arg, event, data, len, partial) != 0) {
+		parser->state = ST_ERROR;
+		return JSMN_STREAM_ERROR_ABORTED;
+	}
+	return 0;
+}
+
+static jsmn_stream_event_t jsmn_stream_token_event(const jsmn_stream_parser *parser) {
+	if (parser->state == ST_PRIMITIVE) {
+		return JSMN_STREAM_PRIMITIVE;
+	}
+	return parser->in_key ? JSMN_STREAM_KEY : JSMN_STREAM_STRING;
+}
+
+static int jsmn_stream_fail(jsmn_stream_parser *parser, int err) {
+	parser->state = ST_ERROR;
+	return err;
+}
+
+static int jsmn_is_hex(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f');
+}
+
+/**
+ * Handles a structural or leading character while between tokens.
+ * Returns 0 or a negative error code.
+ */
+static int jsmn_stream_value_char(jsmn_stream_parser *parser, char c) {
+	switch (c) {
+		case '{': case '[':
+			if (parser->expect != EXP_VALUE && parser->expect != EXP_VALUE_OR_END) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			if (parser->depth >= JSMN_STREAM_MAX_DEPTH) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_NOMEM);
+			}
+			if (c == '{') {
+				parser->objects |= (1UL << parser->depth);
+				parser->expect = EXP_KEY_OR_END;
+			} else {
+				parser->objects &= ~(1UL << parser->depth);
+				parser->expect = EXP_VALUE_OR_END;
+			}
+			parser->depth++;
+			return jsmn_stream_emit(parser, c == '{' ? JSMN_STREAM_OBJECT_START :
+					JSMN_STREAM_ARRAY_START, NULL, 0, 0);
+		case '}': case ']':
+			if (parser->depth == 0 || jsmn_stream_in_object(parser) != (c == '}')) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			if (parser->expect != EXP_COMMA_OR_END &&
+					parser->expect != (c == '}' ? EXP_KEY_OR_END : EXP_VALUE_OR_END)) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			parser->depth--;
+			jsmn_stream_value_done(parser);
+			return jsmn_stream_emit(parser, c == '}' ? JSMN_STREAM_OBJECT_END :
+					JSMN_STREAM_ARRAY_END, NULL, 0, 0);
+		case ',':
+			if (parser->expect != EXP_COMMA_OR_END) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			parser->expect = jsmn_stream_in_object(parser) ? EXP_KEY : EXP_VALUE;
+			return 0;
+		case ':':
+			if (parser->expect != EXP_COLON) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			parser->expect = EXP_VALUE;
+			return 0;
+		case '\"':
+			if (parser->expect == EXP_KEY || parser->expect == EXP_KEY_OR_END) {
+				parser->in_key = 1;
+			} else if (parser->expect == EXP_VALUE || parser->expect == EXP_VALUE_OR_END) {
+				parser->in_key = 0;
+			} else {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			parser->state = ST_STRING;
+			return 0;
+		case '\t': case '\r': case '\n': case ' ':
+			return 0;
+		default:
+			if (parser->expect != EXP_VALUE && parser->expect != EXP_VALUE_OR_END) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			if (c < 32 || c >= 127) {
+				return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+			}
+			parser->state = ST_PRIMITIVE;
+			return 0;
+	}
+}
+
+void jsmn_stream_init(jsmn_stream_parser *parser, jsmn_stream_cb_t cb, void *arg) {
+	parser->cb = cb;
+	parser->arg = arg;
+	parser->pos = 0;
+	parser->objects = 0;
+	parser->depth = 0;
+	parser->state = ST_VALUE;
+	parser->expect = EXP_VALUE;
+	parser->hex_left = 0;
+	parser->in_key = 0;
+}
+
+int jsmn_stream_feed(jsmn_stream_parser *parser, const char *js, size_t len) {
+	size_t i = 0;
+	/* Start of the current token's text within this chunk */
+	size_t tok_start = 0;
+	int r;
+
+	if (parser->state == ST_ERROR) {
+		return JSMN_ERROR_INVAL;
+	}
+
+	while (i < len) {
+		char c = js[i];
+
+		switch (parser->state) {
+			case ST_VALUE:
+				if (c == ' ') {
+					i = jsmn_scan_spaces(js, i, len);
+					continue;
+				}
+				r = jsmn_stream_value_char(parser, c);
+				if (r < 0) {
+					parser->pos += i;
+					return r;
+				}
+				/* Token text starts after the opening quote or at the
+				 * first character of a primitive */
+				tok_start = (parser->state == ST_PRIMITIVE) ? i : i + 1;
+				if (parser->state == ST_PRIMITIVE) {
+					/* Examine the first character as part of the primitive */
+					continue;
+				}
+				break;
+			case ST_STRING:
+				i = jsmn_scan_string(js, i, len);
+				if (i >= len) {
+					continue;
+				}
+				c = js[i];
+				if (c == '\"') {
+					r = jsmn_stream_emit(parser, jsmn_stream_token_event(parser),
+							js + tok_start, i - tok_start, 0);
+					if (r < 0) {
+						parser->pos += i;
+						return r;
+					}
+					parser->state = ST_VALUE;
+					if (parser->in_key) {
+						parser->expect = EXP_COLON;
+					} else {
+						jsmn_stream_value_done(parser);
+					}
+				} else if (c == '\\') {
+					parser->state = ST_ESCAPE;
+				} else if (c == '\0') {
+					parser->pos += i;
+					return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+				}
+				break;
+			case ST_ESCAPE:
+				switch (c) {
+					case '\"': case '/' : case '\\' : case 'b' :
+					case 'f' : case 'r' : case 'n'  : case 't' :
+						parser->state = ST_STRING;
+						break;
+					case 'u':
+						parser->state = ST_UNICODE;
+						parser->hex_left = 4;
+						break;
+					default:
+						parser->pos += i;
+						return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+				}
+				break;
+			case ST_UNICODE:
+				if (!jsmn_is_hex(c)) {
+					parser->pos += i;
+					return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+				}
+				if (--parser->hex_left == 0) {
+					parser->state = ST_STRING;
+				}
+				break;
+			case ST_PRIMITIVE:
+				switch (c) {
+					case '\t': case '\r': case '\n': case ' ':
+					case ',': case ']': case '}': case ':':
+						r = jsmn_stream_emit(parser, JSMN_STREAM_PRIMITIVE,
+								js + tok_start, i - tok_start, 0);
+						if (r < 0) {
+							parser->pos += i;
+							return r;
+						}
+						parser->state = ST_VALUE;
+						jsmn_stream_value_done(parser);
+						/* Terminator is handled in ST_VALUE */
+						continue;
+				}
+				if (c < 32 || c >= 127) {
+					parser->pos += i;
+					return jsmn_stream_fail(parser, JSMN_ERROR_INVAL);
+				}
+				break;
+		}
+		i++;
+	}
+
+	parser->pos += len;
+
+	/* Hand out the part of an unfinished token seen in this chunk */
+	if (parser->state != ST_VALUE && len > tok_start) {
+		return jsmn_stream_emit(parser, jsmn_stream_token_event(parser),
+				js + tok_start, len - tok_start, 1);
+	}
+	return 0;
+}
+
+int jsmn_stream_finish(jsmn_stream_parser *parser) {
+	int r;
+
+	if (parser->state == ST_ERROR) {
+		return JSMN_ERROR_INVAL;
+	}
+	if (parser->state == ST_PRIMITIVE) {
+		/* Top level primitive is terminated by the end of the document */
+		r = jsmn_stream_emit(parser, JSMN_STREAM_PRIMITIVE, "", 0, 0);
+		if (r < 0) {
+			return r;
+		}
+		parser->state = ST_VALUE;
+		jsmn_stream_value_done(parser);
+	}
+	if (parser->state != ST_VALUE || parser->depth != 0 || parser->expect != EXP_VALUE) {
+		return JSMN_ERROR_PART;
+	}
+	return 0;
+}
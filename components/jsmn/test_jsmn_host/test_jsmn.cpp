@@ -0,0 +1,277 @@
+#include "catch.hpp"
+#include "jsmn.h"
+#include "jsmn_stream.h"
+#include <string>
+#include <vector>
+#include <ctime>
+#include <cstdio>
+
+using namespace std;
+
+struct Token {
+    jsmntype_t type;
+    string text;
+    bool operator==(const Token &other) const
+    {
+        return type == other.type && text == other.text;
+    }
+};
+
+/* Tokens in document order as reported by jsmn_parse */
+static vector<Token> parse_all(const string &js)
+{
+    jsmn_parser parser;
+    jsmn_init(&parser);
+    int count = jsmn_parse(&parser, js.c_str(), js.size(), NULL, 0);
+    REQUIRE(count >= 0);
+    vector<jsmntok_t> tokens(count + 1);
+    jsmn_init(&parser);
+    int r = jsmn_parse(&parser, js.c_str(), js.size(), tokens.data(), tokens.size());
+    REQUIRE(r == count);
+    vector<Token> result;
+    for (int i = 0; i < count; i++) {
+        Token t;
+        t.type = tokens[i].type;
+        if (t.type == JSMN_STRING || t.type == JSMN_PRIMITIVE) {
+            t.text = js.substr(tokens[i].start, tokens[i].end - tokens[i].start);
+        }
+        result.push_back(t);
+    }
+    return result;
+}
+
+struct StreamResult {
+    vector<Token> tokens;
+    vector<jsmn_stream_event_t> events;
+    string pending;
+    int depth = 0;
+    int max_depth = 0;
+};
+
+static int stream_cb(void *arg, jsmn_stream_event_t event, const char *data, size_t len, int partial)
+{
+    StreamResult *res = (StreamResult *) arg;
+    Token t;
+    switch (event) {
+    case JSMN_STREAM_OBJECT_START:
+    case JSMN_STREAM_ARRAY_START:
+        t.type = (event == JSMN_STREAM_OBJECT_START) ? JSMN_OBJECT : JSMN_ARRAY;
+        res->tokens.push_back(t);
+        res->events.push_back(event);
+        res->max_depth = max(res->max_depth, ++res->depth);
+        return 0;
+    case JSMN_STREAM_OBJECT_END:
+    case JSMN_STREAM_ARRAY_END:
+        res->events.push_back(event);
+        res->depth--;
+        return 0;
+    default:
+        break;
+    }
+    REQUIRE(data != NULL);
+    res->pending.append(data, len);
+    if (!partial) {
+        t.type = (event == JSMN_STREAM_PRIMITIVE) ? JSMN_PRIMITIVE : JSMN_STRING;
+        t.text = res->pending;
+        res->pending.clear();
+        res->tokens.push_back(t);
+        res->events.push_back(event);
+    }
+    return 0;
+}
+
+static int stream_all(const string &js, size_t chunk, StreamResult &res)
+{
+    jsmn_stream_parser parser;
+    jsmn_stream_init(&parser, stream_cb, &res);
+    for (size_t pos = 0; pos < js.size(); pos += chunk) {
+        /* Copy each chunk, so that reading beyond it is caught by the sanitizers */
+        string part = js.substr(pos, chunk);
+        int r = jsmn_stream_feed(&parser, part.data(), part.size());
+        if (r != 0) {
+            return r;
+        }
+    }
+    return jsmn_stream_finish(&parser);
+}
+
+static string make_document(int entries)
+{
+    string js = "{\n    \"device\": \"esp32\",\n    \"items\": [\n";
+    for (int i = 0; i < entries; i++) {
+        char buf[256];
+        snprintf(buf, sizeof(buf),
+                 "        {\"id\": %d, \"name\": \"item number %d with a longer description\", "
+                 "\"enabled\": %s, \"ratio\": %d.%03d, \"path\": \"\\/data\\/\\u00e9\\\"%d\\\"\", \"tags\": [\"a\", \"bc\", null]}%s\n",
+                 i, i, (i % 2) ? "true" : "false", i / 7, i % 1000, i, (i == entries - 1) ? "" : ",");
+        js += buf;
+    }
+    js += "    ]\n}\n";
+    return js;
+}
+
+TEST_CASE("stream tokenizer matches jsmn_parse for any chunk size", "[jsmn]")
+{
+    const char *docs[] = {
+        "{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"}}",
+        "[]",
+        "{}",
+        "[[[[1]]],{\"x\":{}}]",
+        "  \"a string with \\\"escaped quotes\\\" and \\\\ backslashes\"  ",
+        "{\"unicode\": \"\\u0041\\u00DF\\uabcd\", \"empty\": \"\"}",
+        "[1, -2.5e10, 3, \"abcdefghijklmnopqrstuvwxyz0123456789\"]",
+    };
+    for (const char *doc : docs) {
+        string js(doc);
+        vector<Token> expected = parse_all(js);
+        for (size_t chunk = 1; chunk <= js.size(); chunk++) {
+            StreamResult res;
+            REQUIRE(stream_all(js, chunk, res) == 0);
+            REQUIRE(res.tokens == expected);
+            REQUIRE(res.depth == 0);
+        }
+    }
+
+    string big = make_document(50);
+    vector<Token> expected = parse_all(big);
+    for (size_t chunk : {1, 3, 7, 64, 1000, 100000}) {
+        StreamResult res;
+        REQUIRE(stream_all(big, chunk, res) == 0);
+        REQUIRE(res.tokens == expected);
+    }
+}
+
+TEST_CASE("stream tokenizer reports keys separately from values", "[jsmn]")
+{
+    StreamResult res;
+    REQUIRE(stream_all("{\"k\": \"v\", \"n\": [\"s\", 1]}", 5, res) == 0);
+    vector<jsmn_stream_event_t> expected = {
+        JSMN_STREAM_OBJECT_START,
+        JSMN_STREAM_KEY, JSMN_STREAM_STRING,
+        JSMN_STREAM_KEY, JSMN_STREAM_ARRAY_START, JSMN_STREAM_STRING, JSMN_STREAM_PRIMITIVE, JSMN_STREAM_ARRAY_END,
+        JSMN_STREAM_OBJECT_END,
+    };
+    REQUIRE(res.events == expected);
+}
+
+TEST_CASE("stream tokenizer handles top level primitive", "[jsmn]")
+{
+    StreamResult res;
+    REQUIRE(stream_all("12345", 2, res) == 0);
+    REQUIRE(res.tokens.size() == 1);
+    REQUIRE(res.tokens[0].text == "12345");
+}
+
+TEST_CASE("stream tokenizer rejects malformed documents", "[jsmn]")
+{
+    const char *invalid[] = {
+        "{\"a\" 1}",
+        "{\"a\": 1]",
+        "[1 2]",
+        "{1: 2}",
+        "[1,,2]",
+        "\"bad \\x escape\"",
+        "\"bad \\u12g4 escape\"",
+        "]",
+        ":",
+    };
+    for (const char *doc : invalid) {
+        StreamResult res;
+        INFO(doc);
+        CHECK(stream_all(doc, 3, res) == JSMN_ERROR_INVAL);
+    }
+
+    const char *partial[] = {
+        "{\"a\": 1",
+        "[1, 2,",
+        "\"unterminated",
+        "{\"a\"",
+    };
+    for (const char *doc : partial) {
+        StreamResult res;
+        INFO(doc);
+        CHECK(stream_all(doc, 3, res) == JSMN_ERROR_PART);
+    }
+
+    string deep(JSMN_STREAM_MAX_DEPTH + 1, '[');
+    StreamResult res;
+    CHECK(stream_all(deep, 4, res) == JSMN_ERROR_NOMEM);
+}
+
+TEST_CASE("stream tokenizer stops when callback returns non-zero", "[jsmn]")
+{
+    int calls = 0;
+    jsmn_stream_parser parser;
+    jsmn_stream_init(&parser, [](void *arg, jsmn_stream_event_t, const char *, size_t, int) -> int {
+        return ++*(int *) arg == 2;
+    }, &calls);
+    const char js[] = "[1, 2, 3]";
+    CHECK(jsmn_stream_feed(&parser, js, sizeof(js) - 1) == JSMN_STREAM_ERROR_ABORTED);
+    CHECK(calls == 2);
+    CHECK(jsmn_stream_feed(&parser, js, sizeof(js) - 1) == JSMN_ERROR_INVAL);
+}
+
+TEST_CASE("jsmn_parse finds string ends at every word offset", "[jsmn]")
+{
+    for (size_t len = 0; len < 24; len++) {
+        for (char special : {'\"', '\\'}) {
+            string body(len, 'x');
+            if (special == '\\') {
+                body += "\\n";
+            }
+            string js = "[\"" + body + "\",  \"y\"]";
+            vector<Token> tokens = parse_all(js);
+            REQUIRE(tokens.size() == 3);
+            REQUIRE(tokens[1].text == body);
+            REQUIRE(tokens[2].text == "y");
+        }
+    }
+}
+
+static double elapsed_sec(const struct timespec &start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static int count_cb(void *arg, jsmn_stream_event_t, const char *, size_t, int)
+{
+    ++*(size_t *) arg;
+    return 0;
+}
+
+TEST_CASE("tokenizer throughput", "[.][benchmark]")
+{
+    const int iterations = 50;
+    string js = make_document(5000);
+    double mbytes = (double) js.size() * iterations / (1024 * 1024);
+
+    vector<jsmntok_t> tokens(js.size() / 2);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < iterations; i++) {
+        jsmn_parser parser;
+        jsmn_init(&parser);
+        REQUIRE(jsmn_parse(&parser, js.c_str(), js.size(), tokens.data(), tokens.size()) > 0);
+    }
+    double t = elapsed_sec(start);
+    printf("jsmn_parse: %zu bytes x %d: %.1f MB/s\n", js.size(), iterations, mbytes / t);
+
+    for (size_t chunk : {256, 1460, 16384}) {
+        size_t events = 0;
+        int err = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < iterations; i++) {
+            jsmn_stream_parser parser;
+            jsmn_stream_init(&parser, count_cb, &events);
+            for (size_t pos = 0; pos < js.size(); pos += chunk) {
+                err |= jsmn_stream_feed(&parser, js.data() + pos, min(chunk, js.size() - pos));
+            }
+            err |= jsmn_stream_finish(&parser);
+        }
+        t = elapsed_sec(start);
+        REQUIRE(err == 0);
+        printf("jsmn_stream (%zu byte chunks): %.1f MB/s\n", chunk, mbytes / t);
+    }
+}
@@ -55,6 +55,15 @@
 #define IFNAME0 'e'
 #define IFNAME1 'n'
 
+/* Longer pbuf chains are linearized before sending */
+#define ETH_TX_MAX_SEGS 16
+
+#ifdef PBUF_NEEDS_COPY
+#define ETH_TX_SEG_NEEDS_COPY(q) PBUF_NEEDS_COPY(q)
+#else
+#define ETH_TX_SEG_NEEDS_COPY(q) true
+#endif
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -88,6 +97,43 @@ ethernet_low_level_init(struct netif *netif)
 #endif
 }
 
+static void
+ethernet_free_tx_pbuf(void *arg)
+{
+  pbuf_free((struct pbuf *)arg);
+}
+
+/**
+ * Sends a pbuf chain without linearizing it: driver copies small segments
+ * once to its DMA buffers and sends large ones directly from the pbufs,
+ * which are referenced until they are transmitted.
+ */
+static esp_err_t
+ethernet_output_chain(struct pbuf *p)
+{
+  eth_tx_seg_t segs[ETH_TX_MAX_SEGS];
+  uint32_t count = 0;
+  struct pbuf *q;
+  esp_err_t ret;
+
+  for (q = p; q != NULL; q = q->next) {
+    if (count == ETH_TX_MAX_SEGS) {
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+    segs[count].buf = q->payload;
+    segs[count].len = q->len;
+    segs[count].no_ref = ETH_TX_SEG_NEEDS_COPY(q);
+    count++;
+  }
+
+  pbuf_ref(p);
+  ret = esp_eth_tx_segs(segs, count, ethernet_free_tx_pbuf, p);
+  if (ret != ESP_OK) {
+    pbuf_free(p);
+  }
+  return ret;
+}
+
 /**
  * This function should do the actual transmission of the packet. The packet is
  * contained in the pbuf that is passed to the function. This pbuf
@@ -118,8 +164,8 @@ ethernet_low_level_output(struct netif *netif, struct pbuf *p)
 
   if (q->next == NULL) {
     ret = esp_eth_tx(q->payload, q->len);
-  } else {
-    LWIP_DEBUGF(PBUF_DEBUG, ("low_level_output: pbuf is a list, application may has bug"));
+  } else if ((ret = ethernet_output_chain(p)) == ESP_ERR_NOT_SUPPORTED) {
+    LWIP_DEBUGF(PBUF_DEBUG, ("low_level_output: pbuf chain is too long, copying it"));
     q = pbuf_alloc(PBUF_RAW_TX, p->tot_len, PBUF_RAM);
     if (q != NULL) {
       q->l2_owner = NULL;
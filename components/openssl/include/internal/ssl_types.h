@@ -192,6 +192,9 @@ struct ssl_ctx_st
 
     int read_buffer_len;
 
+    /* TLSEXT_max_fragment_length_* */
+    int max_fragment_len_mode;
+
     X509_VERIFY_PARAM param;
 };
 
@@ -48,6 +48,13 @@
 #define TLS1_1_VERSION                  0x0302
 #define TLS1_2_VERSION                  0x0303
 
+/* Maximum fragment length extension modes, see SSL_CTX_set_tlsext_max_fragment_length() */
+#define TLSEXT_max_fragment_length_DISABLED 0
+#define TLSEXT_max_fragment_length_512      1
+#define TLSEXT_max_fragment_length_1024     2
+#define TLSEXT_max_fragment_length_2048     3
+#define TLSEXT_max_fragment_length_4096     4
+
 #ifdef __cplusplus
 }
 #endif
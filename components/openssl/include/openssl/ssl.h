@@ -427,6 +427,23 @@ unsigned long SSL_CTX_set_options(SSL_CTX *ctx, unsigned long opt);
  */
 int SSL_CTX_set_mode(SSL_CTX *ctx, int mod);
 
+/**
+ * @brief set maximum fragment length of the SSL connections created with the context
+ *
+ * Client requests it from the server with the maximum fragment length extension, server
+ * doesn't send larger records.
+ *
+ * @param ctx  - SSL context point
+ * @param mode - TLSEXT_max_fragment_length_DISABLED, TLSEXT_max_fragment_length_512,
+ *               TLSEXT_max_fragment_length_1024, TLSEXT_max_fragment_length_2048 or
+ *               TLSEXT_max_fragment_length_4096
+ *
+ * @return result
+ *     1 : OK
+ *     0 : failed
+ */
+int SSL_CTX_set_tlsext_max_fragment_length(SSL_CTX *ctx, uint8_t mode);
+
 /*
 }
 */
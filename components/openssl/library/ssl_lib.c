@@ -623,6 +623,23 @@ unsigned long SSL_CTX_set_options(SSL_CTX *ctx, unsigned long opt)
     return ctx->options |= opt;
 }
 
+/**
+ * @brief set maximum fragment length of the SSL context
+ */
+int SSL_CTX_set_tlsext_max_fragment_length(SSL_CTX *ctx, uint8_t mode)
+{
+    SSL_ASSERT1(ctx);
+
+    if (mode > TLSEXT_max_fragment_length_4096) {
+        SSL_DEBUG(SSL_LIB_ERROR_LEVEL, "invalid maximum fragment length mode %d", mode);
+        return 0;
+    }
+
+    ctx->max_fragment_len_mode = mode;
+
+    return 1;
+}
+
 /**
  * @brief clear SSL option
  */
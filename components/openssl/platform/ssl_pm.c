@@ -162,6 +162,15 @@ int ssl_pm_new(SSL *ssl)
     }
     mbedtls_ssl_conf_rng(&ssl_pm->conf, mbedtls_ctr_drbg_random, &ssl_pm->ctr_drbg);
 
+    if (ssl->ctx->max_fragment_len_mode != TLSEXT_max_fragment_length_DISABLED) {
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        /* TLSEXT_max_fragment_length_* values are the same as MBEDTLS_SSL_MAX_FRAG_LEN_* */
+        mbedtls_ssl_conf_max_frag_len(&ssl_pm->conf, ssl->ctx->max_fragment_len_mode);
+#else
+        SSL_DEBUG(SSL_PLATFORM_ERROR_LEVEL, "MBEDTLS_SSL_MAX_FRAGMENT_LENGTH must be enabled to limit fragment length", -1);
+#endif
+    }
+
 #ifdef CONFIG_OPENSSL_LOWLEVEL_DEBUG
     mbedtls_debug_set_threshold(MBEDTLS_DEBUG_LEVEL);
     mbedtls_ssl_conf_dbg(&ssl_pm->conf, ssl_platform_debug, NULL);
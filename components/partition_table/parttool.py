@@ -19,6 +19,7 @@
 from __future__ import print_function, division
 import argparse
 import os
+import shlex
 import sys
 import subprocess
 import tempfile
@@ -39,60 +40,245 @@ def status(msg):
         print(msg)
 
 
-def _invoke_esptool(esptool_args, args):
-    m_esptool_args = [sys.executable, ESPTOOL_PY]
+class EsptoolTarget(object):
+    """ Flash of a device attached to a serial port, accessed with esptool """
 
-    if args.port != "":
-        m_esptool_args.extend(["--port", args.port])
+    def __init__(self, port=""):
+        self.port = port
 
-    m_esptool_args.extend(esptool_args)
-
-    if quiet:
-        with open(os.devnull, "w") as fnull:
-            subprocess.check_call(m_esptool_args, stdout=fnull, stderr=fnull)
-    else:
-        subprocess.check_call(m_esptool_args)
+    def _invoke_esptool(self, esptool_args):
+        m_esptool_args = [sys.executable, ESPTOOL_PY]
 
+        if self.port != "":
+            m_esptool_args.extend(["--port", self.port])
 
-def _get_partition_table(args):
-    partition_table = None
+        m_esptool_args.extend(esptool_args)
 
-    gen.offset_part_table = int(args.partition_table_offset, 0)
-
-    if args.partition_table_file:
-        status("Reading partition table from partition table file...")
-
-        try:
-            with open(args.partition_table_file, "rb") as partition_table_file:
-                partition_table = gen.PartitionTable.from_binary(partition_table_file.read())
-                status("Partition table read from binary file {}".format(partition_table_file.name))
-        except (gen.InputError, TypeError):
-            with open(args.partition_table_file, "r") as partition_table_file:
-                partition_table_file.seek(0)
-                partition_table = gen.PartitionTable.from_csv(partition_table_file.read())
-                status("Partition table read from CSV file {}".format(partition_table_file.name))
-    else:
-        port_info = (" on port " + args.port if args.port else "")
-        status("Reading partition table from device{}...".format(port_info))
+        if quiet:
+            with open(os.devnull, "w") as fnull:
+                subprocess.check_call(m_esptool_args, stdout=fnull, stderr=fnull)
+        else:
+            subprocess.check_call(m_esptool_args)
 
-        f_name = None
+    def read(self, offset, size):
         with tempfile.NamedTemporaryFile(delete=False) as f:
             f_name = f.name
 
         try:
-            invoke_args = ["read_flash", str(gen.offset_part_table), str(gen.MAX_PARTITION_LENGTH), f_name]
-            _invoke_esptool(invoke_args, args)
+            self._invoke_esptool(["read_flash", str(offset), str(size), f_name])
             with open(f_name, "rb") as f:
-                partition_table = gen.PartitionTable.from_binary(f.read())
-                status("Partition table read from device" + port_info)
+                return f.read()
         finally:
             os.unlink(f_name)
 
-    return partition_table
+    def erase(self, offset, size):
+        self._invoke_esptool(["erase_region", str(offset), str(size)])
 
+    def write(self, regions):
+        """ Writes a list of (offset, data) regions, compressed, with a single esptool invocation """
+        f_names = []
+        try:
+            esptool_args = ["write_flash", "-z"]
+            for offset, data in regions:
+                with tempfile.NamedTemporaryFile(delete=False) as f:
+                    f_names.append(f.name)
+                    f.write(data)
+                esptool_args += [str(offset), f.name]
+            self._invoke_esptool(esptool_args)
+        finally:
+            for f_name in f_names:
+                os.unlink(f_name)
+
+
+class ImageTarget(object):
+    """ Flash image file, to perform the operations on the host instead of a device """
+
+    def __init__(self, path):
+        self.path = path
+
+    def read(self, offset, size):
+        with open(self.path, "rb") as f:
+            f.seek(offset)
+            data = f.read(size)
+        # flash beyond the end of the image is erased
+        return data + b"\xFF" * (size - len(data))
+
+    def erase(self, offset, size):
+        self.write([(offset, b"\xFF" * size)])
+
+    def write(self, regions):
+        with open(self.path, "r+b") as f:
+            for offset, data in regions:
+                f.seek(0, os.SEEK_END)
+                if f.tell() < offset:
+                    f.write(b"\xFF" * (offset - f.tell()))
+                f.seek(offset)
+                f.write(data)
+
+
+class FlashSession(object):
+    """
+    Partition level operations on a device or a flash image, which share the work:
+
+    - the partition table is read and parsed once;
+    - data read are kept, reads of regions close to each other can be done together with prefetch();
+    - writes and erases are collected, flush() performs them together: adjacent erases are merged into one
+      erase_region, then the writes are done with a single compressed write.
+
+    Reads return the data written before them in the session, as if the writes were done already.
+    """
+    # Regions with at most this many bytes between them are read together
+    READ_MERGE_GAP = 0x10000
+    # Writes erase the whole flash sectors they touch
+    SECTOR_SIZE = 0x1000
+
+    def __init__(self, target, partition_table_offset=0x8000, partition_table_file=None):
+        self.target = target
+        self.partition_table_offset = partition_table_offset
+        self.partition_table_file = partition_table_file
+        self._partition_table = None
+        self._read_regions = []     # (offset, data) read from the target
+        self._pending_writes = []   # (offset, data) not written to the target yet, these don't overlap
+        self._pending_erases = []   # (offset, size) not erased yet, writes done after them don't overlap them
+
+    @property
+    def partition_table(self):
+        if self._partition_table is None:
+            self._partition_table = self._read_partition_table()
+        return self._partition_table
+
+    def _read_partition_table(self):
+        gen.offset_part_table = self.partition_table_offset
+
+        if self.partition_table_file:
+            status("Reading partition table from partition table file...")
 
-def _get_partition(args):
-    partition_table = _get_partition_table(args)
+            try:
+                with open(self.partition_table_file, "rb") as partition_table_file:
+                    partition_table = gen.PartitionTable.from_binary(partition_table_file.read())
+                    status("Partition table read from binary file {}".format(partition_table_file.name))
+            except (gen.InputError, TypeError):
+                with open(self.partition_table_file, "r") as partition_table_file:
+                    partition_table_file.seek(0)
+                    partition_table = gen.PartitionTable.from_csv(partition_table_file.read())
+                    status("Partition table read from CSV file {}".format(partition_table_file.name))
+        else:
+            status("Reading partition table from {}...".format(self._target_name()))
+            partition_table = gen.PartitionTable.from_binary(self.read(self.partition_table_offset, gen.MAX_PARTITION_LENGTH))
+            status("Partition table read from " + self._target_name())
+
+        return partition_table
+
+    def _target_name(self):
+        if isinstance(self.target, ImageTarget):
+            return "image " + self.target.path
+        return "device" + (" on port " + self.target.port if self.target.port else "")
+
+    def prefetch(self, regions):
+        """ Reads a list of (offset, size) regions with as few reads from the target as possible """
+        regions = sorted((offset, size) for (offset, size) in regions if self._find_read(offset, size) is None)
+        merged = []
+        for offset, size in regions:
+            if merged and offset <= merged[-1][1] + self.READ_MERGE_GAP:
+                merged[-1][1] = max(merged[-1][1], offset + size)
+            else:
+                merged.append([offset, offset + size])
+        for start, end in merged:
+            self._read_regions.append((start, self.target.read(start, end - start)))
+
+    def _find_read(self, offset, size):
+        for start, data in self._read_regions:
+            if start <= offset and offset + size <= start + len(data):
+                return data[offset - start:offset - start + size]
+        return None
+
+    def read(self, offset, size):
+        data = self._find_read(offset, size)
+        if data is None:
+            self.prefetch([(offset, size)])
+            data = self._find_read(offset, size)
+
+        # the data of erases and writes which are not done yet
+        data = bytearray(data)
+        for start, erase_size in self._pending_erases:
+            lo = max(start, offset)
+            hi = min(start + erase_size, offset + size)
+            if lo < hi:
+                data[lo - offset:hi - offset] = b"\xFF" * (hi - lo)
+        for start, pending in self._pending_writes:
+            lo = max(start, offset)
+            hi = min(start + len(pending), offset + size)
+            if lo < hi:
+                data[lo - offset:hi - offset] = pending[lo - start:hi - start]
+        return bytes(data)
+
+    def write(self, offset, data):
+        # merge with the writes this one overlaps, so that each region is written once
+        for start, pending in list(self._pending_writes):
+            if start < offset + len(data) and offset < start + len(pending):
+                merged = bytearray(b"\xFF" * (max(start + len(pending), offset + len(data)) - min(start, offset)))
+                base = min(start, offset)
+                merged[start - base:start - base + len(pending)] = pending
+                merged[offset - base:offset - base + len(data)] = data
+                offset, data = base, bytes(merged)
+                self._pending_writes.remove((start, pending))
+        self._pending_writes.append((offset, bytes(data)))
+
+    def erase(self, offset, size):
+        # the parts of earlier writes which are erased are not written
+        for start, pending in list(self._pending_writes):
+            if start < offset + size and offset < start + len(pending):
+                self._pending_writes.remove((start, pending))
+                if start < offset:
+                    self._pending_writes.append((start, pending[:offset - start]))
+                if offset + size < start + len(pending):
+                    self._pending_writes.append((offset + size, pending[offset + size - start:]))
+        self._pending_erases.append((offset, size))
+
+    def write_erased(self, offset, size, data):
+        """ Writes data to the start of an erased region, the rest of the region is erased with erase_region """
+        # esptool erases the whole sectors it writes to, so the data are padded to a sector only
+        padded_len = min(-(-len(data) // self.SECTOR_SIZE) * self.SECTOR_SIZE, max(size, len(data)))
+        self.erase(offset, size)
+        self.write(offset, data + b"\xFF" * (padded_len - len(data)))
+
+    def _erase_regions(self):
+        """ Returns the merged regions to erase, without the sectors which are erased by the writes """
+        sectors = set()
+        for start, size in self._pending_erases:
+            sectors.update(range(start // self.SECTOR_SIZE, -(-(start + size) // self.SECTOR_SIZE)))
+        for start, data in self._pending_writes:
+            sectors.difference_update(range(start // self.SECTOR_SIZE, -(-(start + len(data)) // self.SECTOR_SIZE)))
+        regions = []
+        for sector in sorted(sectors):
+            if regions and regions[-1][0] + regions[-1][1] == sector * self.SECTOR_SIZE:
+                regions[-1][1] += self.SECTOR_SIZE
+            else:
+                regions.append([sector * self.SECTOR_SIZE, self.SECTOR_SIZE])
+        return regions
+
+    def flush(self):
+        """ Performs the erases and writes of the session """
+        for offset, size in self._erase_regions():
+            self.target.erase(offset, size)
+        if self._pending_writes:
+            self.target.write(sorted(self._pending_writes))
+        regions = [(start, b"\xFF" * size) for (start, size) in self._pending_erases] + self._pending_writes
+        self._read_regions = [r for r in self._read_regions if not any(
+            start < r[0] + len(r[1]) and r[0] < start + len(data) for (start, data) in regions)] + self._pending_writes
+        self._pending_erases = []
+        self._pending_writes = []
+
+
+def get_session(args):
+    """ Returns a session on the device or image, with the partition table source given by the command line arguments """
+    image = getattr(args, "image", None)
+    target = ImageTarget(image) if image else EsptoolTarget(args.port)
+    return FlashSession(target, int(args.partition_table_offset, 0), args.partition_table_file or None)
+
+
+def _get_partition(session, args):
+    partition_table = session.partition_table
 
     partition = None
 
@@ -116,10 +302,10 @@ def _get_partition(args):
     return partition
 
 
-def _get_and_check_partition(args):
+def _get_and_check_partition(session, args):
     partition = None
 
-    partition = _get_partition(args)
+    partition = _get_partition(session, args)
 
     if not partition:
         raise RuntimeError("Unable to find specified partition.")
@@ -127,43 +313,43 @@ def _get_and_check_partition(args):
     return partition
 
 
-def write_partition(args):
-    erase_partition(args)
-
-    partition = _get_and_check_partition(args)
+def write_partition(session, args):
+    partition = _get_and_check_partition(session, args)
 
     status("Checking input file size...")
 
     with open(args.input, "rb") as input_file:
-        content_len = len(input_file.read())
+        content = input_file.read()
+        content_len = len(content)
 
         if content_len != partition.size:
             status("File size (0x{:x}) does not match partition size (0x{:x})".format(content_len, partition.size))
         else:
             status("File size matches partition size (0x{:x})".format(partition.size))
 
-    _invoke_esptool(["write_flash", str(partition.offset),  args.input], args)
+    session.write_erased(partition.offset, partition.size, content)
 
     status("Written contents of file '{}' to device at offset 0x{:x}".format(args.input, partition.offset))
 
 
-def read_partition(args):
-    partition = _get_and_check_partition(args)
-    _invoke_esptool(["read_flash", str(partition.offset), str(partition.size), args.output], args)
+def read_partition(session, args):
+    partition = _get_and_check_partition(session, args)
+    with open(args.output, "wb") as f:
+        f.write(session.read(partition.offset, partition.size))
     status("Read partition contents from device at offset 0x{:x} to file '{}'".format(partition.offset, args.output))
 
 
-def erase_partition(args):
-    partition = _get_and_check_partition(args)
-    _invoke_esptool(["erase_region", str(partition.offset),  str(partition.size)], args)
+def erase_partition(session, args):
+    partition = _get_and_check_partition(session, args)
+    session.erase(partition.offset, partition.size)
     status("Erased partition at offset 0x{:x} on device".format(partition.offset))
 
 
-def get_partition_info(args):
+def get_partition_info(session, args):
     partition = None
 
     if args.table:
-        partition_table = _get_partition_table(args)
+        partition_table = session.partition_table
 
         if args.table.endswith(".csv"):
             partition_table = partition_table.to_csv()
@@ -174,7 +360,7 @@ def get_partition_info(args):
             table_file.write(partition_table)
             status("Partition table written to " + table_file.name)
     else:
-        partition = _get_partition(args)
+        partition = _get_partition(session, args)
 
         if partition:
             info_dict = {
@@ -194,13 +380,15 @@ def get_partition_info(args):
             print(" ".join(infos))
         else:
             status("Partition not found")
+            # an empty line, so that the output of each operation in a batch is on its own line
+            print("")
 
 
-def generate_blank_partition_file(args):
+def generate_blank_partition_file(session, args):
     output = None
     stdout_binary = None
 
-    partition = _get_and_check_partition(args)
+    partition = _get_and_check_partition(session, args)
     output = b"\xFF" * partition.size
 
     try:
@@ -213,22 +401,39 @@ def generate_blank_partition_file(args):
         status("Blank partition file '{}' generated".format(args.output))
 
 
-def main():
-    global quiet
+def read_batch(parser, path):
+    """ Returns the operations in file 'path' ('-' for stdin), one per line with arguments parsed by 'parser' """
+    operations = []
+    with (sys.stdin if path == "-" else open(path, "r")) as f:
+        for line in f:
+            line_args = shlex.split(line, comments=True)
+            if line_args:
+                operation = parser.parse_args(line_args)
+                if operation.operation is None:
+                    raise RuntimeError("No operation specified in '{}'".format(line.strip()))
+                operations.append(operation)
+    return operations
 
-    parser = argparse.ArgumentParser("ESP-IDF Partitions Tool")
 
-    parser.add_argument("--quiet", "-q", help="suppress stderr messages", action="store_true")
+def batch(session, args):
+    # parsed the same as the command line, without the partition table source options
+    parser = argparse.ArgumentParser("batch", add_help=False)
+    _add_operation_args(parser, batch=True)
+    operations = read_batch(parser, args.input)
 
-    # There are two possible sources for the partition table: a device attached to the host
-    # or a partition table CSV/binary file. These sources are mutually exclusive.
-    partition_table_info_source_args = parser.add_mutually_exclusive_group()
+    # read the data of all read operations together
+    regions = []
+    for operation in operations:
+        if operation.operation == "read_partition":
+            partition = _get_and_check_partition(session, operation)
+            regions.append((partition.offset, partition.size))
+    session.prefetch(regions)
 
-    partition_table_info_source_args.add_argument("--port", "-p", help="port where the device to read the partition table from is attached", default="")
-    partition_table_info_source_args.add_argument("--partition-table-file", "-f", help="file (CSV/binary) to read the partition table from")
+    for operation in operations:
+        globals()[operation.operation](session, operation)
 
-    parser.add_argument("--partition-table-offset", "-o", help="offset to read the partition table from",  default="0x8000")
 
+def _add_operation_args(parser, batch=False):
     # Specify what partition to perform the operation on. This can either be specified using the
     # partition name or the first partition that matches the specified type/subtype
     partition_selection_args = parser.add_mutually_exclusive_group()
@@ -260,10 +465,40 @@ def main():
                                                      the specified partition that can be flashed to the device")
     generate_blank_subparser.add_argument("--output", help="blank partition file filename")
 
+    if not batch:
+        batch_subparser = subparsers.add_parser("batch", help="perform the operations listed in a file, one per line with the same arguments \
+                                                as on the command line. The partition table is read once, data are written with a single \
+                                                esptool invocation after all the operations")
+        batch_subparser.add_argument("--input", help="file with the operations, - for stdin", default="-")
+
+
+def main():
+    global quiet
+
+    parser = argparse.ArgumentParser("ESP-IDF Partitions Tool")
+
+    parser.add_argument("--quiet", "-q", help="suppress stderr messages", action="store_true")
+
+    # There are two possible sources for the partition table: a device attached to the host
+    # or a partition table CSV/binary file. These sources are mutually exclusive.
+    partition_table_info_source_args = parser.add_mutually_exclusive_group()
+
+    partition_table_info_source_args.add_argument("--port", "-p", help="port where the device to read the partition table from is attached", default="")
+    partition_table_info_source_args.add_argument("--partition-table-file", "-f", help="file (CSV/binary) to read the partition table from")
+
+    parser.add_argument("--partition-table-offset", "-o", help="offset to read the partition table from",  default="0x8000")
+
+    parser.add_argument("--image", help="flash image file to perform the operations on, instead of a device")
+
+    _add_operation_args(parser)
+
     args = parser.parse_args()
 
     quiet = args.quiet
 
+    if args.image and args.port:
+        parser.error("--port and --image can't be used together")
+
     # No operation specified, display help and exit
     if args.operation is None:
         if not quiet:
@@ -273,14 +508,19 @@ def main():
     # Else execute the operation
     operation_func = globals()[args.operation]
 
+    def run():
+        session = get_session(args)
+        operation_func(session, args)
+        session.flush()
+
     if quiet:
         # If exceptions occur, suppress and exit quietly
         try:
-            operation_func(args)
+            run()
         except Exception:
             sys.exit(2)
     else:
-        operation_func(args)
+        run()
 
 
 if __name__ == '__main__':
@@ -27,42 +27,66 @@ endif()
 # need to re-run CMake if the partition CSV changes, as the offsets/sizes of partitions may change
 set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${PARTITION_CSV_PATH})
 
-# Parse the partition table to get variable partition offsets & sizes which must be known at CMake runtime
-function(get_partition_info variable get_part_info_args part_info)
-    separate_arguments(get_part_info_args)
+# Parse the partition table to get variable partition offsets & sizes which must be known at CMake runtime.
+# Each call adds a query, the partition table is parsed once for all of them by run_partition_info_queries().
+macro(add_partition_info_query variable get_part_info_args part_info)
+    list(APPEND partition_info_variables ${variable})
+    string(APPEND partition_info_queries "${get_part_info_args} get_partition_info --info ${part_info}\n")
+endmacro()
+
+function(run_partition_info_queries)
+    set(queries_file "${CMAKE_BINARY_DIR}/partition_info_queries")
+    file(WRITE "${queries_file}" "${partition_info_queries}")
     execute_process(COMMAND ${PYTHON}
         ${COMPONENT_PATH}/parttool.py -q
         --partition-table-offset ${PARTITION_TABLE_OFFSET}
         --partition-table-file ${PARTITION_CSV_PATH}
-        ${get_part_info_args} get_partition_info --info ${part_info}
+        batch --input ${queries_file}
         OUTPUT_VARIABLE result
-        RESULT_VARIABLE exit_code
-        OUTPUT_STRIP_TRAILING_WHITESPACE)
+        RESULT_VARIABLE exit_code)
     if(NOT ${exit_code} EQUAL 0 AND NOT ${exit_code} EQUAL 1)
         # can't fail here as it would prevent the user from running 'menuconfig' again
         message(WARNING "parttool.py execution failed (${result}), problem with partition CSV file (see above)")
+        set(result "")
     endif()
-    set(${variable} ${result} PARENT_SCOPE)
+
+    # The output has a line for each query, which is empty if the partition is not found
+    string(REPLACE "\n" ";" result "${result}")
+    list(LENGTH result result_count)
+    set(index 0)
+    foreach(variable ${partition_info_variables})
+        set(value "")
+        if(index LESS result_count)
+            list(GET result ${index} value)
+        endif()
+        set(${variable} ${value} PARENT_SCOPE)
+        math(EXPR index "${index} + 1")
+    endforeach()
 endfunction()
 
+set(partition_info_variables)
+set(partition_info_queries "")
+
 if(CONFIG_ESP32_PHY_INIT_DATA_IN_PARTITION)
-    get_partition_info(PHY_PARTITION_OFFSET
+    add_partition_info_query(PHY_PARTITION_OFFSET
                 "--partition-type data --partition-subtype phy" "offset")
     set(PHY_PARTITION_BIN_FILE "esp32/phy_init_data.bin")
 endif()
 
-get_partition_info(APP_PARTITION_OFFSET
+add_partition_info_query(APP_PARTITION_OFFSET
                 "--partition-boot-default" "offset")
 
-get_partition_info(OTADATA_PARTITION_OFFSET
+add_partition_info_query(OTADATA_PARTITION_OFFSET
                 "--partition-type data --partition-subtype ota" "offset")
 
-get_partition_info(OTADATA_PARTITION_SIZE
+add_partition_info_query(OTADATA_PARTITION_SIZE
                 "--partition-type data --partition-subtype ota" "size")
 
-get_partition_info(FACTORY_OFFSET
+add_partition_info_query(FACTORY_OFFSET
                 "--partition-type app --partition-subtype factory" "offset")
 
+run_partition_info_queries()
+
 endif()
 
 set(BOOTLOADER_OFFSET 0x1000)
@@ -9,12 +9,14 @@ import tempfile
 import os
 import io
 import re
+import binascii
 
 try:
     import gen_esp32part
 except ImportError:
     sys.path.append("..")
     import gen_esp32part
+import parttool  # noqa: E402
 
 SIMPLE_CSV = """
 # Name,Type,SubType,Offset,Size,Flags
@@ -459,5 +461,152 @@ ota_1,  app,    ota_1,          ,  1M
             b"0x130000")  # now default is ota_1
 
 
+class PartToolSessionTests(Py23TestCase):
+    CSV = """
+nvs,      data, nvs,     0x9000,  0x4000
+otadata,  data, ota,     0xd000,  0x2000
+phy_init, data, phy,     0xf000,  0x1000
+ota_0,    app,  ota_0,   0x10000, 0x10000
+ota_1,    app,  ota_1,   0x20000, 0x10000
+    """
+
+    def setUp(self):
+        # the session sets the offset of the partition table, it is restored for the other tests
+        self.offset_part_table = gen_esp32part.offset_part_table
+        parttool.quiet = True
+        self.tmp_dir = tempfile.mkdtemp()
+        self.image = bytearray(b"\x5A" * 0x30000)
+        table = gen_esp32part.PartitionTable.from_csv(self.CSV).to_binary()
+        self.image[0x8000:0x8000 + len(table)] = table
+
+    def tearDown(self):
+        gen_esp32part.offset_part_table = self.offset_part_table
+        parttool.quiet = False
+        for name in os.listdir(self.tmp_dir):
+            os.remove(os.path.join(self.tmp_dir, name))
+        os.rmdir(self.tmp_dir)
+
+    def _path(self, name, contents=None):
+        path = os.path.join(self.tmp_dir, name)
+        if contents is not None:
+            with open(path, "wb") as f:
+                f.write(contents)
+        return path
+
+    def _read(self, name):
+        with open(self._path(name), "rb") as f:
+            return f.read()
+
+    def test_batch_on_image(self):
+        image = self._path("flash.img", self.image)
+        app = os.urandom(0x1234)
+        self._path("app.bin", app)
+        with open(self._path("batch.txt"), "w") as f:
+            f.write("# operations are done in order, reads see the data written before them\n")
+            f.write("-n nvs read_partition --output {}\n".format(self._path("nvs.bin")))
+            f.write("-n ota_1 write_partition --input {}\n".format(self._path("app.bin")))
+            f.write("-n ota_1 read_partition --output {}\n".format(self._path("ota_1.bin")))
+            f.write("-t data -s ota erase_partition\n")
+            f.write("-t app -s ota_1 get_partition_info --info offset size\n")
+            f.write("-n missing get_partition_info --info offset\n")
+            f.write("-d get_partition_info --info offset\n")
+        output = subprocess.check_output([sys.executable, "../parttool.py", "-q", "--image", image,
+                                          "batch", "--input", self._path("batch.txt")])
+        self.assertEqual(output.decode().splitlines(), ["0x20000 0x10000", "", "0x10000"])
+
+        self.assertEqual(self._read("nvs.bin"), b"\x5A" * 0x4000)
+        self.assertEqual(self._read("ota_1.bin"), app + b"\xFF" * (0x10000 - len(app)))
+        expected = self.image
+        expected[0x20000:0x30000] = self._read("ota_1.bin")
+        expected[0xd000:0xf000] = b"\xFF" * 0x2000
+        self.assertEqual(self._read("flash.img"), expected)
+
+    def test_esptool_invocations(self):
+        test = self
+
+        class RecordingTarget(parttool.EsptoolTarget):
+            """ Runs esptool commands on the flash image of the test """
+            def __init__(self):
+                super(RecordingTarget, self).__init__()
+                self.invocations = []
+                self.regions = []  # (offset, size) of erased and written regions
+
+            def _invoke_esptool(self, esptool_args):
+                self.invocations.append(esptool_args[0])
+                if esptool_args[0] == "read_flash":
+                    offset, size, f_name = int(esptool_args[1]), int(esptool_args[2]), esptool_args[3]
+                    with open(f_name, "wb") as f:
+                        f.write(test.image[offset:offset + size])
+                elif esptool_args[0] == "erase_region":
+                    offset, size = int(esptool_args[1]), int(esptool_args[2])
+                    self.regions.append((offset, size))
+                    test.image[offset:offset + size] = b"\xFF" * size
+                else:
+                    test.assertEqual(esptool_args[:2], ["write_flash", "-z"])
+                    for offset, f_name in zip(esptool_args[2::2], esptool_args[3::2]):
+                        with open(f_name, "rb") as f:
+                            data = f.read()
+                        self.regions.append((int(offset), len(data)))
+                        test.image[int(offset):int(offset) + len(data)] = data
+
+        target = RecordingTarget()
+        session = parttool.FlashSession(target)
+        table = session.partition_table
+        nvs, otadata, ota_0, ota_1 = (table.find_by_name(n) for n in ["nvs", "otadata", "ota_0", "ota_1"])
+        session.prefetch([(p.offset, p.size) for p in (nvs, otadata, ota_0, ota_1)])
+        self.assertEqual(target.invocations, ["read_flash"] * 2)  # partition table, then the rest together
+
+        session.erase(otadata.offset, otadata.size)
+        session.write(ota_0.offset, b"\x01" * ota_0.size)
+        session.write(ota_0.offset + 0x100, b"\x02" * 0x100)
+        session.write(nvs.offset, b"\x03" * 0x1000)
+        session.write(ota_1.offset, b"\x04" * 0x3000)
+        session.write_erased(ota_1.offset, ota_1.size, b"\x05" * 0x1234)
+        self.assertEqual(session.read(otadata.offset, 4), b"\xFF" * 4)
+        self.assertEqual(session.read(ota_1.offset + 0x1233, 2), b"\x05\xFF")
+        self.assertEqual(session.read(ota_1.offset + 0x2fff, 2), b"\xFF\xFF")
+        self.assertEqual(session.read(ota_0.offset + 0xff, 3), b"\x01\x02\x02")
+        self.assertEqual(session.read(nvs.offset + 0xfff, 2), b"\x03\x5A")
+        self.assertEqual(len(target.invocations), 2)
+
+        expected = bytearray(self.image)
+        expected[otadata.offset:otadata.offset + otadata.size] = b"\xFF" * otadata.size
+        expected[ota_0.offset:ota_0.offset + ota_0.size] = b"\x01" * ota_0.size
+        expected[ota_0.offset + 0x100:ota_0.offset + 0x200] = b"\x02" * 0x100
+        expected[nvs.offset:nvs.offset + 0x1000] = b"\x03" * 0x1000
+        expected[ota_1.offset:ota_1.offset + ota_1.size] = b"\x05" * 0x1234 + b"\xFF" * (ota_1.size - 0x1234)
+        session.flush()
+        # erases are not written as data, data are padded to a sector only
+        self.assertEqual(target.invocations, ["read_flash"] * 2 + ["erase_region"] * 2 + ["write_flash"])
+        self.assertEqual(target.regions, [(otadata.offset, otadata.size), (ota_1.offset + 0x2000, ota_1.size - 0x2000),
+                                          (nvs.offset, 0x1000), (ota_0.offset, ota_0.size), (ota_1.offset, 0x2000)])
+        self.assertEqual(self.image, expected)
+        # data written are known, they are not read again
+        self.assertEqual(session.read(ota_0.offset, 2), b"\x01\x01")
+        self.assertEqual(session.read(ota_1.offset + 0x1233, 2), b"\x05\xFF")
+        self.assertEqual(len(target.invocations), 5)
+
+    def test_otatool_batch(self):
+        image = self._path("flash.img", self.image)
+        app = os.urandom(0x100)
+        self._path("app.bin", app)
+        with open(self._path("batch.txt"), "w") as f:
+            f.write("erase_otadata\n")
+            f.write("write_ota_partition --slot 1 --input {}\n".format(self._path("app.bin")))
+            f.write("switch_otadata --slot 1\n")
+            f.write("read_ota_partition --name ota_1 --output {}\n".format(self._path("ota_1.bin")))
+        env = dict(os.environ, IDF_PATH=os.path.abspath(os.path.join("..", "..", "..")))
+        subprocess.check_call([sys.executable, "../../app_update/otatool.py", "-q", "--image", image,
+                               "batch", "--input", self._path("batch.txt")], env=env)
+
+        self.assertEqual(self._read("ota_1.bin"), app + b"\xFF" * (0x10000 - len(app)))
+        otadata = self._read("flash.img")[0xd000:0xf000]
+        # both copies were erased, the first one selects ota_1
+        seq = struct.pack("<I", 2)
+        self.assertEqual(otadata[:4], seq)
+        self.assertEqual(struct.unpack("<I", otadata[28:32])[0], binascii.crc32(seq, 0xFFFFFFFF) % (1 << 32))
+        self.assertEqual(otadata[4:28] + otadata[32:], b"\xFF" * (0x2000 - 8))
+
+
 if __name__ == "__main__":
     unittest.main()
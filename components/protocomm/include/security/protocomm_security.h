@@ -82,14 +82,18 @@ typedef struct protocomm_security {
                                       void *priv_data);
 
     /**
-     * Function which implements the encryption algorithm
+     * Function which implements the encryption algorithm.
+     * outbuf may be the same pointer as inbuf: protocomm_req_handle()
+     * encrypts responses in place, so this must work in-place
      */
     esp_err_t (*encrypt)(uint32_t session_id,
                          const uint8_t *inbuf, ssize_t inlen,
                          uint8_t *outbuf, ssize_t *outlen);
 
     /**
-     * Function which implements the decryption algorithm
+     * Function which implements the decryption algorithm.
+     * outbuf may be the same pointer as inbuf, so this must
+     * work in-place as well
      */
     esp_err_t (*decrypt)(uint32_t session_id,
                          const uint8_t *inbuf, ssize_t inlen,
@@ -36,6 +36,7 @@ protocomm_t *protocomm_new()
        return NULL;
     }
     SLIST_INIT(&pc->endpoints);
+    vPortCPUInitializeMutex(&pc->req_buf_lock);
 
     return pc;
 }
@@ -52,6 +53,9 @@ void protocomm_delete(protocomm_t *pc)
         free(it);
     }
 
+    /* Free spare request buffer */
+    free(pc->req_buf);
+
     /* Free memory allocated to version string */
     if (pc->ver) {
         free((void *)pc->ver);
@@ -68,11 +72,24 @@ void protocomm_delete(protocomm_t *pc)
     free(pc);
 }
 
+/* FNV-1a hash of the endpoint name. Comparing hashes first avoids
+ * calling strcmp on every endpoint in the list for each request */
+static uint32_t ep_name_hash(const char *ep_name)
+{
+    uint32_t hash = 2166136261U;
+    while (*ep_name) {
+        hash ^= (uint8_t) *ep_name++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
 static protocomm_ep_t *search_endpoint(protocomm_t *pc, const char *ep_name)
 {
+    uint32_t hash = ep_name_hash(ep_name);
     protocomm_ep_t *it;
     SLIST_FOREACH(it, &pc->endpoints, next) {
-        if (strcmp(it->ep_name, ep_name) == 0) {
+        if (it->ep_hash == hash && strcmp(it->ep_name, ep_name) == 0) {
             return it;
         }
     }
@@ -112,6 +129,7 @@ static esp_err_t protocomm_add_endpoint_internal(protocomm_t *pc, const char *ep
 
     /* Initialize ep handler */
     ep->ep_name = ep_name;
+    ep->ep_hash = ep_name_hash(ep_name);
     ep->req_handler = h;
     ep->priv_data = priv_data;
     ep->flag = flag;
@@ -138,17 +156,57 @@ esp_err_t protocomm_remove_endpoint(protocomm_t *pc, const char *ep_name)
         pc->remove_endpoint(ep_name);
     }
 
-    protocomm_ep_t *it, *tmp;
-    SLIST_FOREACH_SAFE(it, &pc->endpoints, next, tmp) {
-        if (strcmp(ep_name, it->ep_name) == 0) {
-            SLIST_REMOVE(&pc->endpoints, it, protocomm_ep, next);
-            free(it);
-            return ESP_OK;
-        }
+    protocomm_ep_t *ep = search_endpoint(pc, ep_name);
+    if (ep) {
+        SLIST_REMOVE(&pc->endpoints, ep, protocomm_ep, next);
+        free(ep);
+        return ESP_OK;
     }
     return ESP_ERR_NOT_FOUND;
 }
 
+/* Request buffers larger than this are freed after the request, so that
+ * one large request does not hold memory for the lifetime of the instance */
+#define PROTOCOMM_REQ_BUF_KEEP_LEN  256
+
+/* Gets a buffer for a decrypted request, the spare buffer of the instance
+ * if no other request is using it and it is large enough */
+static uint8_t *protocomm_get_req_buf(protocomm_t *pc, ssize_t len, ssize_t *buf_len)
+{
+    uint8_t *buf = NULL;
+
+    portENTER_CRITICAL(&pc->req_buf_lock);
+    if (pc->req_buf && pc->req_buf_len >= len) {
+        buf = pc->req_buf;
+        *buf_len = pc->req_buf_len;
+        pc->req_buf = NULL;
+        pc->req_buf_len = 0;
+    }
+    portEXIT_CRITICAL(&pc->req_buf_lock);
+
+    if (!buf) {
+        /* Small requests get a buffer which can be kept for all of them */
+        *buf_len = len > PROTOCOMM_REQ_BUF_KEEP_LEN ? len : PROTOCOMM_REQ_BUF_KEEP_LEN;
+        buf = (uint8_t *) malloc(*buf_len);
+    }
+    return buf;
+}
+
+/* Keeps a request buffer as the spare one of the instance, or frees it */
+static void protocomm_put_req_buf(protocomm_t *pc, uint8_t *buf, ssize_t buf_len)
+{
+    if (buf_len <= PROTOCOMM_REQ_BUF_KEEP_LEN) {
+        portENTER_CRITICAL(&pc->req_buf_lock);
+        if (!pc->req_buf) {
+            pc->req_buf = buf;
+            pc->req_buf_len = buf_len;
+            buf = NULL;
+        }
+        portEXIT_CRITICAL(&pc->req_buf_lock);
+    }
+    free(buf);
+}
+
 esp_err_t protocomm_req_handle(protocomm_t *pc, const char *ep_name, uint32_t session_id,
                                const uint8_t *inbuf, ssize_t inlen,
                                uint8_t **outbuf, ssize_t *outlen)
@@ -174,8 +232,9 @@ esp_err_t protocomm_req_handle(protocomm_t *pc, const char *ep_name, uint32_t se
         ESP_LOGD(TAG, "SEC_EP Req handler returned %d", ret);
     } else if (ep->flag & REQ_EP) {
         if (pc->sec && pc->sec->decrypt) {
-            /* Decrypt the data first */
-            uint8_t *dec_inbuf = (uint8_t *) malloc(inlen);
+            /* Decrypt the data first, into a reused request buffer */
+            ssize_t dec_buf_len = 0;
+            uint8_t *dec_inbuf = protocomm_get_req_buf(pc, inlen, &dec_buf_len);
             if (!dec_inbuf) {
                 ESP_LOGE(TAG, "Failed to allocate decrypt buf len %d", inlen);
                 return ESP_ERR_NO_MEM;
@@ -185,50 +244,38 @@ esp_err_t protocomm_req_handle(protocomm_t *pc, const char *ep_name, uint32_t se
             ret = pc->sec->decrypt(session_id, inbuf, inlen, dec_inbuf, &dec_inbuf_len);
             if (ret != ESP_OK) {
                 ESP_LOGE(TAG, "Decryption of response failed for endpoint %s", ep_name);
-                free(dec_inbuf);
+                protocomm_put_req_buf(pc, dec_inbuf, dec_buf_len);
                 return ret;
             }
 
             /* Invoke the request handler */
-            uint8_t *plaintext_resp = NULL;
-            ssize_t plaintext_resp_len = 0;
+            uint8_t *resp = NULL;
+            ssize_t resp_len = 0;
             ret = ep->req_handler(session_id,
                                   dec_inbuf, dec_inbuf_len,
-                                  &plaintext_resp, &plaintext_resp_len,
+                                  &resp, &resp_len,
                                   ep->priv_data);
+            protocomm_put_req_buf(pc, dec_inbuf, dec_buf_len);
             if (ret != ESP_OK) {
                 ESP_LOGE(TAG, "Request handler for %s failed", ep_name);
-                free(plaintext_resp);
-                free(dec_inbuf);
+                free(resp);
                 return ret;
             }
-            /* We don't need decrypted data anymore */
-            free(dec_inbuf);
 
-            /* Encrypt response to be sent back */
-            uint8_t *enc_resp = (uint8_t *) malloc(plaintext_resp_len);
-            if (!enc_resp) {
-                ESP_LOGE(TAG, "Failed to allocate decrypt buf len %d", inlen);
-                free(plaintext_resp);
-                return ESP_ERR_NO_MEM;
-            }
-
-            ssize_t enc_resp_len = plaintext_resp_len;
-            ret = pc->sec->encrypt(session_id, plaintext_resp, plaintext_resp_len,
-                                   enc_resp, &enc_resp_len);
+            /* Encrypt response in place, as the security layer
+             * is required to support outbuf being same as inbuf */
+            ssize_t enc_resp_len = resp_len;
+            ret = pc->sec->encrypt(session_id, resp, resp_len,
+                                   resp, &enc_resp_len);
 
             if (ret != ESP_OK) {
                 ESP_LOGE(TAG, "Encryption of response failed for endpoint %s", ep_name);
-                free(enc_resp);
-                free(plaintext_resp);
+                free(resp);
                 return ret;
             }
 
-            /* We no more need plaintext response */
-            free(plaintext_resp);
-
             /* Set outbuf and outlen appropriately */
-            *outbuf = enc_resp;
+            *outbuf = resp;
             *outlen = enc_resp_len;
         } else {
             /* No encryption */
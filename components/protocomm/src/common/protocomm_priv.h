@@ -15,6 +15,7 @@
 #pragma once
 
 #include <rom/queue.h>
+#include <freertos/FreeRTOS.h>
 #include <protocomm_security.h>
 #include <esp_err.h>
 
@@ -33,6 +34,7 @@
  */
 typedef struct protocomm_ep {
     const char              *ep_name;       /*!< Unique endpoint name */
+    uint32_t                 ep_hash;       /*!< Hash of endpoint name, for quick lookup */
     protocomm_req_handler_t  req_handler;   /*!< Request handler function */
 
     /* Pointer to private data to be passed as a parameter to the handler
@@ -71,6 +73,18 @@ struct protocomm {
     /* Head of the singly linked list for storing endpoint handlers */
     SLIST_HEAD(eptable_t, protocomm_ep) endpoints;
 
+    /* Spare buffer for holding decrypted requests. A request takes it
+     * over while it is handled, and gives it back afterwards unless it
+     * had to grow over PROTOCOMM_REQ_BUF_KEEP_LEN. Concurrent requests
+     * allocate their own buffer while it is taken */
+    uint8_t *req_buf;
+
+    /* Allocated size of the spare request buffer */
+    ssize_t req_buf_len;
+
+    /* Lock for taking over and giving back the spare request buffer */
+    portMUX_TYPE req_buf_lock;
+
     /* Private data to be used internally by the protocomm instance */
     void* priv;
 
@@ -956,6 +956,98 @@ static esp_err_t test_security1_weak_session (void)
     return ESP_OK;
 }
 
+static esp_err_t test_security1_many_endpoints (void)
+{
+    ESP_LOGI(TAG, "Starting Security 1 many endpoints test");
+
+    const char *pop_data = "test pop";
+    protocomm_security_pop_t pop = {
+        .data = (const uint8_t *)pop_data,
+        .len  = strlen(pop_data)
+    };
+
+    session_t *session = calloc(1, sizeof(session_t));
+    if (session == NULL) {
+        ESP_LOGE(TAG, "Error allocating session");
+        return ESP_ERR_NO_MEM;
+    }
+
+    session->id        = 9;
+    session->sec_ver   = 1;
+    session->pop       = &pop;
+
+    // Start protocomm service
+    if (start_test_service(1, &pop) != ESP_OK) {
+        ESP_LOGE(TAG, "Error starting test");
+        free(session);
+        return ESP_FAIL;
+    }
+
+    // Register more endpoints after the echo endpoint, so that
+    // it is not at the head of the endpoint list
+    static const char *extra_eps[] = {
+        "test-ep0", "test-ep1", "test-ep2", "test-ep3",
+        "test-ep4", "test-ep5", "test-ep6", "test-ep7"
+    };
+    for (int i = 0; i < sizeof(extra_eps)/sizeof(extra_eps[0]); i++) {
+        if (protocomm_add_endpoint(test_pc, extra_eps[i], test_req_handler,
+                                   (void *) &test_priv_data) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to add endpoint %s", extra_eps[i]);
+            stop_test_service();
+            free(session);
+            return ESP_FAIL;
+        }
+    }
+
+    // Duplicate endpoint names must still be rejected
+    if (protocomm_add_endpoint(test_pc, "test-ep3", test_req_handler,
+                               (void *) &test_priv_data) == ESP_OK) {
+        ESP_LOGE(TAG, "Duplicate endpoint was added");
+        stop_test_service();
+        free(session);
+        return ESP_FAIL;
+    }
+
+    if (test_new_session(session) != ESP_OK) {
+        ESP_LOGE(TAG, "Error creating new session");
+        stop_test_service();
+        free(session);
+        return ESP_FAIL;
+    }
+
+    if (test_sec_endpoint(session) != ESP_OK) {
+        ESP_LOGE(TAG, "Error testing security endpoint");
+        stop_test_service();
+        free(session);
+        return ESP_FAIL;
+    }
+
+    // Repeated requests reuse the decryption buffer
+    for (int i = 0; i < 4; i++) {
+        if (test_req_endpoint(session) != ESP_OK) {
+            ESP_LOGE(TAG, "Error testing request endpoint");
+            stop_test_service();
+            free(session);
+            return ESP_FAIL;
+        }
+    }
+
+    // Removed endpoint must no longer be found
+    if (protocomm_remove_endpoint(test_pc, "test-ep5") != ESP_OK ||
+        protocomm_remove_endpoint(test_pc, "test-ep5") != ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "Error removing endpoint");
+        stop_test_service();
+        free(session);
+        return ESP_FAIL;
+    }
+
+    stop_test_service();
+    free(session);
+
+    ESP_LOGI(TAG, "Protocomm test successful");
+    return ESP_OK;
+}
+
 static esp_err_t test_protocomm (session_t *session)
 {
     ESP_LOGI(TAG, "Starting Protocomm test");
@@ -1086,6 +1178,7 @@ TEST_CASE("leak test", "[PROTOCOMM]")
     test_security1_wrong_pop();
     test_security1_insecure_client();
     test_security1_weak_session();
+    test_security1_many_endpoints();
 
     usleep(1000);
 
@@ -1132,3 +1225,8 @@ TEST_CASE("security 1 weak session test", "[PROTOCOMM]")
 {
     TEST_ASSERT(test_security1_weak_session() == ESP_OK);
 }
+
+TEST_CASE("security 1 many endpoints test", "[PROTOCOMM]")
+{
+    TEST_ASSERT(test_security1_many_endpoints() == ESP_OK);
+}
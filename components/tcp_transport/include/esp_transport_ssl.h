@@ -47,6 +47,22 @@ void esp_transport_ssl_set_cert_data(esp_transport_handle_t t, const char *data,
  */
 void esp_transport_ssl_enable_global_ca_store(esp_transport_handle_t t);
 
+/**
+ * @brief      Share parsed certificates and TLS configuration with other connections
+ *             which have the same settings (see use_cert_cache in esp_tls_cfg_t)
+ *
+ * @param      t    ssl transport
+ */
+void esp_transport_ssl_enable_cert_cache(esp_transport_handle_t t);
+
+/**
+ * @brief      Resume TLS session of the previous connection to the same server
+ *             on reconnect (see use_session_cache in esp_tls_cfg_t)
+ *
+ * @param      t    ssl transport
+ */
+void esp_transport_ssl_enable_session_cache(esp_transport_handle_t t);
+
 /**
  * @brief      Set SSL client certificate data for mutual authentication (as PEM format).
  *             Note that, this function stores the pointer to data, rather than making a copy.
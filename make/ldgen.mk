@@ -12,45 +12,61 @@ ifdef OS
 endif
 
 # Target to generate linker script generator from fragments presented by each of
-# the components
+# the components.
+#
+# ldgen only rewrites the linker script when its contents change, so that the app
+# is not re-linked needlessly. The rule running it updates a stamp file instead, and
+# the linker script (its rule has an empty recipe) is checked again by make after
+# that. ldgen-force runs ldgen if the linker script is missing.
 ifeq ($(ON_WINDOWS),y)
 define ldgen_process_template
 $(BUILD_DIR_BASE)/ldgen.section_infos: $(LDGEN_SECTIONS_INFO_FILES) $(IDF_PATH)/make/ldgen.mk
 	printf "$(foreach info,$(LDGEN_SECTIONS_INFO_FILES),$(subst \,/,$(shell cygpath -w $(info)))\n)" > $(BUILD_DIR_BASE)/ldgen.section_infos
 
-$(2): $(1) $(LDGEN_FRAGMENT_FILES) $(SDKCONFIG) $(BUILD_DIR_BASE)/ldgen.section_infos
+$(2).stamp: $(1) $(LDGEN_FRAGMENT_FILES) $(SDKCONFIG) $(BUILD_DIR_BASE)/ldgen.section_infos $(if $(wildcard $(2)),,ldgen-force)
 	@echo 'Generating $(notdir $(2))'
 	$(PYTHON) $(IDF_PATH)/tools/ldgen/ldgen.py \
 		--input         $(1) \
 		--config        $(SDKCONFIG) \
 		--fragments     $(LDGEN_FRAGMENT_FILES) \
 		--output        $(2) \
+		--cache         $(2).cache \
 		--sections      $(BUILD_DIR_BASE)/ldgen.section_infos \
 		--kconfig       $(IDF_PATH)/Kconfig \
 		--env           "COMPONENT_KCONFIGS=$(foreach k, $(COMPONENT_KCONFIGS), $(shell cygpath -w $(k)))" \
 		--env           "COMPONENT_KCONFIGS_PROJBUILD=$(foreach k, $(COMPONENT_KCONFIGS_PROJBUILD), $(shell cygpath -w $(k)))" \
 		--env           "IDF_CMAKE=n"
+	touch $(2).stamp
+
+$(2): $(2).stamp ;
 endef
 else # ON_WINDOWS
 define ldgen_process_template
 $(BUILD_DIR_BASE)/ldgen.section_infos: $(LDGEN_SECTIONS_INFO_FILES) $(IDF_PATH)/make/ldgen.mk
 	printf "$(foreach info,$(LDGEN_SECTIONS_INFO_FILES),$(info)\n)" > $(BUILD_DIR_BASE)/ldgen.section_infos
 
-$(2): $(1) $(LDGEN_FRAGMENT_FILES) $(SDKCONFIG) $(BUILD_DIR_BASE)/ldgen.section_infos 
+$(2).stamp: $(1) $(LDGEN_FRAGMENT_FILES) $(SDKCONFIG) $(BUILD_DIR_BASE)/ldgen.section_infos $(if $(wildcard $(2)),,ldgen-force)
 	@echo 'Generating $(notdir $(2))'
 	$(PYTHON) $(IDF_PATH)/tools/ldgen/ldgen.py \
 		--input         $(1) \
 		--config        $(SDKCONFIG) \
 		--fragments     $(LDGEN_FRAGMENT_FILES) \
 		--output        $(2) \
+		--cache         $(2).cache \
 		--sections      $(BUILD_DIR_BASE)/ldgen.section_infos \
 		--kconfig       $(IDF_PATH)/Kconfig \
 		--env           "COMPONENT_KCONFIGS=$(COMPONENT_KCONFIGS)" \
 		--env           "COMPONENT_KCONFIGS_PROJBUILD=$(COMPONENT_KCONFIGS_PROJBUILD)" \
 		--env           "IDF_CMAKE=n"
+	touch $(2).stamp
+
+$(2): $(2).stamp ;
 endef
 endif # ON_WINDOWS
 
+.PHONY: ldgen-force
+ldgen-force:
+
 define ldgen_create_commands
 $(foreach lib, $(COMPONENT_LIBRARIES), \
 	$(eval $(call ldgen_generate_target_sections_info, $(BUILD_DIR_BASE)/$(lib)/lib$(lib).a)))
@@ -0,0 +1,162 @@
+#!/usr/bin/env python
+#
+# Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Times the CMake configure step of a synthetic project with many components, each with requirements on
+# other components and a Kconfig file. Not run as part of the tests.
+# The toolchain must be in PATH, as for any build.
+#
+# usage: ./benchmark_cmake_configure.py [--components 180] [--repeat 3]
+
+from __future__ import print_function
+
+import argparse
+import os
+import random
+import resource
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+IDF_PATH = os.environ.get("IDF_PATH", os.path.realpath(os.path.join(os.path.dirname(__file__), "..", "..")))
+
+# IDF components the synthetic components require, besides each other
+IDF_REQUIREMENTS = ["log", "freertos", "nvs_flash", "spi_flash", "driver", "esp_event"]
+
+PROJECT_CMAKELISTS = """cmake_minimum_required(VERSION 3.5)
+set(EXTRA_COMPONENT_DIRS "${CMAKE_CURRENT_LIST_DIR}/components")
+include($ENV{IDF_PATH}/tools/cmake/project.cmake)
+project(benchmark)
+"""
+
+COMPONENT_CMAKELISTS = """set(COMPONENT_SRCS "{name}.c")
+set(COMPONENT_ADD_INCLUDE_DIRS ".")
+set(COMPONENT_REQUIRES {requires})
+set(COMPONENT_PRIV_REQUIRES {priv_requires})
+register_component()
+"""
+
+KCONFIG_OPTION = """    config {name}_OPTION_{n}
+        int "Option {n} of {name}"
+        default {n}
+"""
+
+
+def write(path, contents):
+    with open(path, "w") as f:
+        f.write(contents)
+
+
+def append(path, contents):
+    with open(path, "a") as f:
+        f.write(contents)
+
+
+def generate_project(project_dir, components):
+    rand = random.Random(components)
+    write(os.path.join(project_dir, "CMakeLists.txt"), PROJECT_CMAKELISTS)
+
+    os.makedirs(os.path.join(project_dir, "main"))
+    write(os.path.join(project_dir, "main", "CMakeLists.txt"),
+          'set(COMPONENT_SRCS "main.c")\nregister_component()\n')
+    write(os.path.join(project_dir, "main", "main.c"), "void app_main(void) { }\n")
+
+    for n in range(components):
+        name = "comp%03d" % n
+        path = os.path.join(project_dir, "components", name)
+        os.makedirs(path)
+        # Only requirements on components with a lower number, so that the graph has no cycles
+        others = ["comp%03d" % r for r in range(n)]
+        requires = rand.sample(others, min(n, 3)) + rand.sample(IDF_REQUIREMENTS, 1)
+        priv_requires = rand.sample(others, min(n, 2)) + rand.sample(IDF_REQUIREMENTS, 1)
+
+        write(os.path.join(path, "CMakeLists.txt"),
+              COMPONENT_CMAKELISTS.format(name=name, requires=" ".join(requires),
+                                          priv_requires=" ".join(priv_requires)))
+        write(os.path.join(path, name + ".c"), "int %s_function(void) { return %d; }\n" % (name, n))
+        write(os.path.join(path, "Kconfig"),
+              "menu \"%s\"\n%s\nendmenu\n" % (name, "".join(KCONFIG_OPTION.format(name=name.upper(), n=i)
+                                                            for i in range(5))))
+
+
+def timed(args, cwd):
+    """ Run a command, return the elapsed time and the CPU time used by it and its children """
+    start = time.time()
+    start_usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+    with open(os.devnull, "w") as devnull:
+        subprocess.check_call(args, cwd=cwd, stdout=devnull)
+    usage = resource.getrusage(resource.RUSAGE_CHILDREN)
+    cpu = usage.ru_utime + usage.ru_stime - start_usage.ru_utime - start_usage.ru_stime
+    return time.time() - start, cpu
+
+
+def configure(project_dir):
+    build_dir = os.path.join(project_dir, "build")
+    if not os.path.exists(build_dir):
+        os.makedirs(build_dir)
+    return timed(["cmake", "-DPYTHON=" + sys.executable, ".."], build_dir)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="CMake configure time benchmark")
+    parser.add_argument("--components", type=int, default=180)
+    parser.add_argument("--repeat", type=int, default=3, help="Runs of each case, the fastest one is printed")
+    args = parser.parse_args()
+
+    project_dir = tempfile.mkdtemp()
+    try:
+        generate_project(project_dir, args.components)
+        build_dir = os.path.join(project_dir, "build")
+        component = os.path.join(project_dir, "components", "comp%03d" % (args.components // 2))
+
+        def clean(i):
+            shutil.rmtree(build_dir)
+
+        def comment(i):
+            append(os.path.join(component, "CMakeLists.txt"), "# change %d\n" % i)
+
+        def requirement(i):
+            path = os.path.join(component, "CMakeLists.txt")
+            with open(path) as f:
+                contents = f.read()
+            requirement = "list(APPEND COMPONENT_PRIV_REQUIRES %s)\n" % IDF_REQUIREMENTS[i % len(IDF_REQUIREMENTS)]
+            write(path, contents.replace("register_component()", requirement + "register_component()"))
+
+        def config(i):
+            append(os.path.join(project_dir, "sdkconfig"), "CONFIG_COMP000_OPTION_1=%d\n" % (i + 100))
+
+        cases = [("cold", clean), ("nothing changed", None),
+                 ("comment added to one component", comment),
+                 ("requirement added to one component", requirement),
+                 ("sdkconfig changed", config)]
+
+        print("%d components" % args.components)
+        configure(project_dir)  # the cases start from a configured project
+        for name, change in cases:
+            times = []
+            for i in range(args.repeat):
+                if change:
+                    change(i)
+                times.append(configure(project_dir))
+            print("%-40s %.2fs (%.2fs CPU)" % (name + ":", min(t[0] for t in times), min(t[1] for t in times)))
+    finally:
+        shutil.rmtree(project_dir)
+
+
+if __name__ == "__main__":
+    main()
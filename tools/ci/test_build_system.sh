@@ -157,19 +157,22 @@ function run_tests()
     make
     assert_rebuilt ${APP_BINS} ${BOOTLOADER_BINS}
 
-    print_status "Touching app-only template ld file should only re-link app"
+    print_status "Updating app-only template ld file should only re-link app"
     take_build_snapshot
-    touch ${IDF_PATH}/components/esp32/ld/esp32.common.ld.in
+    cp ${IDF_PATH}/components/esp32/ld/esp32.common.ld.in .
+    echo "/* (Build test comment) */" >> ${IDF_PATH}/components/esp32/ld/esp32.common.ld.in
     make
     assert_rebuilt ${APP_BINS}
     assert_not_rebuilt ${BOOTLOADER_BINS}
+    mv esp32.common.ld.in ${IDF_PATH}/components/esp32/ld/
 
-    print_status "Touching a linker fragment file should trigger re-link of app" # only app linker script is generated by tool for now
+    print_status "Touching a linker fragment file should not re-link app, as the generated linker script is the same"
+    make
     take_build_snapshot
     touch ${IDF_PATH}/components/esp32/linker.lf
     make
-    assert_rebuilt ${APP_BINS}
-    assert_not_rebuilt ${BOOTLOADER_BINS}
+    assert_not_rebuilt ${APP_BINS} ${BOOTLOADER_BINS}
+    ( make 2>&1 | grep "Generating esp32.common.ld" ) && failure "Linker script generator should not run again on the next build"
 
     print_status "sdkconfig update triggers full recompile"
     make
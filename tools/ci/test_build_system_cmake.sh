@@ -184,14 +184,14 @@ function run_tests()
     assert_not_rebuilt ${BOOTLOADER_BINS}
     mv esp32.common.ld.in ${IDF_PATH}/components/esp32/ld/
 
-    print_status "Updating fragment file should only re-link app" # only app linker script is generated by tool for now
+    print_status "Updating fragment file without changing placements should not re-link app"
+    idf.py build
     take_build_snapshot
     cp ${IDF_PATH}/components/esp32/ld/esp32_fragments.lf .
     sleep 1  # ninja may ignore if the timestamp delta is too low
     echo "# (Build test comment)" >> ${IDF_PATH}/components/esp32/ld/esp32_fragments.lf
     idf.py build || failure "Failed to rebuild with modified linker fragment file"
-    assert_rebuilt ${APP_BINS}
-    assert_not_rebuilt ${BOOTLOADER_BINS}
+    assert_not_rebuilt ${APP_BINS} ${BOOTLOADER_BINS}
     mv esp32_fragments.lf ${IDF_PATH}/components/esp32/ld/
 
     print_status "sdkconfig update triggers full recompile"
@@ -363,6 +363,26 @@ EOF
     export PATH="$OLDPATH"
     rm ./python
 
+    print_status "Changing component requirements is picked up when cmake runs again"
+    clean_build_dir
+    mkdir -p components/req_test
+    echo "register_component()" > components/req_test/CMakeLists.txt
+    idf.py reconfigure || failure "Failed to configure with a new component"
+    grep -q '__component_requires_req_test ""' build/component_depends.cmake || failure "New component should be found"
+    echo -e "set(COMPONENT_REQUIRES nvs_flash)\nregister_component()" > components/req_test/CMakeLists.txt
+    idf.py reconfigure || failure "Failed to configure with changed requirements"
+    grep -q '__component_requires_req_test "nvs_flash"' build/component_depends.cmake || failure "Changed requirements should be used"
+    rm -rf components/req_test
+    idf.py reconfigure || failure "Failed to configure with a component removed"
+    grep -q 'req_test' build/component_depends.cmake && failure "Removed component should not be in the build"
+
+    print_status "Running cmake again without config changes does not run confgen"
+    idf.py reconfigure
+    take_build_snapshot
+    idf.py reconfigure
+    # confgen.hash is only written after confgen runs
+    assert_not_rebuilt config/confgen.hash config/sdkconfig.h config/sdkconfig.cmake
+
     print_status "All tests completed"
     if [ -n "${FAILURES}" ]; then
         echo "Some failures were detected:"
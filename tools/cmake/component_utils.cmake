@@ -74,3 +74,22 @@ function(components_find_all component_dirs component_paths component_names test
     set(${component_names} ${names} PARENT_SCOPE)
     set(${test_component_names} ${test_names} PARENT_SCOPE)
 endfunction()
+
+# components_files_hash: Set 'variable' to a hash of the CMake files which can affect the
+# requirements of the components in 'component_paths': CMakeLists.txt, test/CMakeLists.txt
+# and any .cmake files in the component directory or one level below it, as a component
+# CMakeLists.txt may include these (for example soc includes ${SOC_NAME}/sources.cmake).
+#
+# Paths which are not components contribute nothing, so a hash of the candidates found by
+# components_find_all() changes when a component is added or removed.
+function(components_files_hash component_paths variable)
+    set(globs "")
+    foreach(path ${component_paths})
+        list(APPEND globs "${path}/CMakeLists.txt" "${path}/test/CMakeLists.txt"
+            "${path}/*.cmake" "${path}/*/*.cmake")
+    endforeach()
+    file(GLOB files ${globs})
+    list(SORT files)
+    files_hash(hash ${files})
+    set(${variable} ${hash} PARENT_SCOPE)
+endfunction()
@@ -71,6 +71,21 @@ if(NOT MCONF)
 
 endif()
 
+# kconfig_inputs_hash: Set 'variable' to a hash of everything confgen.py output depends on, and of the output
+# itself: the confgen command line 'confgen_command', the Kconfig files in the space-separated 'kconfigs',
+# sdkconfig, the defaults files, the tools and the generated files. If the hash is the same as after the previous
+# confgen.py run, running it again would change nothing.
+function(kconfig_inputs_hash variable confgen_command kconfigs)
+    spaces2list(kconfigs)
+    files_hash(hash
+        ${ROOT_KCONFIG} ${kconfigs}
+        ${SDKCONFIG} ${IDF_SDKCONFIG_DEFAULTS} "${IDF_SDKCONFIG_DEFAULTS}.${IDF_TARGET}"
+        ${IDF_PATH}/tools/kconfig_new/confgen.py ${IDF_PATH}/tools/kconfig_new/kconfiglib.py
+        ${SDKCONFIG_HEADER} ${SDKCONFIG_CMAKE} ${SDKCONFIG_JSON} ${KCONFIG_JSON_MENUS})
+    string(MD5 hash "${confgen_command}|${IDF_TARGET}|$ENV{IDF_TARGET}|${hash}")
+    set(${variable} ${hash} PARENT_SCOPE)
+endfunction()
+
 # Find all Kconfig files for all components
 function(kconfig_process_config)
     file(MAKE_DIRECTORY "${CONFIG_DIR}")
@@ -152,27 +167,35 @@ function(kconfig_process_config)
     # Generate configuration output via confgen.py
     # makes sdkconfig.h and skdconfig.cmake
     #
-    # This happens during the cmake run not during the build
+    # This happens during the cmake run not during the build. All outputs come from one confgen.py run, which
+    # is skipped if its inputs and outputs are the same as after the previous run (see kconfig_inputs_hash).
+    set(confgen_outputs
+        --output header ${SDKCONFIG_HEADER}
+        --output cmake ${SDKCONFIG_CMAKE}
+        --output json ${SDKCONFIG_JSON}
+        --output json_menus ${KCONFIG_JSON_MENUS})
     if(NOT BOOTLOADER_BUILD)
+        list(APPEND confgen_outputs --output config ${SDKCONFIG}) # only generate config at the top-level project
+    endif()
+
+    set(confgen_command ${confgen_basecommand} ${confgen_outputs})
+    set(confgen_hash_file "${CONFIG_DIR}/confgen.hash")
+    kconfig_inputs_hash(confgen_hash "${confgen_command}" "${kconfigs} ${kconfigs_projbuild}")
+    if(EXISTS "${confgen_hash_file}")
+        file(READ "${confgen_hash_file}" previous_confgen_hash)
+    endif()
+
+    if(NOT confgen_hash STREQUAL previous_confgen_hash)
         execute_process(
-            COMMAND ${confgen_basecommand}
-            --output header ${SDKCONFIG_HEADER}
-            --output cmake ${SDKCONFIG_CMAKE}
-            --output json ${SDKCONFIG_JSON}
-            --output json_menus ${KCONFIG_JSON_MENUS}
-            --output config ${SDKCONFIG} # only generate config at the top-level project
-            RESULT_VARIABLE config_result)
-    else()
-        execute_process(
-            COMMAND ${confgen_basecommand}
-            --output header ${SDKCONFIG_HEADER}
-            --output cmake ${SDKCONFIG_CMAKE}
-            --output json ${SDKCONFIG_JSON}
-            --output json_menus ${KCONFIG_JSON_MENUS}
+            COMMAND ${confgen_command}
             RESULT_VARIABLE config_result)
-    endif()
-    if(config_result)
-        message(FATAL_ERROR "Failed to run confgen.py (${confgen_basecommand}). Error ${config_result}")
+        if(config_result)
+            file(REMOVE "${confgen_hash_file}")
+            message(FATAL_ERROR "Failed to run confgen.py (${confgen_basecommand}). Error ${config_result}")
+        endif()
+        # sdkconfig and the outputs have changed now
+        kconfig_inputs_hash(confgen_hash "${confgen_command}" "${kconfigs} ${kconfigs_projbuild}")
+        file(WRITE "${confgen_hash_file}" "${confgen_hash}")
     endif()
 
     # When sdkconfig file changes in the future, trigger a cmake run
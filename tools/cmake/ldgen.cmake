@@ -58,6 +58,7 @@ function(ldgen_process_template template output)
         --fragments "$<JOIN:$<TARGET_PROPERTY:ldgen,FRAGMENT_FILES>,\t>"
         --input     ${template}
         --output    ${output}
+        --cache     ${output}.cache
         --sections  ${CMAKE_BINARY_DIR}/ldgen.section_infos
         --kconfig   ${IDF_PATH}/Kconfig
         --env       "COMPONENT_KCONFIGS=${COMPONENT_KCONFIGS}"
@@ -10,6 +10,8 @@
 #   components.
 # - COMPONENT_DIRS = List of paths to search for all components.
 # - DEBUG = Set -DDEBUG=1 to debug component lists in the build.
+# - INPUTS_HASH = Hash of the parameters and of the component CMake files, written to DEPENDENCIES_FILE as
+#   COMPONENT_DEPENDS_INPUTS_HASH. The caller can skip running this script when the hash is unchanged.
 #
 # If successful, DEPENDENCIES_FILE can be expanded to set BUILD_COMPONENTS & BUILD_COMPONENT_PATHS with all
 # components required for the build, and the get_component_requirements() function to return each component's
@@ -86,11 +88,11 @@ endfunction()
 # also invoking the components to call register_component() above,
 # which will add per-component global properties with dependencies, etc.
 function(expand_component_requirements component)
-    get_property(seen_components GLOBAL PROPERTY SEEN_COMPONENTS)
-    if(component IN_LIST seen_components)
+    get_property(seen GLOBAL PROPERTY "${component}_SEEN")
+    if(seen)
         return()  # already added, or in process of adding, this component
     endif()
-    set_property(GLOBAL APPEND PROPERTY SEEN_COMPONENTS ${component})
+    set_property(GLOBAL PROPERTY "${component}_SEEN" 1)
 
     find_component_path("${component}" "${ALL_COMPONENTS}" "${ALL_COMPONENT_PATHS}" component_path)
     debug("Expanding dependencies of ${component} @ ${component_path}")
@@ -202,7 +204,6 @@ debug("ALL_COMPONENT_PATHS ${ALL_COMPONENT_PATHS}")
 debug("ALL_COMPONENTS ${ALL_COMPONENTS}")
 debug("ALL_TEST_COMPONENTS ${ALL_TEST_COMPONENTS}")
 
-set_property(GLOBAL PROPERTY SEEN_COMPONENTS "")  # anti-infinite-recursion
 set_property(GLOBAL PROPERTY BUILD_COMPONENTS "")
 set_property(GLOBAL PROPERTY BUILD_COMPONENT_PATHS "")
 set_property(GLOBAL PROPERTY BUILD_TEST_COMPONENTS "")
@@ -232,13 +233,28 @@ function(line contents)
     file(APPEND "${DEPENDENCIES_FILE}.tmp" "${contents}\n")
 endfunction()
 
+# A component which wasn't found prints a warning every time, so don't let the caller skip the next run
+if(not_found)
+    set(INPUTS_HASH "")
+endif()
+
 file(WRITE "${DEPENDENCIES_FILE}.tmp" "# Component requirements generated by expand_requirements.cmake\n\n")
+line("set(COMPONENT_DEPENDS_INPUTS_HASH \"${INPUTS_HASH}\")")
+line("")
 line("set(BUILD_COMPONENTS ${build_components})")
 line("set(BUILD_COMPONENT_PATHS ${build_component_paths})")
 line("set(BUILD_TEST_COMPONENTS ${build_test_components})")
 line("set(BUILD_TEST_COMPONENT_PATHS ${build_test_component_paths})")
 line("")
 
+foreach(build_component ${build_components})
+    get_property(reqs GLOBAL PROPERTY "${build_component}_REQUIRES")
+    get_property(private_reqs GLOBAL PROPERTY "${build_component}_PRIV_REQUIRES")
+    line("set_property(GLOBAL PROPERTY __component_requires_${build_component} \"${reqs}\")")
+    line("set_property(GLOBAL PROPERTY __component_priv_requires_${build_component} \"${private_reqs}\")")
+endforeach()
+line("")
+
 line("# get_component_requirements: Generated function to read the dependencies of a given component.")
 line("#")
 line("# Parameters:")
@@ -251,17 +267,14 @@ line("#")
 line("# Throws a fatal error if 'componeont' is not found (indicates a build system problem).")
 line("#")
 line("function(get_component_requirements component var_requires var_private_requires)")
-foreach(build_component ${build_components})
-    get_property(reqs GLOBAL PROPERTY "${build_component}_REQUIRES")
-    get_property(private_reqs GLOBAL PROPERTY "${build_component}_PRIV_REQUIRES")
-    line("  if(\"\$\{component}\" STREQUAL \"${build_component}\")")
-    line("    set(\${var_requires} \"${reqs}\" PARENT_SCOPE)")
-    line("    set(\${var_private_requires} \"${private_reqs}\" PARENT_SCOPE)")
-    line("    return()")
-    line("  endif()")
-endforeach()
-
-line("  message(FATAL_ERROR \"Component not found: \${component}\")")
+line("  get_property(found GLOBAL PROPERTY \"__component_requires_\$\{component}\" SET)")
+line("  if(NOT found)")
+line("    message(FATAL_ERROR \"Component not found: \$\{component}\")")
+line("  endif()")
+line("  get_property(reqs GLOBAL PROPERTY \"__component_requires_\$\{component}\")")
+line("  get_property(private_reqs GLOBAL PROPERTY \"__component_priv_requires_\$\{component}\")")
+line("  set(\$\{var_requires} \"\$\{reqs}\" PARENT_SCOPE)")
+line("  set(\$\{var_private_requires} \"\$\{private_reqs}\" PARENT_SCOPE)")
 line("endfunction()")
 
 # only replace DEPENDENCIES_FILE if it has changed (prevents ninja/make build loops.)
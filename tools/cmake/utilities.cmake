@@ -187,3 +187,24 @@ function(fail_at_build_time target_name message_line0)
         COMMAND ${CMAKE_COMMAND} -P ${IDF_PATH}/tools/cmake/scripts/fail.cmake
         VERBATIM)
 endfunction()
+
+# files_hash
+#
+# Set 'variable' to a hash of the paths and contents of the files passed after it. A file which
+# doesn't exist is hashed by its path only, so creating or removing it changes the hash.
+#
+# Used to find out if the inputs of a configure step changed since the step last ran.
+#
+function(files_hash variable)
+    set(hashes "")
+    foreach(file ${ARGN})
+        if(EXISTS "${file}")
+            file(MD5 "${file}" hash)
+        else()
+            set(hash "missing")
+        endif()
+        list(APPEND hashes "${file}=${hash}")
+    endforeach()
+    string(MD5 hash "${hashes}")
+    set(${variable} ${hash} PARENT_SCOPE)
+endfunction()
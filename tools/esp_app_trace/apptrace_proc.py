@@ -7,6 +7,36 @@ import struct
 import sys
 
 
+def read_blocks(files, block_len):
+    """
+    Reads trace blocks from all files and sorts them by timestamp.
+    When tracing module records data to per-CPU buffers blocks written on different CPUs are
+    not ordered in trace stream. Timestamps are 32-bit, so they are unwrapped before sorting.
+    """
+    blocks = []
+    for f in files:
+        try:
+            ftrc = open(f, 'rb')
+        except IOError as e:
+            print("Failed to open trace file (%s)!" % e)
+            sys.exit(2)
+        with ftrc:
+            last_ts = None
+            wraps = 0
+            while True:
+                trc_buf = ftrc.read(block_len)
+                if len(trc_buf) < 8:
+                    break
+                ts = struct.unpack_from('<L', trc_buf, 4)[0]
+                if last_ts is not None and last_ts - ts > 0x80000000:
+                    wraps += 1
+                last_ts = ts
+                blocks.append(((wraps << 32) | ts, trc_buf))
+    # sort is stable, so blocks with the same timestamp keep their order
+    blocks.sort(key=lambda b: b[0])
+    return [b[1] for b in blocks]
+
+
 class bcolors:
     HEADER = '\033[95m'
     OKBLUE = '\033[94m'
@@ -26,7 +56,7 @@ def main():
 
     parser = argparse.ArgumentParser(description='ESP32 App Trace Parse Tool')
 
-    parser.add_argument('file', help='Path to app trace file', type=str)
+    parser.add_argument('file', help='Path to app trace file, data from several files are merged by timestamps', type=str, nargs='+')
     parser.add_argument('--print-tasks', '-p', help='Print tasks', action='store_true')
     parser.add_argument('--print-details', '-d', help='Print detailed stats', action='store_true')
     parser.add_argument('--no-errors', '-n', help='Do not print errors', action='store_true')
@@ -35,25 +65,16 @@ def main():
     args = parser.parse_args()
 
     print("====================================================================")
-    try:
-        ftrc = open(args.file, 'rb')
-    except IOError as e:
-        print("Failed to open trace file (%s)!" % e)
-        sys.exit(2)
+    blocks = read_blocks(args.file, args.block_len)
 
     passed = True
     off = 0
     data_stats = {}
     last_ts = None
     tot_discont = 0
-    while True:
-        # ftrc.seek(off)
+    for trc_buf in blocks:
         task = None
         ts = 0
-        trc_buf = ftrc.read(args.block_len)
-        if len(trc_buf) == 0:
-            # print('EOF')
-            break
         trc_data = struct.unpack('<LL%sB' % (len(trc_buf) - ESP32_TRACE_BLOCK_HDR_SZ), trc_buf)
         if len(trc_data):
             # print("%x %x, len %d" % (trc_data[0], trc_data[1], len(trc_data) - 2))
@@ -102,14 +123,12 @@ def main():
 #                 break
         if len(trc_buf) < args.block_len:
             print('Last block (not full)')
-            break
 
         if data_stats[task]['stamp'] is not None:
             data_stats[task]['stamp'] = (data_stats[task]['stamp'] + 1) & 0xFF
 #             print("stamp=%x" % data_stats[task][ESP32_TRACE_STAMP_IDX])
-        off += args.block_len
+        off += len(trc_buf)
 
-    ftrc.close()
     print("====================================================================")
     print("Trace size %d bytes, discont %d\n" % (off, tot_discont))
     for t in data_stats:
@@ -78,7 +78,7 @@ def logtrace_parse(fname):
 
 
 def logtrace_get_str_from_elf(felf, str_addr):
-    tgt_str = ""
+    tgt_str = b""
     for sect in elfiter.sections(felf):
         hdr = elfutil.section_hdr(felf, sect)
         if hdr.sh_addr == 0 or hdr.sh_type != elfconst.SHT_PROGBITS:
@@ -89,11 +89,11 @@ def logtrace_get_str_from_elf(felf, str_addr):
         sec_data = elfiter.getOnlyData(sect).contents
         buf = ctypes.cast(sec_data.d_buf, ctypes.POINTER(ctypes.c_char))
         for i in range(str_addr - hdr.sh_addr, hdr.sh_size):
-            if buf[i] == "\0":
+            if buf[i] == b"\0":
                 break
             tgt_str += buf[i]
         if len(tgt_str) > 0:
-            return tgt_str
+            return tgt_str.decode('utf-8', 'replace')
     return None
 
 
@@ -105,6 +105,10 @@ def logtrace_formated_print(recs, elfname, no_err):
 
     for lrec in recs:
         fmt_str = logtrace_get_str_from_elf(felf, lrec.fmt_addr)
+        if fmt_str is None:
+            if not no_err:
+                print("Format string not found at 0x%x!" % lrec.fmt_addr)
+            continue
         i = 0
         prcnt_idx = 0
         while i < len(lrec.args):
@@ -0,0 +1,83 @@
+#!/usr/bin/env python
+#
+# Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Generates trace streams in the same format as OpenOCD writes them to files
+# when app_trace unit test (components/app_trace/test) and esp_apptrace_vprintf() are used.
+
+import struct
+
+BLOCK_LEN = 64
+
+# Addresses of strings in components/espcoredump/test/test.elf
+FMT_HEAP_SUMMARY = 0x3f4029b0   # "Heap summary for capabilities 0x%08X:\n"
+FMT_HEAP_BLOCK = 0x3f4029d8     # "  At 0x%08x len %d free %d allocated %d min_free %d\n"
+FMT_SEND_SIGNAL = 0x3f404c64    # "Send signal: [%s]!\n"
+STR_IDLE = 0x3f4021e8           # "IDLE%d"
+
+
+def apptrace_block(task, ts, stamp):
+    return struct.pack('<LL', task, ts) + bytearray([stamp & 0xFF] * (BLOCK_LEN - 8))
+
+
+def task_blocks(task, ts, ts_step, count):
+    """ Blocks written by one task, every block is filled with its own stamp """
+    blocks = []
+    for i in range(count):
+        blocks.append(apptrace_block(task, ts & 0xFFFFFFFF, i))
+        ts += ts_step
+    return blocks
+
+
+def write_file(name, blocks):
+    with open(name, 'wb') as f:
+        for b in blocks:
+            f.write(b)
+
+
+def logtrace_record(fmt_addr, *args):
+    return struct.pack('<BL%dL' % len(args), len(args), fmt_addr, *args)
+
+
+def main():
+    # two tasks running on different CPUs, each CPU buffer is saved to its own file,
+    # timestamps of the second one wrap around
+    cpu0 = task_blocks(0x3ffb1000, 0x1000, 10, 16)
+    cpu1 = task_blocks(0x3ffb2000, 0xffffffd0, 10, 16)
+    write_file('cpu0.trc', cpu0)
+    write_file('cpu1.trc', cpu1)
+
+    # the same data in a single stream
+    stream = [b for pair in zip(cpu0, cpu1) for b in pair]
+    write_file('stream.trc', stream)
+
+    # one byte is corrupted, timestamp of one block is repeated and the last block is not full
+    bad = list(stream)
+    bad[5] = bad[5][:20] + b'\x55' + bad[5][21:]
+    bad[8] = bad[8][:4] + bad[6][4:8] + bad[8][8:]
+    bad[-1] = bad[-1][:BLOCK_LEN // 2]
+    write_file('bad.trc', bad)
+
+    recs = [logtrace_record(FMT_HEAP_SUMMARY, 0x1800),
+            logtrace_record(FMT_HEAP_BLOCK, 0x3ffae6e0, 6432, 0, 6432, 0),
+            logtrace_record(FMT_HEAP_BLOCK, 0x3ffb3d40, 180928, 174260, 6668, 174260),
+            logtrace_record(FMT_SEND_SIGNAL, STR_IDLE),
+            # unknown format string address
+            logtrace_record(0x3f000000, 1)]
+    write_file('log.trc', recs)
+
+
+if __name__ == '__main__':
+    main()
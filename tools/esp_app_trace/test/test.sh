@@ -0,0 +1,10 @@
+#! /bin/bash
+
+{ python gen_traces.py \
+    && python $IDF_PATH/tools/esp_app_trace/apptrace_proc.py -b 64 stream.trc &> output \
+    && python $IDF_PATH/tools/esp_app_trace/apptrace_proc.py -b 64 -p cpu0.trc cpu1.trc &>> output \
+    && python $IDF_PATH/tools/esp_app_trace/apptrace_proc.py -b 64 -d bad.trc &>> output \
+    && python $IDF_PATH/tools/esp_app_trace/logtrace_proc.py log.trc $IDF_PATH/components/espcoredump/test/test.elf &>> output \
+    && rm -f *.trc \
+    && diff output expected_output \
+; } || { echo 'The test for app trace processing tools has failed. Please examine the artifacts.' ; exit 1; }
@@ -23,6 +23,9 @@
 from __future__ import print_function
 from __future__ import unicode_literals
 import argparse
+import hashlib
+import json
+import multiprocessing
 import re
 import os.path
 
@@ -37,6 +40,20 @@ CHIP_SIZES = {
     }
 }
 
+# Parsed MAP file data is cached in a file with this suffix, next to the MAP file.
+# Increment the version whenever the structure returned by load_map_data() changes.
+CACHE_SUFFIX = ".idf_size_cache"
+CACHE_VERSION = 1
+
+# Smaller MAP files are parsed in a single process, as starting more would take longer than parsing
+PARALLEL_MIN_LINES = 100000
+
+RE_MEMORY_SECTION = re.compile(r"(?P<name>[^ ]+) +0x(?P<origin>[\da-f]+) +0x(?P<length>[\da-f]+)")
+RE_SECTION_HEADER = re.compile(r"(?P<name>[^ ]+) +0x(?P<address>[\da-f]+) +0x(?P<size>[\da-f]+)$")
+RE_SOURCE_LINE = re.compile(r"\s*(?P<sym_name>\S*).* +0x(?P<address>[\da-f]+) +0x(?P<size>[\da-f]+) (?P<archive>.+\.a)\((?P<object_file>.+\.ob?j?)\)", re.M)
+RE_SOURCE_LINE_NO_ARCHIVE = re.compile(r"\s*(?P<sym_name>\S*).* +0x(?P<address>[\da-f]+) +0x(?P<size>[\da-f]+) (?P<object_file>.+\.ob?j?)")
+RE_SYMBOL_ONLY_LINE = re.compile(r"^ (?P<sym_name>\S*)$")
+
 
 def scan_to_header(f, header_line):
     """ Scan forward in a file until you reach 'header_line', then return """
@@ -46,9 +63,42 @@ def scan_to_header(f, header_line):
     raise RuntimeError("Didn't find line '%s' in file" % header_line)
 
 
-def load_map_data(map_file):
+def load_map_data(map_file, jobs=1):
     memory_config = load_memory_config(map_file)
-    sections  = load_sections(map_file)
+    sections  = load_sections(map_file, jobs)
+    return memory_config, sections
+
+
+def load_map_data_cached(map_path, jobs=1):
+    """ Same as load_map_data(), but reuses the result of a previous run on the same MAP file.
+
+    The parsed data is stored next to the MAP file, keyed by a hash of the MAP file contents.
+    Failure to read or write the cache is not an error, the MAP file is just parsed again.
+    """
+    with open(map_path, "rb") as f:
+        map_hash = hashlib.sha1(f.read()).hexdigest()
+    cache_path = map_path + CACHE_SUFFIX
+    try:
+        with open(cache_path, "r") as f:
+            cache = json.load(f)
+        if cache["version"] == CACHE_VERSION and cache["map_hash"] == map_hash:
+            return cache["memory_config"], cache["sections"]
+    except (IOError, OSError, ValueError, KeyError, TypeError):
+        pass
+
+    with open(map_path, "r") as map_file:
+        memory_config, sections = load_map_data(map_file, jobs)
+    cache = {
+        "version": CACHE_VERSION,
+        "map_hash": map_hash,
+        "memory_config": memory_config,
+        "sections": sections,
+    }
+    try:
+        with open(cache_path, "w") as f:
+            json.dump(cache, f)
+    except (IOError, OSError):
+        pass
     return memory_config, sections
 
 
@@ -56,9 +106,8 @@ def load_memory_config(map_file):
     """ Memory Configuration section is the total size of each output section """
     result = {}
     scan_to_header(map_file, "Memory Configuration")
-    RE_MEMORY_SECTION = r"(?P<name>[^ ]+) +0x(?P<origin>[\da-f]+) +0x(?P<length>[\da-f]+)"
     for line in map_file:
-        m = re.match(RE_MEMORY_SECTION, line)
+        m = RE_MEMORY_SECTION.match(line)
         if m is None:
             if len(result) == 0:
                 continue  # whitespace or a header, before the content we want
@@ -74,21 +123,91 @@ def load_memory_config(map_file):
     raise RuntimeError("End of file while scanning memory configuration?")
 
 
-def load_sections(map_file):
+def load_sections(map_file, jobs=1):
     """ Load section size information from the MAP file.
 
     Returns a dict of 'sections', where each key is a section name and the value
     is a dict with details about this section, including a "sources" key which holds a list of source file line
     information for each symbol linked into the section.
+
+    Large MAP files are split into chunks which are parsed by up to 'jobs' processes.
     """
     scan_to_header(map_file, "Linker script and memory map")
+    chunks = [map_file]
+    if jobs > 1:
+        lines = list(map_file)
+        if len(lines) >= PARALLEL_MIN_LINES:
+            chunks = split_section_lines(lines, jobs)
+        else:
+            chunks = [lines]
+
+    if len(chunks) > 1:
+        pool = multiprocessing.Pool(min(jobs, len(chunks)))
+        try:
+            results = pool.map(parse_section_chunk, enumerate(chunks))
+        finally:
+            pool.close()
+            pool.join()
+    else:
+        results = [parse_section_lines(chunks[0], first_chunk=True)]
+
+    # Join the chunks in order. A chunk carries on with the last section and symbol name of the previous one.
     sections = {}
     section = None
     sym_backup = None
-    for line in map_file:
+    for chunk_sections, head_sources, unnamed_sources, chunk_sym_backup in results:
+        for source in unnamed_sources:
+            source["sym_name"] = sym_backup
+        if section is not None:
+            section["sources"] += head_sources
+        for section in chunk_sections:
+            sections[section["name"]] = section
+        if chunk_sym_backup is not None:
+            sym_backup = chunk_sym_backup[0]
+    return sections
+
+
+def split_section_lines(lines, count):
+    """ Split the lines of the memory map into 'count' chunks of similar size.
+
+    Chunks may begin in the middle of an output section, but never before the first output section header,
+    so that parse_section_lines() can assume a section is always open in chunks other than the first.
+    """
+    first_header = 0
+    for first_header, line in enumerate(lines):
+        if line[:1] != " " and RE_SECTION_HEADER.match(line):
+            break
+    bounds = [0]
+    for i in range(1, count):
+        bounds.append(max(len(lines) * i // count, first_header + 1, bounds[-1]))
+    bounds.append(len(lines))
+    return [lines[bounds[i]:bounds[i + 1]] for i in range(count) if bounds[i] < bounds[i + 1]]
+
+
+def parse_section_chunk(args):
+    """ multiprocessing.Pool.map() helper, takes a tuple (chunk index, lines) """
+    index, lines = args
+    return parse_section_lines(lines, first_chunk=(index == 0))
+
+
+def parse_section_lines(lines, first_chunk=False):
+    """ Parse a chunk of the memory map part of the MAP file.
+
+    Returns a tuple (sections, head_sources, unnamed_sources, sym_backup):
+    - sections: list of the output sections starting in this chunk, in order of appearance.
+    - head_sources: sources found before the first section header, which belong to the section open at the end of
+      the previous chunk. Always empty for the first chunk.
+    - unnamed_sources: sources which take their symbol name from a line in a previous chunk.
+    - sym_backup: None if no symbol-only line was found, otherwise a 1-tuple with the last symbol name found.
+    """
+    sections = []
+    head_sources = []
+    unnamed_sources = []
+    section = None if first_chunk else {"sources": head_sources}
+    sym_backup = None
+    for line in lines:
         # output section header, ie '.iram0.text     0x0000000040080400    0x129a5'
-        RE_SECTION_HEADER = r"(?P<name>[^ ]+) +0x(?P<address>[\da-f]+) +0x(?P<size>[\da-f]+)$"
-        m = re.match(RE_SECTION_HEADER, line)
+        m = RE_SECTION_HEADER.match(line) if line[:1] != " " else None
         if m is not None:  # start of a new section
             section = {
                 "name": m.group("name"),
@@ -96,20 +215,21 @@ def load_sections(map_file):
                 "size": int(m.group("size"), 16),
                 "sources": [],
             }
-            sections[section["name"]] = section
+            sections.append(section)
             continue
 
         # source file line, ie
         # 0x0000000040080400       0xa4 /home/gus/esp/32/idf/examples/get-started/hello_world/build/esp32/libesp32.a(cpu_start.o)
-        RE_SOURCE_LINE = r"\s*(?P<sym_name>\S*).* +0x(?P<address>[\da-f]+) +0x(?P<size>[\da-f]+) (?P<archive>.+\.a)\((?P<object_file>.+\.ob?j?)\)"
-
-        m = re.match(RE_SOURCE_LINE, line, re.M)
-        if not m:
-            # cmake build system links some object files directly, not part of any archive
-            RE_SOURCE_LINE = r"\s*(?P<sym_name>\S*).* +0x(?P<address>[\da-f]+) +0x(?P<size>[\da-f]+) (?P<object_file>.+\.ob?j?)"
-            m = re.match(RE_SOURCE_LINE, line)
+        # Only run the expressions on lines which have everything they need: address, size and object file
+        m = None
+        if ".o" in line and line.count("0x") >= 2:
+            if ".a(" in line:
+                m = RE_SOURCE_LINE.match(line)
+            if not m:
+                # cmake build system links some object files directly, not part of any archive
+                m = RE_SOURCE_LINE_NO_ARCHIVE.match(line)
         if section is not None and m is not None:  # input source file details=ma,e
-            sym_name = m.group("sym_name") if len(m.group("sym_name")) > 0 else sym_backup
+            sym_name = m.group("sym_name") if len(m.group("sym_name")) > 0 else None
             try:
                 archive = m.group("archive")
             except IndexError:
@@ -122,16 +242,20 @@ def load_sections(map_file):
                 "object_file": os.path.basename(m.group("object_file")),
                 "sym_name": sym_name,
             }
+            if sym_name is None:
+                if sym_backup is not None:
+                    source["sym_name"] = sym_backup[0]
+                elif not first_chunk:
+                    unnamed_sources.append(source)
             source["file"] = "%s:%s" % (source["archive"], source["object_file"])
-            section["sources"] += [source]
+            section["sources"].append(source)
 
         # In some cases the section name appears on the previous line, back it up in here
-        RE_SYMBOL_ONLY_LINE = r"^ (?P<sym_name>\S*)$"
-        m = re.match(RE_SYMBOL_ONLY_LINE, line)
+        m = RE_SYMBOL_ONLY_LINE.match(line)
         if section is not None and m is not None:
-            sym_backup = m.group("sym_name")
+            sym_backup = (m.group("sym_name"),)
 
-    return sections
+    return sections, head_sources, unnamed_sources, sym_backup
 
 
 def sizes_by_key(sections, key):
@@ -152,6 +276,14 @@ def sizes_by_key(sections, key):
     return result
 
 
+def load_map_file(map_file, args):
+    """ Load a MAP file opened by argparse, using the cache unless it's disabled or the file is a pipe """
+    if args.no_cache or not os.path.isfile(map_file.name):
+        return load_map_data(map_file, args.jobs)
+    map_file.close()
+    return load_map_data_cached(map_file.name, args.jobs)
+
+
 def main():
     parser = argparse.ArgumentParser("idf_size - a tool to print IDF elf file sizes")
 
@@ -173,9 +305,37 @@ def main():
     parser.add_argument(
         '--files', help='Print per-file sizes', action='store_true')
 
+    parser.add_argument(
+        '--diff', help='Print the differences to another MAP file instead of the sizes of this one',
+        metavar='REFERENCE_MAP_FILE', type=argparse.FileType('r'))
+
+    parser.add_argument(
+        '--jobs', '-j', help='Number of processes used to parse large MAP files (default: number of CPUs)',
+        type=int, default=multiprocessing.cpu_count())
+
+    parser.add_argument(
+        '--no-cache', help='Do not use or update the "%s" file stored next to the MAP file' % CACHE_SUFFIX,
+        action='store_true')
+
     args = parser.parse_args()
 
-    memory_config, sections = load_map_data(args.map_file)
+    memory_config, sections = load_map_file(args.map_file, args)
+
+    if args.diff:
+        ref_memory_config, ref_sections = load_map_file(args.diff, args)
+        print_summary_diff(memory_config, sections, ref_memory_config, ref_sections)
+
+        if args.archives:
+            print("Per-archive contributions to ELF file, differences:")
+            print_detailed_sizes_diff(sections, ref_sections, "archive", "Archive File")
+        if args.files:
+            print("Per-file contributions to ELF file, differences:")
+            print_detailed_sizes_diff(sections, ref_sections, "file", "Object File")
+        if args.archive_details:
+            print("Symbols within the archive:", args.archive_details, "(Not all symbols may be reported), differences:")
+            print_archive_symbols_diff(sections, ref_sections, args.archive_details)
+        return
+
     print_summary(memory_config, sections)
 
     if args.archives:
@@ -189,7 +349,7 @@ def main():
         print_archive_symbols(sections, args.archive_details)
 
 
-def print_summary(memory_config, sections):
+def get_summary(memory_config, sections):
     def get_size(section):
         try:
             return sections[section]["size"]
@@ -197,41 +357,67 @@ def print_summary(memory_config, sections):
             return 0
 
     # if linker script changes, these need to change
-    total_iram = memory_config["iram0_0_seg"]["length"]
-    total_dram = memory_config["dram0_0_seg"]["length"]
     used_data = get_size(".dram0.data")
     used_bss = get_size(".dram0.bss")
-    used_dram = used_data + used_bss
     used_iram = sum(get_size(s) for s in sections if s.startswith(".iram0"))
     flash_code = get_size(".flash.text")
     flash_rodata = get_size(".flash.rodata")
-    total_size = used_data + used_iram + flash_code + flash_rodata
+    return {
+        "total_iram": memory_config["iram0_0_seg"]["length"],
+        "total_dram": memory_config["dram0_0_seg"]["length"],
+        "used_data": used_data,
+        "used_bss": used_bss,
+        "used_dram": used_data + used_bss,
+        "used_iram": used_iram,
+        "flash_code": flash_code,
+        "flash_rodata": flash_rodata,
+        "total_size": used_data + used_iram + flash_code + flash_rodata,
+    }
+
+
+def print_summary(memory_config, sections):
+    summary = get_summary(memory_config, sections)
+    total_iram = summary["total_iram"]
+    total_dram = summary["total_dram"]
+    used_dram = summary["used_dram"]
+    used_iram = summary["used_iram"]
 
     print("Total sizes:")
-    print(" DRAM .data size: %7d bytes" % used_data)
-    print(" DRAM .bss  size: %7d bytes" % used_bss)
+    print(" DRAM .data size: %7d bytes" % summary["used_data"])
+    print(" DRAM .bss  size: %7d bytes" % summary["used_bss"])
     print("Used static DRAM: %7d bytes (%7d available, %.1f%% used)" %
           (used_dram, total_dram - used_dram,
            100.0 * used_dram / total_dram))
     print("Used static IRAM: %7d bytes (%7d available, %.1f%% used)" %
           (used_iram, total_iram - used_iram,
            100.0 * used_iram / total_iram))
-    print("      Flash code: %7d bytes" % flash_code)
-    print("    Flash rodata: %7d bytes" % flash_rodata)
-    print("Total image size:~%7d bytes (.bin may be padded larger)" % (total_size))
+    print("      Flash code: %7d bytes" % summary["flash_code"])
+    print("    Flash rodata: %7d bytes" % summary["flash_rodata"])
+    print("Total image size:~%7d bytes (.bin may be padded larger)" % summary["total_size"])
 
 
-def print_detailed_sizes(sections, key, header):
+def print_summary_diff(memory_config, sections, ref_memory_config, ref_sections):
+    summary = get_summary(memory_config, sections)
+    ref_summary = get_summary(ref_memory_config, ref_sections)
+
+    print("Total sizes:       %10s %10s %10s" % ("Current", "Reference", "Difference"))
+    for title, key in ((" DRAM .data size:", "used_data"),
+                       (" DRAM .bss  size:", "used_bss"),
+                       ("Used static DRAM:", "used_dram"),
+                       ("Used static IRAM:", "used_iram"),
+                       ("      Flash code:", "flash_code"),
+                       ("    Flash rodata:", "flash_rodata"),
+                       ("Total image size:", "total_size")):
+        print("%s %10d %10d %+10d" % (title, summary[key], ref_summary[key], summary[key] - ref_summary[key]))
+
+
+DETAILED_SIZES_HEADINGS = ("DRAM .data", "& .bss", "IRAM", "Flash code", "& rodata", "Total")
+DETAILED_SIZES_KEYS = ("data", "bss", "iram", "flash_text", "flash_rodata", "total")
+
+
+def get_detailed_sizes(sections, key):
     sizes = sizes_by_key(sections, key)
 
-    headings = (header,
-                "DRAM .data",
-                "& .bss",
-                "IRAM",
-                "Flash code",
-                "& rodata",
-                "Total")
-    print("%24s %10s %6s %6s %10s %8s %7s" % headings)
     result = {}
     for k in sizes:
         v = sizes[k]
@@ -242,6 +428,13 @@ def print_detailed_sizes(sections, key, header):
         result[k]["flash_text"] = v.get(".flash.text", 0)
         result[k]["flash_rodata"] = v.get(".flash.rodata", 0)
         result[k]["total"] = sum(result[k].values())
+    return result
+
+
+def print_detailed_sizes(sections, key, header):
+    result = get_detailed_sizes(sections, key)
+
+    print("%24s %10s %6s %6s %10s %8s %7s" % ((header,) + DETAILED_SIZES_HEADINGS))
 
     def return_total_size(elem):
         val = elem[1]
@@ -254,30 +447,54 @@ def print_detailed_sizes(sections, key, header):
     for k,v in sorted(s, key=return_total_size, reverse=True):
         if ":" in k:  # print subheadings for key of format archive:file
             sh,k = k.split(":")
-        print("%24s %10d %6d %6d %10d %8d %7d" % (k[:24],
-                                                  v["data"],
-                                                  v["bss"],
-                                                  v["iram"],
-                                                  v["flash_text"],
-                                                  v["flash_rodata"],
-                                                  v["total"]))
+        print("%24s %10d %6d %6d %10d %8d %7d" % ((k[:24],) + tuple(v[f] for f in DETAILED_SIZES_KEYS)))
 
 
-def print_archive_symbols(sections, archive):
-    interested_sections = [".dram0.data", ".dram0.bss", ".iram0.text", ".iram0.vectors", ".flash.text", ".flash.rodata"]
+def print_detailed_sizes_diff(sections, ref_sections, key, header):
+    """ Like print_detailed_sizes(), but prints only the entries which differ, with the size differences """
+    result = get_detailed_sizes(sections, key)
+    ref_result = get_detailed_sizes(ref_sections, key)
+
+    print("%24s %10s %6s %6s %10s %8s %7s" % ((header,) + DETAILED_SIZES_HEADINGS))
+
+    no_sizes = dict((f, 0) for f in DETAILED_SIZES_KEYS)
+    diff = {}
+    for k in set(result) | set(ref_result):
+        v = result.get(k, no_sizes)
+        ref_v = ref_result.get(k, no_sizes)
+        d = tuple(v[f] - ref_v[f] for f in DETAILED_SIZES_KEYS)
+        if any(d):
+            diff[k] = d
+
+    # largest changes first, either way; then by name for consistent order
+    for k,d in sorted(sorted(diff.items()), key=lambda k_d: abs(k_d[1][-1]), reverse=True):
+        if ":" in k:  # print subheadings for key of format archive:file
+            sh,k = k.split(":")
+        print("%24s %+10d %+6d %+6d %+10d %+8d %+7d" % ((k[:24],) + d))
+
+
+ARCHIVE_SYMBOLS_SECTIONS = [".dram0.data", ".dram0.bss", ".iram0.text", ".iram0.vectors", ".flash.text", ".flash.rodata"]
+
+
+def get_archive_symbols(sections, archive):
     result = {}
-    for t in interested_sections:
+    for t in ARCHIVE_SYMBOLS_SECTIONS:
         result[t] = {}
     for section in sections.values():
         section_name = section["name"]
-        if section_name not in interested_sections:
+        if section_name not in ARCHIVE_SYMBOLS_SECTIONS:
             continue
         for s in section["sources"]:
             if archive != s["archive"]:
                 continue
             s["sym_name"] = re.sub("(.text.|.literal.|.data.|.bss.|.rodata.)", "", s["sym_name"])
             result[section_name][s["sym_name"]] = result[section_name].get(s["sym_name"], 0) + s["size"]
-    for t in interested_sections:
+    return result
+
+
+def print_archive_symbols(sections, archive):
+    result = get_archive_symbols(sections, archive)
+    for t in ARCHIVE_SYMBOLS_SECTIONS:
         print("\nSymbols from section:", t)
         section_total = 0
         s = sorted(list(result[t].items()), key=lambda k_v: k_v[0])
@@ -288,5 +505,20 @@ def print_archive_symbols(sections, archive):
         print("\nSection total:",section_total)
 
 
+def print_archive_symbols_diff(sections, ref_sections, archive):
+    result = get_archive_symbols(sections, archive)
+    ref_result = get_archive_symbols(ref_sections, archive)
+    for t in ARCHIVE_SYMBOLS_SECTIONS:
+        print("\nSymbols from section:", t)
+        diff = {}
+        for key in set(result[t]) | set(ref_result[t]):
+            d = result[t].get(key, 0) - ref_result[t].get(key, 0)
+            if d != 0:
+                diff[key] = d
+        for key,val in sorted(sorted(diff.items()), key=lambda k_v: abs(k_v[1]), reverse=True):
+            print(("%s(%+d)" % (key.replace(t + ".", ""), val)), end=' ')
+        print("\nSection total: %+d" % sum(diff.values()))
+
+
 if __name__ == "__main__":
     main()
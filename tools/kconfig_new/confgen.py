@@ -157,6 +157,23 @@ def write_cmake(config, filename):
         config.walk_menu(write_node)
 
 
+def get_json_value(sym):
+    """
+    Return the value of 'sym' as it is written to sdkconfig.json, or None if it is not written
+    (the symbol is not visible and has no default which applies).
+    """
+    val = sym.str_value  # this calculates _write_to_conf, due to kconfiglib magic
+    if not sym._write_to_conf:
+        return None
+    if sym.type in [kconfiglib.BOOL, kconfiglib.TRISTATE]:
+        val = (val != "n")
+    elif sym.type == kconfiglib.HEX:
+        val = int(val, 16)
+    elif sym.type == kconfiglib.INT:
+        val = int(val)
+    return val
+
+
 def get_json_values(config):
     config_dict = {}
 
@@ -165,14 +182,8 @@ def get_json_values(config):
         if not isinstance(sym, kconfiglib.Symbol):
             return
 
-        val = sym.str_value  # this calculates _write_to_conf, due to kconfiglib magic
-        if sym._write_to_conf:
-            if sym.type in [kconfiglib.BOOL, kconfiglib.TRISTATE]:
-                val = (val != "n")
-            elif sym.type == kconfiglib.HEX:
-                val = int(val, 16)
-            elif sym.type == kconfiglib.INT:
-                val = int(val)
+        val = get_json_value(sym)
+        if val is not None:
             config_dict[sym.name] = val
     config.walk_menu(write_node)
     return config_dict
@@ -46,9 +46,10 @@ def run_server(kconfig, sdkconfig):
     config = kconfiglib.Kconfig(kconfig)
     config.load_config(sdkconfig)
 
-    config_dict = confgen.get_json_values(config)
-    ranges_dict = get_ranges(config)
-    json.dump({"version": 1, "values": config_dict, "ranges": ranges_dict}, sys.stdout)
+    # The values and ranges the client knows about. Each response only has the changes to these.
+    values = confgen.get_json_values(config)
+    ranges = get_ranges(config)
+    json.dump({"version": 1, "values": values, "ranges": ranges}, sys.stdout)
     print("\n")
 
     while True:
@@ -56,13 +57,8 @@ def run_server(kconfig, sdkconfig):
         if not line:
             break
         req = json.loads(line)
-        before = confgen.get_json_values(config)
-        before_ranges = get_ranges(config)
-
-        if "load" in req:  # if we're loading a different sdkconfig, response should have all items in it
-            before = {}
-            before_ranges = {}
 
+        if "load" in req:
             # if no new filename is supplied, use existing sdkconfig path, otherwise update the path
             if req["load"] is None:
                 req["load"] = sdkconfig
@@ -75,13 +71,17 @@ def run_server(kconfig, sdkconfig):
             else:
                 sdkconfig = req["save"]
 
-        error = handle_request(config, req)
+        set_syms = []
+        error = handle_request(config, req, set_syms)
 
-        after = confgen.get_json_values(config)
-        after_ranges = get_ranges(config)
+        if "load" in req:  # if we're loading a different sdkconfig, response should have all items in it
+            values = confgen.get_json_values(config)
+            ranges = get_ranges(config)
+            values_diff = dict(values)
+            ranges_diff = dict(ranges)
+        else:
+            values_diff, ranges_diff = update_values(config, values, ranges, set_syms)
 
-        values_diff = diff(before, after)
-        ranges_diff = diff(before_ranges, after_ranges)
         response = {"version": 1, "values": values_diff, "ranges": ranges_diff}
         if error:
             for e in error:
@@ -91,7 +91,10 @@ def run_server(kconfig, sdkconfig):
         print("\n")
 
 
-def handle_request(config, req):
+def handle_request(config, req, set_syms):
+    """
+    Handle the request 'req', appending the symbols it sets to 'set_syms'. Returns a list of errors.
+    """
     if "version" not in req:
         return ["All requests must have a 'version'"]
     if int(req["version"]) != 1:
@@ -107,7 +110,7 @@ def handle_request(config, req):
             error += ["Failed to load from %s: %s" % (req["load"], e)]
 
     if "set" in req:
-        handle_set(config, error, req["set"])
+        handle_set(config, error, req["set"], set_syms)
 
     if "save" in req:
         try:
@@ -119,7 +122,7 @@ def handle_request(config, req):
     return error
 
 
-def handle_set(config, error, to_set):
+def handle_set(config, error, to_set, set_syms):
     missing = [k for k in to_set if k not in config.syms]
     if missing:
         error.append("The following config symbol(s) were not found: %s" % (", ".join(missing)))
@@ -146,6 +149,7 @@ def handle_set(config, error, to_set):
             else:
                 sym.set_value(str(val))
             print("Set %s" % sym.name)
+            set_syms.append(sym)
             del to_set[sym]
 
     if len(to_set):
@@ -163,6 +167,14 @@ def diff(before, after):
     return diff
 
 
+def get_range(sym):
+    """
+    Return the active range of 'sym' as a tuple (low, high), or None if no range applies
+    """
+    active_range = sym.active_range
+    return active_range if active_range[0] is not None else None
+
+
 def get_ranges(config):
     ranges_dict = {}
 
@@ -170,14 +182,67 @@ def get_ranges(config):
         sym = node.item
         if not isinstance(sym, kconfiglib.Symbol):
             return
-        active_range = sym.active_range
-        if active_range[0] is not None:
+        active_range = get_range(sym)
+        if active_range is not None:
             ranges_dict[sym.name] = active_range
 
     config.walk_menu(handle_node)
     return ranges_dict
 
 
+def get_dependents(config, syms):
+    """
+    Return 'syms' and all symbols which (possibly) depend on them, so that their value, visibility or range
+    might have changed after 'syms' were set.
+
+    This follows the dependencies kconfiglib tracks to invalidate cached values. Returns None if any symbol
+    could depend on 'syms'.
+    """
+    seen = set()
+    todo = list(syms)
+    while todo:
+        item = todo.pop()
+        if item is config.modules:
+            return None  # see Symbol._rec_invalidate()
+        if item not in seen:
+            seen.add(item)
+            todo.extend(item._dependents)
+    return [item for item in seen if isinstance(item, kconfiglib.Symbol)]
+
+
+def update_values(config, values, ranges, set_syms):
+    """
+    Update 'values' and 'ranges' (as returned by confgen.get_json_values() and get_ranges()) after the symbols in
+    'set_syms' were set. Only the symbols which depend on these are evaluated again.
+
+    Returns a tuple (values_diff, ranges_diff) of the changes, in the format returned by diff().
+    """
+    dependents = get_dependents(config, set_syms)
+    if dependents is None:
+        new_values = confgen.get_json_values(config)
+        new_ranges = get_ranges(config)
+        values_diff = diff(values, new_values)
+        ranges_diff = diff(ranges, new_ranges)
+        values.clear()
+        values.update(new_values)
+        ranges.clear()
+        ranges.update(new_ranges)
+        return values_diff, ranges_diff
+
+    values_diff = {}
+    ranges_diff = {}
+    for sym in dependents:
+        for (current, changes, value) in ((values, values_diff, confgen.get_json_value(sym)),
+                                          (ranges, ranges_diff, get_range(sym))):
+            if current.get(sym.name, None) != value:
+                changes[sym.name] = value
+                if value is None:
+                    del current[sym.name]
+                else:
+                    current[sym.name] = value
+    return values_diff, ranges_diff
+
+
 if __name__ == '__main__':
     try:
         main()
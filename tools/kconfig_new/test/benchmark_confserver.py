@@ -0,0 +1,172 @@
+#!/usr/bin/env python
+#
+# Copyright 2019 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Measures the latency of confserver.py requests for a synthetic Kconfig tree with many symbols, which are
+# organised in menus enabled by a bool symbol, like components' Kconfig files. Not run as part of the tests.
+#
+# usage: ./benchmark_confserver.py [number of menus]
+
+from __future__ import print_function
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+CONFSERVER = os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "confserver.py")
+
+REQUESTS = 50
+
+MENU = """
+menu "Group {n}"
+
+    config GROUP{n}_ENABLE
+        bool "Enable group {n}"
+        default y
+
+    config GROUP{n}_LEVEL
+        int "Level of group {n}"
+        depends on GROUP{n}_ENABLE
+        range 0 100 if GROUP{n}_FAST
+        range 0 10
+        default 5
+
+    config GROUP{n}_FAST
+        bool "Fast group {n}"
+        depends on GROUP{n}_ENABLE
+
+    choice GROUP{n}_MODE
+        prompt "Mode of group {n}"
+        depends on GROUP{n}_ENABLE
+        default GROUP{n}_MODE_A
+
+        config GROUP{n}_MODE_A
+            bool "A"
+        config GROUP{n}_MODE_B
+            bool "B"
+    endchoice
+{options}
+    config GROUP{n}_NAME
+        string "Name of group {n}"
+        default "group {n} in mode B" if GROUP{n}_MODE_B
+        default "group {n}"
+
+endmenu
+"""
+
+OPTION = """
+    config GROUP{n}_OPTION{i}
+        {type} "Option {i} of group {n}"
+        depends on GROUP{n}_ENABLE
+        default {default}
+"""
+
+
+def generate_kconfig(path, menus):
+    with open(path, "w") as f:
+        for n in range(menus):
+            options = ""
+            for i in range(14):
+                if i % 2:
+                    option_type, default = "bool", "y if GROUP%d_FAST" % n
+                else:
+                    option_type, default = "hex", "0x%x" % i
+                options += OPTION.format(n=n, i=i, type=option_type, default=default)
+            f.write(MENU.format(n=n, options=options))
+    return menus * 20  # symbols per menu
+
+
+class Server(object):
+    def __init__(self, kconfig, sdkconfig):
+        self.p = subprocess.Popen([sys.executable, CONFSERVER, "--kconfig", kconfig, "--config", sdkconfig],
+                                  stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=open(os.devnull, "w"),
+                                  universal_newlines=True)
+
+    def response(self):
+        while True:
+            line = self.p.stdout.readline()
+            if not line:
+                raise RuntimeError("confserver.py exited")
+            if line.startswith("{"):
+                return json.loads(line)
+
+    def request(self, req):
+        start = time.time()
+        self.p.stdin.write(json.dumps(dict(req, version=1)) + "\n")
+        self.p.stdin.flush()
+        response = self.response()
+        return time.time() - start, response
+
+    def close(self):
+        self.p.stdin.close()
+        self.p.wait()
+
+
+def measure(server, name, make_request):
+    times = []
+    values = 0
+    for i in range(REQUESTS):
+        elapsed, response = server.request(make_request(i))
+        if "error" in response:
+            raise RuntimeError("Request failed: %s" % response["error"])
+        times.append(elapsed)
+        values += len(response["values"])
+    times.sort()
+    print("%-40s median %6.1f ms, max %6.1f ms, %5.1f values per response" %
+          (name + ":", times[len(times) // 2] * 1000, times[-1] * 1000, float(values) / REQUESTS))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="confserver.py latency benchmark")
+    parser.add_argument("menus", type=int, nargs="?", default=100)
+    args = parser.parse_args()
+
+    work_dir = tempfile.mkdtemp()
+    try:
+        kconfig = os.path.join(work_dir, "Kconfig")
+        sdkconfig = os.path.join(work_dir, "sdkconfig")
+        symbols = generate_kconfig(kconfig, args.menus)
+        open(sdkconfig, "w").close()
+
+        server = Server(kconfig, sdkconfig)
+        start = time.time()
+        server.response()
+        print("%d symbols, startup %.2fs" % (symbols, time.time() - start))
+
+        measure(server, "set string",
+                lambda i: {"set": {"GROUP0_NAME": "name %d" % i}})
+        measure(server, "set int",
+                lambda i: {"set": {"GROUP1_LEVEL": i % 10}})
+        measure(server, "set bool with dependents",
+                lambda i: {"set": {"GROUP2_FAST": bool(i % 2)}})
+        measure(server, "set choice",
+                lambda i: {"set": {"GROUP3_MODE_B" if i % 2 else "GROUP3_MODE_A": True}})
+        measure(server, "enable and disable a menu",
+                lambda i: {"set": {"GROUP4_ENABLE": bool(i % 2)}})
+        measure(server, "load",
+                lambda i: {"load": None})
+        server.close()
+    finally:
+        shutil.rmtree(work_dir)
+
+
+if __name__ == "__main__":
+    main()
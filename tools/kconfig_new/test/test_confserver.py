@@ -1,12 +1,19 @@
 #!/usr/bin/env python
 from __future__ import print_function
 import os
+import sys
 import json
+import random
 import argparse
 import tempfile
 
 import pexpect
 
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.realpath(__file__)), ".."))
+import kconfiglib  # noqa: E402
+import confgen  # noqa: E402
+import confserver  # noqa: E402
+
 
 def parse_testcases():
     with open("testcases.txt", "r") as f:
@@ -34,6 +41,43 @@ def parse_testcases():
         yield (desc, send, expect)
 
 
+def random_value(rand, sym):
+    if sym.type in (kconfiglib.BOOL, kconfiglib.TRISTATE):
+        return True if sym.choice else rand.choice([True, False])
+    if sym.type == kconfiglib.STRING:
+        return "value %d" % rand.randint(0, 3)
+    low, high = sym.active_range
+    value = rand.randint(low if low is not None else -10, high if high is not None else 300)
+    return hex(value) if sym.type == kconfiglib.HEX else value
+
+
+def test_incremental_updates():
+    # confserver.py only evaluates again the symbols which depend on the ones set by a request.
+    # The responses must be the same as when comparing all the values before and after the request.
+    config = kconfiglib.Kconfig("Kconfig")
+    config.load_config("sdkconfig")
+    values = confgen.get_json_values(config)
+    ranges = confserver.get_ranges(config)
+    rand = random.Random(1)
+    syms = [sym for sym in config.defined_syms if any(node.prompt for node in sym.nodes)]
+
+    for i in range(500):
+        visible = [sym for sym in syms if sym.visibility]
+        to_set = dict((sym.name, random_value(rand, sym)) for sym in rand.sample(visible, min(len(visible), rand.randint(1, 3))))
+        before = confgen.get_json_values(config)
+        before_ranges = confserver.get_ranges(config)
+        set_syms = []
+        confserver.handle_request(config, {"version": 1, "set": to_set}, set_syms)
+        values_diff, ranges_diff = confserver.update_values(config, values, ranges, set_syms)
+
+        after = confgen.get_json_values(config)
+        after_ranges = confserver.get_ranges(config)
+        if (values_diff, ranges_diff) != (confserver.diff(before, after), confserver.diff(before_ranges, after_ranges)):
+            raise RuntimeError("Test failed! Setting %s returned %s, %s" % (to_set, values_diff, ranges_diff))
+        assert (values, ranges) == (after, after_ranges)
+    print("OK")
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument('--logfile', type=argparse.FileType('w'), help='Optional session log of the interactions with confserver.py')
@@ -95,6 +139,9 @@ def main():
         print("Load result: %s" % (json.dumps(load_result)))
         assert len(load_result["values"]) > 0  # loading same file should return all config items
         assert len(load_result["ranges"]) > 0
+
+        print("Testing incremental updates...")
+        test_incremental_updates()
         print("Done. All passed.")
 
     finally:
@@ -0,0 +1,176 @@
+#
+# Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+import hashlib
+import os
+import pickle
+
+from fragments import FragmentFileModel
+
+
+class GenerationCache:
+    """
+    Keeps the results of a linker script generation run in a file, so that the next run only processes
+    what has changed:
+
+    - parsed fragment files and sections info files, keyed by path and the hash of the file contents
+    - results of sdkconfig expression evaluation, keyed by the hash of the configuration
+    - the hash of all the inputs of the run, together with the hash of the output generated from them
+
+    A cache file which can't be read is ignored. Only entries used by the current run are saved, so the cache
+    does not grow when fragment files are removed or the configuration changes.
+    """
+
+    # Increment whenever the format of the cached data, or of the cached objects, changes
+    VERSION = 1
+
+    def __init__(self, path=None):
+        self.path = path
+        self.file_hashes = {}
+        self.fragment_files = {}
+        self.sections_info_files = {}
+        self.expressions = {}
+        self.inputs_hash = None
+        self.output_hash = None
+
+        # Entries used by the current run
+        self.used_fragment_files = {}
+        self.used_sections_info_files = {}
+        self.used_expressions = {}
+
+        if path and os.path.exists(path):
+            try:
+                with open(path, "rb") as f:
+                    data = pickle.load(f)
+                if data["version"] == GenerationCache.VERSION:
+                    self.fragment_files = data["fragment_files"]
+                    self.sections_info_files = data["sections_info_files"]
+                    self.expressions = data["expressions"]
+                    self.inputs_hash = data["inputs_hash"]
+                    self.output_hash = data["output_hash"]
+            except Exception:
+                pass  # Start from scratch if the cache is damaged or written by an incompatible version
+
+    @staticmethod
+    def hash_file(path, hasher=None):
+        """
+        Returns the hash of the contents of a file. If 'hasher' is given, the contents are added to it instead.
+        """
+        h = hasher if hasher else hashlib.sha1()
+        with open(path, "rb") as f:
+            h.update(f.read())
+        return h.hexdigest()
+
+    def get_file_hash(self, path):
+        """
+        Same as hash_file(), but each file is only read once per run
+        """
+        path = os.path.realpath(path)
+        try:
+            return self.file_hashes[path]
+        except KeyError:
+            digest = GenerationCache.hash_file(path)
+            self.file_hashes[path] = digest
+            return digest
+
+    def get_fragment_file(self, fragment_file):
+        """
+        Returns the FragmentFileModel for an open fragment file, parsing it only if it is not cached.
+        """
+        path = os.path.realpath(fragment_file.name)
+        digest = self.get_file_hash(path)
+
+        try:
+            (cached_digest, model) = self.fragment_files[path]
+            if cached_digest != digest:
+                model = None
+        except KeyError:
+            model = None
+
+        if model is None:
+            model = FragmentFileModel(fragment_file)
+
+        self.used_fragment_files[path] = (digest, model)
+        return model
+
+    def add_sections_info(self, sections_infos, sections_info_path):
+        """
+        Adds a sections info file to 'sections_infos', with its contents already parsed if they are cached.
+        """
+        path = os.path.realpath(sections_info_path)
+        digest = self.get_file_hash(path)
+
+        try:
+            (cached_digest, archive, obj_sections) = self.sections_info_files[path]
+            if cached_digest != digest or obj_sections is None:
+                archive = None
+        except KeyError:
+            archive = None
+
+        if archive is not None:
+            sections_infos.add_parsed_sections_info(archive, obj_sections)
+        else:
+            with open(sections_info_path) as sections_info_file_obj:
+                archive = sections_infos.add_sections_info(sections_info_file_obj)
+
+        self.used_sections_info_files[path] = (digest, archive)
+
+    def get_expressions(self, config_hash):
+        """
+        Returns a dictionary of expression evaluation results for the configuration with the given hash,
+        to be passed to SDKConfig and filled by it.
+        """
+        expressions = self.expressions.get(config_hash, {})
+        self.used_expressions = {config_hash: expressions}
+        return expressions
+
+    def is_output_up_to_date(self, inputs_hash, output_path):
+        """
+        Checks if the output file was generated from the same inputs in the previous run, and not modified since.
+        """
+        if inputs_hash != self.inputs_hash or not os.path.exists(output_path):
+            return False
+        return GenerationCache.hash_file(output_path) == self.output_hash
+
+    def save(self, inputs_hash, output_path, sections_infos):
+        self.inputs_hash = inputs_hash
+        self.output_hash = GenerationCache.hash_file(output_path)
+
+        if not self.path:
+            return
+
+        # Sections info files are parsed on demand, only for archives with symbol placements. Keep the ones
+        # which have been parsed, either in this run or in a previous one.
+        sections_info_files = {}
+        for (path, (digest, archive)) in self.used_sections_info_files.items():
+            sections_info_files[path] = (digest, archive, sections_infos.get_parsed_sections_info(archive))
+
+        data = {
+            "version": GenerationCache.VERSION,
+            "fragment_files": self.used_fragment_files,
+            "sections_info_files": sections_info_files,
+            "expressions": self.used_expressions,
+            "inputs_hash": self.inputs_hash,
+            "output_hash": self.output_hash,
+        }
+
+        try:
+            with open(self.path, "wb") as f:
+                pickle.dump(data, f, 2)
+        except (IOError, OSError, pickle.PicklingError):
+            # Not being able to cache the results is not an error, the next run just takes longer
+            if os.path.exists(self.path):
+                os.remove(self.path)
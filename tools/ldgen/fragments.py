@@ -54,7 +54,7 @@ class FragmentFileModel():
         parser.ignore("#" + restOfLine)
 
         try:
-            self.fragments = parser.parseFile(fragment_file, parseAll=True)
+            self.fragments = list(parser.parseFile(fragment_file, parseAll=True))
         except ParseBaseException as e:
             # the actual parse error is kind of useless for normal users, so just point to the location of
             # the error
@@ -87,9 +87,9 @@ class Sections(Fragment):
         self._process_entries()
 
     def _process_entries(self):
-        # Quietly ignore duplicate entries
+        # Quietly ignore duplicate entries, keep the rest in a stable order
         self.entries = set(self.entries)
-        self.entries = list(self.entries)
+        self.entries = sorted(self.entries)
 
     """
     Utility function that returns a list of sections given a sections fragment entry,
@@ -282,7 +282,7 @@ class GenerationModel:
         for scheme in self.schemes.values():
             sections_bucket = collections.defaultdict(list)
 
-            for (sections_name, target_name) in scheme.entries:
+            for (sections_name, target_name) in sorted(scheme.entries):
                 # Get the sections under the bucket 'target_name'. If this bucket does not exist
                 # is is created automatically
                 sections_in_bucket = sections_bucket[target_name]
@@ -349,8 +349,9 @@ class GenerationModel:
 
                     mapping_rules = list()
 
+                    # Entries are stored as a set, sort them so that the output does not depend on its ordering
                     archive = mapping.archive
-                    for (obj, symbol, scheme_name) in entries:
+                    for (obj, symbol, scheme_name) in sorted(entries, key=lambda e: (e[0], e[1] or "", e[2])):
                         try:
                             self._add_mapping_rules(archive, obj, symbol, scheme_name, scheme_dictionary, mapping_rules)
                         except KeyError:
@@ -603,6 +604,21 @@ class SectionsInfo(dict):
 
         archive = os.path.basename(results.archive_path)
         self.sections[archive] = SectionsInfo.__info(sections_info_file.name, sections_info_file.read())
+        return archive
+
+    def add_parsed_sections_info(self, archive, obj_sections):
+        """
+        Adds the sections of an archive as returned by get_parsed_sections_info(), e.g. from a previous run
+        """
+        self.sections[archive] = obj_sections
+
+    def get_parsed_sections_info(self, archive):
+        """
+        Returns a dictionary of section names per object file of an archive, or None if its
+        sections info has not been parsed yet
+        """
+        stored = self.sections[archive]
+        return stored if isinstance(stored, dict) else None
 
     def _get_infos_from_file(self, info):
         # Object file line: '{object}:  file format elf32-xtensa-le'
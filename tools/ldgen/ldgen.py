@@ -16,10 +16,11 @@
 #
 
 import argparse
+import hashlib
 import sys
 import tempfile
 
-from fragments import FragmentFileModel
+from cache import GenerationCache
 from sdkconfig import SDKConfig
 from generation import GenerationModel, TemplateModel, SectionsInfo
 from common import LdGenFailure
@@ -65,6 +66,11 @@ def main():
         action='append', default=[],
         help='Environment to set when evaluating the config file', metavar='NAME=VAL')
 
+    argparser.add_argument(
+        "--cache",
+        help="File to keep results in for the next run. The output is only written if it has changed.",
+        type=str)
+
     args = argparser.parse_args()
 
     input_file = args.input
@@ -75,7 +81,7 @@ def main():
     sections = args.sections
 
     try:
-        sections_infos = SectionsInfo()
+        cache = GenerationCache(args.cache)
 
         if sections:
             section_info_contents = [s.strip() for s in sections.read().split("\n")]
@@ -83,17 +89,35 @@ def main():
         else:
             section_info_contents = []
 
+        # The configuration is identified by the values in sdkconfig. Changes to Kconfig files which affect
+        # values cause sdkconfig to be regenerated, so they need not be tracked separately.
+        config_hasher = hashlib.sha1()
+        for path in (kconfig_file.name, config_file.name):
+            config_hasher.update(cache.get_file_hash(path).encode("utf-8"))
+        config_hasher.update("\0".join(args.env).encode("utf-8"))
+        config_hash = config_hasher.hexdigest()
+
+        inputs_hasher = hashlib.sha1(config_hash.encode("utf-8"))
+        for path in [input_file.name] + [f.name for f in fragment_files] + section_info_contents:
+            inputs_hasher.update(path.encode("utf-8"))
+            inputs_hasher.update(cache.get_file_hash(path).encode("utf-8"))
+        inputs_hash = inputs_hasher.hexdigest()
+
+        if cache.is_output_up_to_date(inputs_hash, output_path):
+            return
+
+        sections_infos = SectionsInfo()
+
         for sections_info_file in section_info_contents:
-            with open(sections_info_file) as sections_info_file_obj:
-                sections_infos.add_sections_info(sections_info_file_obj)
+            cache.add_sections_info(sections_infos, sections_info_file)
 
         generation_model = GenerationModel()
 
         for fragment_file in fragment_files:
-            fragment_file = FragmentFileModel(fragment_file)
+            fragment_file = cache.get_fragment_file(fragment_file)
             generation_model.add_fragments_from_file(fragment_file)
 
-        sdkconfig = SDKConfig(kconfig_file, config_file, args.env)
+        sdkconfig = SDKConfig(kconfig_file, config_file, args.env, cache.get_expressions(config_hash))
         mapping_rules = generation_model.generate_rules(sdkconfig, sections_infos)
 
         script_model = TemplateModel(input_file)
@@ -102,8 +126,20 @@ def main():
         with tempfile.TemporaryFile("w+") as output:
             script_model.write(output)
             output.seek(0)
-            with open(output_path, "w") as f:  # only create output file after generation has suceeded
-                f.write(output.read())
+            contents = output.read()
+
+        # only create output file after generation has suceeded, and leave it untouched if it has not
+        # changed so that whatever depends on it does not need to be rebuilt
+        try:
+            with open(output_path, "r") as f:
+                unchanged = (f.read() == contents)
+        except (IOError, OSError):
+            unchanged = False
+        if not unchanged:
+            with open(output_path, "w") as f:
+                f.write(contents)
+
+        cache.save(inputs_hash, output_path, sections_infos)
     except LdGenFailure as e:
         print("linker script generation failed for %s\nERROR: %s" % (input_file.name, e))
         sys.exit(1)
@@ -27,7 +27,7 @@ except ImportError:
     import kconfiglib
 
 
-class SDKConfig:
+class SDKConfig(object):
     """
     Encapsulates an sdkconfig file. Defines grammar of a configuration entry, and enables
     evaluation of logical expressions involving those entries.
@@ -46,26 +46,48 @@ class SDKConfig:
     # Operators supported by the expression evaluation
     OPERATOR = oneOf(["=", "!=", ">", "<", "<=", ">="])
 
-    def __init__(self, kconfig_file, sdkconfig_file, env=[]):
+    def __init__(self, kconfig_file, sdkconfig_file, env=[], evaluated=None):
         env = [(name, value) for (name,value) in (e.split("=",1) for e in env)]
 
         for name, value in env:
             value = " ".join(value.split())
             os.environ[name] = value
 
-        self.config = kconfiglib.Kconfig(kconfig_file.name)
-        self.config.load_config(sdkconfig_file.name)
+        self.kconfig_path = kconfig_file.name
+        self.sdkconfig_path = sdkconfig_file.name
+        self._config = None
+
+        # Results of evaluate_expression() are stored in 'evaluated', if given. When it holds the results of a
+        # previous run with the same configuration for all expressions, the Kconfig tree does not need to be loaded.
+        self.evaluated = evaluated
+        if not self.evaluated:
+            self.config  # load now, so that errors are not reported as failures to evaluate an expression
+
+    @property
+    def config(self):
+        # Loading the Kconfig tree is expensive, so it is done on first use
+        if self._config is None:
+            self._config = kconfiglib.Kconfig(self.kconfig_path)
+            self._config.load_config(self.sdkconfig_path)
+        return self._config
 
     def evaluate_expression(self, expression):
+        if self.evaluated is not None and expression in self.evaluated:
+            return self.evaluated[expression]
+
         result = self.config.eval_string(expression)
 
         if result == 0:  # n
-            return False
+            result = False
         elif result == 2:  # y
-            return True
+            result = True
         else:  # m
             raise Exception("Unsupported config expression result.")
 
+        if self.evaluated is not None:
+            self.evaluated[expression] = result
+        return result
+
     @staticmethod
     def get_expression_grammar():
         identifier = SDKConfig.IDENTIFIER.setResultsName("identifier")
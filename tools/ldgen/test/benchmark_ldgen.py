@@ -0,0 +1,142 @@
+#!/usr/bin/env python
+#
+# Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+# Times linker script generation for a synthetic project with many components, each with a linker
+# fragment file, a sdkconfig condition and a sections info file. Not run as part of the tests.
+#
+# usage: ./benchmark_ldgen.py [number of components]
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+LDGEN = os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "ldgen.py")
+DATA = os.path.join(os.path.dirname(os.path.realpath(__file__)), "data")
+
+OBJECTS_PER_COMPONENT = 5
+FUNCTIONS_PER_OBJECT = 10
+
+FRAGMENT = """
+[mapping]
+archive: libcomponent{n}.a
+entries:
+    : COMPONENT{n}_IN_IRAM
+    * (noflash)
+    : default
+    object0 (noflash)
+    object1:function{n}_1_0 (noflash)
+"""
+
+KCONFIG = """
+    config COMPONENT{n}_IN_IRAM
+        bool "Place component {n} in IRAM"
+"""
+
+SECTION = """  {idx} {name:<13} 00000010  00000000  00000000  00000034  2**2
+                  CONTENTS, ALLOC, LOAD, RELOC, READONLY, CODE
+"""
+
+
+def write(path, contents):
+    with open(path, "w") as f:
+        f.write(contents)
+
+
+def generate_project(project_dir, components):
+    kconfig = "menu \"Benchmark\"\n"
+    sdkconfig = ""
+    fragments = [os.path.join(DATA, "sample.lf")]
+    sections_infos = []
+
+    for n in range(components):
+        kconfig += KCONFIG.format(n=n)
+        sdkconfig += "CONFIG_COMPONENT%d_IN_IRAM=%s\n" % (n, "y" if n % 2 else "")
+
+        fragment = os.path.join(project_dir, "component%d.lf" % n)
+        write(fragment, FRAGMENT.format(n=n))
+        fragments.append(fragment)
+
+        sections_info = "In archive libcomponent%d.a:\n" % n
+        for o in range(OBJECTS_PER_COMPONENT):
+            sections_info += "\nobject%d.c.obj:     file format elf32-xtensa-le\n\n" % o
+            sections_info += "Sections:\nIdx Name          Size      VMA       LMA       File off  Algn\n"
+            names = []
+            for f in range(FUNCTIONS_PER_OBJECT):
+                names += [".literal.function%d_%d_%d" % (n, o, f), ".text.function%d_%d_%d" % (n, o, f)]
+            for idx, name in enumerate(names):
+                sections_info += SECTION.format(idx=idx, name=name)
+        path = os.path.join(project_dir, "libcomponent%d.a.sections_info" % n)
+        write(path, sections_info)
+        sections_infos.append(path)
+
+    kconfig += "endmenu\n"
+    write(os.path.join(project_dir, "Kconfig"), kconfig)
+    write(os.path.join(project_dir, "sdkconfig"), sdkconfig)
+    write(os.path.join(project_dir, "sections_list"), "\n".join(sections_infos) + "\n")
+
+    return fragments
+
+
+def run_ldgen(project_dir, fragments, output, cache):
+    args = [sys.executable, LDGEN, "--input", os.path.join(DATA, "template.ld"), "--fragments"] + fragments
+    args += ["--sections", os.path.join(project_dir, "sections_list"),
+             "--config", os.path.join(project_dir, "sdkconfig"),
+             "--kconfig", os.path.join(project_dir, "Kconfig"),
+             "--output", output]
+    if cache:
+        args += ["--cache", cache]
+
+    start = time.time()
+    subprocess.check_call(args)
+    return time.time() - start
+
+
+def main():
+    parser = argparse.ArgumentParser(description="ldgen benchmark")
+    parser.add_argument("components", type=int, nargs="?", default=200)
+    args = parser.parse_args()
+
+    project_dir = tempfile.mkdtemp()
+    try:
+        fragments = generate_project(project_dir, args.components)
+        output = os.path.join(project_dir, "out.ld")
+        cache = os.path.join(project_dir, "ldgen.cache")
+
+        print("%d components, %d fragment files" % (args.components, len(fragments)))
+        print("%-40s %.2fs" % ("no cache:", run_ldgen(project_dir, fragments, output, None)))
+        print("%-40s %.2fs" % ("empty cache:", run_ldgen(project_dir, fragments, output, cache)))
+
+        # What the build system does after sdkconfig is regenerated with the same contents
+        print("%-40s %.2fs" % ("inputs unchanged:", run_ldgen(project_dir, fragments, output, cache)))
+
+        with open(fragments[1], "a") as f:
+            f.write("\n# changed\n")
+        print("%-40s %.2fs" % ("one fragment file changed:", run_ldgen(project_dir, fragments, output, cache)))
+
+        with open(os.path.join(project_dir, "sdkconfig"), "a") as f:
+            f.write("# changed\n")
+        print("%-40s %.2fs" % ("sdkconfig changed:", run_ldgen(project_dir, fragments, output, cache)))
+    finally:
+        shutil.rmtree(project_dir)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,168 @@
+#!/usr/bin/env python
+#
+# Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+LDGEN = os.path.join(os.path.dirname(os.path.realpath(__file__)), "..", "ldgen.py")
+DATA = os.path.join(os.path.dirname(os.path.realpath(__file__)), "data")
+
+
+class LdGenCacheTest(unittest.TestCase):
+    """
+    Checks that running ldgen.py with a cache gives the same output as running it without one
+    """
+
+    MAPPING = """
+[mapping]
+archive: libfreertos.a
+entries:
+    : PERFORMANCE_LEVEL = 0
+    * (default)
+    : PERFORMANCE_LEVEL = 1
+    port (noflash)
+    : default
+    port (noflash)
+    tasks:vTaskDelay (noflash)
+"""
+
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+
+        self.sections_list = self._path("sections_list")
+        with open(self.sections_list, "w") as f:
+            f.write(os.path.join(DATA, "sections.info") + "\n")
+
+        self.mapping = self._path("mapping.lf")
+        self._write(self.mapping, self.MAPPING)
+
+        self.sdkconfig = self._path("sdkconfig")
+        self._set_performance_level(1)
+
+        self.cache = self._path("ldgen.cache")
+        self.output = self._path("cached.ld")
+
+    def tearDown(self):
+        shutil.rmtree(self.dir)
+
+    def _path(self, name):
+        return os.path.join(self.dir, name)
+
+    def _write(self, path, contents):
+        with open(path, "w") as f:
+            f.write(contents)
+
+    def _read(self, path):
+        with open(path) as f:
+            return f.read()
+
+    def _set_performance_level(self, level):
+        self._write(self.sdkconfig, "CONFIG_PERFORMANCE_LEVEL=%d\n" % level)
+
+    def _ldgen(self, output, cache=None, env=None):
+        args = [sys.executable, LDGEN,
+                "--input", os.path.join(DATA, "template.ld"),
+                "--fragments", os.path.join(DATA, "sample.lf"), self.mapping,
+                "--sections", self.sections_list,
+                "--config", self.sdkconfig,
+                "--kconfig", os.path.join(DATA, "Kconfig"),
+                "--output", output]
+        if cache:
+            args += ["--cache", cache]
+        subprocess.check_call(args, env=env)
+
+    def _check_equivalent(self):
+        """ Generate with the cache, and check the output is the same as generated from scratch """
+        self._ldgen(self.output, self.cache)
+        expected = self._path("expected.ld")
+        self._ldgen(expected)
+        self.assertEqual(self._read(expected), self._read(self.output))
+        return self._read(self.output)
+
+    def _age_output(self):
+        os.utime(self.output, (0, 0))
+
+    def _output_rewritten(self):
+        return os.stat(self.output).st_mtime != 0
+
+    def test_cold_and_warm_cache(self):
+        first = self._check_equivalent()
+        self.assertIn("libfreertos.a:port.*", first)
+        self.assertTrue(os.path.exists(self.cache))
+
+        self._age_output()
+        self.assertEqual(first, self._check_equivalent())
+        self.assertFalse(self._output_rewritten())
+
+    def test_unchanged_output_not_rewritten(self):
+        self._check_equivalent()
+        self._age_output()
+
+        # Same contents, but newer: the build system runs ldgen again
+        self._set_performance_level(1)
+        self._write(self.mapping, self.MAPPING)
+        self._check_equivalent()
+        self.assertFalse(self._output_rewritten())
+
+    def test_changed_fragment(self):
+        first = self._check_equivalent()
+        self._age_output()
+
+        self._write(self.mapping, self.MAPPING.replace("port (noflash)", "port (rtc)"))
+        second = self._check_equivalent()
+        self.assertTrue(self._output_rewritten())
+        self.assertNotEqual(first, second)
+        self.assertIn("libfreertos.a:port.*", second)
+
+    def test_changed_config(self):
+        results = []
+        for level in (1, 0, 2, 1):
+            self._set_performance_level(level)
+            results.append(self._check_equivalent())
+
+        self.assertNotEqual(results[0], results[1])
+        self.assertNotIn("libfreertos.a:port.*", results[1])
+        self.assertIn("vTaskDelay", results[2])
+        self.assertEqual(results[0], results[3])
+
+    def test_modified_output(self):
+        first = self._check_equivalent()
+        self._write(self.output, "")
+        self.assertEqual(first, self._check_equivalent())
+
+    def test_output_independent_of_hash_seed(self):
+        # Otherwise the output would be rewritten on every run, even if the inputs are the same
+        self._set_performance_level(2)
+        outputs = set()
+        for seed in range(4):
+            output = self._path("seed%d.ld" % seed)
+            self._ldgen(output, env=dict(os.environ, PYTHONHASHSEED=str(seed)))
+            outputs.add(self._read(output))
+        self.assertEqual(1, len(outputs))
+
+    def test_damaged_cache(self):
+        first = self._check_equivalent()
+        self._write(self.cache, "not a cache")
+        self.assertEqual(first, self._check_equivalent())
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -6,7 +6,12 @@
     && coverage run -a $IDF_PATH/tools/idf_size.py --archives app.map &>> output \
     && coverage run -a $IDF_PATH/tools/idf_size.py --files app.map &>> output \
     && coverage run -a $IDF_PATH/tools/idf_size.py --archive_details libdriver.a app.map &>> output \
+    && sed -e '18618s/0x246c/0x248c/' -e '18698s/       0x10 /       0x30 /' app.map > app_changed.map \
+    && coverage run -a $IDF_PATH/tools/idf_size.py --diff app.map app_changed.map &>> output \
+    && coverage run -a $IDF_PATH/tools/idf_size.py --archives --files --archive_details libdriver.a --diff app.map app_changed.map &>> output \
+    && coverage run -a $IDF_PATH/tools/idf_size.py --no-cache --archives app.map &>> output \
     && coverage run -a $IDF_PATH/tools/test_idf_size/test_idf_size.py &>> output \
+    && rm -f app_changed.map *.idf_size_cache \
     && diff output expected_output \
     && coverage report \
 ; } || { echo 'The test for idf_size has failed. Please examine the artifacts.' ; exit 1; }
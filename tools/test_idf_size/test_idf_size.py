@@ -35,6 +35,15 @@ if __name__ == "__main__":
     except RuntimeError:
         pass
 
+    # parsing in several processes must give the same result as parsing in one
+    with open("app.map") as f:
+        expected = idf_size.load_map_data(f)
+    idf_size.PARALLEL_MIN_LINES = 0
+    for jobs in (2, 5):
+        with open("app.map") as f:
+            if idf_size.load_map_data(f, jobs) != expected:
+                print("Parsing with %d jobs gives a different result" % jobs)
+
     try:
         idf_size.print_summary({"iram0_0_seg": {"length":0}, "dram0_0_seg": {"length":0}}, {})
     except ZeroDivisionError: